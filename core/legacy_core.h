@@ -33,6 +33,7 @@
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
@@ -391,7 +392,7 @@ int reload_mgr<T>::reload()
 {
     if ( _objects[1 - _curr]->reload() == 0 )
     {
-        _curr = 1 - _curr;
+        __atomic_store_n(&_curr, static_cast<int16_t>(1 - _curr), __ATOMIC_RELEASE);
         return 0;
     } else
     {
@@ -404,8 +405,9 @@ int reload_mgr<T>::reload()
 
 template<typename T>
 T* reload_mgr<T>::current() {
-    if( _curr == 0 || _curr == 1){
-        return (_objects[_curr]);
+    int16_t curr = __atomic_load_n(&_curr, __ATOMIC_ACQUIRE);
+    if( curr == 0 || curr == 1){
+        return (_objects[curr]);
     }
 
     return NULL;
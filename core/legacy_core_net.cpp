@@ -1,4 +1,5 @@
 #include "legacy_core.h"
+#include "rxmetrics.h"
 
 base_data_process::base_data_process(shared_ptr<base_net_obj> p)
 {
@@ -395,6 +396,7 @@ size_t channel_data_process::process_recv_buf(const char *buf, size_t len)
 
         processing_queue.swap(_queue[_current]);
     }
+    CRxMetrics::inc(RX_CNT_CHANNEL_HANDLED, processing_queue.size());
 
     LOG_DEBUG("buf:%s, len:%d, processing_queue.size:%d", buf, len, processing_queue.size());
 
@@ -428,6 +430,7 @@ void channel_data_process::put_msg(uint32_t obj_id, shared_ptr<normal_msg> & p_m
 
     int idle = 1 - _current;
     _queue[idle].push_back(obj_msg);
+    CRxMetrics::inc(RX_CNT_CHANNEL_PUT);
 
     send(_channelid, CHANNEL_MSG_TAG, sizeof(CHANNEL_MSG_TAG), MSG_DONTWAIT);
 
@@ -825,7 +828,7 @@ CRxThreadMutex base_net_thread::_mutex;
 std::map<uint32_t, base_net_thread *> base_net_thread::_base_net_thread_map;
 
 base_net_thread::base_net_thread(int channel_num)
-    : _thread_id(0), _run_flag(true), _channel_num(channel_num), _base_container(NULL)
+    : _thread_id(0), _run_flag(true), _mem_node(-1), _channel_num(channel_num), _base_container(NULL)
 {
     CRxThreadLock lck(&_mutex);
     _thread_index_start++;
@@ -846,15 +849,43 @@ bool base_net_thread::start()
         return false;
     }
 
-    int ret = pthread_create(&_thread_id, NULL, base_thread_proc, this);
+    int ret = -1;
+    if (!_cpu_affinity.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (size_t i = 0; i < _cpu_affinity.size(); i++) {
+            if (_cpu_affinity[i] >= 0 && _cpu_affinity[i] < CPU_SETSIZE) {
+                CPU_SET(_cpu_affinity[i], &cpus);
+            }
+        }
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        ret = pthread_create(&_thread_id, &attr, base_thread_proc, this);
+        pthread_attr_destroy(&attr);
+        if (ret != 0) {
+            LOG_WARNING("thread %u: cpu affinity rejected (%s), starting unpinned", _thread_index, strerror(ret));
+            _cpu_affinity.clear();
+        }
+    }
+    if (ret != 0) {
+        ret = pthread_create(&_thread_id, NULL, base_thread_proc, this);
+    }
     if (ret != 0)
     {
+        _thread_id = 0;
         return false;
     }
     _thread_vec.push_back(this);
     return true;
 }
 
+void base_net_thread::set_placement(const std::vector<int> & cpus, int mem_node)
+{
+    _cpu_affinity = cpus;
+    _mem_node = mem_node;
+}
+
 void base_net_thread::join_thread()
 {
     pthread_join(_thread_id, NULL);
@@ -869,6 +900,14 @@ bool base_net_thread::stop()
 void * base_net_thread::base_thread_proc(void *arg)
 {
     base_net_thread *p = (base_net_thread*)arg;
+    if (p->_mem_node >= 0 && p->_mem_node < (int)(sizeof(unsigned long) * 8)) {
+        // MPOL_PREFERRED: allocations made from this thread (pcap rings,
+        // per-thread caches) land on the node, falling back when it is full.
+        unsigned long nodemask = 1UL << p->_mem_node;
+        if (syscall(SYS_set_mempolicy, 1, &nodemask, sizeof(nodemask) * 8) != 0) {
+            LOG_WARNING("thread %u: set_mempolicy(node %d) failed: %s", p->_thread_index, p->_mem_node, strerror(errno));
+        }
+    }
     return p->run();
 }
 
@@ -443,6 +443,8 @@ class common_epoll
 
         void mod_from_epoll(base_net_obj * p_obj);
 
+        void set_wait_time(int epoll_wait_time) { _epoll_wait_time = epoll_wait_time; }
+
         int epoll_wait(std::map<ObjId, shared_ptr<base_net_obj> > &expect_list, std::map<ObjId, shared_ptr<base_net_obj> > &remove_list, uint32_t num);
 
     private:
@@ -515,6 +517,10 @@ class base_net_thread
         pthread_t get_thread_id();
         uint32_t get_thread_index();
 
+        // Must be called before start(). An empty cpu list leaves the
+        // affinity alone; mem_node < 0 keeps the default memory policy.
+        void set_placement(const std::vector<int> & cpus, int mem_node);
+
         virtual void run_process();
         virtual void net_thread_init();
         virtual void put_msg(uint32_t obj_id, shared_ptr<normal_msg> & p_msg);
@@ -537,6 +543,9 @@ class base_net_thread
         pthread_t _thread_id;
         bool _run_flag;
 
+        std::vector<int> _cpu_affinity;
+        int _mem_node;
+
         static std::vector<base_net_thread*> _thread_vec;
         static uint32_t _thread_index_start;
         static CRxThreadMutex _mutex;
@@ -0,0 +1,682 @@
+#include "optimizer.h"
+#include "../runtime/program.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+#define ACC_NONE     0
+#define ACC_UNKNOWN  1
+#define ACC_KNOWN    2
+
+typedef struct {
+    Instruction*    code;
+    bool*           dead;
+    uint32_t        len;
+} OptBuf;
+
+typedef struct {
+    uint32_t    start;
+    uint32_t    end;
+    uint32_t    index;
+    OpCode      load_op;
+    uint32_t    load_offset;
+    double      rank;
+    double      group_rank;
+    uint32_t    group_first;
+} Block;
+
+static bool is_load(OpCode op) {
+    return op >= OP_LOAD_U8 && op <= OP_LOAD_I64_LE;
+}
+
+static bool is_cmp(OpCode op) {
+    return op >= OP_CMP_EQ && op <= OP_CMP_IN_TABLE;
+}
+
+static bool is_cond_jump(OpCode op) {
+    return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+static bool is_jump(OpCode op) {
+    return is_cond_jump(op) || op == OP_JUMP;
+}
+
+static bool falls_through(OpCode op) {
+    return op != OP_JUMP && op != OP_RETURN_TRUE && op != OP_RETURN_FALSE;
+}
+
+static uint32_t load_width(OpCode op) {
+    switch (op) {
+        case OP_LOAD_U8:
+        case OP_LOAD_I8:
+            return 1;
+        case OP_LOAD_U16_BE:
+        case OP_LOAD_U16_LE:
+        case OP_LOAD_I16_BE:
+        case OP_LOAD_I16_LE:
+            return 2;
+        case OP_LOAD_U32_BE:
+        case OP_LOAD_U32_LE:
+        case OP_LOAD_I32_BE:
+        case OP_LOAD_I32_LE:
+            return 4;
+        case OP_LOAD_U64_BE:
+        case OP_LOAD_U64_LE:
+        case OP_LOAD_I64_BE:
+        case OP_LOAD_I64_LE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+
+
+static bool well_formed(const Instruction* code, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        OpCode op = code[i].opcode;
+        if (op > OP_RETURN_FALSE) {
+            return false;
+        }
+        if (is_cmp(op) && (i + 1 >= len || !is_cond_jump(code[i + 1].opcode))) {
+            return false;
+        }
+        if (is_cond_jump(op) && (i == 0 || !is_cmp(code[i - 1].opcode))) {
+            return false;
+        }
+        if (is_jump(op)) {
+            uint32_t t = code[i].jump_target;
+            if (t <= i || t >= len || is_cond_jump(code[t].opcode)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static uint32_t next_live(const OptBuf* b, uint32_t i) {
+    while (i < b->len && b->dead[i]) {
+        i++;
+    }
+    return i;
+}
+
+
+
+static double cmp_match_rate(const Instruction* cmp, double eq) {
+    double rate;
+    switch (cmp->opcode) {
+        case OP_CMP_EQ:
+            return eq;
+        case OP_CMP_NE:
+            return 1.0 - eq;
+        case OP_CMP_MASK: {
+            uint32_t set = (uint32_t)__builtin_popcountll(cmp->operand);
+            return 1.0 / (double)(1u << (set > 16 ? 16 : set));
+        }
+        case OP_CMP_RANGE:
+            rate = (double)(cmp->operand2 - cmp->operand + 1) * eq;
+            break;
+        case OP_CMP_IN_BITMAP: {
+            const uint64_t* bm = instruction_set_table(cmp);
+            rate = (double)(__builtin_popcountll(bm[0]) + __builtin_popcountll(bm[1]) +
+                            __builtin_popcountll(bm[2]) + __builtin_popcountll(bm[3])) * eq;
+            break;
+        }
+        case OP_CMP_IN_TABLE:
+            rate = (double)cmp->operand2 * eq;
+            break;
+        default:
+            return 0.5;
+    }
+    return rate > 1.0 ? 1.0 : rate;
+}
+
+static double block_pass_rate(const Instruction* code, uint32_t start, uint32_t end, uint32_t fail) {
+    uint32_t cmps = 0;
+    bool jumps_to_fail = false;
+    const Instruction* first_cmp = NULL;
+
+    for (uint32_t i = start; i < end; i++) {
+        if (is_cmp(code[i].opcode)) {
+            if (!first_cmp) {
+                first_cmp = &code[i];
+            }
+            cmps++;
+        } else if (code[i].opcode == OP_JUMP && code[i].jump_target == fail) {
+            jumps_to_fail = true;
+        }
+    }
+    if (!first_cmp) {
+        return 1.0;
+    }
+
+    uint32_t bits = 8 * load_width(code[start].opcode);
+    if (bits > 16) {
+        bits = 16;
+    }
+    double eq = 1.0 / (double)(1u << bits);
+
+    if (jumps_to_fail) {
+        return 1.0 - cmps * eq;
+    }
+    if (cmps > 1) {
+        return cmps * eq;
+    }
+
+    double rate = cmp_match_rate(first_cmp, eq);
+    return first_cmp[1].opcode == OP_JUMP_IF_TRUE ? 1.0 - rate : rate;
+}
+
+static bool block_before(const Block* a, const Block* b) {
+    if (a->group_rank != b->group_rank) {
+        return a->group_rank < b->group_rank;
+    }
+    if (a->group_first != b->group_first) {
+        return a->group_first < b->group_first;
+    }
+    if (a->rank != b->rank) {
+        return a->rank < b->rank;
+    }
+    return a->index < b->index;
+}
+
+
+
+
+static int reorder_blocks(Instruction* code, uint32_t len) {
+    if (len < 3 || !is_load(code[0].opcode) ||
+        code[len - 2].opcode != OP_RETURN_TRUE || code[len - 1].opcode != OP_RETURN_FALSE) {
+        return 0;
+    }
+    const uint32_t success = len - 2;
+    const uint32_t fail = len - 1;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < success; i++) {
+        if (is_load(code[i].opcode)) {
+            count++;
+        }
+    }
+    if (count < 2) {
+        return 0;
+    }
+
+    Block* blocks = (Block*)calloc(count, sizeof(Block));
+    if (!blocks) {
+        return -1;
+    }
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < success; i++) {
+        if (is_load(code[i].opcode)) {
+            if (k > 0) {
+                blocks[k - 1].end = i;
+            }
+            blocks[k].start = i;
+            blocks[k].index = k;
+            blocks[k].load_op = code[i].opcode;
+            blocks[k].load_offset = code[i].offset;
+            k++;
+        }
+    }
+    blocks[count - 1].end = success;
+
+    for (k = 0; k < count; k++) {
+        Block* blk = &blocks[k];
+        for (uint32_t i = blk->start; i < blk->end; i++) {
+            if (!is_jump(code[i].opcode)) {
+                continue;
+            }
+            uint32_t t = code[i].jump_target;
+            if (t != fail && t > blk->end) {
+                free(blocks);
+                return 0;
+            }
+        }
+        double pass = block_pass_rate(code, blk->start, blk->end, fail);
+        double reject = 1.0 - pass;
+        blk->rank = (double)(blk->end - blk->start) / (reject < 1e-6 ? 1e-6 : reject);
+    }
+
+    for (k = 0; k < count; k++) {
+        blocks[k].group_rank = blocks[k].rank;
+        blocks[k].group_first = k;
+        for (uint32_t j = 0; j < count; j++) {
+            if (blocks[j].load_op == blocks[k].load_op && blocks[j].load_offset == blocks[k].load_offset) {
+                if (blocks[j].rank < blocks[k].group_rank) {
+                    blocks[k].group_rank = blocks[j].rank;
+                }
+                if (j < blocks[k].group_first) {
+                    blocks[k].group_first = j;
+                }
+            }
+        }
+    }
+
+    for (k = 1; k < count; k++) {
+        Block cur = blocks[k];
+        uint32_t j = k;
+        while (j > 0 && block_before(&cur, &blocks[j - 1])) {
+            blocks[j] = blocks[j - 1];
+            j--;
+        }
+        blocks[j] = cur;
+    }
+
+    int moved = 0;
+    for (k = 0; k < count; k++) {
+        if (blocks[k].index != k) {
+            moved++;
+        }
+    }
+    if (moved == 0) {
+        free(blocks);
+        return 0;
+    }
+
+    Instruction* tmp = (Instruction*)malloc(len * sizeof(Instruction));
+    if (!tmp) {
+        free(blocks);
+        return -1;
+    }
+    uint32_t pos = 0;
+    for (k = 0; k < count; k++) {
+        const Block* blk = &blocks[k];
+        uint32_t size = blk->end - blk->start;
+        for (uint32_t i = blk->start; i < blk->end; i++) {
+            Instruction ins = code[i];
+            if (is_jump(ins.opcode)) {
+                if (ins.jump_target == fail) {
+                    ins.jump_target = fail;
+                } else if (ins.jump_target == blk->end) {
+                    ins.jump_target = pos + size;
+                } else {
+                    ins.jump_target = pos + (ins.jump_target - blk->start);
+                }
+            }
+            tmp[pos + (i - blk->start)] = ins;
+        }
+        pos += size;
+    }
+    tmp[success] = code[success];
+    tmp[fail] = code[fail];
+    memcpy(code, tmp, len * sizeof(Instruction));
+
+    free(tmp);
+    free(blocks);
+    return moved;
+}
+
+
+
+static int thread_jumps(OptBuf* b, PdefOptStats* st) {
+    int changed = 0;
+
+    bool* targeted = (bool*)calloc(b->len, sizeof(bool));
+    if (!targeted) {
+        return -1;
+    }
+    for (uint32_t i = next_live(b, 0); i < b->len; i = next_live(b, i + 1)) {
+        if (is_jump(b->code[i].opcode) && b->code[i].jump_target < b->len) {
+            targeted[b->code[i].jump_target] = true;
+        }
+    }
+    for (uint32_t i = next_live(b, 0); i < b->len; i = next_live(b, i + 1)) {
+        Instruction* ins = &b->code[i];
+        if (!is_cond_jump(ins->opcode)) {
+            continue;
+        }
+        uint32_t j = next_live(b, i + 1);
+        if (j >= b->len || b->code[j].opcode != OP_JUMP || targeted[j]) {
+            continue;
+        }
+        if (next_live(b, ins->jump_target) != next_live(b, j + 1)) {
+            continue;
+        }
+        ins->opcode = ins->opcode == OP_JUMP_IF_FALSE ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE;
+        ins->jump_target = b->code[j].jump_target;
+        b->dead[j] = true;
+        st->jumps_threaded++;
+        changed = 1;
+    }
+
+    free(targeted);
+
+
+    for (uint32_t i = next_live(b, 0); i < b->len; i = next_live(b, i + 1)) {
+        Instruction* ins = &b->code[i];
+        if (!is_jump(ins->opcode)) {
+            continue;
+        }
+        uint32_t first = next_live(b, ins->jump_target);
+        uint32_t t = first;
+        while (t < b->len && b->code[t].opcode == OP_JUMP) {
+            t = next_live(b, b->code[t].jump_target);
+        }
+
+        if (t == next_live(b, i + 1)) {
+            b->dead[i] = true;
+            if (is_cond_jump(ins->opcode)) {
+                b->dead[i - 1] = true;
+            }
+            st->jumps_threaded++;
+            changed = 1;
+            continue;
+        }
+        if (ins->opcode == OP_JUMP && t < b->len &&
+            (b->code[t].opcode == OP_RETURN_TRUE || b->code[t].opcode == OP_RETURN_FALSE)) {
+            ins->opcode = b->code[t].opcode;
+            ins->jump_target = 0;
+            st->jumps_threaded++;
+            changed = 1;
+            continue;
+        }
+        if (t != ins->jump_target) {
+            if (t != first) {
+                st->jumps_threaded++;
+            }
+            ins->jump_target = t;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+
+
+static void merge_acc(uint8_t* state, OpCode* ops, uint32_t* offsets, uint32_t len,
+                      uint32_t at, uint8_t s, OpCode op, uint32_t offset) {
+    if (at >= len) {
+        return;
+    }
+    if (state[at] == ACC_NONE) {
+        state[at] = s;
+        ops[at] = op;
+        offsets[at] = offset;
+    } else if (state[at] != ACC_KNOWN || s != ACC_KNOWN || ops[at] != op || offsets[at] != offset) {
+        state[at] = ACC_UNKNOWN;
+    }
+}
+
+static int eliminate_loads(OptBuf* b, PdefOptStats* st) {
+    uint8_t* state = (uint8_t*)calloc(b->len, sizeof(uint8_t));
+    OpCode* ops = (OpCode*)calloc(b->len, sizeof(OpCode));
+    uint32_t* offsets = (uint32_t*)calloc(b->len, sizeof(uint32_t));
+    if (!state || !ops || !offsets) {
+        free(state);
+        free(ops);
+        free(offsets);
+        return -1;
+    }
+
+    int changed = 0;
+    uint32_t entry = next_live(b, 0);
+    if (entry < b->len) {
+        state[entry] = ACC_UNKNOWN;
+    }
+
+    for (uint32_t i = entry; i < b->len; i = next_live(b, i + 1)) {
+        if (state[i] == ACC_NONE) {
+            continue;
+        }
+        const Instruction* ins = &b->code[i];
+        uint8_t s = state[i];
+        OpCode op = ops[i];
+        uint32_t offset = offsets[i];
+
+        if (is_load(ins->opcode)) {
+            if (s == ACC_KNOWN && op == ins->opcode && offset == ins->offset) {
+                b->dead[i] = true;
+                st->loads_removed++;
+                changed = 1;
+            } else {
+                s = ACC_KNOWN;
+                op = ins->opcode;
+                offset = ins->offset;
+            }
+        }
+
+        if (falls_through(ins->opcode)) {
+            merge_acc(state, ops, offsets, b->len, next_live(b, i + 1), s, op, offset);
+        }
+        if (is_jump(ins->opcode)) {
+            merge_acc(state, ops, offsets, b->len, next_live(b, ins->jump_target), s, op, offset);
+        }
+    }
+
+    free(state);
+    free(ops);
+    free(offsets);
+    return changed;
+}
+
+static int remove_unreachable(OptBuf* b, PdefOptStats* st) {
+    bool* reach = (bool*)calloc(b->len, sizeof(bool));
+    if (!reach) {
+        return -1;
+    }
+
+    int changed = 0;
+    uint32_t entry = next_live(b, 0);
+    if (entry < b->len) {
+        reach[entry] = true;
+    }
+    for (uint32_t i = entry; i < b->len; i = next_live(b, i + 1)) {
+        if (!reach[i]) {
+            b->dead[i] = true;
+            st->dead_removed++;
+            changed = 1;
+            continue;
+        }
+        const Instruction* ins = &b->code[i];
+        uint32_t next = next_live(b, i + 1);
+        if (falls_through(ins->opcode) && next < b->len) {
+            reach[next] = true;
+        }
+        if (is_jump(ins->opcode)) {
+            uint32_t t = next_live(b, ins->jump_target);
+            if (t < b->len) {
+                reach[t] = true;
+            }
+        }
+    }
+
+    free(reach);
+    return changed;
+}
+
+
+
+
+
+static int64_t hoist_bounds(const OptBuf* b) {
+    uint32_t* need = (uint32_t*)malloc(b->len * sizeof(uint32_t));
+    if (!need) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < b->len; i++) {
+        need[i] = UINT32_MAX;
+    }
+
+    uint32_t accepted = UINT32_MAX;
+    uint32_t widest = 0;
+    uint32_t loads = 0;
+    uint32_t entry = next_live(b, 0);
+    if (entry < b->len) {
+        need[entry] = 0;
+    }
+
+    for (uint32_t i = entry; i < b->len; i = next_live(b, i + 1)) {
+        if (need[i] == UINT32_MAX) {
+            continue;
+        }
+        const Instruction* ins = &b->code[i];
+        uint32_t v = need[i];
+        if (is_load(ins->opcode)) {
+            uint32_t end = ins->offset + load_width(ins->opcode);
+            loads++;
+            if (end > widest) {
+                widest = end;
+            }
+            if (end > v) {
+                v = end;
+            }
+        }
+        if (ins->opcode == OP_RETURN_TRUE && v < accepted) {
+            accepted = v;
+        }
+
+        uint32_t succ[2];
+        int n = 0;
+        if (falls_through(ins->opcode)) {
+            succ[n++] = next_live(b, i + 1);
+        }
+        if (is_jump(ins->opcode)) {
+            succ[n++] = next_live(b, ins->jump_target);
+        }
+        for (int s = 0; s < n; s++) {
+            if (succ[s] < b->len && v < need[succ[s]]) {
+                need[succ[s]] = v;
+            }
+        }
+    }
+
+    free(need);
+    if (loads < 2 || accepted == UINT32_MAX || accepted < widest) {
+        return 0;
+    }
+    return widest;
+}
+
+static bool compact(const OptBuf* b, uint32_t checked_len, Instruction** out, uint32_t* out_len) {
+    uint32_t* map = (uint32_t*)malloc((b->len + 1) * sizeof(uint32_t));
+    if (!map) {
+        return false;
+    }
+    uint32_t n = checked_len ? 1 : 0;
+    for (uint32_t i = 0; i < b->len; i++) {
+        map[i] = n;
+        if (!b->dead[i]) {
+            n++;
+        }
+    }
+    map[b->len] = n;
+
+    Instruction* code = (Instruction*)calloc(n, sizeof(Instruction));
+    if (!code) {
+        free(map);
+        return false;
+    }
+    if (checked_len) {
+        code[0].opcode = OP_CHECK_LEN;
+        code[0].operand = checked_len;
+    }
+    for (uint32_t i = 0; i < b->len; i++) {
+        if (b->dead[i]) {
+            continue;
+        }
+        Instruction ins = b->code[i];
+        if (is_jump(ins.opcode)) {
+            ins.jump_target = map[next_live(b, ins.jump_target)];
+        }
+        code[map[i]] = ins;
+    }
+
+    free(map);
+    *out = code;
+    *out_len = n;
+    return true;
+}
+
+bool pdef_optimize_bytecode(const Instruction* code, uint32_t len,
+                            Instruction** out, uint32_t* out_len,
+                            PdefOptStats* stats) {
+    PdefOptStats local;
+    PdefOptStats* st = stats ? stats : &local;
+    memset(st, 0, sizeof(*st));
+    st->before_len = len;
+
+    if (!code || len == 0 || !out || !out_len) {
+        return false;
+    }
+    *out = NULL;
+    *out_len = 0;
+
+    OptBuf b;
+    b.len = len;
+    b.code = (Instruction*)malloc(len * sizeof(Instruction));
+    b.dead = (bool*)calloc(len, sizeof(bool));
+    if (!b.code || !b.dead) {
+        free(b.code);
+        free(b.dead);
+        return false;
+    }
+    memcpy(b.code, code, len * sizeof(Instruction));
+
+    bool ok = true;
+    int64_t checked_len = 0;
+    if (well_formed(b.code, len)) {
+        int moved = reorder_blocks(b.code, len);
+        ok = moved >= 0;
+        st->blocks_reordered = moved > 0 ? (uint32_t)moved : 0;
+
+        int changed = 1;
+        for (int round = 0; ok && changed && round < 16; round++) {
+            int r1 = thread_jumps(&b, st);
+            int r2 = r1 < 0 ? -1 : eliminate_loads(&b, st);
+            int r3 = r2 < 0 ? -1 : remove_unreachable(&b, st);
+            ok = r1 >= 0 && r2 >= 0 && r3 >= 0;
+            changed = r1 > 0 || r2 > 0 || r3 > 0;
+        }
+
+        if (ok) {
+            checked_len = hoist_bounds(&b);
+            ok = checked_len >= 0;
+        }
+    }
+
+    ok = ok && compact(&b, (uint32_t)checked_len, out, out_len);
+    free(b.code);
+    free(b.dead);
+    if (!ok) {
+        return false;
+    }
+
+    st->after_len = *out_len;
+    st->checked_len = (uint32_t)checked_len;
+    return true;
+}
+
+bool pdef_optimize_rule(FilterRule* rule, PdefOptStats* stats) {
+    if (!rule || !rule->bytecode || rule->bytecode_len == 0) {
+        return false;
+    }
+
+    Instruction* code = NULL;
+    uint32_t len = 0;
+    if (!pdef_optimize_bytecode(rule->bytecode, rule->bytecode_len, &code, &len, stats)) {
+        return false;
+    }
+    Instruction* code_le = (Instruction*)calloc(len, sizeof(Instruction));
+    if (!code_le) {
+        free(code);
+        return false;
+    }
+    for (uint32_t k = 0; k < len; k++) {
+        code_le[k] = code[k];
+        code_le[k].opcode = opcode_swap_endian(code[k].opcode);
+    }
+
+    free(rule->bytecode);
+    free(rule->bytecode_le);
+    rule->bytecode = code;
+    rule->bytecode_len = len;
+    rule->bytecode_be = code;
+    rule->bytecode_be_len = len;
+    rule->bytecode_le = code_le;
+    rule->bytecode_le_len = len;
+    if (rule->program_be || rule->program_le) {
+        filter_rule_build_programs(rule);
+    }
+    return true;
+}
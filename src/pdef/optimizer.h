@@ -0,0 +1,43 @@
+#ifndef PDEF_OPTIMIZER_H
+#define PDEF_OPTIMIZER_H
+
+#include "pdef_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+typedef struct {
+    uint32_t    before_len;
+    uint32_t    after_len;
+    uint32_t    blocks_reordered;
+    uint32_t    loads_removed;
+    uint32_t    jumps_threaded;
+    uint32_t    dead_removed;
+    uint32_t    checked_len;
+} PdefOptStats;
+
+
+
+
+
+
+
+bool pdef_optimize_bytecode(const Instruction* code, uint32_t len,
+                            Instruction** out, uint32_t* out_len,
+                            PdefOptStats* stats);
+
+
+
+
+
+
+bool pdef_optimize_rule(FilterRule* rule, PdefOptStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
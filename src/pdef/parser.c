@@ -1,6 +1,8 @@
 #include "parser.h"
 #include "lexer.h"
+#include "optimizer.h"
 #include "../runtime/protocol.h"
+#include "../runtime/program.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,16 @@ typedef enum {
     COND_NOT_IN,
 } ConditionOp;
 
+typedef enum {
+    SET_CHAIN,
+    SET_SINGLE,
+    SET_RANGE,
+    SET_BITMAP,
+    SET_TABLE,
+} SetKind;
+
+#define PDEF_SET_MIN_VALUES 3
+
 typedef struct {
     char            field_name[128];
     ConditionOp     op;
@@ -26,6 +38,8 @@ typedef struct {
     uint64_t        mask;
     uint64_t*       values;
     uint32_t        value_count;
+    SetKind         set_kind;
+    uint32_t        set_words;
 } FilterCondition;
 
 typedef struct {
@@ -56,6 +70,8 @@ typedef struct {
 
 
     bool            endian_set;
+    bool            optimize;
+    bool            set_ops;
 } Parser;
 
 
@@ -323,30 +339,35 @@ static bool parse_protocol_block(Parser* p) {
             parser_next_token(p);
         } else if (strcmp(key, "ports") == 0) {
 
-
-
-            fprintf(stderr, "[PDEF WARN] Protocol '%s': 'ports' field is DEPRECATED and will be IGNORED.\n",
-                    p->proto->name);
-            fprintf(stderr, "[PDEF WARN] Use BPF filter ('filter' or 'port_filter' in API) for port filtering.\n");
-            fprintf(stderr, "[PDEF WARN] PDEF is now responsible for protocol content filtering only.\n");
-
+            free(p->proto->ports);
+            p->proto->ports = NULL;
+            p->proto->port_count = 0;
+            uint32_t port_cap = 0;
 
             do {
                 if (p->current_token.type == TOKEN_COMMA) {
                     parser_next_token(p);
                 }
 
-                if (p->current_token.type != TOKEN_NUMBER) {
+                if (p->current_token.type != TOKEN_NUMBER || p->current_token.value > 65535) {
                     parser_error(p, "Expected port number");
                     return false;
                 }
 
+                if (p->proto->port_count >= port_cap) {
+                    port_cap = port_cap ? port_cap * 2 : 4;
+                    uint16_t* new_ports = (uint16_t*)realloc(p->proto->ports, port_cap * sizeof(uint16_t));
+                    if (!new_ports) {
+                        parser_error(p, "Memory allocation failed");
+                        return false;
+                    }
+                    p->proto->ports = new_ports;
+                }
+                p->proto->ports[p->proto->port_count++] = (uint16_t)p->current_token.value;
+
                 parser_next_token(p);
             } while (p->current_token.type == TOKEN_COMMA);
 
-
-            p->proto->ports = NULL;
-            p->proto->port_count = 0;
         } else {
             parser_error(p, "Unknown protocol metadata key: %s", key);
             return false;
@@ -828,6 +849,11 @@ static bool parse_struct_def(Parser* p) {
 
 
 ProtocolDef* pdef_parse_string(const char* source, char* error_msg, size_t error_size) {
+    return pdef_parse_string_ex(source, 0, error_msg, error_size);
+}
+
+ProtocolDef* pdef_parse_string_ex(const char* source, unsigned int flags,
+                                  char* error_msg, size_t error_size) {
     Parser parser;
 
     if (!parser_init(&parser, source)) {
@@ -843,6 +869,9 @@ ProtocolDef* pdef_parse_string(const char* source, char* error_msg, size_t error
     }
 
 
+    parser.optimize = !(flags & PDEF_PARSE_NO_OPTIMIZE);
+    parser.set_ops = !(flags & PDEF_PARSE_NO_SET_OPS);
+
     while (parser.current_token.type != TOKEN_EOF) {
         switch (parser.current_token.type) {
             case TOKEN_PROTOCOL:
@@ -1119,26 +1148,6 @@ static OpCode get_load_opcode(const Field* field) {
 }
 
 
-static OpCode swap_endian_opcode(OpCode op) {
-    switch (op) {
-        case OP_LOAD_U16_BE: return OP_LOAD_U16_LE;
-        case OP_LOAD_U16_LE: return OP_LOAD_U16_BE;
-        case OP_LOAD_U32_BE: return OP_LOAD_U32_LE;
-        case OP_LOAD_U32_LE: return OP_LOAD_U32_BE;
-        case OP_LOAD_U64_BE: return OP_LOAD_U64_LE;
-        case OP_LOAD_U64_LE: return OP_LOAD_U64_BE;
-        case OP_LOAD_I16_BE: return OP_LOAD_I16_LE;
-        case OP_LOAD_I16_LE: return OP_LOAD_I16_BE;
-        case OP_LOAD_I32_BE: return OP_LOAD_I32_LE;
-        case OP_LOAD_I32_LE: return OP_LOAD_I32_BE;
-        case OP_LOAD_I64_BE: return OP_LOAD_I64_LE;
-        case OP_LOAD_I64_LE: return OP_LOAD_I64_BE;
-        default:
-            return op;
-    }
-}
-
-
 static OpCode get_cmp_opcode(ConditionOp op) {
     switch (op) {
         case COND_EQ:    return OP_CMP_EQ;
@@ -1152,6 +1161,72 @@ static OpCode get_cmp_opcode(ConditionOp op) {
     }
 }
 
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+
+static void plan_set_condition(FilterCondition* cond, bool set_ops) {
+    qsort(cond->values, cond->value_count, sizeof(uint64_t), compare_u64);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < cond->value_count; i++) {
+        if (n == 0 || cond->values[i] != cond->values[n - 1]) {
+            cond->values[n++] = cond->values[i];
+        }
+    }
+    cond->value_count = n;
+    cond->set_words = 0;
+
+    if (!set_ops) {
+        cond->set_kind = SET_CHAIN;
+    } else if (n == 1) {
+        cond->set_kind = SET_SINGLE;
+    } else if (cond->values[n - 1] - cond->values[0] == n - 1) {
+        cond->set_kind = SET_RANGE;
+    } else if (n < PDEF_SET_MIN_VALUES) {
+        cond->set_kind = SET_CHAIN;
+    } else if (cond->values[n - 1] < 256) {
+        cond->set_kind = SET_BITMAP;
+        cond->set_words = 4;
+    } else {
+        cond->set_kind = SET_TABLE;
+        cond->set_words = n;
+    }
+}
+
+static Instruction compile_set_compare(const FilterCondition* cond, uint64_t* table) {
+    Instruction cmp_ins = (Instruction){0};
+    uint32_t n = cond->value_count;
+    switch (cond->set_kind) {
+        case SET_SINGLE:
+            cmp_ins.opcode = OP_CMP_EQ;
+            cmp_ins.operand = cond->values[0];
+            break;
+        case SET_RANGE:
+            cmp_ins.opcode = OP_CMP_RANGE;
+            cmp_ins.operand = cond->values[0];
+            cmp_ins.operand2 = cond->values[n - 1];
+            break;
+        case SET_BITMAP:
+            for (uint32_t v = 0; v < n; v++) {
+                table[cond->values[v] >> 6] |= 1ULL << (cond->values[v] & 63);
+            }
+            cmp_ins.opcode = OP_CMP_IN_BITMAP;
+            cmp_ins.operand = (uint64_t)(uintptr_t)table;
+            break;
+        default:
+            memcpy(table, cond->values, n * sizeof(uint64_t));
+            cmp_ins.opcode = OP_CMP_IN_TABLE;
+            cmp_ins.operand = (uint64_t)(uintptr_t)table;
+            cmp_ins.operand2 = n;
+            break;
+    }
+    return cmp_ins;
+}
+
 static bool compile_filter_rules(Parser* p) {
 
     for (uint32_t i = 0; i < p->proto->filter_count; i++) {
@@ -1196,6 +1271,7 @@ static bool compile_filter_rules(Parser* p) {
         }
 
         uint32_t total_size = 2;
+        uint32_t set_words = 0;
         for (uint32_t j = 0; j < cond_count; j++) {
             FilterCondition* cond = &temp_rule->conditions[j];
             switch (cond->op) {
@@ -1205,7 +1281,9 @@ static bool compile_filter_rules(Parser* p) {
                         parser_error(p, "Empty IN list in filter '%s'", temp_rule->name);
                         return false;
                     }
-                    cond_sizes[j] = 3 * cond->value_count;
+                    plan_set_condition(cond, p->set_ops);
+                    cond_sizes[j] = cond->set_kind == SET_CHAIN ? 3 * cond->value_count : 3;
+                    set_words += cond->set_words;
                     total_size += cond_sizes[j];
                     break;
                 case COND_NOT_IN:
@@ -1214,7 +1292,9 @@ static bool compile_filter_rules(Parser* p) {
                         parser_error(p, "Empty NOT IN list in filter '%s'", temp_rule->name);
                         return false;
                     }
-                    cond_sizes[j] = 1 + 3 * cond->value_count;
+                    plan_set_condition(cond, p->set_ops);
+                    cond_sizes[j] = cond->set_kind == SET_CHAIN ? 1 + 3 * cond->value_count : 3;
+                    set_words += cond->set_words;
                     total_size += cond_sizes[j];
                     break;
                 case COND_EQ:
@@ -1236,11 +1316,20 @@ static bool compile_filter_rules(Parser* p) {
 
 
         rule->bytecode = (Instruction*)calloc(total_size, sizeof(Instruction));
-        if (!rule->bytecode) {
+        if (set_words > 0) {
+            rule->set_tables = (uint64_t*)calloc(set_words, sizeof(uint64_t));
+            rule->set_table_words = set_words;
+        }
+        if (!rule->bytecode || (set_words > 0 && !rule->set_tables)) {
+            free(rule->bytecode);
+            free(rule->set_tables);
+            rule->bytecode = NULL;
+            rule->set_tables = NULL;
             if (cond_sizes) free(cond_sizes);
             parser_error(p, "Memory allocation failed");
             return false;
         }
+        uint32_t set_used = 0;
 
 
         uint32_t success_label = total_size > 1 ? total_size - 2 : 0;
@@ -1250,6 +1339,7 @@ static bool compile_filter_rules(Parser* p) {
             cond_starts = (uint32_t*)calloc(cond_count, sizeof(uint32_t));
             if (!cond_starts) {
                 free(rule->bytecode);
+                free(rule->set_tables);
                 if (cond_sizes) free(cond_sizes);
                 parser_error(p, "Memory allocation failed");
                 return false;
@@ -1273,6 +1363,7 @@ static bool compile_filter_rules(Parser* p) {
                 parser_error(p, "Field '%s' not found in struct '%s'",
                              cond->field_name, target_struct->name);
                 free(rule->bytecode);
+                free(rule->set_tables);
                 if (cond_sizes) free(cond_sizes);
                 if (cond_starts) free(cond_starts);
                 return false;
@@ -1284,7 +1375,22 @@ static bool compile_filter_rules(Parser* p) {
             load_ins.offset = field->offset;
             rule->bytecode[idx++] = load_ins;
 
-            if (cond->op == COND_IN) {
+            if ((cond->op == COND_IN || cond->op == COND_NOT_IN) && cond->set_kind != SET_CHAIN) {
+                Instruction cmp_ins = compile_set_compare(cond, rule->set_tables + set_used);
+                set_used += cond->set_words;
+                Instruction jump_ins = (Instruction){0};
+                jump_ins.opcode = OP_JUMP_IF_FALSE;
+                if (cond->op == COND_NOT_IN) {
+                    if (cmp_ins.opcode == OP_CMP_EQ) {
+                        cmp_ins.opcode = OP_CMP_NE;
+                    } else {
+                        jump_ins.opcode = OP_JUMP_IF_TRUE;
+                    }
+                }
+                jump_ins.jump_target = fail_label;
+                rule->bytecode[idx++] = cmp_ins;
+                rule->bytecode[idx++] = jump_ins;
+            } else if (cond->op == COND_IN) {
                 for (uint32_t v = 0; v < cond->value_count; v++) {
                     Instruction cmp_ins = {0};
                     cmp_ins.opcode = OP_CMP_EQ;
@@ -1361,7 +1467,7 @@ static bool compile_filter_rules(Parser* p) {
         if (rule->bytecode_le) {
             memcpy(rule->bytecode_le, rule->bytecode_be, total_size * sizeof(Instruction));
             for (uint32_t k = 0; k < total_size; k++) {
-                rule->bytecode_le[k].opcode = swap_endian_opcode(rule->bytecode_le[k].opcode);
+                rule->bytecode_le[k].opcode = opcode_swap_endian(rule->bytecode_le[k].opcode);
             }
             rule->bytecode_le_len = total_size;
         } else {
@@ -1370,12 +1476,23 @@ static bool compile_filter_rules(Parser* p) {
 
         if (cond_sizes) free(cond_sizes);
         if (cond_starts) free(cond_starts);
+
+        if (p->optimize && !pdef_optimize_rule(rule, NULL)) {
+            parser_error(p, "Failed to optimize filter '%s'", temp_rule->name);
+            return false;
+        }
+        filter_rule_build_programs(rule);
     }
 
     return true;
 }
 
 ProtocolDef* pdef_parse_file(const char* filename, char* error_msg, size_t error_size) {
+    return pdef_parse_file_ex(filename, 0, error_msg, error_size);
+}
+
+ProtocolDef* pdef_parse_file_ex(const char* filename, unsigned int flags,
+                                char* error_msg, size_t error_size) {
     FILE* f = fopen(filename, "r");
     if (!f) {
         if (error_msg && error_size > 0) {
@@ -1402,7 +1519,7 @@ ProtocolDef* pdef_parse_file(const char* filename, char* error_msg, size_t error
     source[read_size] = '\0';
     fclose(f);
 
-    ProtocolDef* result = pdef_parse_string(source, error_msg, error_size);
+    ProtocolDef* result = pdef_parse_string_ex(source, flags, error_msg, error_size);
     if (result && filename) {
         strncpy(result->pdef_file_path, filename, sizeof(result->pdef_file_path) - 1);
         result->pdef_file_path[sizeof(result->pdef_file_path) - 1] = '\0';
@@ -37,6 +37,17 @@ ProtocolDef* pdef_parse_file(const char* filename, char* error_msg, size_t error
 
 ProtocolDef* pdef_parse_string(const char* source, char* error_msg, size_t error_size);
 
+
+
+#define PDEF_PARSE_NO_OPTIMIZE  0x1
+#define PDEF_PARSE_NO_SET_OPS   0x2
+
+ProtocolDef* pdef_parse_file_ex(const char* filename, unsigned int flags,
+                                char* error_msg, size_t error_size);
+
+ProtocolDef* pdef_parse_string_ex(const char* source, unsigned int flags,
+                                  char* error_msg, size_t error_size);
+
 #ifdef __cplusplus
 }
 #endif
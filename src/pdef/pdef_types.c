@@ -66,10 +66,34 @@ const char* opcode_name(OpCode opcode) {
         case OP_CMP_LT:          return "CMP_LT";
         case OP_CMP_LE:          return "CMP_LE";
         case OP_CMP_MASK:        return "CMP_MASK";
+        case OP_CMP_RANGE:       return "CMP_RANGE";
+        case OP_CMP_IN_BITMAP:   return "CMP_IN_BITMAP";
+        case OP_CMP_IN_TABLE:    return "CMP_IN_TABLE";
         case OP_JUMP_IF_FALSE:   return "JUMP_IF_FALSE";
+        case OP_JUMP_IF_TRUE:    return "JUMP_IF_TRUE";
         case OP_JUMP:            return "JUMP";
         case OP_RETURN_TRUE:     return "RETURN_TRUE";
         case OP_RETURN_FALSE:    return "RETURN_FALSE";
+        case OP_CHECK_LEN:       return "CHECK_LEN";
         default:                 return "UNKNOWN";
     }
 }
+
+OpCode opcode_swap_endian(OpCode opcode) {
+    switch (opcode) {
+        case OP_LOAD_U16_BE: return OP_LOAD_U16_LE;
+        case OP_LOAD_U16_LE: return OP_LOAD_U16_BE;
+        case OP_LOAD_U32_BE: return OP_LOAD_U32_LE;
+        case OP_LOAD_U32_LE: return OP_LOAD_U32_BE;
+        case OP_LOAD_U64_BE: return OP_LOAD_U64_LE;
+        case OP_LOAD_U64_LE: return OP_LOAD_U64_BE;
+        case OP_LOAD_I16_BE: return OP_LOAD_I16_LE;
+        case OP_LOAD_I16_LE: return OP_LOAD_I16_BE;
+        case OP_LOAD_I32_BE: return OP_LOAD_I32_LE;
+        case OP_LOAD_I32_LE: return OP_LOAD_I32_BE;
+        case OP_LOAD_I64_BE: return OP_LOAD_I64_LE;
+        case OP_LOAD_I64_LE: return OP_LOAD_I64_BE;
+        default:
+            return opcode;
+    }
+}
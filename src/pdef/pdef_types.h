@@ -49,6 +49,12 @@ typedef enum {
     ENDIAN_TYPE_LITTLE,
 } EndianType;
 
+/* An endian state word keeps the EndianType in its low byte; while that is still
+ * UNKNOWN the next two bytes count big- and little-endian votes. */
+#define ENDIAN_STATE_TYPE(state)        ((int)((state) & 0xFF))
+#define ENDIAN_STATE_VOTES_BIG(state)   ((uint32_t)((state) >> 8) & 0xFF)
+#define ENDIAN_STATE_VOTES_LITTLE(state) ((uint32_t)((state) >> 16) & 0xFF)
+
 
 
 typedef struct {
@@ -99,12 +105,19 @@ typedef enum {
     OP_CMP_LT,
     OP_CMP_LE,
     OP_CMP_MASK,
+    OP_CMP_RANGE,
+    OP_CMP_IN_BITMAP,
+    OP_CMP_IN_TABLE,
 
 
     OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
     OP_JUMP,
     OP_RETURN_TRUE,
     OP_RETURN_FALSE,
+
+
+    OP_CHECK_LEN,
 } OpCode;
 
 typedef struct {
@@ -117,6 +130,8 @@ typedef struct {
 
 
 
+struct PdefProgram;
+
 typedef struct {
     char            name[64];
     char            struct_name[64];
@@ -129,6 +144,10 @@ typedef struct {
     uint32_t        min_packet_size;
     bool            sliding_window;
     uint32_t        sliding_max_offset;
+    uint64_t*       set_tables;
+    uint32_t        set_table_words;
+    struct PdefProgram* program_be;
+    struct PdefProgram* program_le;
 } FilterRule;
 
 
@@ -175,6 +194,14 @@ const char* field_type_name(FieldType type);
 
 const char* opcode_name(OpCode opcode);
 
+
+OpCode opcode_swap_endian(OpCode opcode);
+
+/* OP_CMP_IN_BITMAP / OP_CMP_IN_TABLE keep a pointer into FilterRule.set_tables in operand. */
+static inline const uint64_t* instruction_set_table(const Instruction* ins) {
+    return (const uint64_t*)(uintptr_t)ins->operand;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,9 +6,11 @@
 #ifdef __GNUC__
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
+#define ALWAYS_INLINE   inline __attribute__((always_inline))
 #else
 #define likely(x)       (x)
 #define unlikely(x)     (x)
+#define ALWAYS_INLINE   inline
 #endif
 
 bool execute_filter(const uint8_t* packet, uint32_t packet_len, const FilterRule* rule) {
@@ -25,116 +27,124 @@ bool execute_filter(const uint8_t* packet, uint32_t packet_len, const FilterRule
     return execute_bytecode(packet, packet_len, rule->bytecode, rule->bytecode_len);
 }
 
-bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
-                      const Instruction* bytecode, uint32_t bytecode_len) {
-    if (unlikely(!packet || !bytecode || bytecode_len == 0)) {
-        return false;
+static ALWAYS_INLINE bool table_contains(const uint64_t* table, uint64_t count, uint64_t key) {
+    while (count > 1) {
+        uint64_t half = count >> 1;
+        table = table[half] <= key ? table + half : table;
+        count -= half;
     }
+    return *table == key;
+}
 
-    uint32_t ip = 0;
+static ALWAYS_INLINE bool run_bytecode(const uint8_t* packet, uint32_t packet_len,
+                                       const Instruction* bytecode, uint32_t bytecode_len,
+                                       uint32_t ip, const bool checked, uint32_t* executed) {
     uint64_t acc = 0;
     bool cmp_result = false;
 
     while (ip < bytecode_len) {
         const Instruction* ins = &bytecode[ip];
+        if (executed) {
+            (*executed)++;
+        }
 
         switch (ins->opcode) {
 
 
             case OP_LOAD_U8:
 
-                if (unlikely(ins->offset + 1 > packet_len)) {
+                if (checked && unlikely(ins->offset + 1 > packet_len)) {
                     return false;
                 }
                 acc = packet[ins->offset];
                 break;
 
             case OP_LOAD_U16_BE:
-                if (unlikely(ins->offset + 2 > packet_len)) {
+                if (checked && unlikely(ins->offset + 2 > packet_len)) {
                     return false;
                 }
                 acc = read_u16_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_U16_LE:
-                if (unlikely(ins->offset + 2 > packet_len)) {
+                if (checked && unlikely(ins->offset + 2 > packet_len)) {
                     return false;
                 }
                 acc = read_u16_le(packet, ins->offset);
                 break;
 
             case OP_LOAD_U32_BE:
-                if (unlikely(ins->offset + 4 > packet_len)) {
+                if (checked && unlikely(ins->offset + 4 > packet_len)) {
                     return false;
                 }
                 acc = read_u32_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_U32_LE:
-                if (unlikely(ins->offset + 4 > packet_len)) {
+                if (checked && unlikely(ins->offset + 4 > packet_len)) {
                     return false;
                 }
                 acc = read_u32_le(packet, ins->offset);
                 break;
 
             case OP_LOAD_U64_BE:
-                if (unlikely(ins->offset + 8 > packet_len)) {
+                if (checked && unlikely(ins->offset + 8 > packet_len)) {
                     return false;
                 }
                 acc = read_u64_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_U64_LE:
-                if (unlikely(ins->offset + 8 > packet_len)) {
+                if (checked && unlikely(ins->offset + 8 > packet_len)) {
                     return false;
                 }
                 acc = read_u64_le(packet, ins->offset);
                 break;
 
             case OP_LOAD_I8:
-                if (unlikely(ins->offset + 1 > packet_len)) {
+                if (checked && unlikely(ins->offset + 1 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)(int64_t)read_i8(packet, ins->offset);
                 break;
 
             case OP_LOAD_I16_BE:
-                if (unlikely(ins->offset + 2 > packet_len)) {
+                if (checked && unlikely(ins->offset + 2 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)(int64_t)read_i16_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_I16_LE:
-                if (unlikely(ins->offset + 2 > packet_len)) {
+                if (checked && unlikely(ins->offset + 2 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)(int64_t)read_i16_le(packet, ins->offset);
                 break;
 
             case OP_LOAD_I32_BE:
-                if (unlikely(ins->offset + 4 > packet_len)) {
+                if (checked && unlikely(ins->offset + 4 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)(int64_t)read_i32_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_I32_LE:
-                if (unlikely(ins->offset + 4 > packet_len)) {
+                if (checked && unlikely(ins->offset + 4 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)(int64_t)read_i32_le(packet, ins->offset);
                 break;
 
             case OP_LOAD_I64_BE:
-                if (unlikely(ins->offset + 8 > packet_len)) {
+                if (checked && unlikely(ins->offset + 8 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)read_i64_be(packet, ins->offset);
                 break;
 
             case OP_LOAD_I64_LE:
-                if (unlikely(ins->offset + 8 > packet_len)) {
+                if (checked && unlikely(ins->offset + 8 > packet_len)) {
                     return false;
                 }
                 acc = (uint64_t)read_i64_le(packet, ins->offset);
@@ -171,6 +181,20 @@ bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
                 cmp_result = ((acc & ins->operand) == ins->operand2);
                 break;
 
+            case OP_CMP_RANGE:
+                cmp_result = (acc - ins->operand) <= (ins->operand2 - ins->operand);
+                break;
+
+            case OP_CMP_IN_BITMAP: {
+                const uint64_t* bm = instruction_set_table(ins);
+                cmp_result = acc < 256 && ((bm[acc >> 6] >> (acc & 63)) & 1);
+                break;
+            }
+
+            case OP_CMP_IN_TABLE:
+                cmp_result = table_contains(instruction_set_table(ins), ins->operand2, acc);
+                break;
+
 
 
             case OP_JUMP_IF_FALSE:
@@ -184,6 +208,16 @@ bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
                 }
                 break;
 
+            case OP_JUMP_IF_TRUE:
+                if (cmp_result) {
+                    if (unlikely(ins->jump_target >= bytecode_len)) {
+                        return false;
+                    }
+                    ip = ins->jump_target;
+                    continue;
+                }
+                break;
+
             case OP_JUMP:
                 if (unlikely(ins->jump_target >= bytecode_len)) {
                     return false;
@@ -197,6 +231,12 @@ bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
             case OP_RETURN_FALSE:
                 return false;
 
+            case OP_CHECK_LEN:
+                if (packet_len < ins->operand) {
+                    return false;
+                }
+                break;
+
             default:
 
                 return false;
@@ -208,3 +248,32 @@ bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
 
     return false;
 }
+
+static ALWAYS_INLINE bool dispatch_bytecode(const uint8_t* packet, uint32_t packet_len,
+                                            const Instruction* bytecode, uint32_t bytecode_len,
+                                            uint32_t* executed) {
+    if (unlikely(!packet || !bytecode || bytecode_len == 0)) {
+        return false;
+    }
+
+
+    if (bytecode[0].opcode == OP_CHECK_LEN) {
+        if (packet_len < bytecode[0].operand) {
+            return false;
+        }
+        return run_bytecode(packet, packet_len, bytecode, bytecode_len, 1, false, executed);
+    }
+    return run_bytecode(packet, packet_len, bytecode, bytecode_len, 0, true, executed);
+}
+
+bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
+                      const Instruction* bytecode, uint32_t bytecode_len) {
+    return dispatch_bytecode(packet, packet_len, bytecode, bytecode_len, NULL);
+}
+
+bool execute_bytecode_count(const uint8_t* packet, uint32_t packet_len,
+                            const Instruction* bytecode, uint32_t bytecode_len,
+                            uint32_t* executed) {
+    uint32_t local = 0;
+    return dispatch_bytecode(packet, packet_len, bytecode, bytecode_len, executed ? executed : &local);
+}
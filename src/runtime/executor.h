@@ -41,6 +41,12 @@ bool execute_filter(const uint8_t* packet, uint32_t packet_len, const FilterRule
 bool execute_bytecode(const uint8_t* packet, uint32_t packet_len,
                       const Instruction* bytecode, uint32_t bytecode_len);
 
+
+/* Counts dispatched instructions; a leading OP_CHECK_LEN is a prologue guard and is not counted. */
+bool execute_bytecode_count(const uint8_t* packet, uint32_t packet_len,
+                            const Instruction* bytecode, uint32_t bytecode_len,
+                            uint32_t* executed);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,624 @@
+#include "program.h"
+#include "../utils/endian.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef __GNUC__
+#define likely(x)       __builtin_expect(!!(x), 1)
+#define unlikely(x)     __builtin_expect(!!(x), 0)
+#ifndef PDEF_NO_THREADED
+#define PDEF_THREADED   1
+#endif
+#else
+#define likely(x)       (x)
+#define unlikely(x)     (x)
+#endif
+
+#define PDEF_PROGRAM_OPS(X) \
+    X(LD_U8)            \
+    X(LD_U16_BE)        \
+    X(LD_U16_LE)        \
+    X(LD_U32_BE)        \
+    X(LD_U32_LE)        \
+    X(LD_U64_BE)        \
+    X(LD_U64_LE)        \
+    X(LD_I8)            \
+    X(LD_I16_BE)        \
+    X(LD_I16_LE)        \
+    X(LD_I32_BE)        \
+    X(LD_I32_LE)        \
+    X(LD_I64_BE)        \
+    X(LD_I64_LE)        \
+    X(EQ_JF)            \
+    X(EQ_JT)            \
+    X(GT_JF)            \
+    X(GT_JT)            \
+    X(GE_JF)            \
+    X(GE_JT)            \
+    X(MASK_JF)          \
+    X(MASK_JT)          \
+    X(RANGE_JF)         \
+    X(RANGE_JT)         \
+    X(BITMAP_JF)        \
+    X(BITMAP_JT)        \
+    X(TABLE_JF)         \
+    X(TABLE_JT)         \
+    X(LD_U8_EQ_JF)      \
+    X(LD_U8_EQ_JT)      \
+    X(LD_U16_BE_EQ_JF)  \
+    X(LD_U16_BE_EQ_JT)  \
+    X(LD_U16_LE_EQ_JF)  \
+    X(LD_U16_LE_EQ_JT)  \
+    X(LD_U32_BE_EQ_JF)  \
+    X(LD_U32_BE_EQ_JT)  \
+    X(LD_U32_LE_EQ_JF)  \
+    X(LD_U32_LE_EQ_JT)  \
+    X(JUMP)             \
+    X(RET_TRUE)         \
+    X(RET_FALSE)
+
+#define PDEF_OP_ENUM(name) PP_##name,
+#define PDEF_OP_NAME(name) #name,
+
+typedef enum {
+    PDEF_PROGRAM_OPS(PDEF_OP_ENUM)
+    PP_COUNT
+} ProgramOp;
+
+static const char* const kProgramOpNames[] = {
+    PDEF_PROGRAM_OPS(PDEF_OP_NAME)
+};
+
+#define PDEF_PROGRAM_MAX 0xFFFFu
+
+
+
+static bool is_load(OpCode op) {
+    return op >= OP_LOAD_U8 && op <= OP_LOAD_I64_LE;
+}
+
+static bool is_cmp(OpCode op) {
+    return op >= OP_CMP_EQ && op <= OP_CMP_IN_TABLE;
+}
+
+static bool is_cond_jump(OpCode op) {
+    return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+static int fused_base(OpCode load) {
+    switch (load) {
+        case OP_LOAD_U8:     return PP_LD_U8_EQ_JF;
+        case OP_LOAD_U16_BE: return PP_LD_U16_BE_EQ_JF;
+        case OP_LOAD_U16_LE: return PP_LD_U16_LE_EQ_JF;
+        case OP_LOAD_U32_BE: return PP_LD_U32_BE_EQ_JF;
+        case OP_LOAD_U32_LE: return PP_LD_U32_LE_EQ_JF;
+        default:             return -1;
+    }
+}
+
+
+
+static ProgramOp branch_op(OpCode cmp, bool jump_if_true, uint32_t* pool_words) {
+    int base;
+    bool when = jump_if_true;
+    *pool_words = 1;
+    switch (cmp) {
+        case OP_CMP_EQ:        base = PP_EQ_JF; break;
+        case OP_CMP_NE:        base = PP_EQ_JF; when = !when; break;
+        case OP_CMP_GT:        base = PP_GT_JF; break;
+        case OP_CMP_LE:        base = PP_GT_JF; when = !when; break;
+        case OP_CMP_GE:        base = PP_GE_JF; break;
+        case OP_CMP_LT:        base = PP_GE_JF; when = !when; break;
+        case OP_CMP_MASK:      base = PP_MASK_JF; *pool_words = 2; break;
+        case OP_CMP_RANGE:     base = PP_RANGE_JF; *pool_words = 2; break;
+        case OP_CMP_IN_BITMAP: base = PP_BITMAP_JF; break;
+        default:               base = PP_TABLE_JF; *pool_words = 2; break;
+    }
+    return (ProgramOp)(base + (when ? 1 : 0));
+}
+
+static void branch_pool(const Instruction* cmp, uint64_t* pool) {
+    switch (cmp->opcode) {
+        case OP_CMP_MASK:
+        case OP_CMP_RANGE:
+        case OP_CMP_IN_TABLE:
+            pool[0] = cmp->operand;
+            pool[1] = cmp->operand2;
+            break;
+        default:
+            pool[0] = cmp->operand;
+            break;
+    }
+}
+
+static bool fusable(const Instruction* code, uint32_t len, uint32_t i, const bool* targeted) {
+    return i + 2 < len && fused_base(code[i].opcode) >= 0 && !targeted[i + 1] &&
+           (code[i + 1].opcode == OP_CMP_EQ || code[i + 1].opcode == OP_CMP_NE) &&
+           is_cond_jump(code[i + 2].opcode);
+}
+
+PdefProgram* pdef_program_build(const Instruction* code, uint32_t len) {
+    if (!code || len == 0) {
+        return NULL;
+    }
+
+    uint32_t start = 0;
+    uint32_t min_len = 0;
+    if (code[0].opcode == OP_CHECK_LEN) {
+        if (code[0].operand > 0xFFFFFFFFULL) {
+            return NULL;
+        }
+        min_len = (uint32_t)code[0].operand;
+        start = 1;
+    }
+
+    bool* targeted = (bool*)calloc(len, sizeof(bool));
+    uint32_t* map = (uint32_t*)calloc(len + 1, sizeof(uint32_t));
+    if (!targeted || !map) {
+        free(targeted);
+        free(map);
+        return NULL;
+    }
+
+    bool ok = true;
+    for (uint32_t i = start; i < len && ok; i++) {
+        OpCode op = code[i].opcode;
+        if (op == OP_CHECK_LEN || op > OP_CHECK_LEN) {
+            ok = false;
+        } else if (is_cmp(op)) {
+            ok = i + 1 < len && is_cond_jump(code[i + 1].opcode);
+        } else if (is_cond_jump(op)) {
+            ok = i > start && is_cmp(code[i - 1].opcode);
+        } else if (is_load(op)) {
+            ok = code[i].offset <= PDEF_PROGRAM_MAX;
+        }
+        if (ok && (is_cond_jump(op) || op == OP_JUMP)) {
+            uint32_t t = code[i].jump_target;
+            ok = t >= start && t < len && !is_cond_jump(code[t].opcode);
+            if (ok) {
+                targeted[t] = true;
+            }
+        }
+    }
+
+    uint32_t op_count = 0;
+    uint32_t pool_count = 0;
+    for (uint32_t i = start; ok && i < len; ) {
+        uint32_t words = 0;
+        map[i] = op_count++;
+        if (fusable(code, len, i, targeted)) {
+            pool_count++;
+            i += 3;
+        } else if (is_cmp(code[i].opcode)) {
+            branch_op(code[i].opcode, false, &words);
+            pool_count += words;
+            map[i + 1] = map[i];
+            i += 2;
+        } else {
+            i++;
+        }
+    }
+    map[len] = op_count++;
+
+    if (!ok || op_count > PDEF_PROGRAM_MAX || pool_count > PDEF_PROGRAM_MAX) {
+        free(targeted);
+        free(map);
+        return NULL;
+    }
+
+    size_t ops_bytes = (op_count * sizeof(PdefOp) + 7) & ~(size_t)7;
+    PdefProgram* prog = (PdefProgram*)calloc(1, sizeof(PdefProgram) + ops_bytes + pool_count * sizeof(uint64_t));
+    if (!prog) {
+        free(targeted);
+        free(map);
+        return NULL;
+    }
+    PdefOp* ops = (PdefOp*)(prog + 1);
+    uint64_t* pool = (uint64_t*)((uint8_t*)ops + ops_bytes);
+    prog->ops = ops;
+    prog->pool = pool;
+    prog->op_count = op_count;
+    prog->pool_count = pool_count;
+    prog->min_len = min_len;
+
+    uint32_t n = 0;
+    uint32_t k = 0;
+    for (uint32_t i = start; i < len; ) {
+        PdefOp* o = &ops[n++];
+        const Instruction* ins = &code[i];
+        uint32_t words = 0;
+        if (fusable(code, len, i, targeted)) {
+            bool when = (code[i + 2].opcode == OP_JUMP_IF_TRUE) == (code[i + 1].opcode == OP_CMP_EQ);
+            o->op = (uint8_t)(fused_base(ins->opcode) + (when ? 1 : 0));
+            o->offset = (uint16_t)ins->offset;
+            o->k = (uint16_t)k;
+            o->target = (uint16_t)map[code[i + 2].jump_target];
+            pool[k++] = code[i + 1].operand;
+            prog->fused++;
+            i += 3;
+        } else if (is_cmp(ins->opcode)) {
+            o->op = (uint8_t)branch_op(ins->opcode, code[i + 1].opcode == OP_JUMP_IF_TRUE, &words);
+            o->k = (uint16_t)k;
+            o->target = (uint16_t)map[code[i + 1].jump_target];
+            branch_pool(ins, pool + k);
+            k += words;
+            i += 2;
+        } else if (is_load(ins->opcode)) {
+            o->op = (uint8_t)(PP_LD_U8 + (ins->opcode - OP_LOAD_U8));
+            o->offset = (uint16_t)ins->offset;
+            i++;
+        } else if (ins->opcode == OP_JUMP) {
+            o->op = PP_JUMP;
+            o->target = (uint16_t)map[ins->jump_target];
+            i++;
+        } else {
+            o->op = ins->opcode == OP_RETURN_TRUE ? PP_RET_TRUE : PP_RET_FALSE;
+            i++;
+        }
+    }
+    ops[n].op = PP_RET_FALSE;
+
+    free(targeted);
+    free(map);
+    return prog;
+}
+
+void pdef_program_free(PdefProgram* prog) {
+    free(prog);
+}
+
+
+
+static inline bool table_contains(const uint64_t* table, uint64_t count, uint64_t key) {
+    while (count > 1) {
+        uint64_t half = count >> 1;
+        table = table[half] <= key ? table + half : table;
+        count -= half;
+    }
+    return *table == key;
+}
+
+#ifdef PDEF_THREADED
+#define PDEF_OP_LABEL(name) &&L_##name,
+#define OP(name)            L_##name:
+#define DISPATCH()          goto *labels[pc->op]
+#else
+#define OP(name)            case PP_##name:
+#define DISPATCH()          goto dispatch
+#endif
+
+#define NEXT()              do { ++pc; DISPATCH(); } while (0)
+#define BRANCH(cond, when)  do { if ((cond) == (when)) { pc = ops + pc->target; DISPATCH(); } NEXT(); } while (0)
+#define LOAD(width, expr) \
+    do { \
+        if (unlikely((uint32_t)pc->offset + (width) > limit)) { \
+            return false; \
+        } \
+        acc = (expr); \
+    } while (0)
+
+static bool program_exec(const PdefProgram* prog, const uint8_t* packet, uint32_t limit,
+                         const PdefOp* pc, uint64_t acc) {
+#ifdef PDEF_THREADED
+    static const void* const labels[] = {
+        PDEF_PROGRAM_OPS(PDEF_OP_LABEL)
+    };
+#endif
+    const PdefOp* const ops = prog->ops;
+    const uint64_t* const pool = prog->pool;
+
+#ifdef PDEF_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (pc->op) {
+#endif
+
+    OP(LD_U8)      LOAD(1, packet[pc->offset]); NEXT();
+    OP(LD_U16_BE)  LOAD(2, read_u16_be(packet, pc->offset)); NEXT();
+    OP(LD_U16_LE)  LOAD(2, read_u16_le(packet, pc->offset)); NEXT();
+    OP(LD_U32_BE)  LOAD(4, read_u32_be(packet, pc->offset)); NEXT();
+    OP(LD_U32_LE)  LOAD(4, read_u32_le(packet, pc->offset)); NEXT();
+    OP(LD_U64_BE)  LOAD(8, read_u64_be(packet, pc->offset)); NEXT();
+    OP(LD_U64_LE)  LOAD(8, read_u64_le(packet, pc->offset)); NEXT();
+    OP(LD_I8)      LOAD(1, (uint64_t)(int64_t)read_i8(packet, pc->offset)); NEXT();
+    OP(LD_I16_BE)  LOAD(2, (uint64_t)(int64_t)read_i16_be(packet, pc->offset)); NEXT();
+    OP(LD_I16_LE)  LOAD(2, (uint64_t)(int64_t)read_i16_le(packet, pc->offset)); NEXT();
+    OP(LD_I32_BE)  LOAD(4, (uint64_t)(int64_t)read_i32_be(packet, pc->offset)); NEXT();
+    OP(LD_I32_LE)  LOAD(4, (uint64_t)(int64_t)read_i32_le(packet, pc->offset)); NEXT();
+    OP(LD_I64_BE)  LOAD(8, (uint64_t)read_i64_be(packet, pc->offset)); NEXT();
+    OP(LD_I64_LE)  LOAD(8, (uint64_t)read_i64_le(packet, pc->offset)); NEXT();
+
+    OP(EQ_JF)      BRANCH(acc == pool[pc->k], false);
+    OP(EQ_JT)      BRANCH(acc == pool[pc->k], true);
+    OP(GT_JF)      BRANCH(acc > pool[pc->k], false);
+    OP(GT_JT)      BRANCH(acc > pool[pc->k], true);
+    OP(GE_JF)      BRANCH(acc >= pool[pc->k], false);
+    OP(GE_JT)      BRANCH(acc >= pool[pc->k], true);
+    OP(MASK_JF)    BRANCH((acc & pool[pc->k]) == pool[pc->k + 1], false);
+    OP(MASK_JT)    BRANCH((acc & pool[pc->k]) == pool[pc->k + 1], true);
+    OP(RANGE_JF)   BRANCH(acc - pool[pc->k] <= pool[pc->k + 1] - pool[pc->k], false);
+    OP(RANGE_JT)   BRANCH(acc - pool[pc->k] <= pool[pc->k + 1] - pool[pc->k], true);
+    OP(BITMAP_JF) {
+        const uint64_t* bm = (const uint64_t*)(uintptr_t)pool[pc->k];
+        BRANCH(acc < 256 && ((bm[acc >> 6] >> (acc & 63)) & 1), false);
+    }
+    OP(BITMAP_JT) {
+        const uint64_t* bm = (const uint64_t*)(uintptr_t)pool[pc->k];
+        BRANCH(acc < 256 && ((bm[acc >> 6] >> (acc & 63)) & 1), true);
+    }
+    OP(TABLE_JF)   BRANCH(table_contains((const uint64_t*)(uintptr_t)pool[pc->k], pool[pc->k + 1], acc), false);
+    OP(TABLE_JT)   BRANCH(table_contains((const uint64_t*)(uintptr_t)pool[pc->k], pool[pc->k + 1], acc), true);
+
+    OP(LD_U8_EQ_JF)     LOAD(1, packet[pc->offset]); BRANCH(acc == pool[pc->k], false);
+    OP(LD_U8_EQ_JT)     LOAD(1, packet[pc->offset]); BRANCH(acc == pool[pc->k], true);
+    OP(LD_U16_BE_EQ_JF) LOAD(2, read_u16_be(packet, pc->offset)); BRANCH(acc == pool[pc->k], false);
+    OP(LD_U16_BE_EQ_JT) LOAD(2, read_u16_be(packet, pc->offset)); BRANCH(acc == pool[pc->k], true);
+    OP(LD_U16_LE_EQ_JF) LOAD(2, read_u16_le(packet, pc->offset)); BRANCH(acc == pool[pc->k], false);
+    OP(LD_U16_LE_EQ_JT) LOAD(2, read_u16_le(packet, pc->offset)); BRANCH(acc == pool[pc->k], true);
+    OP(LD_U32_BE_EQ_JF) LOAD(4, read_u32_be(packet, pc->offset)); BRANCH(acc == pool[pc->k], false);
+    OP(LD_U32_BE_EQ_JT) LOAD(4, read_u32_be(packet, pc->offset)); BRANCH(acc == pool[pc->k], true);
+    OP(LD_U32_LE_EQ_JF) LOAD(4, read_u32_le(packet, pc->offset)); BRANCH(acc == pool[pc->k], false);
+    OP(LD_U32_LE_EQ_JT) LOAD(4, read_u32_le(packet, pc->offset)); BRANCH(acc == pool[pc->k], true);
+
+    OP(JUMP)       pc = ops + pc->target; DISPATCH();
+    OP(RET_TRUE)   return true;
+    OP(RET_FALSE)  return false;
+
+#ifndef PDEF_THREADED
+    default:
+        return false;
+    }
+#endif
+}
+
+#undef BRANCH
+#undef LOAD
+
+bool pdef_program_run(const PdefProgram* prog, const uint8_t* packet, uint32_t packet_len) {
+    if (unlikely(!prog || !packet || packet_len < prog->min_len)) {
+        return false;
+    }
+    return program_exec(prog, packet, prog->min_len ? 0xFFFFFFFFu : packet_len, prog->ops, 0);
+}
+
+
+
+#define COND_EQ(a)      ((a) == pool[pc->k])
+#define COND_GT(a)      ((a) > pool[pc->k])
+#define COND_GE(a)      ((a) >= pool[pc->k])
+#define COND_MASK(a)    (((a) & pool[pc->k]) == pool[pc->k + 1])
+#define COND_RANGE(a)   ((a) - pool[pc->k] <= pool[pc->k + 1] - pool[pc->k])
+#define COND_BITMAP(a)  bitmap_contains((const uint64_t*)(uintptr_t)pool[pc->k], (a))
+#define COND_TABLE(a)   table_contains((const uint64_t*)(uintptr_t)pool[pc->k], pool[pc->k + 1], (a))
+
+#define LOAD2(width, be_expr, le_expr) \
+    do { \
+        if (unlikely((uint32_t)pc->offset + (width) > limit)) { \
+            return 0; \
+        } \
+        acc_be = (be_expr); \
+        acc_le = (le_expr); \
+    } while (0)
+
+
+#define BRANCH2(cond, when) \
+    do { \
+        const PdefOp* next_be = cond(acc_be) == (when) ? ops + pc->target : pc + 1; \
+        const PdefOp* next_le = cond(acc_le) == (when) ? ops + pc->target : pc + 1; \
+        if (likely(next_be == next_le)) { \
+            pc = next_be; \
+            DISPATCH(); \
+        } \
+        return split_lanes(prog, packet, limit, next_be, acc_be, next_le, acc_le); \
+    } while (0)
+
+static inline bool bitmap_contains(const uint64_t* bm, uint64_t v) {
+    return v < 256 && ((bm[v >> 6] >> (v & 63)) & 1);
+}
+
+static uint32_t split_lanes(const PdefProgram* prog, const uint8_t* packet, uint32_t limit,
+                            const PdefOp* pc_be, uint64_t acc_be, const PdefOp* pc_le, uint64_t acc_le) {
+    const PdefProgram* le = prog->twin;
+    uint32_t verdict = program_exec(prog, packet, limit, pc_be, acc_be) ? PDEF_VERDICT_BIG : 0;
+    if (program_exec(le, packet, limit, le->ops + (pc_le - prog->ops), acc_le)) {
+        verdict |= PDEF_VERDICT_LITTLE;
+    }
+    return verdict;
+}
+
+uint32_t pdef_program_run_dual(const PdefProgram* prog, const uint8_t* packet, uint32_t packet_len) {
+    if (unlikely(!prog || !packet || packet_len < prog->min_len)) {
+        return 0;
+    }
+    const uint32_t limit = prog->min_len ? 0xFFFFFFFFu : packet_len;
+    if (!prog->twin) {
+        return program_exec(prog, packet, limit, prog->ops, 0) ? PDEF_VERDICT_BIG : 0;
+    }
+
+#ifdef PDEF_THREADED
+    static const void* const labels[] = {
+        PDEF_PROGRAM_OPS(PDEF_OP_LABEL)
+    };
+#endif
+    const PdefOp* const ops = prog->ops;
+    const uint64_t* const pool = prog->pool;
+    const PdefOp* pc = ops;
+    uint64_t acc_be = 0;
+    uint64_t acc_le = 0;
+
+#ifdef PDEF_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (pc->op) {
+#endif
+
+    OP(LD_U8)      LOAD2(1, packet[pc->offset], acc_be); NEXT();
+    OP(LD_U16_BE)  LOAD2(2, read_u16_be(packet, pc->offset), read_u16_le(packet, pc->offset)); NEXT();
+    OP(LD_U16_LE)  LOAD2(2, read_u16_le(packet, pc->offset), read_u16_be(packet, pc->offset)); NEXT();
+    OP(LD_U32_BE)  LOAD2(4, read_u32_be(packet, pc->offset), read_u32_le(packet, pc->offset)); NEXT();
+    OP(LD_U32_LE)  LOAD2(4, read_u32_le(packet, pc->offset), read_u32_be(packet, pc->offset)); NEXT();
+    OP(LD_U64_BE)  LOAD2(8, read_u64_be(packet, pc->offset), read_u64_le(packet, pc->offset)); NEXT();
+    OP(LD_U64_LE)  LOAD2(8, read_u64_le(packet, pc->offset), read_u64_be(packet, pc->offset)); NEXT();
+    OP(LD_I8)      LOAD2(1, (uint64_t)(int64_t)read_i8(packet, pc->offset), acc_be); NEXT();
+    OP(LD_I16_BE)  LOAD2(2, (uint64_t)(int64_t)read_i16_be(packet, pc->offset),
+                         (uint64_t)(int64_t)read_i16_le(packet, pc->offset)); NEXT();
+    OP(LD_I16_LE)  LOAD2(2, (uint64_t)(int64_t)read_i16_le(packet, pc->offset),
+                         (uint64_t)(int64_t)read_i16_be(packet, pc->offset)); NEXT();
+    OP(LD_I32_BE)  LOAD2(4, (uint64_t)(int64_t)read_i32_be(packet, pc->offset),
+                         (uint64_t)(int64_t)read_i32_le(packet, pc->offset)); NEXT();
+    OP(LD_I32_LE)  LOAD2(4, (uint64_t)(int64_t)read_i32_le(packet, pc->offset),
+                         (uint64_t)(int64_t)read_i32_be(packet, pc->offset)); NEXT();
+    OP(LD_I64_BE)  LOAD2(8, (uint64_t)read_i64_be(packet, pc->offset), (uint64_t)read_i64_le(packet, pc->offset)); NEXT();
+    OP(LD_I64_LE)  LOAD2(8, (uint64_t)read_i64_le(packet, pc->offset), (uint64_t)read_i64_be(packet, pc->offset)); NEXT();
+
+    OP(EQ_JF)      BRANCH2(COND_EQ, false);
+    OP(EQ_JT)      BRANCH2(COND_EQ, true);
+    OP(GT_JF)      BRANCH2(COND_GT, false);
+    OP(GT_JT)      BRANCH2(COND_GT, true);
+    OP(GE_JF)      BRANCH2(COND_GE, false);
+    OP(GE_JT)      BRANCH2(COND_GE, true);
+    OP(MASK_JF)    BRANCH2(COND_MASK, false);
+    OP(MASK_JT)    BRANCH2(COND_MASK, true);
+    OP(RANGE_JF)   BRANCH2(COND_RANGE, false);
+    OP(RANGE_JT)   BRANCH2(COND_RANGE, true);
+    OP(BITMAP_JF)  BRANCH2(COND_BITMAP, false);
+    OP(BITMAP_JT)  BRANCH2(COND_BITMAP, true);
+    OP(TABLE_JF)   BRANCH2(COND_TABLE, false);
+    OP(TABLE_JT)   BRANCH2(COND_TABLE, true);
+
+    OP(LD_U8_EQ_JF)     LOAD2(1, packet[pc->offset], acc_be); BRANCH2(COND_EQ, false);
+    OP(LD_U8_EQ_JT)     LOAD2(1, packet[pc->offset], acc_be); BRANCH2(COND_EQ, true);
+    OP(LD_U16_BE_EQ_JF) LOAD2(2, read_u16_be(packet, pc->offset), read_u16_le(packet, pc->offset)); BRANCH2(COND_EQ, false);
+    OP(LD_U16_BE_EQ_JT) LOAD2(2, read_u16_be(packet, pc->offset), read_u16_le(packet, pc->offset)); BRANCH2(COND_EQ, true);
+    OP(LD_U16_LE_EQ_JF) LOAD2(2, read_u16_le(packet, pc->offset), read_u16_be(packet, pc->offset)); BRANCH2(COND_EQ, false);
+    OP(LD_U16_LE_EQ_JT) LOAD2(2, read_u16_le(packet, pc->offset), read_u16_be(packet, pc->offset)); BRANCH2(COND_EQ, true);
+    OP(LD_U32_BE_EQ_JF) LOAD2(4, read_u32_be(packet, pc->offset), read_u32_le(packet, pc->offset)); BRANCH2(COND_EQ, false);
+    OP(LD_U32_BE_EQ_JT) LOAD2(4, read_u32_be(packet, pc->offset), read_u32_le(packet, pc->offset)); BRANCH2(COND_EQ, true);
+    OP(LD_U32_LE_EQ_JF) LOAD2(4, read_u32_le(packet, pc->offset), read_u32_be(packet, pc->offset)); BRANCH2(COND_EQ, false);
+    OP(LD_U32_LE_EQ_JT) LOAD2(4, read_u32_le(packet, pc->offset), read_u32_be(packet, pc->offset)); BRANCH2(COND_EQ, true);
+
+    OP(JUMP)       pc = ops + pc->target; DISPATCH();
+    OP(RET_TRUE)   return PDEF_VERDICT_BIG | PDEF_VERDICT_LITTLE;
+    OP(RET_FALSE)  return 0;
+
+#ifndef PDEF_THREADED
+    default:
+        return 0;
+    }
+#endif
+}
+
+#undef COND_EQ
+#undef COND_GT
+#undef COND_GE
+#undef COND_MASK
+#undef COND_RANGE
+#undef COND_BITMAP
+#undef COND_TABLE
+#undef LOAD2
+#undef BRANCH2
+#undef OP
+#undef DISPATCH
+#undef NEXT
+
+
+
+static int swap_op(int op) {
+    switch (op) {
+        case PP_LD_U16_BE:       return PP_LD_U16_LE;
+        case PP_LD_U16_LE:       return PP_LD_U16_BE;
+        case PP_LD_U32_BE:       return PP_LD_U32_LE;
+        case PP_LD_U32_LE:       return PP_LD_U32_BE;
+        case PP_LD_U64_BE:       return PP_LD_U64_LE;
+        case PP_LD_U64_LE:       return PP_LD_U64_BE;
+        case PP_LD_I16_BE:       return PP_LD_I16_LE;
+        case PP_LD_I16_LE:       return PP_LD_I16_BE;
+        case PP_LD_I32_BE:       return PP_LD_I32_LE;
+        case PP_LD_I32_LE:       return PP_LD_I32_BE;
+        case PP_LD_I64_BE:       return PP_LD_I64_LE;
+        case PP_LD_I64_LE:       return PP_LD_I64_BE;
+        case PP_LD_U16_BE_EQ_JF: return PP_LD_U16_LE_EQ_JF;
+        case PP_LD_U16_BE_EQ_JT: return PP_LD_U16_LE_EQ_JT;
+        case PP_LD_U16_LE_EQ_JF: return PP_LD_U16_BE_EQ_JF;
+        case PP_LD_U16_LE_EQ_JT: return PP_LD_U16_BE_EQ_JT;
+        case PP_LD_U32_BE_EQ_JF: return PP_LD_U32_LE_EQ_JF;
+        case PP_LD_U32_BE_EQ_JT: return PP_LD_U32_LE_EQ_JT;
+        case PP_LD_U32_LE_EQ_JF: return PP_LD_U32_BE_EQ_JF;
+        case PP_LD_U32_LE_EQ_JT: return PP_LD_U32_BE_EQ_JT;
+        default:                 return op;
+    }
+}
+
+/* The dual runner walks be's ops for both lanes, so le must differ only in load byte order. */
+static bool programs_are_twins(const PdefProgram* be, const PdefProgram* le) {
+    if (be->op_count != le->op_count || be->pool_count != le->pool_count || be->min_len != le->min_len) {
+        return false;
+    }
+    if (be->pool_count && memcmp(be->pool, le->pool, be->pool_count * sizeof(uint64_t)) != 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < be->op_count; i++) {
+        const PdefOp* a = &be->ops[i];
+        const PdefOp* b = &le->ops[i];
+        if (b->op != swap_op(a->op) || a->target != b->target || a->offset != b->offset || a->k != b->k) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void filter_rule_free_programs(FilterRule* rule) {
+    if (!rule) {
+        return;
+    }
+    pdef_program_free(rule->program_be);
+    pdef_program_free(rule->program_le);
+    rule->program_be = NULL;
+    rule->program_le = NULL;
+}
+
+void filter_rule_build_programs(FilterRule* rule) {
+    if (!rule) {
+        return;
+    }
+    filter_rule_free_programs(rule);
+    const Instruction* code_be = rule->bytecode_be ? rule->bytecode_be : rule->bytecode;
+    uint32_t len_be = rule->bytecode_be_len ? rule->bytecode_be_len : rule->bytecode_len;
+    rule->program_be = pdef_program_build(code_be, len_be);
+    if (rule->bytecode_le) {
+        rule->program_le = pdef_program_build(rule->bytecode_le, rule->bytecode_le_len);
+    }
+    if (rule->program_be && rule->program_le && programs_are_twins(rule->program_be, rule->program_le)) {
+        rule->program_be->twin = rule->program_le;
+    }
+}
+
+void pdef_program_disassemble(const PdefProgram* prog) {
+    if (!prog) {
+        printf("Compact program: none (interpreted)\n");
+        return;
+    }
+    printf("Compact program (%u ops, %u pool words, %zu bytes, %u fused, min_len=%u):\n",
+           prog->op_count, prog->pool_count,
+           prog->op_count * sizeof(PdefOp) + prog->pool_count * sizeof(uint64_t),
+           prog->fused, prog->min_len);
+    for (uint32_t i = 0; i < prog->op_count; i++) {
+        const PdefOp* o = &prog->ops[i];
+        printf("  %4u: %-16s", i, o->op < PP_COUNT ? kProgramOpNames[o->op] : "UNKNOWN");
+        if (o->op <= PP_LD_I64_LE || (o->op >= PP_LD_U8_EQ_JF && o->op <= PP_LD_U32_LE_EQ_JT)) {
+            printf("offset=%u ", o->offset);
+        }
+        if (o->op >= PP_BITMAP_JF && o->op <= PP_TABLE_JT) {
+            printf("set k[%u] target=%u", o->k, o->target);
+        } else if (o->op >= PP_EQ_JF && o->op <= PP_LD_U32_LE_EQ_JT) {
+            printf("k[%u]=0x%llx target=%u", o->k, (unsigned long long)prog->pool[o->k], o->target);
+        } else if (o->op == PP_JUMP) {
+            printf("target=%u", o->target);
+        }
+        printf("\n");
+    }
+}
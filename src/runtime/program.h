@@ -0,0 +1,60 @@
+#ifndef PDEF_PROGRAM_H
+#define PDEF_PROGRAM_H
+
+#include "../pdef/pdef_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+typedef struct {
+    uint8_t     op;
+    uint8_t     reserved;
+    uint16_t    target;
+    uint16_t    offset;
+    uint16_t    k;
+} PdefOp;
+
+typedef struct PdefProgram {
+    const PdefOp*   ops;
+    const uint64_t* pool;
+    uint32_t        op_count;
+    uint32_t        pool_count;
+    uint32_t        min_len;
+    uint32_t        fused;
+    const struct PdefProgram* twin;
+} PdefProgram;
+
+#define PDEF_VERDICT_BIG    0x1u
+#define PDEF_VERDICT_LITTLE 0x2u
+
+
+
+
+
+
+PdefProgram* pdef_program_build(const Instruction* code, uint32_t len);
+
+void pdef_program_free(PdefProgram* prog);
+
+
+bool pdef_program_run(const PdefProgram* prog, const uint8_t* packet, uint32_t packet_len);
+
+/* Runs prog and its byte-swapped twin over one pass of the packet and returns a
+ * PDEF_VERDICT_* mask. Without a twin only the PDEF_VERDICT_BIG bit is meaningful. */
+uint32_t pdef_program_run_dual(const PdefProgram* prog, const uint8_t* packet, uint32_t packet_len);
+
+
+void filter_rule_build_programs(FilterRule* rule);
+
+void filter_rule_free_programs(FilterRule* rule);
+
+void pdef_program_disassemble(const PdefProgram* prog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,16 +1,74 @@
 #include "protocol.h"
 #include "executor.h"
+#include "program.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
+static inline bool run_rule_code(const uint8_t* packet, uint32_t packet_len,
+                                 const PdefProgram* prog, const Instruction* code, uint32_t len)
+{
+    if (prog) {
+        return pdef_program_run(prog, packet, packet_len);
+    }
+    return execute_bytecode(packet, packet_len, code, len);
+}
+
+#define PDEF_ENDIAN_MIN_VOTES   8
+#define PDEF_ENDIAN_VOTE_RATIO  4
+#define PDEF_ENDIAN_VOTE_WINDOW 64
+
+
+
+static void vote_endian(volatile int* endian_state, uint32_t verdict, const ProtocolDef* proto)
+{
+    if (!endian_state || verdict == (PDEF_VERDICT_BIG | PDEF_VERDICT_LITTLE)) {
+        return;
+    }
+    bool big = verdict == PDEF_VERDICT_BIG;
+
+    for (;;) {
+        int old_state = *endian_state;
+        if (ENDIAN_STATE_TYPE(old_state) != ENDIAN_TYPE_UNKNOWN) {
+            return;
+        }
+        uint32_t votes_big = ENDIAN_STATE_VOTES_BIG(old_state) + (big ? 1 : 0);
+        uint32_t votes_little = ENDIAN_STATE_VOTES_LITTLE(old_state) + (big ? 0 : 1);
+        uint32_t lead = big ? votes_big : votes_little;
+        uint32_t trail = big ? votes_little : votes_big;
+
+        int new_state;
+        if (lead >= PDEF_ENDIAN_MIN_VOTES && lead >= trail * PDEF_ENDIAN_VOTE_RATIO) {
+            new_state = big ? ENDIAN_TYPE_BIG : ENDIAN_TYPE_LITTLE;
+        } else {
+
+            if (votes_big + votes_little >= PDEF_ENDIAN_VOTE_WINDOW) {
+                votes_big >>= 1;
+                votes_little >>= 1;
+            }
+            new_state = (int)((votes_big << 8) | (votes_little << 16));
+        }
+
+        if (__sync_val_compare_and_swap(endian_state, old_state, new_state) == old_state) {
+            if (ENDIAN_STATE_TYPE(new_state) != ENDIAN_TYPE_UNKNOWN) {
+                fprintf(stderr, "[PDEF] Auto-detected endian: %s-endian for %s (votes big=%u little=%u)\n",
+                        big ? "big" : "little", proto->name,
+                        ENDIAN_STATE_VOTES_BIG(old_state) + (big ? 1 : 0),
+                        ENDIAN_STATE_VOTES_LITTLE(old_state) + (big ? 0 : 1));
+            }
+            return;
+        }
+    }
+}
+
 static bool try_match_with_endian(
     const uint8_t* packet, uint32_t packet_len,
     const FilterRule* rule,
-    ProtocolDef* mutable_proto)
+    const ProtocolDef* proto,
+    volatile int* endian_state)
 {
-    if (!packet || !rule || !mutable_proto) {
+    if (!packet || !rule || !proto) {
         return false;
     }
 
@@ -18,85 +76,70 @@ static bool try_match_with_endian(
     uint32_t len_be = rule->bytecode_be_len ? rule->bytecode_be_len : rule->bytecode_len;
     const Instruction* code_le = rule->bytecode_le ? rule->bytecode_le : rule->bytecode;
     uint32_t len_le = rule->bytecode_le_len ? rule->bytecode_le_len : rule->bytecode_len;
+    const PdefProgram* prog_be = rule->program_be;
+    const PdefProgram* prog_le = rule->bytecode_le ? rule->program_le : rule->program_be;
 
-    switch (mutable_proto->endian_mode) {
+    switch (proto->endian_mode) {
         case ENDIAN_MODE_BIG:
 
-            return execute_bytecode(packet, packet_len, code_be, len_be);
+            return run_rule_code(packet, packet_len, prog_be, code_be, len_be);
 
         case ENDIAN_MODE_LITTLE:
 
-            return execute_bytecode(packet, packet_len, code_le, len_le);
+            return run_rule_code(packet, packet_len, prog_le, code_le, len_le);
 
         case ENDIAN_MODE_AUTO:
         default: {
 
-
-            __sync_synchronize();
-            int detected = mutable_proto->detected_endian;
+            int detected = ENDIAN_TYPE_UNKNOWN;
+            if (endian_state) {
+                __sync_synchronize();
+                detected = ENDIAN_STATE_TYPE(*endian_state);
+            }
 
             if (detected == ENDIAN_TYPE_BIG) {
 
-                return execute_bytecode(packet, packet_len, code_be, len_be);
+                return run_rule_code(packet, packet_len, prog_be, code_be, len_be);
             }
 
             if (detected == ENDIAN_TYPE_LITTLE) {
 
-                return execute_bytecode(packet, packet_len, code_le, len_le);
+                return run_rule_code(packet, packet_len, prog_le, code_le, len_le);
             }
 
 
 
-
-            if (execute_bytecode(packet, packet_len, code_be, len_be)) {
-
-
-                int old_val = __sync_val_compare_and_swap(&mutable_proto->detected_endian,
-                                                           ENDIAN_TYPE_UNKNOWN,
-                                                           ENDIAN_TYPE_BIG);
-                if (old_val == ENDIAN_TYPE_UNKNOWN) {
-
-                    fprintf(stderr, "[PDEF] Auto-detected endian: big-endian for %s\n",
-                            mutable_proto->name);
+            uint32_t verdict;
+            if (prog_be && prog_be->twin) {
+                verdict = pdef_program_run_dual(prog_be, packet, packet_len);
+            } else {
+                verdict = run_rule_code(packet, packet_len, prog_be, code_be, len_be) ? PDEF_VERDICT_BIG : 0;
+                if (run_rule_code(packet, packet_len, prog_le, code_le, len_le)) {
+                    verdict |= PDEF_VERDICT_LITTLE;
                 }
-                return true;
             }
 
-
-            if (execute_bytecode(packet, packet_len, code_le, len_le)) {
-
-                int old_val = __sync_val_compare_and_swap(&mutable_proto->detected_endian,
-                                                           ENDIAN_TYPE_UNKNOWN,
-                                                           ENDIAN_TYPE_LITTLE);
-                if (old_val == ENDIAN_TYPE_UNKNOWN) {
-
-                    fprintf(stderr, "[PDEF] Auto-detected endian: little-endian for %s\n",
-                            mutable_proto->name);
-                }
-                return true;
+            if (verdict == 0) {
+                return false;
             }
-
-
-            return false;
+            vote_endian(endian_state, verdict, proto);
+            return true;
         }
     }
 }
 
-bool packet_filter_match(const uint8_t* packet, uint32_t packet_len,
-                         uint16_t port, const ProtocolDef* proto) {
+bool packet_filter_match_state(const uint8_t* packet, uint32_t packet_len,
+                               const ProtocolDef* proto, volatile int* endian_state) {
+    return packet_filter_match_at(packet, packet_len, proto, endian_state, NULL);
+}
+
+bool packet_filter_match_at(const uint8_t* packet, uint32_t packet_len,
+                            const ProtocolDef* proto, volatile int* endian_state,
+                            uint32_t* match_offset) {
     if (!packet || !proto) {
         return false;
     }
 
-
-
-
-    (void)port;
-
-
-    ProtocolDef* mutable_proto = (ProtocolDef*)proto;
-
-
     for (uint32_t i = 0; i < proto->filter_count; i++) {
         const FilterRule* rule = &proto->filters[i];
 
@@ -114,13 +157,19 @@ bool packet_filter_match(const uint8_t* packet, uint32_t packet_len,
                     break;
                 }
 
-                if (try_match_with_endian(packet + offset, remaining, rule, mutable_proto)) {
+                if (try_match_with_endian(packet + offset, remaining, rule, proto, endian_state)) {
+                    if (match_offset) {
+                        *match_offset = offset;
+                    }
                     return true;
                 }
             }
         } else {
 
-            if (try_match_with_endian(packet, packet_len, rule, mutable_proto)) {
+            if (try_match_with_endian(packet, packet_len, rule, proto, endian_state)) {
+                if (match_offset) {
+                    *match_offset = 0;
+                }
                 return true;
             }
         }
@@ -129,6 +178,24 @@ bool packet_filter_match(const uint8_t* packet, uint32_t packet_len,
     return false;
 }
 
+bool packet_filter_match(const uint8_t* packet, uint32_t packet_len,
+                         uint16_t port, const ProtocolDef* proto) {
+    if (!packet || !proto) {
+        return false;
+    }
+
+
+
+
+    (void)port;
+
+
+    ProtocolDef* mutable_proto = (ProtocolDef*)proto;
+
+    return packet_filter_match_state(packet, packet_len, proto,
+                                     &mutable_proto->detected_endian);
+}
+
 void protocol_free(ProtocolDef* proto) {
     if (!proto) {
         return;
@@ -158,6 +225,10 @@ void protocol_free(ProtocolDef* proto) {
             if (proto->filters[i].bytecode_le) {
                 free(proto->filters[i].bytecode_le);
             }
+            if (proto->filters[i].set_tables) {
+                free(proto->filters[i].set_tables);
+            }
+            filter_rule_free_programs(&proto->filters[i]);
         }
         free(proto->filters);
     }
@@ -305,15 +376,47 @@ void filter_rule_disassemble(const FilterRule* rule) {
                 printf("mask=0x%lx, expected=0x%lx", ins->operand, ins->operand2);
                 break;
 
+            case OP_CMP_RANGE:
+                printf("range=[0x%lx, 0x%lx]", ins->operand, ins->operand2);
+                break;
+
+            case OP_CMP_IN_BITMAP: {
+                const uint64_t* bm = instruction_set_table(ins);
+                printf("bitmap members=%d", __builtin_popcountll(bm[0]) + __builtin_popcountll(bm[1]) +
+                                            __builtin_popcountll(bm[2]) + __builtin_popcountll(bm[3]));
+                break;
+            }
+
+            case OP_CMP_IN_TABLE: {
+                const uint64_t* table = instruction_set_table(ins);
+                printf("table members=%lu [0x%lx .. 0x%lx]", ins->operand2, table[0], table[ins->operand2 - 1]);
+                break;
+            }
+
             case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
             case OP_JUMP:
                 printf("target=%u", ins->jump_target);
                 break;
 
+            case OP_CHECK_LEN:
+                printf("min_len=%lu", ins->operand);
+                break;
+
             default:
                 break;
         }
 
         printf("\n");
     }
+
+    const PdefProgram* prog = rule->program_be;
+    if (prog) {
+        printf("Compact: %u ops, %u pool words, %zu bytes (bytecode %zu bytes), %u fused\n",
+               prog->op_count, prog->pool_count,
+               prog->op_count * sizeof(PdefOp) + prog->pool_count * sizeof(uint64_t),
+               rule->bytecode_len * sizeof(Instruction), prog->fused);
+    } else {
+        printf("Compact: none (interpreted)\n");
+    }
 }
@@ -34,6 +34,16 @@ bool packet_filter_match(const uint8_t* packet, uint32_t packet_len,
 
 
 
+bool packet_filter_match_state(const uint8_t* packet, uint32_t packet_len,
+                               const ProtocolDef* proto, volatile int* endian_state);
+
+bool packet_filter_match_at(const uint8_t* packet, uint32_t packet_len,
+                            const ProtocolDef* proto, volatile int* endian_state,
+                            uint32_t* match_offset);
+
+
+
+
 
 
 void protocol_free(ProtocolDef* proto);
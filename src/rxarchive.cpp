@@ -0,0 +1,1017 @@
+#include "rxarchive.h"
+#include "rxcompresspool.h"
+#include "rxmetrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const uint32_t INDEX_MAGIC = 0x49415852;   // "RXAI"
+const uint32_t FOOTER_MAGIC = 0x46415852;  // "RXAF"
+const uint32_t INDEX_VERSION = 1;
+const size_t INDEX_CHUNK = 65000;
+const size_t FOOTER_PAYLOAD = 20;
+// gzip header (10) + XLEN (2) + subfield header (4) + payload + empty deflate
+// block (2) + CRC32/ISIZE (8).
+const size_t FOOTER_SIZE = 10 + 2 + 4 + FOOTER_PAYLOAD + 2 + 8;
+const size_t PCAP_HEADER_SIZE = 24;
+const size_t PCAP_RECORD_SIZE = 16;
+const uint32_t MAX_RECORD_SIZE = 256 * 1024 * 1024;
+const size_t FRAME_SIZE_ON_DISK = 36;
+const uint64_t THROTTLE_CHUNK = 256 * 1024;
+
+void put_u16(std::string& out, uint16_t v)
+{
+    out += static_cast<char>(v & 0xff);
+    out += static_cast<char>((v >> 8) & 0xff);
+}
+
+void put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+void put_u64(std::string& out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+uint16_t get_u16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const unsigned char* p)
+{
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+uint32_t swap32(uint32_t v)
+{
+    return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+// An empty gzip member carrying one FEXTRA subfield. gunzip accepts and skips
+// it, so the index never shows up in decompressed output.
+std::string extra_member(char si1, char si2, const std::string& payload)
+{
+    std::string m;
+    m += '\x1f';
+    m += '\x8b';
+    m += '\x08';
+    m += '\x04';
+    put_u32(m, 0);
+    m += '\x00';
+    m += '\xff';
+    put_u16(m, static_cast<uint16_t>(payload.size() + 4));
+    m += si1;
+    m += si2;
+    put_u16(m, static_cast<uint16_t>(payload.size()));
+    m += payload;
+    m += '\x03';
+    m += '\x00';
+    put_u32(m, 0);
+    put_u32(m, 0);
+    return m;
+}
+
+// Parses one extra_member() at p; returns its length or 0 if it is not one.
+size_t parse_extra_member(const unsigned char* p, size_t len, char si1, char si2, std::string& payload)
+{
+    if (len < 12 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || p[3] != 4) {
+        return 0;
+    }
+    size_t xlen = get_u16(p + 10);
+    if (xlen < 4 || len < 12 + xlen + 10) {
+        return 0;
+    }
+    const unsigned char* sub = p + 12;
+    size_t sub_len = get_u16(sub + 2);
+    if (sub[0] != static_cast<unsigned char>(si1) || sub[1] != static_cast<unsigned char>(si2) ||
+        sub_len + 4 != xlen) {
+        return 0;
+    }
+    payload.assign(reinterpret_cast<const char*>(sub + 4), sub_len);
+    return 12 + xlen + 10;
+}
+
+bool pread_all(int fd, void* buf, size_t len, uint64_t offset)
+{
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool inflate_frame(int fd, const SRxArchiveFrame& frame, std::string& out, std::string& error)
+{
+    std::string comp(frame.comp_size, '\0');
+    if (frame.comp_size == 0 || !pread_all(fd, &comp[0], comp.size(), frame.comp_offset)) {
+        error = "short read";
+        return false;
+    }
+    out.resize(frame.raw_size);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        error = "inflateInit failed";
+        return false;
+    }
+    zs.next_in = reinterpret_cast<Bytef*>(&comp[0]);
+    zs.avail_in = static_cast<uInt>(comp.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.empty() ? NULL : &out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int rc = inflate(&zs, Z_FINISH);
+    uLong produced = zs.total_out;
+    inflateEnd(&zs);
+    if (rc != Z_STREAM_END || produced != frame.raw_size) {
+        error = "corrupt frame";
+        return false;
+    }
+    return true;
+}
+
+// A frame as seen through a stream: bytes [skip, raw_size) of the frame sit
+// at stream offset start.
+struct StreamPart {
+    SRxArchiveFrame frame;
+    uint64_t start;
+    uint32_t skip;
+};
+
+struct StreamCtx {
+    int fd;
+    std::string header;
+    uint64_t size;
+    std::vector<StreamPart> parts;
+    uint64_t pos;
+    int cached;
+    std::string buf;
+};
+
+uint64_t part_end(const StreamPart& p)
+{
+    return p.start + (p.frame.raw_size - p.skip);
+}
+
+int stream_part_at(const StreamCtx* ctx, uint64_t pos)
+{
+    size_t lo = 0;
+    size_t hi = ctx->parts.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const StreamPart& p = ctx->parts[mid];
+        if (pos < p.start) {
+            hi = mid;
+        } else if (pos >= part_end(p)) {
+            lo = mid + 1;
+        } else {
+            return static_cast<int>(mid);
+        }
+    }
+    return -1;
+}
+
+// Appends a file's frames after the bytes already in the stream. The first
+// header_len bytes of the file are left out; the stream serves its own header.
+void stream_append(StreamCtx* ctx, const SRxArchiveFile& file,
+                   const std::vector<SRxArchiveFrame>& frames, size_t header_len)
+{
+    uint64_t base = ctx->size;
+    for (uint32_t i = 0; i < file.frame_count; ++i) {
+        const SRxArchiveFrame& fr = frames[file.first_frame + i];
+        uint32_t skip = fr.raw_offset < header_len ? static_cast<uint32_t>(header_len - fr.raw_offset) : 0;
+        if (skip >= fr.raw_size) {
+            continue;
+        }
+        StreamPart part;
+        part.frame = fr;
+        part.skip = skip;
+        part.start = base + (fr.raw_offset + skip - header_len);
+        ctx->parts.push_back(part);
+    }
+    if (file.raw_size > header_len) {
+        ctx->size = base + (file.raw_size - header_len);
+    }
+}
+
+ssize_t stream_read(void* cookie, char* buf, size_t size)
+{
+    StreamCtx* ctx = static_cast<StreamCtx*>(cookie);
+    size_t done = 0;
+    while (done < size && ctx->pos < ctx->size) {
+        // The global header is kept in the index, so opening a stream and
+        // seeking past it never inflates the first frame.
+        if (ctx->pos < ctx->header.size()) {
+            size_t n = ctx->header.size() - static_cast<size_t>(ctx->pos);
+            if (n > size - done) {
+                n = size - done;
+            }
+            memcpy(buf + done, ctx->header.data() + ctx->pos, n);
+            done += n;
+            ctx->pos += n;
+            continue;
+        }
+        int idx = stream_part_at(ctx, ctx->pos);
+        if (idx < 0) {
+            break;
+        }
+        const StreamPart& p = ctx->parts[idx];
+        if (idx != ctx->cached) {
+            std::string error;
+            if (!inflate_frame(ctx->fd, p.frame, ctx->buf, error)) {
+                ctx->cached = -1;
+                errno = EIO;
+                return done > 0 ? static_cast<ssize_t>(done) : -1;
+            }
+            ctx->cached = idx;
+        }
+        size_t off = p.skip + static_cast<size_t>(ctx->pos - p.start);
+        size_t n = p.frame.raw_size - off;
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy(buf + done, ctx->buf.data() + off, n);
+        done += n;
+        ctx->pos += n;
+    }
+    return static_cast<ssize_t>(done);
+}
+
+int stream_seek(void* cookie, off64_t* offset, int whence)
+{
+    StreamCtx* ctx = static_cast<StreamCtx*>(cookie);
+    int64_t base = 0;
+    if (whence == SEEK_CUR) {
+        base = static_cast<int64_t>(ctx->pos);
+    } else if (whence == SEEK_END) {
+        base = static_cast<int64_t>(ctx->size);
+    } else if (whence != SEEK_SET) {
+        errno = EINVAL;
+        return -1;
+    }
+    int64_t target = base + *offset;
+    if (target < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    ctx->pos = static_cast<uint64_t>(target);
+    *offset = target;
+    return 0;
+}
+
+int stream_close(void* cookie)
+{
+    StreamCtx* ctx = static_cast<StreamCtx*>(cookie);
+    ::close(ctx->fd);
+    delete ctx;
+    return 0;
+}
+
+// Takes ownership of ctx.
+FILE* open_cookie_stream(const std::string& path, StreamCtx* ctx, std::string& error)
+{
+    ctx->fd = ::open(path.c_str(), O_RDONLY);
+    if (ctx->fd < 0) {
+        error = std::string("cannot open ") + path + ": " + strerror(errno);
+        delete ctx;
+        return NULL;
+    }
+    ctx->pos = 0;
+    ctx->cached = -1;
+
+    cookie_io_functions_t io;
+    io.read = stream_read;
+    io.write = NULL;
+    io.seek = stream_seek;
+    io.close = stream_close;
+    FILE* fp = fopencookie(ctx, "r", io);
+    if (!fp) {
+        error = "fopencookie failed";
+        ::close(ctx->fd);
+        delete ctx;
+    }
+    return fp;
+}
+
+// Global header fields in the byte order given by the magic.
+uint32_t pcap_header_u32(const std::string& hdr, size_t off)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(hdr.data()) + off;
+    if (static_cast<unsigned char>(hdr[0]) == 0xa1) {
+        return (static_cast<uint32_t>(b[0]) << 24) | (static_cast<uint32_t>(b[1]) << 16) |
+               (static_cast<uint32_t>(b[2]) << 8) | b[3];
+    }
+    return (static_cast<uint32_t>(b[3]) << 24) | (static_cast<uint32_t>(b[2]) << 16) |
+           (static_cast<uint32_t>(b[1]) << 8) | b[0];
+}
+
+void pcap_header_set_u32(std::string& hdr, size_t off, uint32_t v)
+{
+    bool big = static_cast<unsigned char>(hdr[0]) == 0xa1;
+    for (int i = 0; i < 4; ++i) {
+        int shift = big ? 24 - 8 * i : 8 * i;
+        hdr[off + i] = static_cast<char>((v >> shift) & 0xff);
+    }
+}
+
+}
+
+CRxArchiveWriter::CRxArchiveWriter()
+    : fp_(NULL)
+    , frame_bytes_(DEFAULT_FRAME_BYTES)
+    , threads_(1)
+    , level_(Z_DEFAULT_COMPRESSION)
+    , offset_(0)
+    , raw_bytes_(0)
+    , file_raw_offset_(0)
+    , throttle_(NULL)
+    , unthrottled_(0)
+{
+}
+
+CRxArchiveWriter::~CRxArchiveWriter()
+{
+    for (size_t i = 0; i < batch_.size(); ++i) {
+        delete batch_[i];
+    }
+    if (fp_) {
+        fclose(fp_);
+        ::unlink(path_.c_str());
+    }
+}
+
+bool CRxArchiveWriter::open(const std::string& path, size_t frame_bytes, int threads, int level, std::string& error)
+{
+    if (fp_) {
+        error = "archive already open";
+        return false;
+    }
+    fp_ = fopen(path.c_str(), "wb");
+    if (!fp_) {
+        error = std::string("cannot create ") + path + ": " + strerror(errno);
+        return false;
+    }
+    path_ = path;
+    // Frame sizes are stored as 32-bit values.
+    frame_bytes_ = frame_bytes < 64 * 1024 ? 64 * 1024 : (frame_bytes > 1024 * 1024 * 1024 ? 1024 * 1024 * 1024 : frame_bytes);
+    threads_ = threads < 1 ? 1 : (threads > MAX_THREADS ? static_cast<int>(MAX_THREADS) : threads);
+    level_ = (level < 1 || level > 9) ? Z_DEFAULT_COMPRESSION : level;
+    offset_ = 0;
+    raw_bytes_ = 0;
+    files_.clear();
+    frames_.clear();
+    return true;
+}
+
+CRxArchiveWriter::Frame* CRxArchiveWriter::current_frame()
+{
+    if (batch_.empty() || batch_.back()->raw.size() >= frame_bytes_) {
+        Frame* frame = new Frame();
+        frame->raw.reserve(frame_bytes_ + 64 * 1024);
+        frame->first_ts = 0;
+        frame->last_ts = 0;
+        frame->packets = 0;
+        frame->ok = false;
+        batch_.push_back(frame);
+    }
+    return batch_.back();
+}
+
+bool CRxArchiveWriter::end_frame(std::string& error)
+{
+    if (static_cast<int>(batch_.size()) >= threads_ && batch_.back()->raw.size() >= frame_bytes_) {
+        return flush_frames(error);
+    }
+    return true;
+}
+
+void CRxArchiveWriter::compress_frame(Frame* frame, int level)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    frame->ok = false;
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return;
+    }
+    frame->comp.resize(deflateBound(&zs, frame->raw.size()) + 64);
+    zs.next_in = reinterpret_cast<Bytef*>(frame->raw.empty() ? NULL : &frame->raw[0]);
+    zs.avail_in = static_cast<uInt>(frame->raw.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&frame->comp[0]);
+    zs.avail_out = static_cast<uInt>(frame->comp.size());
+    int rc = deflate(&zs, Z_FINISH);
+    frame->comp.resize(zs.total_out);
+    deflateEnd(&zs);
+    frame->ok = rc == Z_STREAM_END;
+}
+
+void* CRxArchiveWriter::compress_thread(void* arg)
+{
+    std::pair<Frame*, int>* job = static_cast<std::pair<Frame*, int>*>(arg);
+    compress_frame(job->first, job->second);
+    return NULL;
+}
+
+bool CRxArchiveWriter::flush_frames(std::string& error)
+{
+    if (batch_.empty()) {
+        return true;
+    }
+
+    // Frames are independent, so the batch compresses in parallel; the
+    // calling thread takes the first frame and output order is preserved.
+    std::vector<std::pair<Frame*, int> > jobs(batch_.size());
+    std::vector<pthread_t> tids(batch_.size());
+    std::vector<bool> started(batch_.size(), false);
+    for (size_t i = 1; i < batch_.size(); ++i) {
+        jobs[i] = std::make_pair(batch_[i], level_);
+        started[i] = pthread_create(&tids[i], NULL, compress_thread, &jobs[i]) == 0;
+    }
+    compress_frame(batch_[0], level_);
+    for (size_t i = 1; i < batch_.size(); ++i) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        } else {
+            compress_frame(batch_[i], level_);
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < batch_.size(); ++i) {
+        Frame* frame = batch_[i];
+        if (ok && !frame->raw.empty()) {
+            if (!frame->ok) {
+                error = "deflate failed";
+                ok = false;
+            } else {
+                SRxArchiveFrame entry;
+                entry.comp_offset = offset_;
+                entry.comp_size = static_cast<uint32_t>(frame->comp.size());
+                entry.raw_offset = file_raw_offset_;
+                entry.raw_size = static_cast<uint32_t>(frame->raw.size());
+                entry.first_ts = frame->first_ts;
+                entry.last_ts = frame->last_ts;
+                entry.packets = frame->packets;
+                ok = write_bytes(frame->comp.data(), frame->comp.size(), error);
+                if (ok) {
+                    frames_.push_back(entry);
+                    files_.back().frame_count++;
+                    file_raw_offset_ += frame->raw.size();
+                }
+            }
+        }
+        delete frame;
+    }
+    batch_.clear();
+    return ok;
+}
+
+bool CRxArchiveWriter::write_bytes(const void* data, size_t len, std::string& error)
+{
+    if (len > 0 && fwrite(data, 1, len, fp_) != len) {
+        error = std::string("write failed: ") + strerror(errno);
+        return false;
+    }
+    offset_ += len;
+    return true;
+}
+
+void CRxArchiveWriter::charge_read(size_t bytes)
+{
+    if (!throttle_) {
+        return;
+    }
+    // Charging per record would take the bucket lock for every packet.
+    unthrottled_ += bytes;
+    if (unthrottled_ >= THROTTLE_CHUNK || bytes == 0) {
+        uint64_t slept = throttle_->consume(unthrottled_);
+        unthrottled_ = 0;
+        if (slept >= 1000000ULL) {
+            CRxMetrics::inc(RX_CNT_COMPRESS_THROTTLE_MS, slept / 1000000ULL);
+        }
+    }
+}
+
+bool CRxArchiveWriter::add_file(const std::string& src_path, const std::string& name, std::string& error)
+{
+    if (!fp_) {
+        error = "archive not open";
+        return false;
+    }
+    FILE* in = fopen(src_path.c_str(), "rb");
+    if (!in) {
+        error = std::string("cannot open ") + src_path + ": " + strerror(errno);
+        return false;
+    }
+
+    SRxArchiveFile file;
+    file.name = name;
+    file.raw_size = 0;
+    file.first_frame = static_cast<uint32_t>(frames_.size());
+    file.frame_count = 0;
+    files_.push_back(file);
+    file_raw_offset_ = 0;
+
+    unsigned char hdr[PCAP_HEADER_SIZE];
+    size_t n = fread(hdr, 1, sizeof(hdr), in);
+    bool is_pcap = false;
+    bool swapped = false;
+    if (n == sizeof(hdr)) {
+        uint32_t magic;
+        memcpy(&magic, hdr, 4);
+        if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+            is_pcap = true;
+        } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+            is_pcap = true;
+            swapped = true;
+        }
+    }
+    if (is_pcap) {
+        files_.back().pcap_header.assign(reinterpret_cast<const char*>(hdr), sizeof(hdr));
+    }
+    current_frame()->raw.append(reinterpret_cast<const char*>(hdr), n);
+    uint64_t total = n;
+
+    bool ok = true;
+    if (is_pcap) {
+        // Frames end on record boundaries so each one can be parsed on its
+        // own. A truncated tail (capture killed mid-write) is kept verbatim.
+        unsigned char rec[PCAP_RECORD_SIZE];
+        for (;;) {
+            n = fread(rec, 1, sizeof(rec), in);
+            if (n == 0) {
+                break;
+            }
+            Frame* frame = current_frame();
+            frame->raw.append(reinterpret_cast<const char*>(rec), n);
+            total += n;
+            if (n < sizeof(rec)) {
+                break;
+            }
+            uint32_t ts;
+            uint32_t caplen;
+            memcpy(&ts, rec, 4);
+            memcpy(&caplen, rec + 8, 4);
+            if (swapped) {
+                ts = swap32(ts);
+                caplen = swap32(caplen);
+            }
+            if (caplen > MAX_RECORD_SIZE) {
+                is_pcap = false;
+                break;
+            }
+            size_t old = frame->raw.size();
+            frame->raw.resize(old + caplen);
+            size_t got = caplen > 0 ? fread(&frame->raw[old], 1, caplen, in) : 0;
+            frame->raw.resize(old + got);
+            total += got;
+            charge_read(sizeof(rec) + got);
+            if (got < caplen) {
+                break;
+            }
+            if (frame->packets == 0) {
+                frame->first_ts = ts;
+            }
+            frame->last_ts = ts;
+            frame->packets++;
+            if (!(ok = end_frame(error))) {
+                break;
+            }
+        }
+    }
+    if (ok && !is_pcap) {
+        char buf[64 * 1024];
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            current_frame()->raw.append(buf, n);
+            total += n;
+            charge_read(n);
+            if (!(ok = end_frame(error))) {
+                break;
+            }
+        }
+    }
+    if (ok && ferror(in)) {
+        error = std::string("read failed on ") + src_path;
+        ok = false;
+    }
+    fclose(in);
+    charge_read(0);
+
+    // A file's last frame is never shared with the next file.
+    if (ok) {
+        ok = flush_frames(error);
+    }
+    files_.back().raw_size = total;
+    raw_bytes_ += total;
+    return ok;
+}
+
+bool CRxArchiveWriter::close(std::string& error)
+{
+    if (!fp_) {
+        error = "archive not open";
+        return false;
+    }
+    bool ok = flush_frames(error);
+
+    std::string blob;
+    put_u32(blob, INDEX_MAGIC);
+    put_u32(blob, INDEX_VERSION);
+    put_u32(blob, static_cast<uint32_t>(files_.size()));
+    put_u32(blob, static_cast<uint32_t>(frames_.size()));
+    for (size_t i = 0; i < files_.size(); ++i) {
+        const SRxArchiveFile& f = files_[i];
+        std::string name = f.name.size() > 4096 ? f.name.substr(0, 4096) : f.name;
+        put_u16(blob, static_cast<uint16_t>(name.size()));
+        blob += name;
+        put_u64(blob, f.raw_size);
+        put_u32(blob, f.first_frame);
+        put_u32(blob, f.frame_count);
+        put_u16(blob, static_cast<uint16_t>(f.pcap_header.size()));
+        blob += f.pcap_header;
+    }
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        const SRxArchiveFrame& f = frames_[i];
+        put_u64(blob, f.comp_offset);
+        put_u32(blob, f.comp_size);
+        put_u64(blob, f.raw_offset);
+        put_u32(blob, f.raw_size);
+        put_u32(blob, f.first_ts);
+        put_u32(blob, f.last_ts);
+        put_u32(blob, f.packets);
+    }
+
+    uint64_t index_offset = offset_;
+    for (size_t pos = 0; ok && pos < blob.size(); pos += INDEX_CHUNK) {
+        std::string member = extra_member('R', 'I', blob.substr(pos, INDEX_CHUNK));
+        ok = write_bytes(member.data(), member.size(), error);
+    }
+    if (ok) {
+        std::string footer;
+        put_u64(footer, index_offset);
+        put_u32(footer, static_cast<uint32_t>(offset_ - index_offset));
+        put_u32(footer, INDEX_VERSION);
+        put_u32(footer, FOOTER_MAGIC);
+        std::string member = extra_member('R', 'F', footer);
+        ok = write_bytes(member.data(), member.size(), error);
+    }
+    if (ok && fflush(fp_) != 0) {
+        error = std::string("flush failed: ") + strerror(errno);
+        ok = false;
+    }
+    if (fclose(fp_) != 0 && ok) {
+        error = std::string("close failed: ") + strerror(errno);
+        ok = false;
+    }
+    fp_ = NULL;
+    if (!ok) {
+        ::unlink(path_.c_str());
+    }
+    return ok;
+}
+
+CRxArchiveReader::CRxArchiveReader()
+    : fd_(-1)
+{
+}
+
+CRxArchiveReader::~CRxArchiveReader()
+{
+    close();
+}
+
+void CRxArchiveReader::close()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    files_.clear();
+    frames_.clear();
+}
+
+bool CRxArchiveReader::is_archive(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = false;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= FOOTER_SIZE) {
+        unsigned char tail[FOOTER_SIZE];
+        std::string payload;
+        ok = pread_all(fd, tail, sizeof(tail), static_cast<uint64_t>(st.st_size) - FOOTER_SIZE) &&
+             parse_extra_member(tail, sizeof(tail), 'R', 'F', payload) == FOOTER_SIZE &&
+             payload.size() == FOOTER_PAYLOAD &&
+             get_u32(reinterpret_cast<const unsigned char*>(payload.data()) + 16) == FOOTER_MAGIC;
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool CRxArchiveReader::open(const std::string& path, std::string& error)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        error = std::string("cannot open ") + path + ": " + strerror(errno);
+        return false;
+    }
+    path_ = path;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < FOOTER_SIZE) {
+        error = "not a seekable archive";
+        close();
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    unsigned char tail[FOOTER_SIZE];
+    std::string payload;
+    if (!pread_all(fd_, tail, sizeof(tail), size - FOOTER_SIZE) ||
+        parse_extra_member(tail, sizeof(tail), 'R', 'F', payload) != FOOTER_SIZE ||
+        payload.size() != FOOTER_PAYLOAD) {
+        error = "not a seekable archive";
+        close();
+        return false;
+    }
+    const unsigned char* fp = reinterpret_cast<const unsigned char*>(payload.data());
+    uint64_t index_offset = get_u64(fp);
+    uint32_t index_len = get_u32(fp + 8);
+    if (get_u32(fp + 16) != FOOTER_MAGIC || get_u32(fp + 12) != INDEX_VERSION ||
+        index_offset + index_len + FOOTER_SIZE != size) {
+        error = "unsupported archive footer";
+        close();
+        return false;
+    }
+
+    std::string raw(index_len, '\0');
+    if (index_len > 0 && !pread_all(fd_, &raw[0], raw.size(), index_offset)) {
+        error = "short read on index";
+        close();
+        return false;
+    }
+    std::string blob;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        std::string chunk;
+        size_t used = parse_extra_member(reinterpret_cast<const unsigned char*>(raw.data()) + pos,
+                                         raw.size() - pos, 'R', 'I', chunk);
+        if (used == 0) {
+            error = "corrupt archive index";
+            close();
+            return false;
+        }
+        blob += chunk;
+        pos += used;
+    }
+    if (!parse_index(blob, error)) {
+        close();
+        return false;
+    }
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        if (frames_[i].comp_offset + frames_[i].comp_size > index_offset) {
+            error = "frame outside archive data";
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CRxArchiveReader::parse_index(const std::string& blob, std::string& error)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(blob.data());
+    const unsigned char* end = p + blob.size();
+    if (blob.size() < 16 || get_u32(p) != INDEX_MAGIC || get_u32(p + 4) != INDEX_VERSION) {
+        error = "corrupt archive index";
+        return false;
+    }
+    uint32_t file_count = get_u32(p + 8);
+    uint32_t frame_count = get_u32(p + 12);
+    p += 16;
+
+    for (uint32_t i = 0; i < file_count; ++i) {
+        SRxArchiveFile f;
+        if (end - p < 2) {
+            break;
+        }
+        size_t name_len = get_u16(p);
+        p += 2;
+        if (static_cast<size_t>(end - p) < name_len + 8 + 4 + 4 + 2) {
+            break;
+        }
+        f.name.assign(reinterpret_cast<const char*>(p), name_len);
+        p += name_len;
+        f.raw_size = get_u64(p);
+        f.first_frame = get_u32(p + 8);
+        f.frame_count = get_u32(p + 12);
+        size_t hdr_len = get_u16(p + 16);
+        p += 18;
+        if (static_cast<size_t>(end - p) < hdr_len || (hdr_len != 0 && hdr_len != PCAP_HEADER_SIZE)) {
+            break;
+        }
+        f.pcap_header.assign(reinterpret_cast<const char*>(p), hdr_len);
+        p += hdr_len;
+        if (static_cast<uint64_t>(f.first_frame) + f.frame_count > frame_count) {
+            break;
+        }
+        files_.push_back(f);
+    }
+    if (files_.size() != file_count || static_cast<size_t>(end - p) != static_cast<size_t>(frame_count) * FRAME_SIZE_ON_DISK) {
+        error = "corrupt archive index";
+        files_.clear();
+        return false;
+    }
+    frames_.reserve(frame_count);
+    for (uint32_t i = 0; i < frame_count; ++i, p += FRAME_SIZE_ON_DISK) {
+        SRxArchiveFrame f;
+        f.comp_offset = get_u64(p);
+        f.comp_size = get_u32(p + 8);
+        f.raw_offset = get_u64(p + 12);
+        f.raw_size = get_u32(p + 20);
+        f.first_ts = get_u32(p + 24);
+        f.last_ts = get_u32(p + 28);
+        f.packets = get_u32(p + 32);
+        frames_.push_back(f);
+    }
+    return true;
+}
+
+int CRxArchiveReader::find_file(const std::string& name) const
+{
+    for (size_t i = 0; i < files_.size(); ++i) {
+        if (files_[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int CRxArchiveReader::frame_at(size_t file, uint64_t raw_offset) const
+{
+    if (file >= files_.size()) {
+        return -1;
+    }
+    const SRxArchiveFile& f = files_[file];
+    size_t lo = f.first_frame;
+    size_t hi = f.first_frame + f.frame_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const SRxArchiveFrame& fr = frames_[mid];
+        if (raw_offset < fr.raw_offset) {
+            hi = mid;
+        } else if (raw_offset >= fr.raw_offset + fr.raw_size) {
+            lo = mid + 1;
+        } else {
+            return static_cast<int>(mid);
+        }
+    }
+    return -1;
+}
+
+int CRxArchiveReader::frame_at_time(size_t file, uint32_t ts) const
+{
+    if (file >= files_.size()) {
+        return -1;
+    }
+    // Capture files are nearly time ordered; a frame's last timestamp is a
+    // good enough upper bound to skip whole frames.
+    const SRxArchiveFile& f = files_[file];
+    for (uint32_t i = 0; i < f.frame_count; ++i) {
+        const SRxArchiveFrame& fr = frames_[f.first_frame + i];
+        if (fr.packets > 0 && fr.last_ts >= ts) {
+            return static_cast<int>(f.first_frame + i);
+        }
+    }
+    return -1;
+}
+
+bool CRxArchiveReader::read_frame(size_t index, std::string& out, std::string& error) const
+{
+    if (fd_ < 0 || index >= frames_.size()) {
+        error = "no such frame";
+        return false;
+    }
+    return inflate_frame(fd_, frames_[index], out, error);
+}
+
+FILE* CRxArchiveReader::open_stream(size_t file, std::string& error) const
+{
+    if (fd_ < 0 || file >= files_.size()) {
+        error = "no such file in archive";
+        return NULL;
+    }
+    StreamCtx* ctx = new StreamCtx();
+    ctx->header = files_[file].pcap_header;
+    ctx->size = ctx->header.size();
+    stream_append(ctx, files_[file], frames_, ctx->header.size());
+    return open_cookie_stream(path_, ctx, error);
+}
+
+FILE* CRxArchiveReader::open_capture(uint32_t from_ts, uint64_t& from_offset, std::string& error) const
+{
+    if (fd_ < 0 || files_.empty()) {
+        error = "archive holds no pcap file";
+        return NULL;
+    }
+    // Every file must be a pcap with the same magic (byte order, timestamp
+    // precision) and linktype; the merged header carries the largest snaplen.
+    std::string header = files_[0].pcap_header;
+    for (size_t i = 0; i < files_.size(); ++i) {
+        const std::string& h = files_[i].pcap_header;
+        if (h.size() != PCAP_HEADER_SIZE) {
+            error = files_[i].name + " is not a pcap file";
+            return NULL;
+        }
+        if (h.compare(0, 4, header, 0, 4) != 0) {
+            error = files_[i].name + ": pcap magic differs from " + files_[0].name;
+            return NULL;
+        }
+        if (pcap_header_u32(h, 20) != pcap_header_u32(header, 20)) {
+            error = files_[i].name + ": linktype differs from " + files_[0].name;
+            return NULL;
+        }
+        if (pcap_header_u32(h, 16) > pcap_header_u32(header, 16)) {
+            pcap_header_set_u32(header, 16, pcap_header_u32(h, 16));
+        }
+    }
+
+    StreamCtx* ctx = new StreamCtx();
+    ctx->header = header;
+    ctx->size = PCAP_HEADER_SIZE;
+    from_offset = 0;
+    bool found = from_ts == 0;
+    for (size_t i = 0; i < files_.size(); ++i) {
+        size_t first_part = ctx->parts.size();
+        stream_append(ctx, files_[i], frames_, PCAP_HEADER_SIZE);
+        // Capture files are nearly time ordered; a frame's last timestamp is
+        // a good enough upper bound to skip whole frames.
+        for (size_t k = first_part; !found && k < ctx->parts.size(); ++k) {
+            const StreamPart& part = ctx->parts[k];
+            if (part.frame.packets > 0 && part.frame.last_ts >= from_ts) {
+                from_offset = part.start;
+                found = true;
+            }
+        }
+    }
+    if (!found) {
+        from_offset = ctx->size;
+    }
+    return open_cookie_stream(path_, ctx, error);
+}
+
+pcap_t* CRxArchiveReader::open_offline(const std::string& path, char* errbuf, uint32_t from_ts)
+{
+    if (!is_archive(path)) {
+        return pcap_open_offline(path.c_str(), errbuf);
+    }
+    CRxArchiveReader reader;
+    std::string error;
+    uint64_t from_offset = 0;
+    FILE* fp = NULL;
+    if (reader.open(path, error)) {
+        fp = reader.open_capture(from_ts, from_offset, error);
+    }
+    if (!fp) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %s", path.c_str(), error.c_str());
+        return NULL;
+    }
+    // pcap_close() closes the stream, which releases the archive.
+    pcap_t* handle = pcap_fopen_offline(fp, errbuf);
+    if (!handle) {
+        fclose(fp);
+        return NULL;
+    }
+    if (from_offset > PCAP_HEADER_SIZE) {
+        fseek(fp, static_cast<long>(from_offset), SEEK_SET);
+    }
+    return handle;
+}
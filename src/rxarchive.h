@@ -0,0 +1,149 @@
+#ifndef RX_ARCHIVE_H
+#define RX_ARCHIVE_H
+
+#include <pcap.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class CRxIoThrottle;
+
+// Seekable capture archive (*.pcap.gz). Every archived file is cut at packet
+// boundaries into frames of roughly frame_bytes and each frame is written as an
+// independent gzip member, so zcat/gunzip still decompress it; for archives
+// holding several files the output is the files back to back, each with its
+// own pcap global header, which pcap readers do not accept as one capture.
+// The frame index follows the data in empty gzip members (FEXTRA subfield
+// "RI") and a fixed-size footer member (subfield "RF") points at it; readers
+// only inflate the frames covering the offsets or time range they need.
+struct SRxArchiveFrame {
+    uint64_t comp_offset;
+    uint32_t comp_size;
+    // Offset within the original file, pcap global header included.
+    uint64_t raw_offset;
+    uint32_t raw_size;
+    uint32_t first_ts;
+    uint32_t last_ts;
+    uint32_t packets;
+};
+
+struct SRxArchiveFile {
+    std::string name;
+    uint64_t raw_size;
+    uint32_t first_frame;
+    uint32_t frame_count;
+    // 24-byte pcap global header; empty when the input was not a pcap file,
+    // in which case frames are plain byte ranges without timestamps.
+    std::string pcap_header;
+};
+
+class CRxArchiveWriter {
+public:
+    enum {
+        DEFAULT_FRAME_BYTES = 4 * 1024 * 1024,
+        MAX_THREADS = 16
+    };
+
+    CRxArchiveWriter();
+    ~CRxArchiveWriter();
+
+    // level is the zlib level (1-9); frames are compressed threads at a time.
+    bool open(const std::string& path, size_t frame_bytes, int threads, int level, std::string& error);
+    // Input reads are charged to the throttle, if any.
+    void set_throttle(CRxIoThrottle* throttle) { throttle_ = throttle; }
+    bool add_file(const std::string& src_path, const std::string& name, std::string& error);
+    // Writes the index and footer. An archive that was not closed has no
+    // footer and is rejected by the reader.
+    bool close(std::string& error);
+
+    uint64_t raw_bytes() const { return raw_bytes_; }
+    uint64_t compressed_bytes() const { return offset_; }
+
+private:
+    struct Frame {
+        std::string raw;
+        std::string comp;
+        uint32_t first_ts;
+        uint32_t last_ts;
+        uint32_t packets;
+        bool ok;
+    };
+
+    CRxArchiveWriter(const CRxArchiveWriter&);
+    CRxArchiveWriter& operator=(const CRxArchiveWriter&);
+
+    Frame* current_frame();
+    bool end_frame(std::string& error);
+    bool flush_frames(std::string& error);
+    bool write_bytes(const void* data, size_t len, std::string& error);
+    void charge_read(size_t bytes);
+    static void* compress_thread(void* arg);
+    static void compress_frame(Frame* frame, int level);
+
+    FILE* fp_;
+    std::string path_;
+    size_t frame_bytes_;
+    int threads_;
+    int level_;
+    uint64_t offset_;
+    uint64_t raw_bytes_;
+    uint64_t file_raw_offset_;
+    CRxIoThrottle* throttle_;
+    uint64_t unthrottled_;
+    std::vector<Frame*> batch_;
+    std::vector<SRxArchiveFile> files_;
+    std::vector<SRxArchiveFrame> frames_;
+};
+
+class CRxArchiveReader {
+public:
+    CRxArchiveReader();
+    ~CRxArchiveReader();
+
+    // Cheap footer check, used to tell archives from plain pcap files.
+    static bool is_archive(const std::string& path);
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    const std::vector<SRxArchiveFile>& files() const { return files_; }
+    const std::vector<SRxArchiveFrame>& frames() const { return frames_; }
+    // -1 when no archived file has that name.
+    int find_file(const std::string& name) const;
+    // Frame of the given file holding raw_offset, or -1 past its end.
+    int frame_at(size_t file, uint64_t raw_offset) const;
+    // First frame of the file whose packets may be at or after ts.
+    int frame_at_time(size_t file, uint32_t ts) const;
+    bool read_frame(size_t index, std::string& out, std::string& error) const;
+
+    // Streams one archived file as an ordinary seekable stdio stream; frames
+    // are inflated on demand, one at a time. NULL on error.
+    FILE* open_stream(size_t file, std::string& error) const;
+
+    // Streams all archived files in order as one pcap: later global headers
+    // are dropped and files whose magic or linktype differ from the first
+    // are rejected. from_offset is where the first frame that may hold
+    // packets at or after from_ts starts (past the end when none does).
+    FILE* open_capture(uint32_t from_ts, uint64_t& from_offset, std::string& error) const;
+
+    // pcap_open_offline() that also accepts archives, reading every file in
+    // them through open_capture(). With from_ts set, frames ending before it
+    // are not inflated; the caller still sees a few earlier packets from the
+    // first frame read.
+    static pcap_t* open_offline(const std::string& path, char* errbuf, uint32_t from_ts = 0);
+
+private:
+    CRxArchiveReader(const CRxArchiveReader&);
+    CRxArchiveReader& operator=(const CRxArchiveReader&);
+
+    bool parse_index(const std::string& blob, std::string& error);
+
+    int fd_;
+    std::string path_;
+    std::vector<SRxArchiveFile> files_;
+    std::vector<SRxArchiveFrame> frames_;
+};
+
+#endif
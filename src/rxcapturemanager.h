@@ -16,7 +16,19 @@ struct CRxCaptureTaskCfg {
     std::string protocol_filter;
     std::string protocol_filter_inline;
     int port;
-    CRxCaptureTaskCfg() : duration_sec(0), max_bytes(0), port(0) {}
+    std::string replay_file;
+    double replay_speed;
+    long replay_pps;
+    int replay_loops;
+    bool stats_only;
+    std::string aggregate_fields;
+    int snaplen;
+    std::string netns_path;
+    std::string rate_ladder;
+    double rate_drop_pct;
+    CRxCaptureTaskCfg()
+        : duration_sec(0), max_bytes(0), port(0), replay_speed(0.0), replay_pps(0), replay_loops(1),
+          stats_only(false), snaplen(65535), rate_drop_pct(0.1) {}
 };
 
 struct CRxCaptureTaskInfo {
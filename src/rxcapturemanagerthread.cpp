@@ -6,6 +6,9 @@
 #include "rxprocessresolver.h"
 #include "rxcleanupthread.h"
 #include "rxsamplethread.h"
+#include "rxprotocoldispatcher.h"
+#include "rxplacement.h"
+#include "rxcaptureprogress.h"
 #include <cstdio>
 #include <malloc.h>
 #include <time.h>
@@ -218,6 +221,9 @@ static std::string build_capture_signature(const CaptureSpec& spec,
     append_json_str_field(oss, first, "protocol_filter", spec.protocol_filter);
     append_json_str_field(oss, first, "ip_filter", spec.ip_filter);
     append_json_int_field(oss, first, "port_filter", spec.port_filter);
+    append_json_str_field(oss, first, "replay_file", spec.replay_file);
+    append_json_bool_field(oss, first, "stats_only", spec.stats_only);
+    append_json_str_field(oss, first, "aggregate", spec.aggregate_fields);
 
     int effective_duration = spec.max_duration_sec > 0 ? spec.max_duration_sec : config_snapshot.max_duration_sec;
     if (effective_duration > 0) {
@@ -409,6 +415,24 @@ struct MarkStoppedFunctor {
     }
 };
 
+struct RecordLossFunctor {
+    CaptureLossStats loss;
+    explicit RecordLossFunctor(const CaptureLossStats& l) : loss(l) {}
+    void operator()(SRxCaptureTask& task) const {
+        task.loss = loss;
+    }
+};
+
+void log_capture_loss(int capture_id, const CaptureLossStats& loss)
+{
+    if (loss.kernel_dropped == 0 && loss.if_dropped == 0 && loss.rate_actions.empty()) {
+        return;
+    }
+    LOG_WARNING("Task %d: kernel received=%lu dropped=%lu ifdropped=%lu sampled_out=%lu rate_actions=%zu",
+                capture_id, loss.kernel_received, loss.kernel_dropped, loss.if_dropped,
+                loss.sampled_out, loss.rate_actions.size());
+}
+
 }
 SRxCaptureTask::SRxCaptureTask()
     : capture_id(-1)
@@ -433,7 +457,9 @@ SRxCaptureTask::SRxCaptureTask()
 
 CRxCaptureManagerThread::CRxCaptureManagerThread()
     : _is_first(false)
+    , _next_capture_id(RxCaptureConstants::kCaptureIdStartValue)
     , _next_filter_thread_idx(0)
+    , _last_rate_sample_ms(0)
 {
 }
 
@@ -482,6 +508,12 @@ bool CRxCaptureManagerThread::start()
         return false;
     }
 
+    // Ids of captures restored from the task journal stay reserved.
+    int restored_max = p_data->capture_task_mgr().max_capture_id();
+    if (restored_max >= _next_capture_id) {
+        _next_capture_id = restored_max + 1;
+    }
+
     int capture_threads_count = cfg->capture_threads();
     if (capture_threads_count <= 0)
     {
@@ -502,6 +534,10 @@ bool CRxCaptureManagerThread::start()
             continue;
         }
 
+        char worker_name[32];
+        snprintf(worker_name, sizeof(worker_name), "capture_%d", i);
+        CRxThreadPlacement::instance()->place(worker, RX_ROLE_CAPTURE, worker_name);
+
         if (!worker->start())
         {
             LOG_ERROR("CRxCaptureManagerThread: failed to start CRxCaptureThread %d", i);
@@ -534,6 +570,15 @@ bool CRxCaptureManagerThread::start()
             continue;
         }
 
+        const CRxServerConfig::FilterConfig& filter_cfg = cfg->filter();
+        if (filter_cfg.tcp_reassembly) {
+            filter_thread->configure_reassembly(filter_cfg.reassembly_max_flows, filter_cfg.reassembly_depth);
+        }
+
+
+        char filter_name[32];
+        snprintf(filter_name, sizeof(filter_name), "filter_%d", i);
+        CRxThreadPlacement::instance()->place(filter_thread, RX_ROLE_FILTER, filter_name);
 
         if (!filter_thread->start()) {
             LOG_ERROR("CRxCaptureManagerThread: failed to start FilterThread %d", i);
@@ -556,6 +601,7 @@ bool CRxCaptureManagerThread::start()
 void CRxCaptureManagerThread::add_worker_thread(uint32_t thread_index)
 {
     _worker_thd_vec.push_back(thread_index);
+    _scheduler.add_worker(thread_index, CRxThreadPlacement::instance()->thread_node(thread_index));
     LOG_NOTICE("CRxCaptureManagerThread: added worker thread ID = %u", thread_index);
 }
 
@@ -569,6 +615,8 @@ void CRxCaptureManagerThread::run_process()
 
         start_queue_timer();
         start_clean_timer();
+        start_journal_timer(TIMER_TYPE_JOURNAL_SYNC);
+        start_journal_timer(TIMER_TYPE_JOURNAL_COMPACT);
     }
 
     CRxProcData* global_data = CRxProcData::instance();
@@ -600,12 +648,12 @@ void CRxCaptureManagerThread::handle_msg(shared_ptr<normal_msg>& msg)
         case RX_MSG_CAPTURE_STARTED:
             handle_capture_started_v2(msg);
             break;
-        case RX_MSG_CAPTURE_PROGRESS:
-            handle_capture_progress_v2(msg);
-            break;
         case RX_MSG_CAPTURE_FILE_READY:
             handle_capture_file_ready_v2(msg);
             break;
+        case RX_MSG_CAPTURE_FILE_BATCH:
+            handle_capture_file_batch_v2(msg);
+            break;
         case RX_MSG_CAPTURE_FINISHED:
             handle_capture_finished_v2(msg);
             break;
@@ -1005,6 +1053,7 @@ bool CRxCaptureManagerThread::prepare_capture_from_sample(const shared_ptr<SRxSa
 
     msg->client_ip = "sample";
     msg->request_user = "module:" + module_name;
+    msg->priority = PRIORITY_SAMPLER;
     msg->enqueue_ts_ms = GetMilliSecond();
 
     start_msg = msg;
@@ -1028,6 +1077,19 @@ void CRxCaptureManagerThread::handle_timeout(shared_ptr<timer_msg>& t_msg)
             clean_expired_files();
             start_clean_timer();
             break;
+        case TIMER_TYPE_JOURNAL_SYNC:
+            if (CRxProcData::instance()) {
+                CRxProcData::instance()->task_journal().sync();
+            }
+            start_journal_timer(TIMER_TYPE_JOURNAL_SYNC);
+            break;
+        case TIMER_TYPE_JOURNAL_COMPACT:
+            if (CRxProcData::instance() &&
+                CRxProcData::instance()->task_journal().needs_compaction(JOURNAL_COMPACT_MIN_RECORDS)) {
+                CRxProcData::instance()->compact_task_journal();
+            }
+            start_journal_timer(TIMER_TYPE_JOURNAL_COMPACT);
+            break;
         default:
             LOG_DEBUG("Unknown timer type: %d", t_msg->_timer_type);
             break;
@@ -1228,13 +1290,11 @@ int CRxCaptureManagerThread::create_and_add_capture_task(
     const std::string& task_key,
     const std::string& signature,
     const std::string& sid,
-    const std::vector<SProcessInfo>& matched_processes,
-    shared_ptr<SRxHttpReplyMsg>& reply)
+    const std::vector<SProcessInfo>& matched_processes)
 {
 
-    static int next_capture_id = RxCaptureConstants::kCaptureIdStartValue;
-    int capture_id = next_capture_id < RxCaptureConstants::kCaptureIdStartValue
-        ? RxCaptureConstants::kCaptureIdStartValue : next_capture_id++;
+    int capture_id = _next_capture_id < RxCaptureConstants::kCaptureIdStartValue
+        ? RxCaptureConstants::kCaptureIdStartValue : _next_capture_id++;
 
     SRxCaptureTask* task = new SRxCaptureTask();
     task->capture_id = capture_id;
@@ -1265,7 +1325,7 @@ int CRxCaptureManagerThread::create_and_add_capture_task(
     task->duration_sec = start_msg->duration_sec;
     task->max_bytes = start_msg->max_bytes;
     task->max_packets = start_msg->max_packets;
-    task->priority = 0;
+    task->priority = start_msg->priority;
     task->signature = signature;
     task->sid = sid;
 
@@ -1280,44 +1340,55 @@ int CRxCaptureManagerThread::create_and_add_capture_task(
     CRxSafeTaskMgr& task_mgr = global_data->capture_task_mgr();
     task_mgr.add_task(capture_id, task_key, signature, sid, task);
 
+    return capture_id;
+}
+
+void CRxCaptureManagerThread::create_start_reply(shared_ptr<SRxHttpReplyMsg>& reply,
+                                                 int capture_id,
+                                                 const shared_ptr<SRxStartCaptureMsg>& start_msg,
+                                                 const std::string& task_key,
+                                                 const std::string& sid,
+                                                 size_t matched_pids,
+                                                 size_t queue_position)
+{
     reply->status = 200;
     reply->reason = "OK";
     reply->headers["Content-Type"] = "application/json";
 
     char buf[1024];
     const char* mode_name[] = {"interface", "process", "pid", "container"};
-    snprintf(buf, sizeof(buf),
-            "{\"capture_id\":%d,\"duplicate\":false,\"status\":\"started\","
-            "\"mode\":\"%s\",\"key\":\"%s\",\"sid\":\"%s\",\"matched_pids\":%zu,\"port\":%d}",
-            capture_id, mode_name[start_msg->capture_mode], task_key.c_str(),
-            sid.c_str(), matched_processes.size(), start_msg->port_filter);
+    int len = snprintf(buf, sizeof(buf),
+            "{\"capture_id\":%d,\"duplicate\":false,\"status\":\"%s\","
+            "\"mode\":\"%s\",\"key\":\"%s\",\"sid\":\"%s\",\"matched_pids\":%zu,\"port\":%d,"
+            "\"priority\":\"%s\"",
+            capture_id, queue_position > 0 ? "queued" : "started",
+            mode_name[start_msg->capture_mode], task_key.c_str(),
+            sid.c_str(), matched_pids, start_msg->port_filter,
+            capture_priority_to_string(start_msg->priority));
+    if (len > 0 && static_cast<size_t>(len) < sizeof(buf) && queue_position > 0) {
+        snprintf(buf + len, sizeof(buf) - len, ",\"queue_position\":%zu", queue_position);
+    }
     reply->body = buf;
+    reply->body += "}";
 
-    LOG_NOTICE("Started capture task %d (mode=%s, pids=%zu, port=%d): %s",
+    LOG_NOTICE("%s capture task %d (mode=%s, priority=%s, pids=%zu, port=%d): %s",
+              queue_position > 0 ? "Queued" : "Started",
               capture_id, mode_name[start_msg->capture_mode],
-              matched_processes.size(), start_msg->port_filter, task_key.c_str());
-
-    return capture_id;
+              capture_priority_to_string(start_msg->priority),
+              matched_pids, start_msg->port_filter, task_key.c_str());
 }
 
 void CRxCaptureManagerThread::dispatch_task_to_worker(int capture_id,
+    uint32_t worker,
     const std::string& task_key,
     const std::string& sid,
     const CaptureSpec& spec,
     const CaptureConfigSnapshot& config_snapshot,
     shared_ptr<SRxStartCaptureMsg>& start_msg)
 {
-    if (_worker_thd_vec.empty()) {
-        return;
-    }
-
-    static size_t next_worker = 0;
-    size_t worker_index = next_worker % _worker_thd_vec.size();
-    next_worker++;
-
     ObjId worker_target;
     worker_target._id = OBJ_ID_THREAD;
-    worker_target._thread_index = _worker_thd_vec[worker_index];
+    worker_target._thread_index = worker;
 
     shared_ptr<SRxCaptureStartMsgV2> start_v2(new SRxCaptureStartMsgV2());
     start_v2->capture_id = capture_id;
@@ -1379,6 +1450,19 @@ void CRxCaptureManagerThread::handle_start_capture(shared_ptr<normal_msg>& msg)
         return;
     }
 
+    if (start_msg->netns_path.empty()) {
+        for (size_t i = 0; i < matched_processes.size(); ++i) {
+            std::string netns_file = CRxProcessResolver::GetForeignNetNsFile(matched_processes[i].pid);
+            if (!netns_file.empty()) {
+                start_msg->netns_path = netns_file;
+                LOG_NOTICE("Process %d runs in its own network namespace (%s), capturing inside %s",
+                           matched_processes[i].pid, matched_processes[i].netns_path.c_str(),
+                           netns_file.c_str());
+                break;
+            }
+        }
+    }
+
     if (start_msg->capture_mode == MODE_PROCESS && start_msg->filter.empty()
         && !start_msg->proc_name.empty()) {
         std::set<int> ports;
@@ -1400,6 +1484,8 @@ void CRxCaptureManagerThread::handle_start_capture(shared_ptr<normal_msg>& msg)
                 }
                 bpf << "port " << *it;
             }
+
+
             start_msg->filter = bpf.str();
 
 
@@ -1428,7 +1514,8 @@ void CRxCaptureManagerThread::handle_start_capture(shared_ptr<normal_msg>& msg)
     CRxStrategyConfigManager* strategy_cfg = proc_data ? proc_data->current_strategy_config() : NULL;
 
     if (start_msg->iface.empty()) {
-        if (strategy_cfg) {
+        // The host default interface means nothing inside a foreign namespace.
+        if (strategy_cfg && start_msg->netns_path.empty()) {
             start_msg->iface = strategy_cfg->get_default_iface();
         }
         if (start_msg->iface.empty()) {
@@ -1473,12 +1560,12 @@ void CRxCaptureManagerThread::handle_start_capture(shared_ptr<normal_msg>& msg)
     capture_spec.max_bytes = start_msg->max_bytes;
     capture_spec.max_packets = start_msg->max_packets;
     capture_spec.snaplen = config_snapshot.snaplen;
-
-    if (!matched_processes.empty()) {
-        if (capture_spec.netns_path.empty()) {
-            capture_spec.netns_path = matched_processes[0].netns_path;
-        }
-    }
+    capture_spec.replay_file = start_msg->replay_file;
+    capture_spec.replay_speed = start_msg->replay_speed;
+    capture_spec.replay_pps = start_msg->replay_pps;
+    capture_spec.replay_loops = start_msg->replay_loops;
+    capture_spec.stats_only = start_msg->stats_only;
+    capture_spec.aggregate_fields = start_msg->aggregate_fields;
 
     std::string signature_payload = build_capture_signature(capture_spec, config_snapshot, matched_processes);
     unsigned long long fnv = 1469598103934665603ULL;
@@ -1536,14 +1623,30 @@ void CRxCaptureManagerThread::handle_start_capture(shared_ptr<normal_msg>& msg)
         const std::string& duplicate_key = existing_snapshot.key.empty() ? task_key : existing_snapshot.key;
         const std::string& duplicate_sid = existing_snapshot.sid.empty() ? sid : existing_snapshot.sid;
         create_duplicate_error_reply(reply, duplicate_key, duplicate_sid, existing_id, existing_status);
-    } else if (running_count >= static_cast<size_t>(max_concurrent)) {
+    } else if (_scheduler.pending() >= static_cast<size_t>(get_max_pending_limit())) {
         create_capacity_error_reply(reply, max_concurrent, running_count, pending_count);
     } else {
 
-        capture_id = create_and_add_capture_task(start_msg, task_key, signature, sid, matched_processes, reply);
-
-        dispatch_task_to_worker(capture_id, task_key, sid, capture_spec, config_snapshot, start_msg);
-        accepted = (capture_id > 0);
+        capture_id = create_and_add_capture_task(start_msg, task_key, signature, sid, matched_processes);
+
+        std::string sched_iface = capture_spec.replay_file.empty() ? capture_spec.iface : std::string();
+        if (_scheduler.enqueue(capture_id, start_msg->priority, sched_iface,
+                               CRxThreadPlacement::iface_numa_node(sched_iface))) {
+            PendingStart& pending = _pending_starts[capture_id];
+            pending.task_key = task_key;
+            pending.sid = sid;
+            pending.spec = capture_spec;
+            pending.config = config_snapshot;
+            pending.start_msg = start_msg;
+
+            schedule_pending();
+            create_start_reply(reply, capture_id, start_msg, task_key, sid,
+                               matched_processes.size(), _scheduler.position(capture_id));
+            accepted = true;
+        } else {
+            task_mgr.set_capture_failed(capture_id, "queue_full");
+            create_capacity_error_reply(reply, max_concurrent, running_count, pending_count);
+        }
     }
 
     uint64_t reply_ready_ms = GetMilliSecond();
@@ -1580,13 +1683,79 @@ void CRxCaptureManagerThread::handle_stop_capture(shared_ptr<normal_msg>& msg)
     reply->conn_id = stop_msg->reply_target._id;
     reply->headers["Content-Type"] = "application/json";
 
+    // Tasks still waiting in the scheduler queue never reached a worker and
+    // can simply be dropped.
+    if (_scheduler.cancel(stop_msg->capture_id)) {
+        _pending_starts.erase(stop_msg->capture_id);
+
+        CRxProcData* global_data = CRxProcData::instance();
+        if (global_data) {
+            CRxSafeTaskMgr& task_mgr = global_data->capture_task_mgr();
+            task_mgr.update_task(stop_msg->capture_id, MarkStoppedFunctor(0, 0, 0, "cancelled before start"));
+            task_mgr.update_status(stop_msg->capture_id, STATUS_STOPPED);
+        }
+        clear_module_cooldown_for_capture(stop_msg->capture_id);
+
+        reply->status = 200;
+        reply->reason = "OK";
+        char buf[128];
+        snprintf(buf, sizeof(buf), "{\"capture_id\":%d,\"status\":\"stopped\"}", stop_msg->capture_id);
+        reply->body = buf;
+
+        LOG_NOTICE("Task %d cancelled while queued", stop_msg->capture_id);
+        send_reply_to_http(stop_msg->reply_target, reply);
+        return;
+    }
+
+    CRxProcData* global_data = CRxProcData::instance();
+    TaskSnapshot snapshot;
+    if (!global_data || !global_data->capture_task_mgr().query_task(stop_msg->capture_id, snapshot)) {
+        reply->status = 404;
+        reply->reason = "Not Found";
+        char buf[128];
+        snprintf(buf, sizeof(buf), "{\"error\":\"capture_not_found\",\"capture_id\":%d}", stop_msg->capture_id);
+        reply->body = buf;
+        send_reply_to_http(stop_msg->reply_target, reply);
+        return;
+    }
+
+    if ((snapshot.status != STATUS_RESOLVING && snapshot.status != STATUS_RUNNING) ||
+        snapshot.worker_thread_index == 0) {
+        reply->status = 409;
+        reply->reason = "Conflict";
+        char buf[160];
+        snprintf(buf, sizeof(buf), "{\"error\":\"capture_not_running\",\"capture_id\":%d,\"status\":\"%s\"}",
+                 stop_msg->capture_id, capture_status_to_string(snapshot.status));
+        reply->body = buf;
+        send_reply_to_http(stop_msg->reply_target, reply);
+        return;
+    }
+
+    // The worker finishes the job as cancelled and reports it through the
+    // usual finished (or filtered-file) message.
+    global_data->capture_task_mgr().update_task(stop_msg->capture_id, MarkStopFunctor(true));
+
+    shared_ptr<SRxCaptureStopMsgV2> stop_v2(new SRxCaptureStopMsgV2());
+    stop_v2->capture_id = stop_msg->capture_id;
+    stop_v2->key = snapshot.key;
+    stop_v2->sid = snapshot.sid;
+    stop_v2->sender_thread_index = static_cast<int>(get_thread_index());
+    stop_v2->stop_reason = "stopped by user";
 
-    reply->status = 501;
-    reply->reason = "Not Implemented";
-    reply->body = "{\"error\":\"stop not supported\",\"message\":\"capture tasks cannot be stopped once started\"}";
+    ObjId worker_target;
+    worker_target._id = OBJ_ID_THREAD;
+    worker_target._thread_index = snapshot.worker_thread_index;
+    shared_ptr<normal_msg> stop_base = static_pointer_cast<normal_msg>(stop_v2);
+    base_net_thread::put_obj_msg(worker_target, stop_base);
+
+    reply->status = 202;
+    reply->reason = "Accepted";
+    char buf[128];
+    snprintf(buf, sizeof(buf), "{\"capture_id\":%d,\"status\":\"stopping\"}", stop_msg->capture_id);
+    reply->body = buf;
 
-    LOG_NOTICE("Stop capture request rejected: feature not supported (capture_id=%d)",
-               stop_msg->capture_id);
+    LOG_NOTICE("Stop requested for capture task %d on worker thread %u",
+               stop_msg->capture_id, snapshot.worker_thread_index);
 
     send_reply_to_http(stop_msg->reply_target, reply);
 }
@@ -1656,11 +1825,36 @@ void CRxCaptureManagerThread::handle_query_capture(shared_ptr<normal_msg>& msg)
     if (snapshot.port_filter > 0) {
         oss << ",\"port\":" << snapshot.port_filter;
     }
+    // Running captures publish counters straight from the worker; the task
+    // record only gets totals when the capture finishes.
+    unsigned long packets = snapshot.packet_count;
+    unsigned long bytes = snapshot.bytes_captured;
+    CaptureProgressStats live;
+    uint32_t segments = 0;
+    bool has_live = snapshot.status == STATUS_RUNNING &&
+                    CRxProgressBoard::instance()->read(snapshot.capture_id, live, &segments);
+    if (has_live) {
+        packets = live.packets;
+        bytes = live.bytes;
+    }
+
     oss << ",\"start_time\":" << snapshot.start_time
         << ",\"end_time\":" << snapshot.end_time
-        << ",\"packets\":" << snapshot.packet_count
-        << ",\"bytes\":" << snapshot.bytes_captured
-        << ",\"worker\":" << snapshot.worker_thread_index;
+        << ",\"packets\":" << packets
+        << ",\"bytes\":" << bytes
+        << ",\"worker\":" << snapshot.worker_thread_index
+        << ",\"priority\":\"" << capture_priority_to_string(snapshot.priority) << "\"";
+
+    size_t queue_position = _scheduler.position(snapshot.capture_id);
+    if (queue_position > 0) {
+        oss << ",\"queue_position\":" << queue_position;
+    }
+    if (has_live) {
+        if (live.last_packet_ts > 0) {
+            oss << ",\"last_packet_ts\":" << live.last_packet_ts;
+        }
+        oss << ",\"segments\":" << segments;
+    }
 
 
     if (snapshot.status == STATUS_RUNNING || snapshot.status == STATUS_RESOLVING) {
@@ -1717,9 +1911,6 @@ void CRxCaptureManagerThread::handle_query_capture(shared_ptr<normal_msg>& msg)
             if (info.compress_finish_ts > 0) {
                 oss << ",\"compressed_at\":" << info.compress_finish_ts;
             }
-            if (!info.record_path.empty()) {
-                oss << ",\"record\":\"" << json_escape(info.record_path) << "\"";
-            }
             oss << "}";
         }
         oss << "]";
@@ -1900,34 +2091,19 @@ void CRxCaptureManagerThread::handle_capture_started_v2(shared_ptr<normal_msg>&
                started->capture_id, started->sender_thread_index);
 }
 
-void CRxCaptureManagerThread::handle_capture_progress_v2(shared_ptr<normal_msg>& msg)
+void CRxCaptureManagerThread::handle_capture_file_batch_v2(shared_ptr<normal_msg>& msg)
 {
-    shared_ptr<SRxCaptureProgressMsgV2> progress =
-        dynamic_pointer_cast<SRxCaptureProgressMsgV2>(msg);
-    if (!progress) {
-        LOG_WARNING("handle_capture_progress_v2: invalid message type");
+    shared_ptr<SRxCaptureFileBatchMsgV2> batch =
+        dynamic_pointer_cast<SRxCaptureFileBatchMsgV2>(msg);
+    if (!batch) {
+        LOG_WARNING("handle_capture_file_batch_v2: invalid message type");
         return;
     }
 
-    CRxProcData* global_data = CRxProcData::instance();
-    if (!global_data) {
-        return;
+    for (size_t i = 0; i < batch->items.size(); ++i) {
+        shared_ptr<normal_msg> item = static_pointer_cast<normal_msg>(batch->items[i]);
+        handle_capture_file_ready_v2(item);
     }
-
-    CRxSafeTaskMgr& task_mgr = global_data->capture_task_mgr();
-    int64_t last_ts = progress->progress.last_packet_ts != 0
-        ? progress->progress.last_packet_ts
-        : progress->report_ts;
-
-    task_mgr.update_progress(progress->capture_id,
-                             progress->progress.packets,
-                             progress->progress.bytes,
-                             last_ts);
-
-    LOG_DEBUG("Task %d progress: packets=%lu bytes=%lu",
-              progress->capture_id,
-              progress->progress.packets,
-              progress->progress.bytes);
 }
 
 void CRxCaptureManagerThread::handle_capture_file_ready_v2(shared_ptr<normal_msg>& msg)
@@ -2001,6 +2177,9 @@ void CRxCaptureManagerThread::handle_capture_finished_v2(shared_ptr<normal_msg>&
 
     CRxSafeTaskMgr& task_mgr = global_data->capture_task_mgr();
 
+    task_mgr.update_task(finished->capture_id, RecordLossFunctor(finished->result.loss));
+    log_capture_loss(finished->capture_id, finished->result.loss);
+
     if (finished->result.exit_code == 0) {
         task_mgr.set_capture_finished(finished->capture_id,
                                       finished->result.finish_ts,
@@ -2033,6 +2212,7 @@ void CRxCaptureManagerThread::handle_capture_finished_v2(shared_ptr<normal_msg>&
     }
 
     clear_module_cooldown_for_capture(finished->capture_id);
+    release_capture_slot(finished->capture_id);
 }
 
 void CRxCaptureManagerThread::handle_capture_failed_v2(shared_ptr<normal_msg>& msg)
@@ -2059,6 +2239,7 @@ void CRxCaptureManagerThread::handle_capture_failed_v2(shared_ptr<normal_msg>& m
     LOG_WARNING("Task %d failed: %s", failed->capture_id, message.c_str());
 
     clear_module_cooldown_for_capture(failed->capture_id);
+    release_capture_slot(failed->capture_id);
 }
 
 void CRxCaptureManagerThread::handle_capture_raw_file_v2(shared_ptr<normal_msg>& msg)
@@ -2073,15 +2254,26 @@ void CRxCaptureManagerThread::handle_capture_raw_file_v2(shared_ptr<normal_msg>&
         return;
     }
 
+    // The worker is done with the interface once the raw file is handed over;
+    // PDEF filtering runs on the filter threads.
+    release_capture_slot(raw->capture_id);
+
     fprintf(stderr, "[DEBUG MGR RAW] Task %d: raw_pcap_path='%s', pdef_file_path='%s'\n",
             raw->capture_id, raw->raw_pcap_path.c_str(), raw->pdef_file_path.c_str());
 
     LOG_NOTICE("Task %d: raw file ready, sending to FilterThread for PDEF filtering: %s",
                raw->capture_id, raw->raw_pcap_path.c_str());
 
+    CRxProcData* global_data = CRxProcData::instance();
+    if (global_data) {
+        global_data->capture_task_mgr().update_task(raw->capture_id, RecordLossFunctor(raw->loss));
+    }
+    log_capture_loss(raw->capture_id, raw->loss);
+
 
-    if (!raw->pdef_file_path.empty()) {
-        track_pdef_usage_start(raw->capture_id, raw->pdef_file_path);
+    std::vector<std::string> pdef_paths = CRxProtocolDispatcher::split_list(raw->pdef_file_path);
+    for (size_t i = 0; i < pdef_paths.size(); ++i) {
+        track_pdef_usage_start(raw->capture_id, pdef_paths[i]);
     }
 
 
@@ -2091,15 +2283,15 @@ void CRxCaptureManagerThread::handle_capture_raw_file_v2(shared_ptr<normal_msg>&
         LOG_ERROR("No FilterThread available for PDEF filtering");
         fprintf(stderr, "[DEBUG MGR RAW] ERROR: No FilterThread available!\n");
 
-        if (!raw->pdef_file_path.empty()) {
-            track_pdef_usage_end(raw->capture_id, raw->pdef_file_path);
+        for (size_t i = 0; i < pdef_paths.size(); ++i) {
+            track_pdef_usage_end(raw->capture_id, pdef_paths[i]);
         }
         return;
     }
 
-    static size_t next_filter = 0;
-    size_t filter_index = next_filter % _filter_threads.size();
-    next_filter++;
+    // Every file of a capture goes to the same filter thread, which keeps
+    // the capture's endian detection state between files.
+    size_t filter_index = static_cast<size_t>(raw->capture_id > 0 ? raw->capture_id : 0) % _filter_threads.size();
 
     CRxFilterThread* filter_thread = _filter_threads[filter_index];
     if (!filter_thread) {
@@ -2145,15 +2337,29 @@ void CRxCaptureManagerThread::handle_capture_filtered_file_v2(shared_ptr<normal_
     file_info.file_ready_ts = rx_capture_now_usec();
 
     std::vector<CaptureFileInfo> files;
-    files.push_back(file_info);
+    if (filtered->protocol_files.empty()) {
+        files.push_back(file_info);
+    } else {
+        files = filtered->protocol_files;
+        for (size_t i = 0; i < files.size(); ++i) {
+            files[i].file_ready_ts = file_info.file_ready_ts;
+        }
+    }
     task_mgr.append_capture_files(filtered->capture_id, files);
 
+    TaskSnapshot snapshot;
+    bool stopped = task_mgr.query_task(filtered->capture_id, snapshot) && snapshot.stop_requested;
 
     task_mgr.set_capture_finished(filtered->capture_id,
                                   rx_capture_now_usec(),
                                   filtered->total_packets,
                                   filtered->file_size,
                                   filtered->filtered_pcap_path);
+    if (stopped) {
+        task_mgr.update_task(filtered->capture_id,
+                             MarkStoppedFunctor(0, filtered->total_packets, filtered->file_size, "stopped by user"));
+        task_mgr.update_status(filtered->capture_id, STATUS_STOPPED);
+    }
 
     LOG_NOTICE("Task %d: PDEF filtered file ready: %s (%lu/%lu packets kept)",
                filtered->capture_id,
@@ -2164,9 +2370,10 @@ void CRxCaptureManagerThread::handle_capture_filtered_file_v2(shared_ptr<normal_
     clear_module_cooldown_for_capture(filtered->capture_id);
 
 
-    if (!filtered->pdef_file_path.empty()) {
-        track_pdef_usage_end(filtered->capture_id, filtered->pdef_file_path);
-        try_writeback_pdef_endian(filtered->pdef_file_path);
+    std::vector<std::string> pdef_paths = CRxProtocolDispatcher::split_list(filtered->pdef_file_path);
+    for (size_t i = 0; i < pdef_paths.size(); ++i) {
+        track_pdef_usage_end(filtered->capture_id, pdef_paths[i]);
+        try_writeback_pdef_endian(pdef_paths[i]);
     }
 }
 
@@ -2250,6 +2457,28 @@ void CRxCaptureManagerThread::start_clean_timer()
     }
 }
 
+void CRxCaptureManagerThread::start_journal_timer(int type)
+{
+    CRxProcData* p_data = CRxProcData::instance();
+    CRxServerConfig* cfg = p_data ? p_data->server_config() : NULL;
+    if (!cfg || !p_data->task_journal().is_open()) {
+        return;
+    }
+    const CRxServerConfig::JournalConfig& journal = cfg->journal();
+    uint32_t interval_ms = type == TIMER_TYPE_JOURNAL_SYNC
+        ? journal.sync_interval_ms
+        : journal.compact_interval_sec * 1000U;
+    if (interval_ms == 0) {
+        return;
+    }
+
+    shared_ptr<timer_msg> t_msg(new timer_msg);
+    t_msg->_timer_type = type;
+    t_msg->_time_length = interval_ms;
+    t_msg->_obj_id = OBJ_ID_THREAD;
+    add_timer(t_msg);
+}
+
 void CRxCaptureManagerThread::check_queue()
 {
     CRxProcData* p_data = CRxProcData::instance();
@@ -2270,16 +2499,62 @@ void CRxCaptureManagerThread::check_queue()
     if (!p_data->server_config())
         return;
 
-    int max_concurrent = p_data->server_config()->limits().max_concurrent_captures;
-    LOG_DEBUG("max_concurrent_captures: %d", max_concurrent);
+    uint64_t now_ms = GetMilliSecond();
+    if (_last_rate_sample_ms > 0 && now_ms > _last_rate_sample_ms) {
+        _scheduler.sample_rates(static_cast<double>(now_ms - _last_rate_sample_ms) / 1000.0);
+    }
+    _last_rate_sample_ms = now_ms;
 
-    if ((int)running_size < max_concurrent && pending_size > 0)
-    {
-        LOG_NOTICE("Can start new capture task, pending queue has tasks");
+    schedule_pending();
+}
+
+int CRxCaptureManagerThread::get_max_pending_limit()
+{
+    CRxProcData* global_data = CRxProcData::instance();
+    if (global_data && global_data->server_config()) {
+        int max_pending = global_data->server_config()->limits().max_pending_captures;
+        return max_pending > 0 ? max_pending : 0;
+    }
+    return 0;
+}
+
+void CRxCaptureManagerThread::schedule_pending()
+{
+    CRxProcData* global_data = CRxProcData::instance();
+    int max_per_iface = 0;
+    if (global_data && global_data->server_config()) {
+        max_per_iface = global_data->server_config()->limits().max_captures_per_iface;
+    }
+    _scheduler.set_limits(get_max_concurrent_limit(), max_per_iface,
+                          static_cast<size_t>(get_max_pending_limit()));
 
+    int capture_id = 0;
+    uint32_t worker = 0;
+    while (_scheduler.next(capture_id, worker)) {
+        std::map<int, PendingStart>::iterator it = _pending_starts.find(capture_id);
+        if (it == _pending_starts.end()) {
+            _scheduler.release(capture_id);
+            continue;
+        }
+        PendingStart pending = it->second;
+        _pending_starts.erase(it);
+
+        dispatch_task_to_worker(capture_id, worker, pending.task_key, pending.sid,
+                                pending.spec, pending.config, pending.start_msg);
+    }
+
+    if (_scheduler.pending() > 0) {
+        LOG_DEBUG("check_queue: %zu capture(s) waiting, running=%zu",
+                  _scheduler.pending(), _scheduler.running());
     }
 }
 
+void CRxCaptureManagerThread::release_capture_slot(int capture_id)
+{
+    _scheduler.release(capture_id);
+    schedule_pending();
+}
+
 void CRxCaptureManagerThread::clean_expired_files()
 {
     LOG_DEBUG("clean_expired_files");
@@ -6,6 +6,7 @@
 #include "rxcapturetasktypes.h"
 #include "rxprocessresolver.h"
 #include "rxcapturemessages.h"
+#include "rxcapturescheduler.h"
 using compat::shared_ptr;
 using compat::weak_ptr;
 using compat::static_pointer_cast;
@@ -19,11 +20,14 @@ using compat::make_shared;
 
 enum ERxCaptureTimer {
     TIMER_TYPE_QUEUE_CHECK = 1,
-    TIMER_TYPE_EXPIRE_CLEAN = 2
+    TIMER_TYPE_EXPIRE_CLEAN = 2,
+    TIMER_TYPE_JOURNAL_SYNC = 3,
+    TIMER_TYPE_JOURNAL_COMPACT = 4
 };
 
 
 static const int QUEUE_TIMER_INTERVAL_MS = 1000;
+static const uint64_t JOURNAL_COMPACT_MIN_RECORDS = 4096;
 
 struct SRxSampleMsg;
 
@@ -51,8 +55,8 @@ private:
     void handle_query_capture(shared_ptr<normal_msg>& msg);
     void handle_task_update(shared_ptr<normal_msg>& msg);
     void handle_capture_started_v2(shared_ptr<normal_msg>& msg);
-    void handle_capture_progress_v2(shared_ptr<normal_msg>& msg);
     void handle_capture_file_ready_v2(shared_ptr<normal_msg>& msg);
+    void handle_capture_file_batch_v2(shared_ptr<normal_msg>& msg);
     void handle_capture_finished_v2(shared_ptr<normal_msg>& msg);
     void handle_capture_failed_v2(shared_ptr<normal_msg>& msg);
     void handle_capture_raw_file_v2(shared_ptr<normal_msg>& msg);
@@ -71,7 +75,10 @@ private:
 
     void start_queue_timer();
     void start_clean_timer();
+    void start_journal_timer(int type);
     void check_queue();
+    void schedule_pending();
+    void release_capture_slot(int capture_id);
     void clean_expired_files();
     void check_system_threshold();
 
@@ -81,6 +88,7 @@ private:
     std::string generate_task_key(const shared_ptr<SRxStartCaptureMsg>& start_msg);
     bool check_task_duplicate(const std::string& task_key, int& existing_id, std::string& existing_status);
     int get_max_concurrent_limit();
+    int get_max_pending_limit();
     void count_active_tasks(size_t& running_count, size_t& pending_count);
     void create_duplicate_error_reply(shared_ptr<SRxHttpReplyMsg>& reply,
                                        const std::string& task_key,
@@ -93,9 +101,16 @@ private:
                                      const std::string& task_key,
                                      const std::string& signature,
                                      const std::string& sid,
-                                     const std::vector<SProcessInfo>& matched_processes,
-                                     shared_ptr<SRxHttpReplyMsg>& reply);
+                                     const std::vector<SProcessInfo>& matched_processes);
+    void create_start_reply(shared_ptr<SRxHttpReplyMsg>& reply,
+                            int capture_id,
+                            const shared_ptr<SRxStartCaptureMsg>& start_msg,
+                            const std::string& task_key,
+                            const std::string& sid,
+                            size_t matched_pids,
+                            size_t queue_position);
     void dispatch_task_to_worker(int capture_id,
+                                 uint32_t worker,
                                  const std::string& task_key,
                                  const std::string& sid,
                                  const CaptureSpec& spec,
@@ -112,6 +127,7 @@ private:
 
 private:
     bool _is_first;
+    int _next_capture_id;
 
     std::vector<class CRxCaptureThread*> _capture_threads;
     std::vector<class CRxFilterThread*> _filter_threads;
@@ -120,6 +136,17 @@ private:
     std::vector<uint32_t> _worker_thd_vec;
     std::map<std::string, time_t> _module_last_trigger;
 
+    struct PendingStart {
+        std::string task_key;
+        std::string sid;
+        CaptureSpec spec;
+        CaptureConfigSnapshot config;
+        shared_ptr<SRxStartCaptureMsg> start_msg;
+    };
+    CRxCaptureScheduler _scheduler;
+    std::map<int, PendingStart> _pending_starts;
+    uint64_t _last_rate_sample_ms;
+
 
     struct PDEFUsageInfo {
         std::set<int> active_capture_ids;
@@ -74,6 +74,8 @@ struct CaptureConfigSnapshot {
     long max_bytes;
     int max_packets;
     int snaplen;
+    std::string rate_ladder;
+    double rate_drop_pct;
 
     bool compress_enabled;
     int compress_threshold_mb;
@@ -99,9 +101,10 @@ struct CaptureConfigSnapshot {
         , max_bytes(0)
         , max_packets(0)
         , snaplen(65535)
+        , rate_drop_pct(0.1)
         , compress_enabled(true)
         , compress_threshold_mb(100)
-        , compress_format("tar.gz")
+        , compress_format("pcap.gz")
         , compress_level(6)
         , compress_remove_src(false)
         , retain_days(7)
@@ -139,6 +142,14 @@ struct CaptureSpec {
     int max_packets;
     int snaplen;
 
+    std::string replay_file;
+    double replay_speed;
+    long replay_pps;
+    int replay_loops;
+
+    bool stats_only;
+    std::string aggregate_fields;
+
     CaptureSpec()
         : capture_mode(MODE_INTERFACE)
         , target_pid(-1)
@@ -147,6 +158,10 @@ struct CaptureSpec {
         , max_bytes(0)
         , max_packets(0)
         , snaplen(65535)
+        , replay_speed(0.0)
+        , replay_pps(0)
+        , replay_loops(1)
+        , stats_only(false)
     {
     }
 };
@@ -177,6 +192,7 @@ struct CaptureResultStats {
     int64_t finish_ts;
     int exit_code;
     std::string error_message;
+    CaptureLossStats loss;
 
     CaptureResultStats()
         : total_packets(0)
@@ -262,22 +278,22 @@ struct SRxCaptureStartedMsgV2 : public CaptureMessageBase {
     }
 };
 
-struct SRxCaptureProgressMsgV2 : public CaptureMessageBase {
-    CaptureProgressStats progress;
-    int64_t report_ts;
+struct SRxCaptureFileReadyMsgV2 : public CaptureMessageBase {
+    std::vector<CaptureFileInfo> files;
 
-    SRxCaptureProgressMsgV2()
-        : CaptureMessageBase(RX_MSG_CAPTURE_PROGRESS)
-        , report_ts(rx_capture_now_usec())
+    SRxCaptureFileReadyMsgV2()
+        : CaptureMessageBase(RX_MSG_CAPTURE_FILE_READY)
     {
     }
 };
 
-struct SRxCaptureFileReadyMsgV2 : public CaptureMessageBase {
-    std::vector<CaptureFileInfo> files;
+// File-ready notifications a capture worker accumulated over one batching
+// interval, possibly for several captures.
+struct SRxCaptureFileBatchMsgV2 : public normal_msg {
+    std::vector<shared_ptr<SRxCaptureFileReadyMsgV2> > items;
 
-    SRxCaptureFileReadyMsgV2()
-        : CaptureMessageBase(RX_MSG_CAPTURE_FILE_READY)
+    SRxCaptureFileBatchMsgV2()
+        : normal_msg(RX_MSG_CAPTURE_FILE_BATCH)
     {
     }
 };
@@ -319,6 +335,7 @@ struct SRxCaptureRawFileMsgV2 : public CaptureMessageBase {
     std::string pdef_inline_content;
     bool has_pdef_filter;
     int manager_thread_index;
+    CaptureLossStats loss;
 
     SRxCaptureRawFileMsgV2()
         : CaptureMessageBase(RX_MSG_CAPTURE_RAW_FILE)
@@ -334,6 +351,7 @@ struct SRxCaptureFilteredFileMsgV2 : public CaptureMessageBase {
     unsigned long filtered_packets;
     unsigned long file_size;
     std::string pdef_file_path;
+    std::vector<CaptureFileInfo> protocol_files;
 
     SRxCaptureFilteredFileMsgV2()
         : CaptureMessageBase(RX_MSG_CAPTURE_FILTERED_FILE)
@@ -443,6 +461,13 @@ struct SRxStartCaptureMsg : public normal_msg {
     std::string request_user;
     uint64_t enqueue_ts_ms;
     std::string sid;
+    std::string replay_file;
+    double replay_speed;
+    long replay_pps;
+    int replay_loops;
+    bool stats_only;
+    std::string aggregate_fields;
+    int priority;
 
     SRxStartCaptureMsg()
         : normal_msg(RX_MSG_START_CAPTURE)
@@ -453,6 +478,11 @@ struct SRxStartCaptureMsg : public normal_msg {
         , max_bytes(0)
         , max_packets(0)
         , enqueue_ts_ms(0)
+        , replay_speed(0.0)
+        , replay_pps(0)
+        , replay_loops(1)
+        , stats_only(false)
+        , priority(PRIORITY_API)
     {
     }
 };
@@ -0,0 +1,152 @@
+#include "rxcaptureprogress.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+inline void write_begin(SRxProgressSlot* slot)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+inline void write_end(SRxProgressSlot* slot)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+}
+
+CRxProgressBoard* CRxProgressBoard::instance()
+{
+    static CRxProgressBoard board;
+    return &board;
+}
+
+CRxProgressBoard::CRxProgressBoard()
+{
+    memset(blocks_, 0, sizeof(blocks_));
+}
+
+SRxProgressSlot* CRxProgressBoard::claim(uint32_t worker, int capture_id)
+{
+    if (worker >= MAX_WORKERS || capture_id <= 0) {
+        return NULL;
+    }
+    SRxProgressSlot* block = __atomic_load_n(&blocks_[worker], __ATOMIC_ACQUIRE);
+    if (!block) {
+        // Only the owning worker allocates its block, so there is no race on
+        // the pointer; allocating from the worker also keeps it node-local.
+        void* mem = NULL;
+        if (posix_memalign(&mem, 64, sizeof(SRxProgressSlot) * SLOTS_PER_WORKER) != 0 || !mem) {
+            return NULL;
+        }
+        memset(mem, 0, sizeof(SRxProgressSlot) * SLOTS_PER_WORKER);
+        block = static_cast<SRxProgressSlot*>(mem);
+        __atomic_store_n(&blocks_[worker], block, __ATOMIC_RELEASE);
+    }
+
+    // Prefer never-used slots so released ones keep their final values as
+    // long as possible.
+    SRxProgressSlot* slot = NULL;
+    for (int i = 0; i < SLOTS_PER_WORKER; ++i) {
+        if (block[i].live) {
+            continue;
+        }
+        if (block[i].capture_id == 0) {
+            slot = &block[i];
+            break;
+        }
+        if (!slot) {
+            slot = &block[i];
+        }
+    }
+    if (slot) {
+        write_begin(slot);
+        __atomic_store_n(&slot->capture_id, capture_id, __ATOMIC_RELAXED);
+        slot->live = 1;
+        __atomic_store_n(&slot->packets, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->file_size, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->first_packet_ts, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->last_packet_ts, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->segments, 0, __ATOMIC_RELAXED);
+        write_end(slot);
+        return slot;
+    }
+    return NULL;
+}
+
+void CRxProgressBoard::publish(SRxProgressSlot* slot, const CaptureProgressStats& progress, uint32_t segments)
+{
+    if (!slot) {
+        return;
+    }
+    write_begin(slot);
+    __atomic_store_n(&slot->packets, progress.packets, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes, progress.bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->file_size, progress.file_size, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->first_packet_ts, progress.first_packet_ts, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->last_packet_ts, progress.last_packet_ts, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->segments, segments, __ATOMIC_RELAXED);
+    write_end(slot);
+}
+
+void CRxProgressBoard::release(SRxProgressSlot* slot)
+{
+    if (!slot) {
+        return;
+    }
+    // Only the owner reads live, so no barrier is needed.
+    slot->live = 0;
+}
+
+bool CRxProgressBoard::read(int capture_id, CaptureProgressStats& out, uint32_t* segments) const
+{
+    if (capture_id <= 0) {
+        return false;
+    }
+    for (int w = 0; w < MAX_WORKERS; ++w) {
+        const SRxProgressSlot* block = __atomic_load_n(&blocks_[w], __ATOMIC_ACQUIRE);
+        if (!block) {
+            continue;
+        }
+        for (int i = 0; i < SLOTS_PER_WORKER; ++i) {
+            const SRxProgressSlot* slot = &block[i];
+            if (__atomic_load_n(&slot->capture_id, __ATOMIC_RELAXED) != capture_id) {
+                continue;
+            }
+            // Writers hold a slot for a few stores; a handful of retries is
+            // enough unless the slot is being recycled under us.
+            for (int attempt = 0; attempt < 64; ++attempt) {
+                uint32_t s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+                if (s1 & 1) {
+                    continue;
+                }
+                int32_t id = __atomic_load_n(&slot->capture_id, __ATOMIC_RELAXED);
+                CaptureProgressStats snap;
+                snap.packets = static_cast<unsigned long>(__atomic_load_n(&slot->packets, __ATOMIC_RELAXED));
+                snap.bytes = static_cast<unsigned long>(__atomic_load_n(&slot->bytes, __ATOMIC_RELAXED));
+                snap.file_size = static_cast<unsigned long>(__atomic_load_n(&slot->file_size, __ATOMIC_RELAXED));
+                snap.first_packet_ts = __atomic_load_n(&slot->first_packet_ts, __ATOMIC_RELAXED);
+                snap.last_packet_ts = __atomic_load_n(&slot->last_packet_ts, __ATOMIC_RELAXED);
+                uint32_t segs = __atomic_load_n(&slot->segments, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != s1) {
+                    continue;
+                }
+                if (id != capture_id) {
+                    break;
+                }
+                out = snap;
+                if (segments) {
+                    *segments = segs;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
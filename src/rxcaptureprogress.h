@@ -0,0 +1,50 @@
+#ifndef RX_CAPTURE_PROGRESS_H
+#define RX_CAPTURE_PROGRESS_H
+
+#include "rxcapturemessages.h"
+#include <stdint.h>
+
+// Live per-capture counters shared between capture workers and readers.
+// Each worker owns one block of slots and is the only writer to it; readers
+// (the status API) take a seqlock snapshot without locks or messages.
+struct SRxProgressSlot {
+    uint32_t seq;
+    int32_t capture_id;
+    uint32_t live;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t file_size;
+    int64_t first_packet_ts;
+    int64_t last_packet_ts;
+    uint32_t segments;
+} __attribute__((aligned(64)));
+
+class CRxProgressBoard {
+public:
+    enum {
+        MAX_WORKERS = 256,
+        SLOTS_PER_WORKER = 128
+    };
+
+    static CRxProgressBoard* instance();
+
+    // Worker side. claim() returns NULL when every slot of the worker's block
+    // is live, in which case the task simply has no live progress. Released
+    // slots keep their last values, so a reader racing the finished message
+    // still sees final counters, until claim() recycles them.
+    SRxProgressSlot* claim(uint32_t worker, int capture_id);
+    static void publish(SRxProgressSlot* slot, const CaptureProgressStats& progress, uint32_t segments);
+    static void release(SRxProgressSlot* slot);
+
+    // Reader side; false when no worker is publishing for capture_id.
+    bool read(int capture_id, CaptureProgressStats& out, uint32_t* segments = NULL) const;
+
+private:
+    CRxProgressBoard();
+    CRxProgressBoard(const CRxProgressBoard&);
+    CRxProgressBoard& operator=(const CRxProgressBoard&);
+
+    SRxProgressSlot* blocks_[MAX_WORKERS];
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "rxcapturescheduler.h"
+
+uint64_t CRxCaptureScheduler::worker_packets_[CRxCaptureScheduler::MAX_THREAD_SLOTS];
+
+const char* capture_priority_to_string(int priority)
+{
+    switch (priority) {
+        case PRIORITY_BATCH: return "batch";
+        case PRIORITY_SAMPLER: return "sampler";
+        case PRIORITY_API: return "api";
+        default: return "unknown";
+    }
+}
+
+int capture_priority_from_string(const std::string& name)
+{
+    if (name == "api") {
+        return PRIORITY_API;
+    }
+    if (name == "sampler") {
+        return PRIORITY_SAMPLER;
+    }
+    if (name == "batch") {
+        return PRIORITY_BATCH;
+    }
+    return -1;
+}
+
+CRxCaptureScheduler::CRxCaptureScheduler()
+    : next_seq_(0)
+    , max_running_(1)
+    , max_per_iface_(0)
+    , max_pending_(64)
+{
+}
+
+void CRxCaptureScheduler::add_worker(uint32_t thread_index, int numa_node)
+{
+    WorkerLoad load;
+    load.thread_index = thread_index;
+    load.numa_node = numa_node;
+    if (thread_index < MAX_THREAD_SLOTS) {
+        load.last_packets = __atomic_load_n(&worker_packets_[thread_index], __ATOMIC_RELAXED);
+    }
+    workers_.push_back(load);
+}
+
+void CRxCaptureScheduler::set_limits(int max_running, int max_per_iface, size_t max_pending)
+{
+    max_running_ = max_running > 0 ? max_running : 1;
+    max_per_iface_ = max_per_iface;
+    max_pending_ = max_pending;
+}
+
+bool CRxCaptureScheduler::enqueue(int capture_id, int priority, const std::string& iface, int iface_node)
+{
+    if (pending_.size() >= max_pending_ || pending_.count(capture_id) || running_.count(capture_id)) {
+        return false;
+    }
+    Pending entry;
+    entry.key.priority = priority;
+    entry.key.seq = next_seq_++;
+    entry.key.capture_id = capture_id;
+    entry.iface = iface;
+    entry.node = iface_node;
+    pending_[capture_id] = entry;
+    queue_.insert(entry.key);
+    return true;
+}
+
+bool CRxCaptureScheduler::cancel(int capture_id)
+{
+    std::map<int, Pending>::iterator it = pending_.find(capture_id);
+    if (it == pending_.end()) {
+        return false;
+    }
+    queue_.erase(it->second.key);
+    pending_.erase(it);
+    return true;
+}
+
+bool CRxCaptureScheduler::iface_admits(const std::string& iface) const
+{
+    if (max_per_iface_ <= 0 || iface.empty()) {
+        return true;
+    }
+    std::map<std::string, int>::const_iterator it = per_iface_.find(iface);
+    return it == per_iface_.end() || it->second < max_per_iface_;
+}
+
+size_t CRxCaptureScheduler::least_loaded(int node) const
+{
+    size_t best = 0;
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        const WorkerLoad& w = workers_[i];
+        const WorkerLoad& b = workers_[best];
+        if (node >= 0) {
+            bool w_local = w.numa_node == node;
+            bool b_local = b.numa_node == node;
+            if (w_local != b_local) {
+                if (w_local) {
+                    best = i;
+                }
+                continue;
+            }
+        }
+        bool w_hot = w.pps >= DEDICATED_PPS;
+        bool b_hot = b.pps >= DEDICATED_PPS;
+        if (w_hot != b_hot) {
+            if (!w_hot) {
+                best = i;
+            }
+            continue;
+        }
+        if (w.jobs < b.jobs || (w.jobs == b.jobs && w.pps < b.pps)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool CRxCaptureScheduler::next(int& capture_id, uint32_t& worker)
+{
+    if (workers_.empty() || static_cast<int>(running_.size()) >= max_running_) {
+        return false;
+    }
+
+    for (std::set<QueueKey>::iterator it = queue_.begin(); it != queue_.end(); ++it) {
+        std::map<int, Pending>::iterator pit = pending_.find(it->capture_id);
+        if (!iface_admits(pit->second.iface)) {
+            continue;
+        }
+
+        size_t slot = least_loaded(pit->second.node);
+        Running run;
+        run.iface = pit->second.iface;
+        run.worker = slot;
+        running_[it->capture_id] = run;
+        if (!run.iface.empty()) {
+            per_iface_[run.iface]++;
+        }
+        workers_[slot].jobs++;
+
+        capture_id = it->capture_id;
+        worker = workers_[slot].thread_index;
+        pending_.erase(pit);
+        queue_.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void CRxCaptureScheduler::release(int capture_id)
+{
+    std::map<int, Running>::iterator it = running_.find(capture_id);
+    if (it == running_.end()) {
+        return;
+    }
+    if (!it->second.iface.empty()) {
+        std::map<std::string, int>::iterator iface = per_iface_.find(it->second.iface);
+        if (iface != per_iface_.end() && --iface->second <= 0) {
+            per_iface_.erase(iface);
+        }
+    }
+    if (workers_[it->second.worker].jobs > 0) {
+        workers_[it->second.worker].jobs--;
+    }
+    running_.erase(it);
+}
+
+void CRxCaptureScheduler::sample_rates(double elapsed_sec)
+{
+    if (elapsed_sec <= 0.0) {
+        return;
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        WorkerLoad& w = workers_[i];
+        if (w.thread_index >= MAX_THREAD_SLOTS) {
+            continue;
+        }
+        uint64_t packets = __atomic_load_n(&worker_packets_[w.thread_index], __ATOMIC_RELAXED);
+        double rate = packets >= w.last_packets
+            ? static_cast<double>(packets - w.last_packets) / elapsed_sec : 0.0;
+        w.last_packets = packets;
+        w.pps = w.pps * 0.5 + rate * 0.5;
+    }
+}
+
+size_t CRxCaptureScheduler::position(int capture_id) const
+{
+    size_t pos = 1;
+    for (std::set<QueueKey>::const_iterator it = queue_.begin(); it != queue_.end(); ++it, ++pos) {
+        if (it->capture_id == capture_id) {
+            return pos;
+        }
+    }
+    return 0;
+}
+
+void CRxCaptureScheduler::publish_worker_packets(uint32_t thread_index, uint64_t packets)
+{
+    if (thread_index < MAX_THREAD_SLOTS) {
+        __atomic_store_n(&worker_packets_[thread_index], packets, __ATOMIC_RELAXED);
+    }
+}
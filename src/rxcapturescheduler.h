@@ -0,0 +1,112 @@
+#ifndef RX_CAPTURE_SCHEDULER_H
+#define RX_CAPTURE_SCHEDULER_H
+
+#include "rxcapturetasktypes.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+const char* capture_priority_to_string(int priority);
+// Returns -1 for an unknown name.
+int capture_priority_from_string(const std::string& name);
+
+// Pending capture queue and worker placement. Owned by the manager thread and
+// not locked; capture workers only touch it through publish_worker_packets(),
+// a relaxed atomic store into a per-thread slot.
+class CRxCaptureScheduler {
+public:
+    enum {
+        MAX_THREAD_SLOTS = 256,
+        // A worker above this rate is treated as dedicated to its current
+        // capture(s) and only receives new work when every worker is.
+        DEDICATED_PPS = 200000
+    };
+
+    struct WorkerLoad {
+        uint32_t thread_index;
+        int numa_node;
+        int jobs;
+        uint64_t last_packets;
+        double pps;
+
+        WorkerLoad() : thread_index(0), numa_node(-1), jobs(0), last_packets(0), pps(0.0) {}
+    };
+
+    CRxCaptureScheduler();
+
+    void add_worker(uint32_t thread_index, int numa_node = -1);
+
+    // max_per_iface <= 0 means no per-interface limit.
+    void set_limits(int max_running, int max_per_iface, size_t max_pending);
+
+    // Returns false when the pending queue is full. iface_node is the NUMA
+    // node of the capture NIC (-1 if unknown); workers on that node are
+    // preferred when the task is placed.
+    bool enqueue(int capture_id, int priority, const std::string& iface, int iface_node = -1);
+    bool cancel(int capture_id);
+
+    // Pops the highest priority task that fits the running limits (FIFO within
+    // a priority; a task blocked by its interface limit does not hold back
+    // tasks on other interfaces) and assigns it the least loaded worker.
+    bool next(int& capture_id, uint32_t& worker);
+
+    // Frees the running slot taken by next(). Unknown ids are ignored.
+    void release(int capture_id);
+
+    // Called about once a second; turns published packet counters into rates.
+    void sample_rates(double elapsed_sec);
+
+    size_t pending() const { return pending_.size(); }
+    size_t running() const { return running_.size(); }
+    // 1-based position in dispatch order, 0 when not queued.
+    size_t position(int capture_id) const;
+    const std::vector<WorkerLoad>& workers() const { return workers_; }
+
+    static void publish_worker_packets(uint32_t thread_index, uint64_t packets);
+
+private:
+    struct QueueKey {
+        int priority;
+        uint64_t seq;
+        int capture_id;
+
+        bool operator<(const QueueKey& other) const
+        {
+            if (priority != other.priority) {
+                return priority > other.priority;
+            }
+            return seq < other.seq;
+        }
+    };
+
+    struct Pending {
+        QueueKey key;
+        std::string iface;
+        int node;
+    };
+
+    struct Running {
+        std::string iface;
+        size_t worker;
+    };
+
+    bool iface_admits(const std::string& iface) const;
+    size_t least_loaded(int node) const;
+
+    std::set<QueueKey> queue_;
+    std::map<int, Pending> pending_;
+    std::map<int, Running> running_;
+    std::map<std::string, int> per_iface_;
+    std::vector<WorkerLoad> workers_;
+    uint64_t next_seq_;
+    int max_running_;
+    int max_per_iface_;
+    size_t max_pending_;
+
+    static uint64_t worker_packets_[MAX_THREAD_SLOTS];
+};
+
+#endif
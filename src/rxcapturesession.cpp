@@ -2,10 +2,17 @@
 #include <time.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 
 #include "pdef/parser.h"
 #include "runtime/protocol.h"
+#include "rxcapturemessages.h"
+#include "rxmetrics.h"
+#include "rxpdefbpf.h"
+#include "rxpdefcache.h"
+#include "rxprotocoldispatcher.h"
+#include <string.h>
 
 static unsigned long now_sec()
 {
@@ -13,9 +20,15 @@ static unsigned long now_sec()
 }
 
 CRxCaptureJob::CRxCaptureJob(const CRxCaptureTaskCfg& cfg, const CRxCaptureTaskInfo* parent_task_info)
-    : cfg_(cfg), parent_task_info_(parent_task_info), pcap_handle_(NULL), done_(false), packets_(0), end_time_sec_(0),
-      filter_thread_(NULL), use_filter_thread_(false)
+    : cfg_(cfg), parent_task_info_(parent_task_info), source_(NULL), pcap_handle_(NULL), done_(false), packets_(0), end_time_sec_(0),
+      last_stats_sec_(0), filter_thread_(NULL), use_filter_thread_(false), stats_(NULL), stats_producer_(0),
+      start_sec_(0), dispatch_calls_(0), full_batches_(0), sample_n_(0), sample_next_cb_(NULL), sample_next_user_(NULL),
+      handle_generation_(0), segments_taken_(0)
 {
+    memset(&last_pcap_stats_, 0, sizeof(last_pcap_stats_));
+    dumper_context_.written = 0;
+    dumper_context_.closed_bytes = 0;
+    dumper_context_.seq = 0;
 }
 
 CRxCaptureJob::~CRxCaptureJob()
@@ -24,6 +37,38 @@ CRxCaptureJob::~CRxCaptureJob()
     if (pcap_handle_) {
         cleanup();
     }
+    delete stats_;
+    delete source_;
+}
+
+void CRxCaptureJob::install_filter()
+{
+    CRxPdefCache* pdef_cache = CRxPdefCache::instance();
+    const ProtocolDef* def = NULL;
+    char errmsg[512];
+    errmsg[0] = '\0';
+
+    // Stats-only captures count every packet, so they never get a PDEF prefilter.
+    if (!cfg_.stats_only && !cfg_.protocol_filter_inline.empty()) {
+        def = pdef_cache->acquire_source(cfg_.protocol_filter_inline, std::string(), errmsg, sizeof(errmsg));
+    } else if (!cfg_.stats_only) {
+        std::vector<std::string> paths = CRxProtocolDispatcher::split_list(cfg_.protocol_filter);
+        if (paths.size() == 1) {
+            def = pdef_cache->acquire_file(paths[0], errmsg, sizeof(errmsg));
+        } else if (paths.size() > 1) {
+            fprintf(stderr, "[Capture] %zu PDEFs requested, prefilter left to userspace dispatch\n", paths.size());
+        }
+    }
+    CRxPdefHandle pdef(pdef_cache, def);
+
+    std::string detail;
+    // Filter threads judge flows, not packets: only the flow-agnostic part of
+    // the PDEF may run in the kernel.
+    if (CRxPdefBpf::install(pcap_handle_, cfg_.bpf, def, false, detail)) {
+        fprintf(stderr, "[Capture] PDEF %s prefilter installed in BPF (%s)\n", def->name, detail.c_str());
+    } else if (def) {
+        fprintf(stderr, "[Capture] PDEF %s kept in userspace: %s\n", def->name, detail.c_str());
+    }
 }
 
 bool CRxCaptureJob::prepare()
@@ -31,28 +76,48 @@ bool CRxCaptureJob::prepare()
     char errbuf[PCAP_ERRBUF_SIZE];
     errbuf[0] = '\0';
 
-    pcap_handle_ = pcap_open_live(cfg_.iface.c_str(), 65535, 1, 1000, errbuf);
-    if (!pcap_handle_) {
-        fprintf(stderr, "pcap_open_live failed for %s: %s\n", cfg_.iface.c_str(), errbuf);
+    delete source_;
+    source_ = CRxCaptureSource::create(cfg_);
+    if (!source_) {
         return false;
     }
+    if (!source_->open(errbuf)) {
+        fprintf(stderr, "%s capture open failed for %s: %s\n", source_->kind(),
+                cfg_.replay_file.empty() ? cfg_.iface.c_str() : cfg_.replay_file.c_str(), errbuf);
+        delete source_;
+        source_ = NULL;
+        return false;
+    }
+    pcap_handle_ = source_->handle();
+    handle_generation_++;
 
-    if (!cfg_.bpf.empty()) {
-        struct bpf_program bpf;
-        if (pcap_compile(pcap_handle_, &bpf, cfg_.bpf.c_str(), 1, PCAP_NETMASK_UNKNOWN) == 0) {
-            pcap_setfilter(pcap_handle_, &bpf);
-            pcap_freecode(&bpf);
-        } else {
-            fprintf(stderr, "pcap_compile failed for BPF: %s\n", cfg_.bpf.c_str());
+    install_filter();
 
+    start_sec_ = now_sec();
+    if (!cfg_.rate_ladder.empty() && cfg_.replay_file.empty()) {
+        std::string rate_error;
+        if (!rate_.configure(cfg_.rate_ladder, cfg_.rate_drop_pct, rate_error)) {
+            fprintf(stderr, "[Capture] rate control disabled: %s\n", rate_error.c_str());
         }
     }
 
-    errbuf[0] = '\0';
-    if (pcap_setnonblock(pcap_handle_, 1, errbuf) == -1) {
-        fprintf(stderr, "pcap_setnonblock failed for %s: %s\n", cfg_.iface.c_str(),
-                errbuf[0] ? errbuf : "unknown error");
+    if (cfg_.duration_sec > 0) {
+        end_time_sec_ = now_sec() + (unsigned long)cfg_.duration_sec;
+    }
 
+    if (cfg_.stats_only) {
+        if (!prepare_stats()) {
+            delete stats_;
+            stats_ = NULL;
+            for (size_t i = 0; i < stats_defs_.size(); ++i) {
+                CRxPdefCache::instance()->release(stats_defs_[i]);
+            }
+            stats_defs_.clear();
+            source_->close();
+            pcap_handle_ = NULL;
+            return false;
+        }
+        return true;
     }
 
     dumper_context_.p = pcap_handle_;
@@ -60,11 +125,13 @@ bool CRxCaptureJob::prepare()
     dumper_context_.max_bytes = cfg_.max_bytes;
     dumper_context_.seq = 0;
     dumper_context_.written = 0;
+    dumper_context_.closed_bytes = 0;
+    dumper_context_.closed_paths.clear();
     dumper_context_.start_time = time(NULL);
     dumper_context_.base_dir = parent_task_info_->base_dir;
     dumper_context_.pattern = cfg_.file_pattern;
     dumper_context_.category = cfg_.category;
-    dumper_context_.iface = cfg_.iface;
+    dumper_context_.iface = cfg_.replay_file.empty() ? cfg_.iface : source_->label();
     dumper_context_.proc = cfg_.proc_name;
     dumper_context_.port = cfg_.port;
     dumper_context_.compress_enabled = parent_task_info_->compress_enabled;
@@ -85,7 +152,7 @@ bool CRxCaptureJob::prepare()
         CRxStorageUtils::rotate_open(&dumper_context_);
         if (!dumper_context_.d) {
             fprintf(stderr, "pcap_dump_open failed (pattern): %s\n", pcap_geterr(pcap_handle_));
-            pcap_close(pcap_handle_);
+            source_->close();
             pcap_handle_ = NULL;
             return false;
         }
@@ -94,47 +161,225 @@ bool CRxCaptureJob::prepare()
         dumper_context_.current_path = cfg_.outfile;
         if (!dumper_context_.d) {
             fprintf(stderr, "pcap_dump_open failed for %s: %s\n", cfg_.outfile.c_str(), pcap_geterr(pcap_handle_));
-            pcap_close(pcap_handle_);
+            source_->close();
             pcap_handle_ = NULL;
             return false;
         }
     } else {
         fprintf(stderr, "No output file or pattern specified\n");
-        pcap_close(pcap_handle_);
+        source_->close();
         pcap_handle_ = NULL;
         return false;
     }
 
-    if (cfg_.duration_sec > 0) {
-        end_time_sec_ = now_sec() + (unsigned long)cfg_.duration_sec;
+    return true;
+}
+
+bool CRxCaptureJob::prepare_stats()
+{
+    CRxPdefCache* pdef_cache = CRxPdefCache::instance();
+    char errmsg[512];
+    errmsg[0] = '\0';
+
+    if (!cfg_.protocol_filter_inline.empty()) {
+        const ProtocolDef* def = pdef_cache->acquire_source(cfg_.protocol_filter_inline, std::string(),
+                                                            errmsg, sizeof(errmsg));
+        if (!def) {
+            fprintf(stderr, "[Stats] failed to load inline PDEF: %s\n", errmsg);
+            return false;
+        }
+        stats_defs_.push_back(def);
+    } else {
+        std::vector<std::string> paths = CRxProtocolDispatcher::split_list(cfg_.protocol_filter);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            const ProtocolDef* def = pdef_cache->acquire_file(paths[i], errmsg, sizeof(errmsg));
+            if (!def) {
+                fprintf(stderr, "[Stats] failed to load PDEF %s: %s\n", paths[i].c_str(), errmsg);
+                return false;
+            }
+            stats_defs_.push_back(def);
+        }
+    }
+
+    stats_ = new (std::nothrow) CRxStatsAggregator();
+    if (!stats_) {
+        return false;
+    }
+    std::string error;
+    if (!stats_->init(stats_defs_, cfg_.aggregate_fields, pcap_datalink(pcap_handle_), error)) {
+        fprintf(stderr, "[Stats] aggregation setup failed: %s\n", error.c_str());
+        return false;
     }
 
+    fprintf(stderr, "[Stats] Stats-only mode: %zu PDEF(s), fields='%s', no packets written\n",
+            stats_defs_.size(), cfg_.aggregate_fields.c_str());
     return true;
 }
 
+void CRxCaptureJob::publish_stats(bool finished)
+{
+    if (!stats_) {
+        return;
+    }
+    SRxStatsSnapshot snap;
+    stats_->snapshot(snap, CRxStatsAggregator::PUBLISH_TOP);
+    CRxStatsRegistry::instance()->publish(parent_task_info_->id, stats_producer_, snap, finished);
+}
+
 int CRxCaptureJob::run_once()
 {
     if (is_done()) {
         return -2;
     }
 
-    int ret = pcap_dispatch(pcap_handle_, 100, CRxStorageUtils::dump_cb, (u_char*)&dumper_context_);
+    uint64_t dispatch_start_ns = CRxMetrics::now_ns();
+    pcap_handler cb = stats_ ? CRxStatsAggregator::pcap_cb : CRxStorageUtils::dump_cb;
+    u_char* user = stats_ ? (u_char*)stats_ : (u_char*)&dumper_context_;
+    int ret;
+    if (sample_n_ > 1) {
+        sample_next_cb_ = cb;
+        sample_next_user_ = user;
+        ret = source_->dispatch(DISPATCH_BATCH, sample_cb, (u_char*)this);
+    } else {
+        ret = source_->dispatch(DISPATCH_BATCH, cb, user);
+    }
 
+    dispatch_calls_++;
+    if (ret >= DISPATCH_BATCH) {
+        full_batches_++;
+    }
     if (ret > 0) {
         packets_ += (unsigned long)ret;
+        CRxMetrics::observe_ns(RX_HIST_CAPTURE_DISPATCH, CRxMetrics::now_ns() - dispatch_start_ns);
     }
 
-    if (ret == 0) {
-        usleep(1000);
-    } else if (ret < 0) {
-        usleep(1000);
+    if (parent_task_info_->stopping || source_->exhausted()) {
+        done_ = true;
     }
 
-    if (parent_task_info_->stopping || (end_time_sec_ > 0 && now_sec() >= end_time_sec_)) {
+    return ret;
+}
+
+void CRxCaptureJob::tick()
+{
+    if (is_done()) {
+        return;
+    }
+    unsigned long now = now_sec();
+    if (now != last_stats_sec_) {
+        last_stats_sec_ = now;
+        poll_pcap_stats(true);
+        publish_stats(false);
+    }
+    if (parent_task_info_->stopping || (end_time_sec_ > 0 && now >= end_time_sec_)) {
         done_ = true;
     }
+}
 
-    return ret;
+int CRxCaptureJob::selectable_fd() const
+{
+    return source_ && pcap_handle_ ? source_->selectable_fd() : -1;
+}
+
+void CRxCaptureJob::poll_pcap_stats(bool adjust)
+{
+    if (!pcap_handle_) {
+        return;
+    }
+    struct pcap_stat ps;
+    if (!source_->stats(&ps)) {
+        return;
+    }
+
+
+    CRxMetrics::inc(RX_CNT_CAPTURE_PCAP_RECV, static_cast<uint32_t>(ps.ps_recv - last_pcap_stats_.ps_recv));
+    CRxMetrics::inc(RX_CNT_CAPTURE_PCAP_DROP, static_cast<uint32_t>(ps.ps_drop - last_pcap_stats_.ps_drop));
+    CRxMetrics::inc(RX_CNT_CAPTURE_PCAP_IFDROP, static_cast<uint32_t>(ps.ps_ifdrop - last_pcap_stats_.ps_ifdrop));
+
+    uint32_t recv_delta = ps.ps_recv - last_pcap_stats_.ps_recv;
+    uint32_t drop_delta = ps.ps_drop - last_pcap_stats_.ps_drop;
+    loss_.kernel_received += recv_delta;
+    loss_.kernel_dropped += drop_delta;
+    loss_.if_dropped += ps.ps_ifdrop - last_pcap_stats_.ps_ifdrop;
+    last_pcap_stats_ = ps;
+
+    if (adjust) {
+        adjust_rate(recv_delta, drop_delta);
+    }
+}
+
+void CRxCaptureJob::adjust_rate(uint64_t recv_delta, uint64_t drop_delta)
+{
+    double backlog = dispatch_calls_ > 0 ?
+        static_cast<double>(full_batches_) / static_cast<double>(dispatch_calls_) : 0.0;
+    dispatch_calls_ = 0;
+    full_batches_ = 0;
+
+    if (!rate_.enabled()) {
+        return;
+    }
+    int index = rate_.observe(recv_delta, drop_delta, backlog);
+    if (index < 0) {
+        return;
+    }
+    apply_rate_step(rate_.step(index));
+}
+
+void CRxCaptureJob::apply_rate_step(const SRxRateStep& step)
+{
+    std::string desc = CRxRateController::describe(step);
+    bool applied = true;
+    char errbuf[PCAP_ERRBUF_SIZE];
+    errbuf[0] = '\0';
+
+    if (step.kind == RX_RATE_SAMPLE) {
+        sample_decoder_.set_linktype(pcap_datalink(pcap_handle_));
+        sample_n_ = static_cast<uint32_t>(step.value);
+    } else {
+        int buffer = step.kind == RX_RATE_BUFFER ? static_cast<int>(step.value) : 0;
+        int snaplen = step.kind == RX_RATE_SNAPLEN ? static_cast<int>(step.value) : 0;
+        // The counters die with the old handle; fold in what it saw since the last poll.
+        poll_pcap_stats(false);
+        applied = source_->reconfigure(buffer, snaplen, errbuf);
+        pcap_handle_ = source_->handle();
+        handle_generation_++;
+        dumper_context_.p = pcap_handle_;
+        memset(&last_pcap_stats_, 0, sizeof(last_pcap_stats_));
+        if (!pcap_handle_) {
+            done_ = true;
+        } else {
+            install_filter();
+        }
+    }
+
+    char entry[160];
+    snprintf(entry, sizeof(entry), "t=%lus %s%s%s", now_sec() - start_sec_, desc.c_str(),
+             applied ? "" : " failed: ", applied ? "" : errbuf);
+    loss_.rate_actions.push_back(entry);
+    fprintf(stderr, "[Capture] kernel drops=%lu, rate control: %s\n", loss_.kernel_dropped, entry);
+}
+
+void CRxCaptureJob::sample_cb(u_char* user, const struct pcap_pkthdr* h, const u_char* bytes)
+{
+    CRxCaptureJob* job = reinterpret_cast<CRxCaptureJob*>(user);
+    SRxDecodedPacket pkt;
+    if (job->sample_decoder_.decode(bytes, h->caplen, pkt)) {
+        SRxFlowKey key = CRxPacketDecoder::flow_key(pkt);
+        uint32_t mix = 0;
+        for (int i = 0; i < 4; ++i) {
+            mix = (mix << 7 | mix >> 25) ^ key.src_ip[i] ^ key.dst_ip[i];
+        }
+        mix *= 0x9e3779b1u;
+        mix ^= (static_cast<uint32_t>(key.src_port ^ key.dst_port) << 8) | key.proto;
+        mix ^= mix >> 15;
+        mix *= 0x85ebca6bu;
+        mix ^= mix >> 13;
+        if (mix % job->sample_n_ != 0) {
+            job->loss_.sampled_out++;
+            return;
+        }
+    }
+    job->sample_next_cb_(job->sample_next_user_, h, bytes);
 }
 
 void CRxCaptureJob::cleanup()
@@ -148,8 +393,9 @@ void CRxCaptureJob::cleanup()
 
         CRxFilterThread::FilterStats stats = filter_thread_->get_stats();
         if (dumper_context_.protocol_def) {
-            fprintf(stderr, "[Filter] Thread stats: processed=%lu matched=%lu filtered=%lu\n",
-                    stats.packets_processed, stats.packets_matched, stats.packets_filtered);
+            fprintf(stderr, "[Filter] Thread stats: processed=%lu matched=%lu filtered=%lu flow_cache_hit=%.1f%%\n",
+                    stats.packets_processed, stats.packets_matched, stats.packets_filtered,
+                    stats.flow_cache_hit_ratio() * 100.0);
         } else {
             fprintf(stderr, "[Filter] Thread stats: processed=%lu written=%lu\n",
                     stats.packets_processed, stats.packets_matched);
@@ -174,10 +420,20 @@ void CRxCaptureJob::cleanup()
         dumper_context_.d = NULL;
     }
     if (pcap_handle_) {
-        pcap_close(pcap_handle_);
+        poll_pcap_stats(false);
+        source_->close();
         pcap_handle_ = NULL;
     }
 
+    if (stats_) {
+        publish_stats(true);
+    }
+    CRxPdefCache* pdef_cache = CRxPdefCache::instance();
+    for (size_t i = 0; i < stats_defs_.size(); ++i) {
+        pdef_cache->release(stats_defs_[i]);
+    }
+    stats_defs_.clear();
+
     done_ = true;
 }
 
@@ -201,12 +457,38 @@ std::string CRxCaptureJob::get_current_file() const
     return dumper_context_.current_path;
 }
 
+void CRxCaptureJob::take_closed_segments(std::vector<CaptureFileInfo>& out)
+{
+    if (dumper_context_.closed_paths.empty()) {
+        return;
+    }
+    int64_t now = rx_capture_now_usec();
+    for (size_t i = 0; i < dumper_context_.closed_paths.size(); ++i) {
+        CaptureFileInfo info;
+        info.file_path = dumper_context_.closed_paths[i];
+        struct stat st;
+        if (stat(info.file_path.c_str(), &st) == 0) {
+            info.file_size = static_cast<unsigned long>(st.st_size);
+        }
+        info.segment_index = segments_taken_++;
+        // The total is only known once the capture ends.
+        info.total_segments = 0;
+        info.file_ready_ts = now;
+        out.push_back(info);
+    }
+    dumper_context_.closed_paths.clear();
+}
+
 unsigned long CRxCaptureJob::get_bytes_written() const
 {
-    if (dumper_context_.written < 0) {
+    if (stats_) {
+        return static_cast<unsigned long>(stats_->bytes());
+    }
+    long total = dumper_context_.closed_bytes + dumper_context_.written;
+    if (total < 0) {
         return 0;
     }
-    return static_cast<unsigned long>(dumper_context_.written);
+    return static_cast<unsigned long>(total);
 }
 
 uint32_t CRxCaptureJob::get_filter_thread_index() const
@@ -4,6 +4,10 @@
 #include "rxcapturemanager.h"
 #include "rxstorageutils.h"
 #include "rxfilterthread.h"
+#include "rxcapturesource.h"
+#include "rxstatsaggregator.h"
+#include "rxratecontrol.h"
+#include "rxcapturetasktypes.h"
 #include <pcap/pcap.h>
 #include <string>
 
@@ -14,12 +18,25 @@ public:
 
     bool prepare();
 
+    // Non-blocking: dispatches at most DISPATCH_BATCH packets and returns the
+    // pcap_dispatch result (0 when nothing was ready).
     int run_once();
 
+    // Once a second: kernel counters, rate control, stats publishing and the
+    // duration/stop checks.
+    void tick();
+
+    void request_stop() { done_ = true; }
+
     void cleanup();
 
     bool is_done() const;
 
+    // -1 when the source has no pollable descriptor (offline replay).
+    int selectable_fd() const;
+    // Bumped whenever the pcap handle is reopened, which invalidates the fd.
+    uint32_t handle_generation() const { return handle_generation_; }
+
     unsigned long get_packet_count() const;
 
     std::string get_final_path() const;
@@ -28,26 +45,72 @@ public:
 
     unsigned long get_bytes_written() const;
 
+    // Moves segments closed by rotation into out, numbered in order. The
+    // final (current) file is segment segments_taken().
+    void take_closed_segments(std::vector<CaptureFileInfo>& out);
+    int segments_taken() const { return segments_taken_; }
+    // Files opened so far, including the current one.
+    int segment_count() const { return dumper_context_.seq; }
+
     CRxFilterThread* get_filter_thread() { return filter_thread_; }
     uint32_t get_filter_thread_index() const;
 
+    void set_stats_producer(int producer) { stats_producer_ = producer; }
+
+    const CaptureLossStats& loss_stats() const { return loss_; }
+
+    enum {
+        DISPATCH_BATCH = 100
+    };
+
 private:
 
     CRxCaptureJob(const CRxCaptureJob&);
     CRxCaptureJob& operator=(const CRxCaptureJob&);
 
+    void install_filter();
+
+    void poll_pcap_stats(bool adjust);
+
+    void adjust_rate(uint64_t recv_delta, uint64_t drop_delta);
+    void apply_rate_step(const SRxRateStep& step);
+
+    static void sample_cb(u_char* user, const struct pcap_pkthdr* h, const u_char* bytes);
+
+    bool prepare_stats();
+    void publish_stats(bool finished);
+
     const CRxCaptureTaskCfg cfg_;
     const CRxCaptureTaskInfo* parent_task_info_;
 
+    CRxCaptureSource* source_;
     pcap_t* pcap_handle_;
     CRxDumpCtx dumper_context_;
 
     bool done_;
     unsigned long packets_;
     unsigned long end_time_sec_;
+    unsigned long last_stats_sec_;
+    struct pcap_stat last_pcap_stats_;
 
     CRxFilterThread* filter_thread_;
     bool use_filter_thread_;
+
+    CRxStatsAggregator* stats_;
+    std::vector<const ProtocolDef*> stats_defs_;
+    int stats_producer_;
+
+    CRxRateController rate_;
+    CaptureLossStats loss_;
+    unsigned long start_sec_;
+    unsigned long dispatch_calls_;
+    unsigned long full_batches_;
+    uint32_t sample_n_;
+    CRxPacketDecoder sample_decoder_;
+    pcap_handler sample_next_cb_;
+    u_char* sample_next_user_;
+    uint32_t handle_generation_;
+    int segments_taken_;
 };
 
 #endif
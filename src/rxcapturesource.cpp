@@ -0,0 +1,301 @@
+#include "rxcapturesource.h"
+#include "rxmetrics.h"
+#include "rxarchive.h"
+#include "legacy_core.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+
+namespace {
+
+const uint64_t kReplaySlackNs = 500000ULL;
+
+uint64_t ts_to_ns(const struct timeval& tv)
+{
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000000ULL + static_cast<uint64_t>(tv.tv_usec) * 1000ULL;
+}
+
+class NetNsSwitch {
+public:
+    NetNsSwitch() : home_fd_(-1) {}
+
+    ~NetNsSwitch()
+    {
+        if (home_fd_ < 0) {
+            return;
+        }
+        if (setns(home_fd_, CLONE_NEWNET) != 0) {
+            LOG_ERROR("failed to return capture thread to its network namespace: %s", strerror(errno));
+        }
+        ::close(home_fd_);
+    }
+
+    bool enter(int target_fd, const std::string& path, char* errbuf)
+    {
+        home_fd_ = ::open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+        if (home_fd_ < 0) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "open own netns: %s", strerror(errno));
+            return false;
+        }
+        if (setns(target_fd, CLONE_NEWNET) != 0) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "setns %s: %s", path.c_str(), strerror(errno));
+            ::close(home_fd_);
+            home_fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    NetNsSwitch(const NetNsSwitch&);
+    NetNsSwitch& operator=(const NetNsSwitch&);
+
+    int home_fd_;
+};
+
+}
+
+CRxCaptureSource* CRxCaptureSource::create(const CRxCaptureTaskCfg& cfg)
+{
+    if (!cfg.replay_file.empty()) {
+        return new (std::nothrow) CRxReplayCaptureSource(cfg.replay_file, cfg.replay_speed,
+                                                         cfg.replay_pps, cfg.replay_loops);
+    }
+    return new (std::nothrow) CRxLiveCaptureSource(cfg.iface, cfg.snaplen > 0 ? cfg.snaplen : 65535,
+                                                   cfg.netns_path);
+}
+
+void CRxCaptureSource::close()
+{
+    if (handle_) {
+        pcap_close(handle_);
+        handle_ = NULL;
+    }
+}
+
+CRxLiveCaptureSource::CRxLiveCaptureSource(const std::string& iface, int snaplen, const std::string& netns_path)
+    : iface_(iface), snaplen_(snaplen), buffer_bytes_(0), netns_path_(netns_path), netns_fd_(-1)
+{
+}
+
+CRxLiveCaptureSource::~CRxLiveCaptureSource()
+{
+    close();
+    if (netns_fd_ >= 0) {
+        ::close(netns_fd_);
+    }
+}
+
+bool CRxLiveCaptureSource::open(char* errbuf)
+{
+    // A packet socket stays bound to the namespace it was created in, so the
+    // worker thread only switches for pcap_activate and comes straight back.
+    // The namespace is pinned by fd on first open so reopens cannot land in a
+    // different one if the process behind /proc/<pid>/ns/net has gone.
+    NetNsSwitch netns;
+    std::string device = iface_.empty() ? "any" : iface_;
+    if (!netns_path_.empty()) {
+        if (netns_fd_ < 0) {
+            netns_fd_ = ::open(netns_path_.c_str(), O_RDONLY | O_CLOEXEC);
+            if (netns_fd_ < 0) {
+                snprintf(errbuf, PCAP_ERRBUF_SIZE, "open %s: %s", netns_path_.c_str(), strerror(errno));
+                return false;
+            }
+        }
+        if (!netns.enter(netns_fd_, netns_path_, errbuf)) {
+            return false;
+        }
+        if (device != "any" && if_nametoindex(device.c_str()) == 0) {
+            LOG_WARNING("interface %s not found in %s, capturing on any", device.c_str(), netns_path_.c_str());
+            device = "any";
+        }
+    }
+
+    handle_ = pcap_create(device.c_str(), errbuf);
+    if (!handle_) {
+        return false;
+    }
+    pcap_set_snaplen(handle_, snaplen_);
+    pcap_set_promisc(handle_, 1);
+    pcap_set_timeout(handle_, 1000);
+    if (buffer_bytes_ > 0) {
+        pcap_set_buffer_size(handle_, buffer_bytes_);
+    }
+    if (pcap_activate(handle_) < 0) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(handle_));
+        close();
+        return false;
+    }
+
+    char nb_err[PCAP_ERRBUF_SIZE];
+    nb_err[0] = '\0';
+    if (pcap_setnonblock(handle_, 1, nb_err) == -1) {
+        fprintf(stderr, "pcap_setnonblock failed for %s: %s\n", iface_.c_str(),
+                nb_err[0] ? nb_err : "unknown error");
+
+    }
+    return true;
+}
+
+int CRxLiveCaptureSource::dispatch(int cnt, pcap_handler cb, u_char* user)
+{
+    return pcap_dispatch(handle_, cnt, cb, user);
+}
+
+bool CRxLiveCaptureSource::stats(struct pcap_stat* ps)
+{
+    return handle_ && pcap_stats(handle_, ps) == 0;
+}
+
+bool CRxLiveCaptureSource::reconfigure(int buffer_bytes, int snaplen, char* errbuf)
+{
+    int old_buffer = buffer_bytes_;
+    int old_snaplen = snaplen_;
+    close();
+    if (buffer_bytes > 0) {
+        buffer_bytes_ = buffer_bytes;
+    }
+    if (snaplen > 0) {
+        snaplen_ = snaplen;
+    }
+    if (open(errbuf)) {
+        return true;
+    }
+
+    char retry_err[PCAP_ERRBUF_SIZE];
+    buffer_bytes_ = old_buffer;
+    snaplen_ = old_snaplen;
+    open(retry_err);
+    return false;
+}
+
+CRxReplayCaptureSource::CRxReplayCaptureSource(const std::string& path, double speed, long pps, int loops)
+    : path_(path),
+      speed_(speed > 0.0 ? speed : 0.0),
+      pps_(pps > 0 ? pps : 0),
+      loops_left_(loops > 1 ? loops - 1 : 0),
+      data_offset_(-1),
+      exhausted_(false),
+      have_pending_(false),
+      pending_hdr_(NULL),
+      pending_data_(NULL),
+      start_wall_ns_(0),
+      first_ts_ns_(0),
+      last_ts_ns_(0),
+      pass_offset_ns_(0),
+      have_first_ts_(false),
+      replayed_(0)
+{
+}
+
+bool CRxReplayCaptureSource::open(char* errbuf)
+{
+    handle_ = CRxArchiveReader::open_offline(path_, errbuf);
+    if (!handle_) {
+        return false;
+    }
+
+    FILE* fp = pcap_file(handle_);
+    data_offset_ = fp ? ftell(fp) : -1;
+    if (loops_left_ > 0 && data_offset_ < 0) {
+        fprintf(stderr, "[Replay] %s is not seekable, looping disabled\n", path_.c_str());
+        loops_left_ = 0;
+    }
+
+    start_wall_ns_ = CRxMetrics::now_ns();
+    fprintf(stderr, "[Replay] Opened %s (linktype=%d speed=%.2f pps=%ld loops=%d)\n",
+            path_.c_str(), pcap_datalink(handle_), speed_, pps_, loops_left_ + 1);
+    return true;
+}
+
+bool CRxReplayCaptureSource::rewind()
+{
+    FILE* fp = pcap_file(handle_);
+    if (loops_left_ <= 0 || !fp || data_offset_ < 0 || fseek(fp, data_offset_, SEEK_SET) != 0) {
+        return false;
+    }
+    --loops_left_;
+
+
+    pass_offset_ns_ += (last_ts_ns_ - first_ts_ns_) + 1000ULL;
+    have_first_ts_ = false;
+    return true;
+}
+
+bool CRxReplayCaptureSource::fetch_next()
+{
+    for (;;) {
+        int rc = pcap_next_ex(handle_, &pending_hdr_, &pending_data_);
+        if (rc == 1) {
+            uint64_t ts = ts_to_ns(pending_hdr_->ts);
+            if (!have_first_ts_) {
+                first_ts_ns_ = ts;
+                have_first_ts_ = true;
+            }
+            last_ts_ns_ = ts > last_ts_ns_ ? ts : last_ts_ns_;
+            have_pending_ = true;
+            return true;
+        }
+        if (rc == 0) {
+            continue;
+        }
+        if (rc == -2 && rewind()) {
+            continue;
+        }
+        if (rc == -1) {
+            fprintf(stderr, "[Replay] Read error in %s: %s\n", path_.c_str(), pcap_geterr(handle_));
+        }
+        exhausted_ = true;
+        return false;
+    }
+}
+
+uint64_t CRxReplayCaptureSource::due_ns(const struct pcap_pkthdr* hdr) const
+{
+    if (pps_ > 0) {
+        return start_wall_ns_ + static_cast<uint64_t>(replayed_) * 1000000000ULL / static_cast<uint64_t>(pps_);
+    }
+    if (speed_ > 0.0) {
+        uint64_t ts = ts_to_ns(hdr->ts);
+        uint64_t rel = pass_offset_ns_ + (ts > first_ts_ns_ ? ts - first_ts_ns_ : 0);
+        return start_wall_ns_ + static_cast<uint64_t>(static_cast<double>(rel) / speed_);
+    }
+    return 0;
+}
+
+int CRxReplayCaptureSource::dispatch(int cnt, pcap_handler cb, u_char* user)
+{
+    if (!handle_ || exhausted_) {
+        return 0;
+    }
+
+    bool paced = pps_ > 0 || speed_ > 0.0;
+    uint64_t now = paced ? CRxMetrics::now_ns() : 0;
+    int delivered = 0;
+
+    while (delivered < cnt) {
+        if (!have_pending_ && !fetch_next()) {
+            break;
+        }
+        if (paced && due_ns(pending_hdr_) > now + kReplaySlackNs) {
+            break;
+        }
+        cb(user, pending_hdr_, pending_data_);
+        have_pending_ = false;
+        ++replayed_;
+        ++delivered;
+    }
+    return delivered;
+}
+
+bool CRxReplayCaptureSource::stats(struct pcap_stat* ps)
+{
+    memset(ps, 0, sizeof(*ps));
+    ps->ps_recv = static_cast<unsigned int>(replayed_);
+    return true;
+}
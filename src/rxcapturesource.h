@@ -0,0 +1,112 @@
+#ifndef RX_CAPTURE_SOURCE_H
+#define RX_CAPTURE_SOURCE_H
+
+#include "rxcapturemanager.h"
+#include <pcap/pcap.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+class CRxCaptureSource {
+public:
+    CRxCaptureSource() : handle_(NULL) {}
+    virtual ~CRxCaptureSource() { close(); }
+
+    static CRxCaptureSource* create(const CRxCaptureTaskCfg& cfg);
+
+    virtual bool open(char* errbuf) = 0;
+
+    virtual int dispatch(int cnt, pcap_handler cb, u_char* user) = 0;
+
+    virtual bool stats(struct pcap_stat* ps) = 0;
+
+    virtual bool exhausted() const { return false; }
+
+    // Descriptor to wait on for readiness, -1 if the source must be polled.
+    virtual int selectable_fd() const { return -1; }
+
+    // Reopens the handle with a new kernel buffer size and snaplen (0 keeps the
+    // current value). On failure the previous settings are reopened if possible.
+    virtual bool reconfigure(int buffer_bytes, int snaplen, char* errbuf)
+    {
+        (void)buffer_bytes;
+        (void)snaplen;
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s source cannot be reconfigured", kind());
+        return false;
+    }
+
+    virtual const char* kind() const = 0;
+
+    virtual std::string label() const = 0;
+
+    void close();
+
+    pcap_t* handle() const { return handle_; }
+
+protected:
+    pcap_t* handle_;
+
+private:
+    CRxCaptureSource(const CRxCaptureSource&);
+    CRxCaptureSource& operator=(const CRxCaptureSource&);
+};
+
+class CRxLiveCaptureSource : public CRxCaptureSource {
+public:
+    CRxLiveCaptureSource(const std::string& iface, int snaplen, const std::string& netns_path);
+    virtual ~CRxLiveCaptureSource();
+
+    virtual bool open(char* errbuf);
+    virtual int dispatch(int cnt, pcap_handler cb, u_char* user);
+    virtual bool stats(struct pcap_stat* ps);
+    virtual bool reconfigure(int buffer_bytes, int snaplen, char* errbuf);
+    virtual int selectable_fd() const { return handle_ ? pcap_get_selectable_fd(handle_) : -1; }
+    virtual const char* kind() const { return "live"; }
+    virtual std::string label() const { return iface_; }
+
+private:
+    std::string iface_;
+    int snaplen_;
+    int buffer_bytes_;
+    std::string netns_path_;
+    int netns_fd_;
+};
+
+class CRxReplayCaptureSource : public CRxCaptureSource {
+public:
+    CRxReplayCaptureSource(const std::string& path, double speed, long pps, int loops);
+
+    virtual bool open(char* errbuf);
+    virtual int dispatch(int cnt, pcap_handler cb, u_char* user);
+    virtual bool stats(struct pcap_stat* ps);
+    virtual bool exhausted() const { return exhausted_; }
+    virtual const char* kind() const { return "replay"; }
+    virtual std::string label() const { return "replay"; }
+
+    unsigned long replayed() const { return replayed_; }
+
+private:
+    bool fetch_next();
+    bool rewind();
+    uint64_t due_ns(const struct pcap_pkthdr* hdr) const;
+
+    std::string path_;
+    double speed_;
+    long pps_;
+    int loops_left_;
+
+    long data_offset_;
+    bool exhausted_;
+    bool have_pending_;
+    struct pcap_pkthdr* pending_hdr_;
+    const u_char* pending_data_;
+
+    uint64_t start_wall_ns_;
+    uint64_t first_ts_ns_;
+    uint64_t last_ts_ns_;
+    uint64_t pass_offset_ns_;
+    bool have_first_ts_;
+    unsigned long replayed_;
+};
+
+#endif
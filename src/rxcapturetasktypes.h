@@ -24,7 +24,6 @@ struct CaptureFileInfo {
     bool compressed;
     std::string archive_path;
     int64_t compress_finish_ts;
-    std::string record_path;
 
     CaptureFileInfo()
         : file_size(0)
@@ -50,6 +49,22 @@ struct CaptureArchiveInfo {
     }
 };
 
+struct CaptureLossStats {
+    unsigned long kernel_received;
+    unsigned long kernel_dropped;
+    unsigned long if_dropped;
+    unsigned long sampled_out;
+    std::vector<std::string> rate_actions;
+
+    CaptureLossStats()
+        : kernel_received(0)
+        , kernel_dropped(0)
+        , if_dropped(0)
+        , sampled_out(0)
+    {
+    }
+};
+
 enum ECaptureMode {
     MODE_INTERFACE = 0,
     MODE_PROCESS = 1,
@@ -57,6 +72,13 @@ enum ECaptureMode {
     MODE_CONTAINER = 3
 };
 
+// Higher value is scheduled first.
+enum ECapturePriority {
+    PRIORITY_BATCH = 0,
+    PRIORITY_SAMPLER = 1,
+    PRIORITY_API = 2
+};
+
 enum ECaptureTaskStatus {
     STATUS_PENDING = 0,
     STATUS_RESOLVING = 1,
@@ -111,6 +133,7 @@ struct SRxCaptureTask {
 
     std::vector<CaptureFileInfo> captured_files;
     std::vector<CaptureArchiveInfo> archives;
+    CaptureLossStats loss;
 
     ObjId reply_target;
     std::string client_ip;
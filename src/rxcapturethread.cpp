@@ -1,5 +1,6 @@
 #include "rxcapturethread.h"
 #include "rxcapturemessages.h"
+#include "rxcapturescheduler.h"
 #include "legacy_core.h"
 
 #include <unistd.h>
@@ -15,6 +16,9 @@ using compat::make_shared;
 #include <vector>
 
 CRxCaptureThread::CRxCaptureThread()
+    : polled_jobs_(0)
+    , packets_total_(0)
+    , last_ready_flush_(0)
 {
 }
 
@@ -38,6 +42,15 @@ void CRxCaptureThread::handle_msg(shared_ptr<normal_msg>& msg)
             }
             break;
         }
+        case RX_MSG_CAPTURE_STOP:
+        {
+            shared_ptr<SRxCaptureStopMsgV2> stop_v2 =
+                dynamic_pointer_cast<SRxCaptureStopMsgV2>(msg);
+            if (stop_v2) {
+                handle_capture_stop_v2(stop_v2.get());
+            }
+            break;
+        }
         default:
         {
             LOG_DEBUG("Capture worker %u received unsupported message op=%d",
@@ -47,20 +60,6 @@ void CRxCaptureThread::handle_msg(shared_ptr<normal_msg>& msg)
     }
 }
 
-void CRxCaptureThread::handle_capture_start_v2(SRxCaptureStartMsgV2* msg)
-{
-    if (!msg) {
-        return;
-    }
-
-    LOG_NOTICE("Capture worker %u starting capture task %d (key=%s, sid=%s)",
-               get_thread_index(), msg->capture_id, msg->key.c_str(), msg->sid.c_str());
-
-
-    execute_capture(*msg);
-}
-
-
 static CRxCaptureTaskCfg build_task_cfg(const CaptureSpec& spec,
                                         const CaptureConfigSnapshot& config)
 {
@@ -81,6 +80,16 @@ static CRxCaptureTaskCfg build_task_cfg(const CaptureSpec& spec,
     cfg.protocol_filter = spec.protocol_filter;
     cfg.protocol_filter_inline = spec.protocol_filter_inline;
     cfg.port = spec.port_filter;
+    cfg.replay_file = spec.replay_file;
+    cfg.replay_speed = spec.replay_speed;
+    cfg.replay_pps = spec.replay_pps;
+    cfg.replay_loops = spec.replay_loops;
+    cfg.stats_only = spec.stats_only;
+    cfg.aggregate_fields = spec.aggregate_fields;
+    cfg.snaplen = spec.snaplen > 0 ? spec.snaplen : config.snaplen;
+    cfg.netns_path = spec.netns_path;
+    cfg.rate_ladder = config.rate_ladder;
+    cfg.rate_drop_pct = config.rate_drop_pct;
 
     fprintf(stderr, "[DEBUG] build_task_cfg: spec.protocol_filter='%s', spec.protocol_filter_inline='%s'\n",
             spec.protocol_filter.c_str(), spec.protocol_filter_inline.c_str());
@@ -88,54 +97,323 @@ static CRxCaptureTaskCfg build_task_cfg(const CaptureSpec& spec,
     return cfg;
 }
 
-void CRxCaptureThread::execute_capture(const SRxCaptureStartMsgV2& start_msg)
+CRxCaptureJobObj::CRxCaptureJobObj(CRxCaptureThread* owner, const SRxCaptureStartMsgV2& start_msg)
+    : owner_(owner)
+    , start_msg_(start_msg)
+    , job_(NULL)
+    , start_ts_(0)
+    , registered_generation_(0)
+    , polled_(false)
+    , finished_(false)
+    , progress_slot_(NULL)
 {
-    const CaptureSpec& spec = start_msg.spec;
-    const CaptureConfigSnapshot& config = start_msg.config;
-    int manager_thread_index = start_msg.sender_thread_index;
+    _fd = -1;
+    _epoll_event = EPOLLIN;
+
+    CRxCaptureTaskCfg cfg = build_task_cfg(start_msg_.spec, start_msg_.config);
+    const CaptureConfigSnapshot& config = start_msg_.config;
+    task_info_.id = start_msg_.capture_id;
+    task_info_.cfg = cfg;
+    task_info_.base_dir = config.output_dir.empty() ? std::string("capture_output") : config.output_dir;
+    task_info_.compress_enabled = config.compress_enabled;
+    task_info_.compress_remove_src = config.compress_remove_src;
+    task_info_.post_sink = NULL;
+    task_info_.running = true;
+    task_info_.exit_code = -1;
+    task_info_.packets = 0;
+    task_info_.stopping = false;
+    task_info_.resolved_path.clear();
+
+    job_ = new CRxCaptureJob(cfg, &task_info_);
+}
+
+CRxCaptureJobObj::~CRxCaptureJobObj()
+{
+    CRxProgressBoard::release(progress_slot_);
+    delete job_;
+}
+
+bool CRxCaptureJobObj::start()
+{
+    job_->set_stats_producer(static_cast<int>(owner_->get_thread_index()));
+    start_ts_ = rx_capture_now_usec();
+    if (!job_->prepare()) {
+        return false;
+    }
+    progress_slot_ = CRxProgressBoard::instance()->claim(owner_->get_thread_index(), capture_id());
+
+    sync_fd();
+    arm_timer(TIMER_JOB_TICK, 1000);
+    if (task_info_.cfg.duration_sec > 0) {
+        arm_timer(TIMER_JOB_END, static_cast<uint32_t>(task_info_.cfg.duration_sec) * 1000U);
+    }
+    return true;
+}
+
+void CRxCaptureJobObj::arm_timer(uint32_t type, uint32_t ms)
+{
+    shared_ptr<timer_msg> t_msg(new timer_msg);
+    t_msg->_timer_type = type;
+    t_msg->_time_length = ms;
+    t_msg->_obj_id = get_id()._id;
+    add_timer(t_msg);
+}
+
+void CRxCaptureJobObj::unregister_fd()
+{
+    if (_fd >= 0) {
+        get_net_container()->get_epoll()->del_from_epoll(this);
+    }
+    // The descriptor belongs to pcap; keep ~base_net_obj from closing it.
+    _fd = -1;
+}
+
+void CRxCaptureJobObj::sync_fd()
+{
+    if (registered_generation_ == job_->handle_generation()) {
+        return;
+    }
+    registered_generation_ = job_->handle_generation();
+
+    unregister_fd();
+    int fd = job_->selectable_fd();
+    if (fd >= 0) {
+        _fd = fd;
+        get_net_container()->get_epoll()->add_to_epoll(this);
+    }
+    polled_ = fd < 0;
+}
+
+int CRxCaptureJobObj::drain()
+{
+    int total = 0;
+    for (int i = 0; i < MAX_BATCHES_PER_EVENT && !job_->is_done(); ++i) {
+        int ret = job_->run_once();
+        if (ret < 0) {
+            // Without the old sleep-and-retry loop a persistent pcap error
+            // would keep the fd readable and spin the worker.
+            LOG_WARNING("Capture task %d: pcap_dispatch failed, stopping capture", capture_id());
+            job_->request_stop();
+            break;
+        }
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+        if (ret < CRxCaptureJob::DISPATCH_BATCH) {
+            break;
+        }
+    }
+    return total;
+}
+
+bool CRxCaptureJobObj::reports_segments() const
+{
+    const CaptureSpec& spec = start_msg_.spec;
+    return !spec.stats_only && spec.protocol_filter.empty() && spec.protocol_filter_inline.empty();
+}
 
+void CRxCaptureJobObj::publish_progress()
+{
+    unsigned long packets = job_->get_packet_count();
+    if (!progress_slot_ || packets == progress_.packets) {
+        return;
+    }
+    int64_t now = rx_capture_now_usec();
+    if (progress_.first_packet_ts == 0) {
+        progress_.first_packet_ts = now;
+    }
+    progress_.last_packet_ts = now;
+    progress_.packets = packets;
+    progress_.bytes = job_->get_bytes_written();
+    progress_.file_size = progress_.bytes;
+    CRxProgressBoard::publish(progress_slot_, progress_, static_cast<uint32_t>(job_->segment_count()));
+}
+
+void CRxCaptureJobObj::event_process(int events)
+{
+    if (finished_) {
+        return;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        LOG_WARNING("Capture task %d: capture socket reported error, stopping capture", capture_id());
+        job_->request_stop();
+    } else if (drain() > 0) {
+        publish_progress();
+    }
+    check_done();
+}
 
+int CRxCaptureJobObj::poll()
+{
+    if (finished_) {
+        return 0;
+    }
+    int got = drain();
+    if (got > 0) {
+        publish_progress();
+    }
+    check_done();
+    return got;
+}
 
-    CRxCaptureTaskCfg cfg = build_task_cfg(spec, config);
+void CRxCaptureJobObj::handle_timeout(shared_ptr<timer_msg>& t_msg)
+{
+    if (finished_) {
+        return;
+    }
+    if (t_msg->_timer_type == TIMER_JOB_END) {
+        job_->request_stop();
+    } else if (t_msg->_timer_type == TIMER_JOB_TICK) {
+        job_->tick();
+        if (!job_->is_done()) {
+            sync_fd();
+            arm_timer(TIMER_JOB_TICK, 1000);
+        }
+        owner_->publish_packets();
+        owner_->collect_segments(*this);
+        owner_->flush_file_ready(false);
+    }
+    check_done();
+}
 
+void CRxCaptureJobObj::stop(const std::string& reason)
+{
+    if (finished_) {
+        return;
+    }
+    task_info_.stopping = true;
+    stop_reason_ = reason;
+    job_->request_stop();
+    check_done();
+}
 
-    CRxCaptureTaskInfo task_info;
-    task_info.id = start_msg.capture_id;
-    task_info.cfg = cfg;
-    task_info.base_dir = config.output_dir.empty() ? std::string("capture_output") : config.output_dir;
-    task_info.compress_enabled = config.compress_enabled;
-    task_info.compress_remove_src = config.compress_remove_src;
-    task_info.post_sink = NULL;
-    task_info.running = true;
-    task_info.exit_code = -1;
-    task_info.packets = 0;
-    task_info.stopping = false;
-    task_info.resolved_path.clear();
+void CRxCaptureJobObj::check_done()
+{
+    if (finished_ || !job_->is_done()) {
+        return;
+    }
+    finished_ = true;
+    unregister_fd();
+    publish_progress();
+    // The slot keeps its final values until the worker reuses it, which
+    // covers queries that arrive before the manager sees the finished message.
+    CRxProgressBoard::release(progress_slot_);
+    progress_slot_ = NULL;
+    owner_->job_done(this);
+}
 
+void CRxCaptureThread::handle_capture_start_v2(SRxCaptureStartMsgV2* msg)
+{
+    if (!msg) {
+        return;
+    }
 
-    CRxCaptureJob job(cfg, &task_info);
-    int64_t start_ts = rx_capture_now_usec();
+    LOG_NOTICE("Capture worker %u starting capture task %d (key=%s, sid=%s, hosting %zu)",
+               get_thread_index(), msg->capture_id, msg->key.c_str(), msg->sid.c_str(), jobs_.size());
 
+    shared_ptr<CRxCaptureJobObj> obj(new CRxCaptureJobObj(this, *msg));
+    shared_ptr<base_net_obj> base = obj;
+    base->set_net_container(get_net_container());
 
-    if (!job.prepare()) {
-        send_failure(manager_thread_index, start_msg, ERR_START_TCPDUMP_FAILED,
+    if (!obj->start()) {
+        get_net_container()->erase(obj->get_id()._id);
+        send_failure(msg->sender_thread_index, *msg, ERR_START_TCPDUMP_FAILED,
                      "pcap_prepare_failed");
         return;
     }
 
+    jobs_[msg->capture_id] = obj;
+    if (obj->polled()) {
+        polled_jobs_++;
+        update_wait_time();
+    }
+
+    send_started(msg->sender_thread_index, *msg, obj->start_ts(),
+                 static_cast<pid_t>(getpid()), obj->job().get_current_file());
+}
 
-    std::string initial_file = job.get_current_file();
-    send_started(manager_thread_index, start_msg, start_ts,
-                 static_cast<pid_t>(getpid()), initial_file);
+void CRxCaptureThread::handle_capture_stop_v2(SRxCaptureStopMsgV2* msg)
+{
+    if (!msg) {
+        return;
+    }
 
+    std::map<int, shared_ptr<CRxCaptureJobObj> >::iterator it = jobs_.find(msg->capture_id);
+    if (it == jobs_.end()) {
+        LOG_DEBUG("Capture worker %u: stop for task %d ignored, not hosted here",
+                  get_thread_index(), msg->capture_id);
+        return;
+    }
 
-    while (!job.is_done()) {
-        int ret = job.run_once();
-        if (ret < 0) {
-            usleep(1000);
+    LOG_NOTICE("Capture worker %u stopping capture task %d (%s)",
+               get_thread_index(), msg->capture_id, msg->stop_reason.c_str());
+    // stop() may finish the job and drop it from jobs_.
+    shared_ptr<CRxCaptureJobObj> obj = it->second;
+    obj->stop(msg->stop_reason);
+}
+
+void CRxCaptureThread::run_process()
+{
+    if (polled_jobs_ == 0) {
+        return;
+    }
+    std::vector<shared_ptr<CRxCaptureJobObj> > polled;
+    for (std::map<int, shared_ptr<CRxCaptureJobObj> >::iterator it = jobs_.begin(); it != jobs_.end(); ++it) {
+        if (it->second->polled()) {
+            polled.push_back(it->second);
         }
     }
+    for (size_t i = 0; i < polled.size(); ++i) {
+        polled[i]->poll();
+    }
+}
+
+void CRxCaptureThread::update_wait_time()
+{
+    // Polled sources have no fd to wake us, so keep the loop spinning at 1 ms
+    // while any are active instead of the default epoll wait.
+    get_net_container()->get_epoll()->set_wait_time(polled_jobs_ > 0 ? 1 : DEFAULT_EPOLL_WAITE);
+}
+
+void CRxCaptureThread::publish_packets()
+{
+    uint64_t packets = packets_total_;
+    for (std::map<int, shared_ptr<CRxCaptureJobObj> >::iterator it = jobs_.begin(); it != jobs_.end(); ++it) {
+        packets += it->second->job().get_packet_count();
+    }
+    CRxCaptureScheduler::publish_worker_packets(get_thread_index(), packets);
+}
+
+void CRxCaptureThread::job_done(CRxCaptureJobObj* obj)
+{
+    std::map<int, shared_ptr<CRxCaptureJobObj> >::iterator it = jobs_.find(obj->capture_id());
+    if (it == jobs_.end()) {
+        return;
+    }
+    // Hold a reference: the container erase below may drop the last one
+    // while the object is still on the call stack.
+    shared_ptr<CRxCaptureJobObj> keep = it->second;
+    jobs_.erase(it);
+    if (keep->polled()) {
+        polled_jobs_--;
+        update_wait_time();
+    }
+
+    complete_capture(*keep);
+    packets_total_ += keep->job().get_packet_count();
+    publish_packets();
 
+    get_net_container()->erase(keep->get_id()._id);
+}
+
+void CRxCaptureThread::complete_capture(CRxCaptureJobObj& obj)
+{
+    const SRxCaptureStartMsgV2& start_msg = obj.start_msg();
+    const CaptureSpec& spec = start_msg.spec;
+    int manager_thread_index = start_msg.sender_thread_index;
+    CRxCaptureJob& job = obj.job();
+    int64_t start_ts = obj.start_ts();
 
     job.cleanup();
 
@@ -150,9 +428,17 @@ void CRxCaptureThread::execute_capture(const SRxCaptureStartMsgV2& start_msg)
     result.start_ts = start_ts;
     result.finish_ts = finish_ts;
     result.exit_code = 0;
+    if (obj.stopped()) {
+        result.exit_code = ERR_RUN_CANCELLED;
+        result.error_message = obj.stop_reason();
+    }
+    result.loss = job.loss_stats();
 
 
     std::vector<CaptureFileInfo> files;
+    if (obj.reports_segments()) {
+        job.take_closed_segments(files);
+    }
     std::string final_path = job.get_final_path();
     if (!final_path.empty()) {
         CaptureFileInfo file_info;
@@ -163,8 +449,8 @@ void CRxCaptureThread::execute_capture(const SRxCaptureStartMsgV2& start_msg)
         } else {
             file_info.file_size = total_bytes;
         }
-        file_info.segment_index = 0;
-        file_info.total_segments = 1;
+        file_info.segment_index = job.segments_taken();
+        file_info.total_segments = job.segments_taken() + 1;
         file_info.file_ready_ts = finish_ts;
         files.push_back(file_info);
     }
@@ -173,13 +459,13 @@ void CRxCaptureThread::execute_capture(const SRxCaptureStartMsgV2& start_msg)
     fprintf(stderr, "[DEBUG CAPTURE] Checking PDEF filter: protocol_filter='%s', protocol_filter_inline='%s'\n",
             spec.protocol_filter.c_str(), spec.protocol_filter_inline.c_str());
 
-    if (!spec.protocol_filter.empty() || !spec.protocol_filter_inline.empty()) {
+    if (!spec.stats_only && (!spec.protocol_filter.empty() || !spec.protocol_filter_inline.empty())) {
         fprintf(stderr, "[DEBUG CAPTURE] PDEF filter needed, calling send_raw_file_for_filter() with final_path='%s'\n",
                 final_path.c_str());
 
 
         send_raw_file_for_filter(manager_thread_index, start_msg, final_path,
-                                  spec.protocol_filter, spec.protocol_filter_inline);
+                                  spec.protocol_filter, spec.protocol_filter_inline, result.loss);
 
         fprintf(stderr, "[DEBUG CAPTURE] send_raw_file_for_filter() completed\n");
 
@@ -187,9 +473,8 @@ void CRxCaptureThread::execute_capture(const SRxCaptureStartMsgV2& start_msg)
                    get_thread_index(), start_msg.capture_id, total_packets, total_bytes);
     } else {
 
-        if (!files.empty()) {
-            send_file_ready(manager_thread_index, start_msg, files);
-        }
+        queue_file_ready(manager_thread_index, start_msg, files);
+        flush_file_ready(true);
         send_finished(manager_thread_index, start_msg, result);
 
         LOG_NOTICE("Capture worker %u completed task %d (packets=%lu, bytes=%lu, duration=%.2fs, no PDEF filter)",
@@ -227,9 +512,39 @@ void CRxCaptureThread::send_started(int manager_thread_index,
     base_net_thread::put_obj_msg(target, base);
 }
 
-void CRxCaptureThread::send_file_ready(int manager_thread_index,
-                                       const SRxCaptureStartMsgV2& start_msg,
-                                       const std::vector<CaptureFileInfo>& files)
+void CRxCaptureThread::collect_segments(CRxCaptureJobObj& obj)
+{
+    if (!obj.reports_segments()) {
+        return;
+    }
+    std::vector<CaptureFileInfo> files;
+    obj.job().take_closed_segments(files);
+    queue_file_ready(obj.start_msg().sender_thread_index, obj.start_msg(), files);
+}
+
+void CRxCaptureThread::flush_file_ready(bool force)
+{
+    int64_t now = rx_capture_now_usec();
+    if (ready_batches_.empty() ||
+        (!force && now - last_ready_flush_ < static_cast<int64_t>(FILE_READY_BATCH_MS) * 1000)) {
+        return;
+    }
+    last_ready_flush_ = now;
+
+    for (std::map<int, shared_ptr<SRxCaptureFileBatchMsgV2> >::iterator it = ready_batches_.begin();
+         it != ready_batches_.end(); ++it) {
+        ObjId target;
+        target._id = OBJ_ID_THREAD;
+        target._thread_index = static_cast<uint32_t>(it->first);
+        shared_ptr<normal_msg> base = static_pointer_cast<normal_msg>(it->second);
+        base_net_thread::put_obj_msg(target, base);
+    }
+    ready_batches_.clear();
+}
+
+void CRxCaptureThread::queue_file_ready(int manager_thread_index,
+                                        const SRxCaptureStartMsgV2& start_msg,
+                                        const std::vector<CaptureFileInfo>& files)
 {
     if (manager_thread_index <= 0 || files.empty()) {
         return;
@@ -243,11 +558,11 @@ void CRxCaptureThread::send_file_ready(int manager_thread_index,
     ready->sender_thread_index = static_cast<int>(get_thread_index());
     ready->files = files;
 
-    ObjId target;
-    target._id = OBJ_ID_THREAD;
-    target._thread_index = static_cast<uint32_t>(manager_thread_index);
-    shared_ptr<normal_msg> base = static_pointer_cast<normal_msg>(ready);
-    base_net_thread::put_obj_msg(target, base);
+    shared_ptr<SRxCaptureFileBatchMsgV2>& batch = ready_batches_[manager_thread_index];
+    if (!batch) {
+        batch.reset(new SRxCaptureFileBatchMsgV2());
+    }
+    batch->items.push_back(ready);
 }
 
 void CRxCaptureThread::send_finished(int manager_thread_index,
@@ -302,7 +617,8 @@ void CRxCaptureThread::send_raw_file_for_filter(int manager_thread_index,
                                                  const SRxCaptureStartMsgV2& start_msg,
                                                  const std::string& raw_pcap_path,
                                                  const std::string& pdef_file_path,
-                                                 const std::string& pdef_inline_content)
+                                                 const std::string& pdef_inline_content,
+                                                 const CaptureLossStats& loss)
 {
     fprintf(stderr, "[DEBUG SEND_RAW] Called with manager_thread_index=%d, raw_pcap_path='%s', pdef_file_path='%s'\n",
             manager_thread_index, raw_pcap_path.c_str(), pdef_file_path.c_str());
@@ -323,6 +639,7 @@ void CRxCaptureThread::send_raw_file_for_filter(int manager_thread_index,
     raw_file->pdef_file_path = pdef_file_path;
     raw_file->pdef_inline_content = pdef_inline_content;
     raw_file->has_pdef_filter = !pdef_file_path.empty() || !pdef_inline_content.empty();
+    raw_file->loss = loss;
 
     fprintf(stderr, "[DEBUG SEND_RAW] Sending RX_MSG_CAPTURE_RAW_FILE message to manager thread %d\n", manager_thread_index);
 
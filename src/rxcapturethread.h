@@ -5,25 +5,110 @@
 #include "rxcapturemanager.h"
 #include "rxcapturesession.h"
 #include "rxcapturemessages.h"
+#include "rxcaptureprogress.h"
+#include <map>
 
 
 
 
 
+class CRxCaptureThread;
+
+// A capture job hosted in its worker's epoll set. Live sources are driven by
+// readiness of pcap_get_selectable_fd(); sources without one (offline replay)
+// are polled from the worker loop. A one second timer covers stats and rate
+// control, a one-shot timer the duration limit; stop requests arrive from the
+// manager as RX_MSG_CAPTURE_STOP.
+class CRxCaptureJobObj : public base_net_obj {
+public:
+    enum {
+        TIMER_JOB_TICK = 1,
+        TIMER_JOB_END = 2,
+        // Batches per readiness event before yielding to other jobs; epoll is
+        // level triggered so leftover packets wake us again.
+        MAX_BATCHES_PER_EVENT = 16
+    };
+
+    CRxCaptureJobObj(CRxCaptureThread* owner, const SRxCaptureStartMsgV2& start_msg);
+    virtual ~CRxCaptureJobObj();
+
+    bool start();
+
+    virtual void event_process(int events);
+    virtual int real_net_process() { return 0; }
+    virtual void handle_timeout(shared_ptr<timer_msg>& t_msg);
+
+    bool polled() const { return polled_; }
+    int poll();
+
+    int capture_id() const { return start_msg_.capture_id; }
+    const SRxCaptureStartMsgV2& start_msg() const { return start_msg_; }
+    CRxCaptureJob& job() { return *job_; }
+    int64_t start_ts() const { return start_ts_; }
+    // Rotated segments are handed to cleanup while the capture runs, except
+    // for PDEF-filtered captures whose raw file goes to the filter thread.
+    bool reports_segments() const;
+
+    void publish_progress();
+
+    // Stop requested through the manager; the job finishes as cancelled.
+    void stop(const std::string& reason);
+    bool stopped() const { return task_info_.stopping; }
+    const std::string& stop_reason() const { return stop_reason_; }
+
+private:
+    CRxCaptureJobObj(const CRxCaptureJobObj&);
+    CRxCaptureJobObj& operator=(const CRxCaptureJobObj&);
+
+    int drain();
+    void sync_fd();
+    void unregister_fd();
+    void arm_timer(uint32_t type, uint32_t ms);
+    void check_done();
+
+    CRxCaptureThread* owner_;
+    SRxCaptureStartMsgV2 start_msg_;
+    CRxCaptureTaskInfo task_info_;
+    CRxCaptureJob* job_;
+    int64_t start_ts_;
+    uint32_t registered_generation_;
+    bool polled_;
+    bool finished_;
+    std::string stop_reason_;
+
+    SRxProgressSlot* progress_slot_;
+    CaptureProgressStats progress_;
+};
+
 class CRxCaptureThread : public base_net_thread {
 public:
     CRxCaptureThread();
     ~CRxCaptureThread();
 
+    virtual void run_process();
+
+    size_t job_count() const { return jobs_.size(); }
+
+    void publish_packets();
+    void job_done(CRxCaptureJobObj* obj);
+
+    // Queues segments the job closed by rotation; queued notifications go to
+    // the manager in one message at most every FILE_READY_BATCH_MS.
+    void collect_segments(CRxCaptureJobObj& obj);
+    void flush_file_ready(bool force);
+
+    enum {
+        FILE_READY_BATCH_MS = 2000
+    };
+
 protected:
     virtual void handle_msg(shared_ptr<normal_msg>& msg);
 
 private:
     void handle_capture_start_v2(SRxCaptureStartMsgV2* msg);
+    void handle_capture_stop_v2(SRxCaptureStopMsgV2* msg);
 
-
-    void execute_capture(const SRxCaptureStartMsgV2& start_msg);
-
+    void complete_capture(CRxCaptureJobObj& obj);
 
     void send_started(int manager_thread_index,
                       const SRxCaptureStartMsgV2& start_msg,
@@ -31,9 +116,9 @@ private:
                       pid_t capture_pid,
                       const std::string& output_file);
 
-    void send_file_ready(int manager_thread_index,
-                         const SRxCaptureStartMsgV2& start_msg,
-                         const std::vector<CaptureFileInfo>& files);
+    void queue_file_ready(int manager_thread_index,
+                          const SRxCaptureStartMsgV2& start_msg,
+                          const std::vector<CaptureFileInfo>& files);
 
     void send_finished(int manager_thread_index,
                        const SRxCaptureStartMsgV2& start_msg,
@@ -48,10 +133,20 @@ private:
                                    const SRxCaptureStartMsgV2& start_msg,
                                    const std::string& raw_pcap_path,
                                    const std::string& pdef_file_path,
-                                   const std::string& pdef_inline_content);
+                                   const std::string& pdef_inline_content,
+                                   const CaptureLossStats& loss);
+
+    void update_wait_time();
 
     CRxCaptureThread(const CRxCaptureThread&);
     CRxCaptureThread& operator=(const CRxCaptureThread&);
+
+    std::map<int, shared_ptr<CRxCaptureJobObj> > jobs_;
+    size_t polled_jobs_;
+    uint64_t packets_total_;
+
+    std::map<int, shared_ptr<SRxCaptureFileBatchMsgV2> > ready_batches_;
+    int64_t last_ready_flush_;
 };
 
 #endif
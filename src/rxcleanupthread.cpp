@@ -2,6 +2,9 @@
 #include "legacy_core.h"
 #include "rxprocdata.h"
 #include "rxcapturemanagerthread.h"
+#include "rxmetrics.h"
+#include "rxarchive.h"
+#include "rxplacement.h"
 
 #include <sys/stat.h>
 #include <dirent.h>
@@ -11,7 +14,6 @@
 #include <cstdlib>
 #include <algorithm>
 #include <time.h>
-#include <sstream>
 #include <limits.h>
 
 namespace {
@@ -52,16 +54,6 @@ bool ensure_directory(const std::string& path)
     return true;
 }
 
-struct RecordFileEntry {
-    std::string path;
-    time_t mtime;
-};
-
-bool record_entry_less(const RecordFileEntry& a, const RecordFileEntry& b)
-{
-    return a.mtime < b.mtime;
-}
-
 struct ArchiveFileEntry {
     std::string path;
     time_t mtime;
@@ -73,32 +65,6 @@ bool archive_entry_less(const ArchiveFileEntry& a, const ArchiveFileEntry& b)
     return a.mtime < b.mtime;
 }
 
-std::string json_escape_local(const std::string& input)
-{
-    std::string out;
-    out.reserve(input.size());
-    for (size_t i = 0; i < input.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(input[i]);
-        switch (c) {
-            case '\\': out += "\\\\"; break;
-            case '"': out += "\\\""; break;
-            case '\n': out += "\\n"; break;
-            case '\r': out += "\\r"; break;
-            case '\t': out += "\\t"; break;
-            default:
-                if (c < 0x20) {
-                    char buf[7];
-                    snprintf(buf, sizeof(buf), "\\u%04x", c);
-                    out += buf;
-                } else {
-                    out += static_cast<char>(c);
-                }
-                break;
-        }
-    }
-    return out;
-}
-
 std::string timestamp_suffix()
 {
     char buf[32];
@@ -111,15 +77,17 @@ std::string timestamp_suffix()
 
 }
 
+SRxCompressBacklog CRxCleanupThread::backlog_;
+
 CRxCleanupThread::CRxCleanupThread()
     : cleanup_interval_sec_(CLEANUP_INTERVAL_SEC)
     , pdef_dir_("/tmp/rxtracenetcap_pdef")
     , pdef_ttl_seconds_(24 * 3600L)
-    , current_record_size_(0)
-    , record_max_size_bytes_(RECORD_MAX_SIZE_BYTES)
     , compress_threshold_bytes_(0)
     , archive_max_total_bytes_(0)
     , archive_retention_seconds_(0)
+    , ioprio_(0)
+    , next_job_seq_(0)
 {
 }
 
@@ -155,6 +123,17 @@ void CRxCleanupThread::configure(const CRxServerConfig::CleanupConfig& cfg, cons
     } else {
         archive_max_total_bytes_ = 0;
     }
+
+    CRxCompressQueue::EOrder order = CRxCompressQueue::ORDER_OLDEST;
+    if (!CRxCompressQueue::parse_order(cfg.compress_order, order)) {
+        LOG_WARNING("Cleanup: unknown compress_order '%s', using oldest", cfg.compress_order.c_str());
+    }
+    compress_queue_.configure(cfg.compress_queue_max, order);
+    if (!parse_ioprio(cfg.compress_ioprio, ioprio_)) {
+        LOG_WARNING("Cleanup: invalid compress_ioprio '%s', leaving I/O priority unchanged", cfg.compress_ioprio.c_str());
+        ioprio_ = 0;
+    }
+    throttle_.set_rate(static_cast<uint64_t>(cfg.compress_max_read_mbps) * 1024ULL * 1024ULL);
 }
 
 bool CRxCleanupThread::start()
@@ -162,16 +141,13 @@ bool CRxCleanupThread::start()
     if (!base_net_thread::start()) {
         return false;
     }
-    std::string record_dir = get_record_base_dir();
-    if (!ensure_directory(record_dir)) {
-        LOG_WARNING("Cleanup: failed to ensure record directory %s", record_dir.c_str());
-    }
     if (!ensure_directory(config_.archive_dir)) {
         LOG_WARNING("Cleanup: failed to ensure archive directory %s", config_.archive_dir.c_str());
     }
     if (!pdef_dir_.empty() && !ensure_directory(pdef_dir_)) {
         LOG_WARNING("Cleanup: failed to ensure pdef directory %s", pdef_dir_.c_str());
     }
+    start_compress_workers();
     schedule_cleanup_timer();
     return true;
 }
@@ -192,6 +168,18 @@ void CRxCleanupThread::handle_msg(shared_ptr<normal_msg>& msg)
             }
             break;
         }
+        case RX_MSG_COMPRESS_DONE:
+        {
+            shared_ptr<SRxCompressDoneMsg> done =
+                dynamic_pointer_cast<SRxCompressDoneMsg>(msg);
+            if (done) {
+                idle_workers_.push_back(done->worker_index);
+                handle_compress_done(*done);
+                process_pending_files();
+                dispatch_compress_jobs();
+            }
+            break;
+        }
         case RX_MSG_CLEAN_CFG_REFRESH:
         {
 
@@ -302,34 +290,22 @@ void CRxCleanupThread::enqueue_files(const SRxFileEnqueueMsgV2& enqueue_msg)
         pending.capture_id = enqueue_msg.capture_id;
         pending.key = enqueue_msg.key;
         pending.sid = enqueue_msg.sid;
-        CaptureFileInfo file_info = enqueue_msg.files[i];
-        std::string record_path = record_file_metadata(enqueue_msg.capture_id,
-                                                       enqueue_msg.key,
-                                                       enqueue_msg.files[i]);
-        if (!record_path.empty()) {
-            file_info.record_path = record_path;
-        }
-        pending.file = file_info;
+        pending.file = enqueue_msg.files[i];
         pending.policy = enqueue_msg.clean_policy;
         pending_files_.push_back(pending);
-
-        CRxProcData* global = CRxProcData::instance();
-        if (global) {
-            std::vector<CaptureFileInfo> files;
-            files.push_back(file_info);
-            global->capture_task_mgr().append_capture_files(enqueue_msg.capture_id, files);
-        }
     }
 
     LOG_NOTICE("Cleanup thread queued %zu file(s) for capture %d (total pending=%zu)",
                enqueue_msg.files.size(),
                enqueue_msg.capture_id,
                pending_files_.size());
+    process_pending_files();
+    publish_backlog();
 }
 
 void CRxCleanupThread::process_pending_files()
 {
-    if (pending_files_.empty()) {
+    if (pending_files_.empty() || compress_queue_.full()) {
         return;
     }
 
@@ -357,166 +333,189 @@ void CRxCleanupThread::process_pending_files()
     }
 
 
-    LOG_NOTICE("Cleanup: starting batch compression for %zu files (total size=%llu MB)",
-               total_count, total_size / (1024ULL * 1024ULL));
-
-
     std::map<int, std::vector<PendingFile> > groups;
     for (size_t i = 0; i < pending_files_.size(); ++i) {
         groups[pending_files_[i].capture_id].push_back(pending_files_[i]);
     }
 
 
+    // Groups that do not fit in the work queue stay pending and are retried
+    // when a worker finishes or on the next timer.
+    std::vector<PendingFile> kept;
+    size_t queued = 0;
     for (std::map<int, std::vector<PendingFile> >::iterator it = groups.begin();
          it != groups.end(); ++it) {
-        CaptureArchiveInfo archive;
-        std::string error;
-        if (compress_batch(it->second, archive, error)) {
-            if (!archive.files.empty() && !it->second.empty()) {
-                notify_archive_result(it->second[0].capture_id,
-                                    it->second[0].key,
-                                    it->second[0].sid,
-                                    archive);
+        const std::vector<PendingFile>& group = it->second;
+        SRxCompressJob job;
+        job.seq = next_job_seq_++;
+        job.capture_id = group[0].capture_id;
+        job.key = group[0].key;
+        job.sid = group[0].sid;
+        job.policy = group[0].policy;
+        for (size_t i = 0; i < group.size(); ++i) {
+            job.files.push_back(group[i].file);
+            struct stat st;
+            if (stat(group[i].file.file_path.c_str(), &st) == 0) {
+                job.bytes += static_cast<uint64_t>(st.st_size);
             }
-        } else {
-            if (!it->second.empty()) {
-                std::vector<CaptureFileInfo> failed;
-                for (size_t i = 0; i < it->second.size(); ++i) {
-                    failed.push_back(it->second[i].file);
-                }
-                notify_archive_failure(it->second[0].capture_id,
-                                     it->second[0].key,
-                                     it->second[0].sid,
-                                     failed, error);
+            int64_t ts = group[i].file.file_ready_ts;
+            if (ts > 0 && (job.oldest_ts == 0 || ts < job.oldest_ts)) {
+                job.oldest_ts = ts;
             }
         }
+        if (compress_queue_.push(job)) {
+            queued++;
+        } else {
+            kept.insert(kept.end(), group.begin(), group.end());
+        }
     }
 
-
-    pending_files_.clear();
+    LOG_NOTICE("Cleanup: queued %zu compression job(s) for %zu files (total size=%llu MB, %zu files deferred)",
+               queued, total_count, total_size / (1024ULL * 1024ULL), kept.size());
+    pending_files_.swap(kept);
+    dispatch_compress_jobs();
 }
 
-bool CRxCleanupThread::compress_file(const PendingFile& pending,
-                                     CaptureArchiveInfo& archive,
-                                     std::string& error_msg)
+void CRxCleanupThread::start_compress_workers()
 {
-    struct stat st;
-    if (stat(pending.file.file_path.c_str(), &st) != 0) {
-        LOG_WARNING("Cleanup: file %s not found, skipping", pending.file.file_path.c_str());
-        error_msg = "file_not_found";
-        return false;
-    }
-
-    if (!pending.policy.compress_enabled) {
-        LOG_DEBUG("Cleanup: compression disabled, leaving file %s as-is",
-                  pending.file.file_path.c_str());
-        return true;
-    }
-
-    if (!should_compress_size(static_cast<unsigned long>(st.st_size),
-                              pending.policy.compress_threshold_mb)) {
-        LOG_NOTICE("Cleanup: file %s (%lu bytes) below compression threshold, skipping",
-                   pending.file.file_path.c_str(),
-                   static_cast<unsigned long>(st.st_size));
-        return true;
-    }
-
-    bool use_policy_cmd = !pending.policy.compress_format.empty();
-    std::string archive_path;
-    std::string command;
-
-    if (use_policy_cmd) {
-        command = pending.policy.compress_format;
-        command += " '";
-        command += pending.file.file_path;
-        command += "'";
-    } else {
-        if (!ensure_directory(config_.archive_dir)) {
-            LOG_WARNING("Cleanup: archive directory %s unavailable", config_.archive_dir.c_str());
-            error_msg = "archive_dir_unavailable";
-            return false;
+    int count = config_.compress_workers;
+    for (int i = 0; i < count; ++i) {
+        CRxCompressWorker* worker = new (std::nothrow) CRxCompressWorker(this, ioprio_);
+        if (!worker) {
+            LOG_ERROR("Cleanup: failed to allocate compress worker %d", i);
+            continue;
         }
-        archive_path = config_.archive_dir;
-        if (!archive_path.empty() && archive_path[archive_path.size() - 1] != '/') {
-            archive_path += "/";
+        char name[32];
+        snprintf(name, sizeof(name), "compress_%d", i);
+        CRxThreadPlacement::instance()->place(worker, RX_ROLE_CLEANUP, name);
+        if (!worker->start()) {
+            LOG_ERROR("Cleanup: failed to start compress worker %d", i);
+            delete worker;
+            continue;
         }
-        archive_path += "capture_";
-        archive_path += timestamp_suffix();
-        archive_path += "_";
-        char seqbuf[32];
-        snprintf(seqbuf, sizeof(seqbuf), "%d_%d", pending.capture_id, pending.file.segment_index);
-        archive_path += seqbuf;
-        archive_path += ".tgz";
-
-        command = "tar -czf '";
-        command += archive_path;
-        command += "' '";
-        command += pending.file.file_path;
-        command += "'";
+        compress_workers_.push_back(worker);
+        idle_workers_.push_back(worker->get_thread_index());
     }
+    LOG_NOTICE("Cleanup: %zu compress worker(s), queue limit %u, order %s",
+               compress_workers_.size(), config_.compress_queue_max, config_.compress_order.c_str());
+    publish_backlog();
+}
 
-    LOG_NOTICE("Cleanup: compressing %s with command: %s", pending.file.file_path.c_str(), command.c_str());
-    int rc = std::system(command.c_str());
-    if (rc != 0) {
-        LOG_WARNING("Cleanup: compression command failed rc=%d for %s",
-                    rc, pending.file.file_path.c_str());
-        error_msg = "compress_failed";
-        return false;
+void CRxCleanupThread::dispatch_compress_jobs()
+{
+    SRxCompressJob job;
+    if (compress_workers_.empty()) {
+        // No pool: compress inline as before, one job per call.
+        while (compress_queue_.pop(job)) {
+            SRxCompressDoneMsg done;
+            done.job = job;
+            uint64_t start = CRxMetrics::now_ns();
+            done.ok = compress_batch(done.job, done.archive, done.error);
+            done.elapsed_ns = CRxMetrics::now_ns() - start;
+            handle_compress_done(done);
+        }
+        publish_backlog();
+        return;
     }
+    while (!idle_workers_.empty() && compress_queue_.pop(job)) {
+        shared_ptr<SRxCompressJobMsg> msg(new SRxCompressJobMsg());
+        msg->job = job;
+        ObjId target;
+        target._id = OBJ_ID_THREAD;
+        target._thread_index = idle_workers_.back();
+        idle_workers_.pop_back();
+        shared_ptr<normal_msg> base = static_pointer_cast<normal_msg>(msg);
+        base_net_thread::put_obj_msg(target, base);
+    }
+    publish_backlog();
+}
 
-    std::string produced_path;
-    unsigned long archive_size = 0;
-    if (use_policy_cmd) {
-        struct stat after;
-        if (stat(pending.file.file_path.c_str(), &after) == 0) {
-            produced_path = pending.file.file_path;
-            archive_size = static_cast<unsigned long>(after.st_size);
-        } else {
-            std::string gz_path = pending.file.file_path;
-            gz_path += ".gz";
-            if (stat(gz_path.c_str(), &after) == 0) {
-                produced_path = gz_path;
-                archive_size = static_cast<unsigned long>(after.st_size);
-            } else {
-                produced_path = pending.file.file_path;
-            }
+void CRxCleanupThread::handle_compress_done(const SRxCompressDoneMsg& done)
+{
+    const SRxCompressJob& job = done.job;
+    int64_t duration_ms = static_cast<int64_t>(done.elapsed_ns / 1000000ULL);
+    if (done.ok) {
+        if (!done.archive.files.empty()) {
+            notify_archive_result(job.capture_id, job.key, job.sid, done.archive, duration_ms);
         }
     } else {
-        struct stat after;
-        if (stat(archive_path.c_str(), &after) == 0) {
-            archive_size = static_cast<unsigned long>(after.st_size);
-        }
-        produced_path = archive_path;
+        notify_archive_failure(job.capture_id, job.key, job.sid, job.files, done.error);
     }
+}
 
-    if ((config_.archive_remove_source || pending.policy.compress_remove_src) && stat(pending.file.file_path.c_str(), &st) == 0) {
-        if (::remove(pending.file.file_path.c_str()) != 0) {
-            LOG_WARNING("Cleanup: failed to remove source file %s", pending.file.file_path.c_str());
-        }
-    }
+void CRxCleanupThread::publish_backlog()
+{
+    uint64_t pending_bytes = 0;
+    for (size_t i = 0; i < pending_files_.size(); ++i) {
+        pending_bytes += pending_files_[i].file.file_size;
+    }
+    __atomic_store_n(&backlog_.queued_jobs, static_cast<uint64_t>(compress_queue_.size()), __ATOMIC_RELAXED);
+    __atomic_store_n(&backlog_.queued_bytes, compress_queue_.bytes(), __ATOMIC_RELAXED);
+    __atomic_store_n(&backlog_.pending_files, static_cast<uint64_t>(pending_files_.size()), __ATOMIC_RELAXED);
+    __atomic_store_n(&backlog_.pending_bytes, pending_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&backlog_.busy_workers,
+                     static_cast<uint64_t>(compress_workers_.size() - idle_workers_.size()), __ATOMIC_RELAXED);
+    __atomic_store_n(&backlog_.workers, static_cast<uint64_t>(compress_workers_.size()), __ATOMIC_RELAXED);
+}
 
-    CaptureFileInfo compressed = pending.file;
-    compressed.compressed = true;
-    compressed.archive_path = produced_path.empty() ? pending.file.file_path : produced_path;
-    compressed.compress_finish_ts = static_cast<int64_t>(time(NULL));
+SRxCompressBacklog CRxCleanupThread::compress_backlog()
+{
+    SRxCompressBacklog out;
+    out.queued_jobs = __atomic_load_n(&backlog_.queued_jobs, __ATOMIC_RELAXED);
+    out.queued_bytes = __atomic_load_n(&backlog_.queued_bytes, __ATOMIC_RELAXED);
+    out.pending_files = __atomic_load_n(&backlog_.pending_files, __ATOMIC_RELAXED);
+    out.pending_bytes = __atomic_load_n(&backlog_.pending_bytes, __ATOMIC_RELAXED);
+    out.busy_workers = __atomic_load_n(&backlog_.busy_workers, __ATOMIC_RELAXED);
+    out.workers = __atomic_load_n(&backlog_.workers, __ATOMIC_RELAXED);
+    return out;
+}
 
-    archive.archive_path = compressed.archive_path;
-    archive.archive_size = archive_size;
-    archive.compress_finish_ts = compressed.compress_finish_ts;
-    archive.files.clear();
-    archive.files.push_back(compressed);
+CRxCleanupThread::ArchiveKind CRxCleanupThread::archive_kind(const std::string& format)
+{
+    if (format.empty() || format == "pcap.gz") {
+        return ARCHIVE_SEEKABLE;
+    }
+    if (format == "tar.gz" || format == "tgz") {
+        return ARCHIVE_TAR;
+    }
+    return ARCHIVE_COMMAND;
+}
 
-    LOG_NOTICE("Cleanup: compression complete for %s (archive=%s size=%lu)",
-               pending.file.file_path.c_str(),
-               compressed.archive_path.c_str(),
-               archive_size);
+bool CRxCleanupThread::write_archive(const std::string& archive_path,
+                                     const std::vector<std::string>& sources,
+                                     int level,
+                                     std::string& error_msg) const
+{
+    CRxArchiveWriter writer;
+    writer.set_throttle(&throttle_);
+    std::string error;
+    size_t frame_bytes = static_cast<size_t>(config_.archive_frame_mb) * 1024UL * 1024UL;
+    bool ok = writer.open(archive_path, frame_bytes, config_.archive_threads, level, error);
+    for (size_t i = 0; ok && i < sources.size(); ++i) {
+        size_t pos = sources[i].find_last_of('/');
+        std::string name = pos != std::string::npos ? sources[i].substr(pos + 1) : sources[i];
+        ok = writer.add_file(sources[i], name, error);
+    }
+    if (ok) {
+        ok = writer.close(error);
+    }
+    if (!ok) {
+        LOG_WARNING("Cleanup: archive %s failed: %s", archive_path.c_str(), error.c_str());
+        error_msg = error;
+        return false;
+    }
+    LOG_NOTICE("Cleanup: archive %s written, %llu -> %llu bytes",
+               archive_path.c_str(),
+               static_cast<unsigned long long>(writer.raw_bytes()),
+               static_cast<unsigned long long>(writer.compressed_bytes()));
     return true;
 }
 
-bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
+bool CRxCleanupThread::compress_batch(const SRxCompressJob& job,
                                        CaptureArchiveInfo& archive,
-                                       std::string& error_msg)
+                                       std::string& error_msg) const
 {
+    const std::vector<CaptureFileInfo>& files = job.files;
     if (files.empty()) {
         error_msg = "no_files_to_compress";
         return false;
@@ -537,19 +536,22 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
     archive_path += "batch_";
     archive_path += timestamp_suffix();
     archive_path += "_";
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%d", files[0].capture_id);
+    // Workers run concurrently, so the job sequence keeps two archives of one
+    // capture built within the same second apart.
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%d_%llu", job.capture_id, static_cast<unsigned long long>(job.seq));
     archive_path += buf;
-    archive_path += ".tar.gz";
+    ArchiveKind kind = archive_kind(job.policy.compress_format);
+    archive_path += kind == ARCHIVE_SEEKABLE ? ".pcap.gz" : ".tar.gz";
 
 
     std::string command = "tar -czf '";
     command += archive_path;
     command += "'";
-    size_t file_count = 0;
+    std::vector<std::string> sources;
     for (size_t i = 0; i < files.size(); ++i) {
 
-        std::string filename = files[i].file.file_path;
+        std::string filename = files[i].file_path;
         size_t pos = filename.find_last_of('/');
         std::string basename = (pos != std::string::npos) ? filename.substr(pos + 1) : filename;
         if (basename.find("cleanup") == 0 && basename.find(".log") != std::string::npos) {
@@ -557,10 +559,11 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
             continue;
         }
         command += " '";
-        command += files[i].file.file_path;
+        command += files[i].file_path;
         command += "'";
-        file_count++;
+        sources.push_back(files[i].file_path);
     }
+    size_t file_count = sources.size();
 
     if (file_count == 0) {
         LOG_WARNING("Cleanup: no files to compress after filtering");
@@ -569,9 +572,25 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
     }
 
     LOG_NOTICE("Cleanup: batch compressing %zu files into %s", files.size(), archive_path.c_str());
-    int rc = std::system(command.c_str());
-    if (rc != 0) {
-        LOG_WARNING("Cleanup: batch compression command failed rc=%d", rc);
+    CRxMetrics::inc(RX_CNT_COMPRESS_BATCHES);
+    CRxMetrics::inc(RX_CNT_COMPRESS_FILES, file_count);
+    bool ok = true;
+    if (kind == ARCHIVE_SEEKABLE) {
+        CRxMetricTimer timer(RX_HIST_COMPRESS);
+        ok = write_archive(archive_path, sources, job.policy.compress_level, error_msg);
+    } else {
+        int rc = 0;
+        {
+            CRxMetricTimer timer(RX_HIST_COMPRESS);
+            rc = std::system(command.c_str());
+        }
+        if (rc != 0) {
+            LOG_WARNING("Cleanup: batch compression command failed rc=%d", rc);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        CRxMetrics::inc(RX_CNT_COMPRESS_FAILURES);
         error_msg = "compress_failed";
         return false;
     }
@@ -582,20 +601,22 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
     if (stat(archive_path.c_str(), &archive_st) == 0) {
         archive_size = static_cast<unsigned long>(archive_st.st_size);
     }
+    CRxMetrics::inc(RX_CNT_COMPRESS_IN_BYTES, job.bytes);
+    CRxMetrics::inc(RX_CNT_COMPRESS_OUT_BYTES, archive_size);
 
 
     if (config_.archive_remove_source) {
         for (size_t i = 0; i < files.size(); ++i) {
 
-            std::string filename = files[i].file.file_path;
+            std::string filename = files[i].file_path;
             size_t pos = filename.find_last_of('/');
             std::string basename = (pos != std::string::npos) ? filename.substr(pos + 1) : filename;
             if (basename.find("cleanup") == 0 && basename.find(".log") != std::string::npos) {
                 LOG_DEBUG("Cleanup: skipping record file %s from removal", filename.c_str());
                 continue;
             }
-            if (::remove(files[i].file.file_path.c_str()) != 0) {
-                LOG_WARNING("Cleanup: failed to remove source file %s", files[i].file.file_path.c_str());
+            if (::remove(files[i].file_path.c_str()) != 0) {
+                LOG_WARNING("Cleanup: failed to remove source file %s", files[i].file_path.c_str());
             }
         }
     }
@@ -607,7 +628,7 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
     archive.files.clear();
 
     for (size_t i = 0; i < files.size(); ++i) {
-        CaptureFileInfo compressed = files[i].file;
+        CaptureFileInfo compressed = files[i];
         compressed.compressed = true;
         compressed.archive_path = archive_path;
         compressed.compress_finish_ts = archive.compress_finish_ts;
@@ -619,168 +640,6 @@ bool CRxCleanupThread::compress_batch(const std::vector<PendingFile>& files,
     return true;
 }
 
-std::string CRxCleanupThread::get_record_base_dir() const
-{
-
-    std::string base;
-    CRxProcData* global = CRxProcData::instance();
-    if (global) {
-        CRxStrategyConfigManager* cfg = global->current_strategy_config();
-        if (cfg) {
-            base = cfg->storage().base_dir;
-        }
-    }
-    if (base.empty()) {
-        base = "/var/log/rxtrace/captures";
-    }
-    return base;
-}
-
-std::string CRxCleanupThread::current_record_file() const
-{
-    std::string base = get_record_base_dir();
-    if (!base.empty() && base[base.size() - 1] != '/') {
-        base += "/";
-    }
-    base += "cleanup.log";
-    return base;
-}
-
-void CRxCleanupThread::rotate_record_file_if_needed(size_t incoming_size)
-{
-    if (record_file_path_.empty()) {
-        record_file_path_ = current_record_file();
-        struct stat st;
-        if (stat(record_file_path_.c_str(), &st) == 0) {
-            current_record_size_ = static_cast<unsigned long>(st.st_size);
-        } else {
-            current_record_size_ = 0;
-        }
-    }
-
-    if (record_max_size_bytes_ == 0) {
-        return;
-    }
-
-    if (current_record_size_ + incoming_size <= record_max_size_bytes_) {
-        return;
-    }
-
-    std::string rotated = get_record_base_dir();
-    if (!rotated.empty() && rotated[rotated.size() - 1] != '/') {
-        rotated += "/";
-    }
-    rotated += "cleanup_";
-    rotated += timestamp_suffix();
-    rotated += ".log";
-
-    if (::rename(record_file_path_.c_str(), rotated.c_str()) != 0) {
-        LOG_WARNING("Cleanup: failed to rotate record file %s -> %s (errno=%d)",
-                    record_file_path_.c_str(), rotated.c_str(), errno);
-        current_record_size_ = 0;
-    } else {
-        LOG_NOTICE("Cleanup: rotated record file to %s", rotated.c_str());
-        current_record_size_ = 0;
-        prune_record_files();
-    }
-}
-
-void CRxCleanupThread::prune_record_files()
-{
-    std::string record_dir = get_record_base_dir();
-    DIR* dir = opendir(record_dir.c_str());
-    if (!dir) {
-        return;
-    }
-
-    std::vector<RecordFileEntry> entries;
-    struct dirent* ent = NULL;
-    while ((ent = readdir(dir)) != NULL) {
-        if (ent->d_name[0] == '.') {
-            continue;
-        }
-        std::string name(ent->d_name);
-        if (name.find("cleanup") != 0) {
-            continue;
-        }
-        std::string path = record_dir;
-        if (!path.empty() && path[path.size() - 1] != '/') {
-            path += "/";
-        }
-        path += name;
-        struct stat st;
-        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
-            RecordFileEntry entry;
-            entry.path = path;
-            entry.mtime = st.st_mtime;
-            entries.push_back(entry);
-        }
-    }
-    closedir(dir);
-
-    if (entries.size() <= RECORD_MAX_FILES) {
-        return;
-    }
-
-    std::sort(entries.begin(), entries.end(), record_entry_less);
-
-    size_t to_remove = entries.size() - RECORD_MAX_FILES;
-    for (size_t i = 0; i < to_remove; ++i) {
-        if (::remove(entries[i].path.c_str()) == 0) {
-            LOG_NOTICE("Cleanup: pruned old record file %s", entries[i].path.c_str());
-        }
-    }
-}
-
-std::string CRxCleanupThread::record_file_metadata(int capture_id,
-                                                   const std::string& key,
-                                                   const CaptureFileInfo& info)
-{
-    std::ostringstream oss;
-    int64_t ts = static_cast<int64_t>(time(NULL));
-    oss << "{\"ts\":" << ts
-        << ",\"capture_id\":" << capture_id
-        << ",\"key\":\"" << json_escape_local(key) << "\""
-        << ",\"file\":\"" << json_escape_local(info.file_path) << "\""
-        << ",\"size\":" << info.file_size
-        << ",\"segment\":" << info.segment_index
-        << ",\"segments\":" << info.total_segments
-        << "}\n";
-
-    std::string line = oss.str();
-    std::string record_dir = get_record_base_dir();
-    if (!ensure_directory(record_dir)) {
-        LOG_WARNING("Cleanup: record directory %s unavailable", record_dir.c_str());
-        return std::string();
-    }
-
-    if (record_file_path_.empty()) {
-        record_file_path_ = current_record_file();
-        struct stat st;
-        if (stat(record_file_path_.c_str(), &st) == 0) {
-            current_record_size_ = static_cast<unsigned long>(st.st_size);
-        } else {
-            current_record_size_ = 0;
-        }
-    }
-
-    rotate_record_file_if_needed(line.size());
-
-    FILE* fp = ::fopen(record_file_path_.c_str(), "a");
-    if (!fp) {
-        LOG_WARNING("Cleanup: failed to open record file %s", record_file_path_.c_str());
-        return std::string();
-    }
-    size_t written = ::fwrite(line.data(), 1, line.size(), fp);
-    ::fclose(fp);
-    if (written != line.size()) {
-        LOG_WARNING("Cleanup: failed to write full record entry to %s", record_file_path_.c_str());
-    } else {
-        current_record_size_ += static_cast<unsigned long>(written);
-    }
-    return record_file_path_;
-}
-
 bool CRxCleanupThread::should_compress_size(unsigned long file_size, int policy_threshold_mb) const
 {
     unsigned long effective = compress_threshold_bytes_;
@@ -900,7 +759,8 @@ void CRxCleanupThread::prune_archives()
 void CRxCleanupThread::notify_archive_result(int capture_id,
                                              const std::string& key,
                                              const std::string& sid,
-                                             const CaptureArchiveInfo& archive)
+                                             const CaptureArchiveInfo& archive,
+                                             int64_t duration_ms)
 {
     CRxProcData* global = CRxProcData::instance();
     if (!global) {
@@ -919,7 +779,7 @@ void CRxCleanupThread::notify_archive_result(int capture_id,
     msg->compressed_files = archive.files;
     msg->archive_path = archive.archive_path;
     msg->compressed_bytes = archive.archive_size;
-    msg->compress_duration_ms = 0;
+    msg->compress_duration_ms = duration_ms;
     msg->sender_thread_index = static_cast<int>(get_thread_index());
 
     ObjId target;
@@ -4,6 +4,7 @@
 #include "legacy_core.h"
 #include "rxcapturemessages.h"
 #include "rxserverconfig.h"
+#include "rxcompresspool.h"
 using compat::shared_ptr;
 using compat::weak_ptr;
 using compat::static_pointer_cast;
@@ -15,10 +16,6 @@ using compat::make_shared;
 
 static const int CLEANUP_INTERVAL_SEC = 60;
 
-
-static const unsigned long RECORD_MAX_SIZE_BYTES = 50 * 1024UL * 1024UL;
-static const unsigned int RECORD_MAX_FILES = 2;
-
 class CRxCleanupThread : public base_net_thread {
 public:
     CRxCleanupThread();
@@ -27,6 +24,11 @@ public:
     bool start();
     void configure(const CRxServerConfig::CleanupConfig& cfg, const CRxServerConfig::StorageConfig& storage_cfg);
 
+    // Runs on a compression worker; only reads configuration.
+    bool compress_batch(const SRxCompressJob& job, CaptureArchiveInfo& archive, std::string& error_msg) const;
+
+    static SRxCompressBacklog compress_backlog();
+
 protected:
     virtual void handle_msg(shared_ptr<normal_msg>& msg);
     virtual void handle_timeout(shared_ptr<timer_msg>& t_msg);
@@ -40,34 +42,40 @@ private:
         CaptureConfigSnapshot policy;
     };
     enum { CLEANUP_TIMER_TYPE = 1 };
+    enum ArchiveKind { ARCHIVE_SEEKABLE, ARCHIVE_TAR, ARCHIVE_COMMAND };
+    static ArchiveKind archive_kind(const std::string& format);
     void schedule_cleanup_timer();
     void do_cleanup();
     void cleanup_pdef_temp_files();
     void enqueue_files(const SRxFileEnqueueMsgV2& enqueue_msg);
     void process_pending_files();
-    bool compress_file(const PendingFile& pending, CaptureArchiveInfo& archive, std::string& error_msg);
-    bool compress_batch(const std::vector<PendingFile>& files, CaptureArchiveInfo& archive, std::string& error_msg);
-    std::string record_file_metadata(int capture_id, const std::string& key, const CaptureFileInfo& info);
-    void rotate_record_file_if_needed(size_t incoming_size);
-    void prune_record_files();
-    std::string current_record_file() const;
-    void notify_archive_result(int capture_id, const std::string& key, const std::string& sid, const CaptureArchiveInfo& archive);
+    bool write_archive(const std::string& archive_path, const std::vector<std::string>& sources, int level, std::string& error_msg) const;
+    void start_compress_workers();
+    void dispatch_compress_jobs();
+    void handle_compress_done(const SRxCompressDoneMsg& done);
+    void publish_backlog();
+    void notify_archive_result(int capture_id, const std::string& key, const std::string& sid, const CaptureArchiveInfo& archive, int64_t duration_ms);
     void notify_archive_failure(int capture_id, const std::string& key, const std::string& sid, const std::vector<CaptureFileInfo>& files, const std::string& error);
     bool should_compress_size(unsigned long file_size, int policy_threshold_mb) const;
     void prune_archives();
-    std::string get_record_base_dir() const;
 
     int cleanup_interval_sec_;
     CRxServerConfig::CleanupConfig config_;
     std::string pdef_dir_;
     long pdef_ttl_seconds_;
-    std::string record_file_path_;
-    unsigned long current_record_size_;
-    unsigned long record_max_size_bytes_;
     unsigned long compress_threshold_bytes_;
     unsigned long long archive_max_total_bytes_;
     long archive_retention_seconds_;
     std::vector<PendingFile> pending_files_;
+
+    CRxCompressQueue compress_queue_;
+    mutable CRxIoThrottle throttle_;
+    int ioprio_;
+    std::vector<CRxCompressWorker*> compress_workers_;
+    std::vector<uint32_t> idle_workers_;
+    uint64_t next_job_seq_;
+
+    static SRxCompressBacklog backlog_;
 };
 
 #endif
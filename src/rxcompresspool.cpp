@@ -0,0 +1,178 @@
+#include "rxcompresspool.h"
+#include "rxcleanupthread.h"
+#include "rxmetrics.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+const int IOPRIO_CLASS_SHIFT = 13;
+const int IOPRIO_CLASS_BE = 2;
+const int IOPRIO_CLASS_IDLE = 3;
+const int IOPRIO_WHO_PROCESS = 1;
+
+}
+
+CRxCompressQueue::CRxCompressQueue()
+    : max_jobs_(32)
+    , order_(ORDER_OLDEST)
+    , bytes_(0)
+    , next_seq_(0)
+{
+}
+
+bool CRxCompressQueue::parse_order(const std::string& name, EOrder& order)
+{
+    if (name == "oldest") {
+        order = ORDER_OLDEST;
+    } else if (name == "largest") {
+        order = ORDER_LARGEST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void CRxCompressQueue::configure(size_t max_jobs, EOrder order)
+{
+    max_jobs_ = max_jobs > 0 ? max_jobs : 1;
+    order_ = order;
+}
+
+bool CRxCompressQueue::push(const SRxCompressJob& job)
+{
+    if (full()) {
+        return false;
+    }
+    Key key;
+    if (order_ == ORDER_LARGEST) {
+        key.rank = ~job.bytes;
+    } else {
+        key.rank = job.oldest_ts > 0 ? static_cast<uint64_t>(job.oldest_ts) : 0;
+    }
+    key.seq = next_seq_++;
+    jobs_[key] = job;
+    bytes_ += job.bytes;
+    return true;
+}
+
+bool CRxCompressQueue::pop(SRxCompressJob& job)
+{
+    if (jobs_.empty()) {
+        return false;
+    }
+    std::map<Key, SRxCompressJob>::iterator it = jobs_.begin();
+    job = it->second;
+    bytes_ -= job.bytes;
+    jobs_.erase(it);
+    return true;
+}
+
+CRxIoThrottle::CRxIoThrottle()
+    : rate_(0)
+    , tokens_(0.0)
+    , last_ns_(0)
+{
+}
+
+void CRxIoThrottle::set_rate(uint64_t bytes_per_sec)
+{
+    CRxThreadLock lock(&mutex_);
+    __atomic_store_n(&rate_, bytes_per_sec, __ATOMIC_RELAXED);
+    tokens_ = static_cast<double>(bytes_per_sec);
+    last_ns_ = CRxMetrics::now_ns();
+}
+
+uint64_t CRxIoThrottle::consume(uint64_t bytes)
+{
+    if (rate() == 0 || bytes == 0) {
+        return 0;
+    }
+    uint64_t wait_ns = 0;
+    {
+        CRxThreadLock lock(&mutex_);
+        if (rate_ == 0) {
+            return 0;
+        }
+        uint64_t now = CRxMetrics::now_ns();
+        double burst = static_cast<double>(rate_);
+        tokens_ += static_cast<double>(now - last_ns_) * 1e-9 * burst;
+        if (tokens_ > burst) {
+            tokens_ = burst;
+        }
+        last_ns_ = now;
+        tokens_ -= static_cast<double>(bytes);
+        if (tokens_ < 0.0) {
+            wait_ns = static_cast<uint64_t>(-tokens_ / burst * 1e9);
+        }
+    }
+    if (wait_ns > 0) {
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(wait_ns / 1000000000ULL);
+        ts.tv_nsec = static_cast<long>(wait_ns % 1000000000ULL);
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+    return wait_ns;
+}
+
+bool parse_ioprio(const std::string& spec, int& value)
+{
+    if (spec.empty() || spec == "none") {
+        value = 0;
+    } else if (spec == "idle") {
+        value = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    } else if (spec == "be") {
+        value = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 4;
+    } else if (spec.size() == 4 && spec.compare(0, 3, "be:") == 0 && spec[3] >= '0' && spec[3] <= '7') {
+        value = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | (spec[3] - '0');
+    } else {
+        return false;
+    }
+    return true;
+}
+
+CRxCompressWorker::CRxCompressWorker(CRxCleanupThread* owner, int ioprio)
+    : owner_(owner)
+    , ioprio_(ioprio)
+    , ioprio_applied_(false)
+{
+}
+
+void CRxCompressWorker::handle_msg(shared_ptr<normal_msg>& msg)
+{
+    if (!msg || msg->_msg_op != RX_MSG_COMPRESS_JOB) {
+        base_net_thread::handle_msg(msg);
+        return;
+    }
+    shared_ptr<SRxCompressJobMsg> job_msg = dynamic_pointer_cast<SRxCompressJobMsg>(msg);
+    if (!job_msg || !owner_) {
+        return;
+    }
+
+    // ioprio_set() with who == 0 targets the calling thread, so this has to
+    // run on the worker rather than in the constructor.
+    if (!ioprio_applied_) {
+        ioprio_applied_ = true;
+        if (ioprio_ != 0 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio_) != 0) {
+            LOG_WARNING("compress worker %u: ioprio_set failed: %s", get_thread_index(), strerror(errno));
+        }
+    }
+
+    shared_ptr<SRxCompressDoneMsg> done(new SRxCompressDoneMsg());
+    done->job = job_msg->job;
+    done->worker_index = get_thread_index();
+    uint64_t start = CRxMetrics::now_ns();
+    done->ok = owner_->compress_batch(done->job, done->archive, done->error);
+    done->elapsed_ns = CRxMetrics::now_ns() - start;
+
+    ObjId target;
+    target._id = OBJ_ID_THREAD;
+    target._thread_index = owner_->get_thread_index();
+    shared_ptr<normal_msg> base = static_pointer_cast<normal_msg>(done);
+    base_net_thread::put_obj_msg(target, base);
+}
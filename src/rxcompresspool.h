@@ -0,0 +1,167 @@
+#ifndef RX_COMPRESS_POOL_H
+#define RX_COMPRESS_POOL_H
+
+#include "legacy_core.h"
+#include "rxcapturemessages.h"
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class CRxCleanupThread;
+
+// One archive to build: the pending segments of a capture at the time the
+// batch thresholds were met.
+struct SRxCompressJob {
+    uint64_t seq;
+    int capture_id;
+    std::string key;
+    std::string sid;
+    std::vector<CaptureFileInfo> files;
+    CaptureConfigSnapshot policy;
+    uint64_t bytes;
+    int64_t oldest_ts;
+
+    SRxCompressJob()
+        : seq(0)
+        , capture_id(0)
+        , bytes(0)
+        , oldest_ts(0)
+    {
+    }
+};
+
+struct SRxCompressJobMsg : public normal_msg {
+    SRxCompressJob job;
+
+    SRxCompressJobMsg()
+        : normal_msg(RX_MSG_COMPRESS_JOB)
+    {
+    }
+};
+
+struct SRxCompressDoneMsg : public normal_msg {
+    SRxCompressJob job;
+    bool ok;
+    CaptureArchiveInfo archive;
+    std::string error;
+    uint32_t worker_index;
+    uint64_t elapsed_ns;
+
+    SRxCompressDoneMsg()
+        : normal_msg(RX_MSG_COMPRESS_DONE)
+        , ok(false)
+        , worker_index(0)
+        , elapsed_ns(0)
+    {
+    }
+};
+
+// Pending archive jobs, bounded, ordered by the configured priority (FIFO
+// among equals). Owned by the cleanup thread and not locked.
+class CRxCompressQueue {
+public:
+    enum EOrder {
+        ORDER_OLDEST = 0,
+        ORDER_LARGEST
+    };
+
+    CRxCompressQueue();
+
+    // Returns false for an unknown name.
+    static bool parse_order(const std::string& name, EOrder& order);
+
+    void configure(size_t max_jobs, EOrder order);
+
+    // False when the queue is full; the caller keeps the files pending.
+    bool push(const SRxCompressJob& job);
+    bool pop(SRxCompressJob& job);
+
+    size_t size() const { return jobs_.size(); }
+    uint64_t bytes() const { return bytes_; }
+    bool full() const { return jobs_.size() >= max_jobs_; }
+
+private:
+    struct Key {
+        uint64_t rank;
+        uint64_t seq;
+
+        bool operator<(const Key& other) const
+        {
+            if (rank != other.rank) {
+                return rank < other.rank;
+            }
+            return seq < other.seq;
+        }
+    };
+
+    std::map<Key, SRxCompressJob> jobs_;
+    size_t max_jobs_;
+    EOrder order_;
+    uint64_t bytes_;
+    uint64_t next_seq_;
+};
+
+// Token bucket on bytes read by the archive writers, shared by all
+// compression workers. A consumer that overdraws sleeps off its debt, so the
+// long-run read rate stays at the limit with at most one second of burst.
+class CRxIoThrottle {
+public:
+    CRxIoThrottle();
+
+    // 0 disables throttling.
+    void set_rate(uint64_t bytes_per_sec);
+    uint64_t rate() const { return __atomic_load_n(&rate_, __ATOMIC_RELAXED); }
+
+    // Returns the nanoseconds slept.
+    uint64_t consume(uint64_t bytes);
+
+private:
+    CRxThreadMutex mutex_;
+    uint64_t rate_;
+    double tokens_;
+    uint64_t last_ns_;
+};
+
+// Parses "none", "idle", "be" or "be:N" (N = 0..7, 7 lowest) into an
+// ioprio_set() value; 0 means leave the I/O priority alone.
+bool parse_ioprio(const std::string& spec, int& value);
+
+// Snapshot of the compression backlog, published by the cleanup thread for
+// /metrics.
+struct SRxCompressBacklog {
+    uint64_t queued_jobs;
+    uint64_t queued_bytes;
+    uint64_t pending_files;
+    uint64_t pending_bytes;
+    uint64_t busy_workers;
+    uint64_t workers;
+
+    SRxCompressBacklog()
+        : queued_jobs(0)
+        , queued_bytes(0)
+        , pending_files(0)
+        , pending_bytes(0)
+        , busy_workers(0)
+        , workers(0)
+    {
+    }
+};
+
+// Builds archives for the cleanup thread, one job at a time, and reports the
+// result back to it. The I/O priority is applied to the worker thread itself
+// and is inherited by tar or policy commands it runs.
+class CRxCompressWorker : public base_net_thread {
+public:
+    CRxCompressWorker(CRxCleanupThread* owner, int ioprio);
+
+protected:
+    virtual void handle_msg(shared_ptr<normal_msg>& msg);
+
+private:
+    CRxCleanupThread* owner_;
+    int ioprio_;
+    bool ioprio_applied_;
+};
+
+#endif
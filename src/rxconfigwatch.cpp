@@ -0,0 +1,143 @@
+#include "rxconfigwatch.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+namespace {
+
+const uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+
+void split_path(const std::string& path, std::string& dir, std::string& name)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        dir = ".";
+        name = path;
+    } else {
+        dir = slash == 0 ? std::string("/") : path.substr(0, slash);
+        name = path.substr(slash + 1);
+    }
+}
+
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+shared_ptr<CRxConfigWatcher> CRxConfigWatcher::create(CRxConfigChangeSink* sink)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        LOG_WARNING("inotify_init1 failed: %s", strerror(errno));
+        return shared_ptr<CRxConfigWatcher>();
+    }
+    return shared_ptr<CRxConfigWatcher>(new CRxConfigWatcher(fd, sink));
+}
+
+CRxConfigWatcher::CRxConfigWatcher(int fd, CRxConfigChangeSink* sink)
+    : sink_(sink)
+{
+    _fd = fd;
+    _epoll_event = EPOLLIN;
+}
+
+CRxConfigWatcher::DirWatch* CRxConfigWatcher::add_dir_watch(const std::string& dir)
+{
+    int wd = inotify_add_watch(_fd, dir.c_str(), kWatchMask);
+    if (wd < 0) {
+        LOG_WARNING("inotify watch on %s failed: %s", dir.c_str(), strerror(errno));
+        return NULL;
+    }
+    DirWatch& watch = watches_[wd];
+    watch.dir = dir;
+    return &watch;
+}
+
+bool CRxConfigWatcher::watch_file(const std::string& path, int kind)
+{
+    if (path.empty()) {
+        return false;
+    }
+    std::string dir;
+    std::string name;
+    split_path(path, dir, name);
+    DirWatch* watch = add_dir_watch(dir);
+    if (!watch) {
+        return false;
+    }
+    watch->files[name] |= kind;
+    return true;
+}
+
+bool CRxConfigWatcher::watch_dir(const std::string& dir, const std::string& suffix, int kind)
+{
+    if (dir.empty()) {
+        return false;
+    }
+    DirWatch* watch = add_dir_watch(dir);
+    if (!watch) {
+        return false;
+    }
+    watch->suffixes[suffix] |= kind;
+    return true;
+}
+
+void CRxConfigWatcher::dispatch(const DirWatch& watch, const std::string& name)
+{
+    int kind = 0;
+    std::map<std::string, int>::const_iterator file = watch.files.find(name);
+    if (file != watch.files.end()) {
+        kind |= file->second;
+    }
+    for (std::map<std::string, int>::const_iterator it = watch.suffixes.begin(); it != watch.suffixes.end(); ++it) {
+        if (ends_with(name, it->first)) {
+            kind |= it->second;
+        }
+    }
+    if (kind != 0) {
+        sink_->on_config_change(kind, watch.dir == "/" ? "/" + name : watch.dir + "/" + name);
+    }
+}
+
+void CRxConfigWatcher::event_process(int events)
+{
+    if ((events & EPOLLIN) == 0) {
+        return;
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t len = read(_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (char* ptr = buf; ptr < buf + len; ) {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                sink_->on_config_change(RX_WATCH_SERVER_CONFIG | RX_WATCH_STRATEGY | RX_WATCH_PDEF, std::string());
+                continue;
+            }
+            std::map<int, DirWatch>::iterator it = watches_.find(ev->wd);
+            if (it == watches_.end()) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                LOG_WARNING("config watch on %s dropped", it->second.dir.c_str());
+                watches_.erase(it);
+                continue;
+            }
+            if (ev->len > 0) {
+                dispatch(it->second, ev->name);
+            }
+        }
+    }
+}
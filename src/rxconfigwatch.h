@@ -0,0 +1,51 @@
+#ifndef RX_CONFIG_WATCH_H
+#define RX_CONFIG_WATCH_H
+
+#include "legacy_core.h"
+#include <map>
+#include <string>
+
+enum ERxWatchKind {
+    RX_WATCH_SERVER_CONFIG = 0x01,
+    RX_WATCH_STRATEGY = 0x02,
+    RX_WATCH_PDEF = 0x04
+};
+
+class CRxConfigChangeSink {
+public:
+    virtual ~CRxConfigChangeSink() {}
+    virtual void on_config_change(int kind, const std::string& path) = 0;
+};
+
+// inotify descriptor living in the owning thread's epoll set. Files are watched
+// through their parent directory so editors that replace a file by rename are
+// still seen; directory watches match by suffix.
+class CRxConfigWatcher : public base_net_obj {
+public:
+    static shared_ptr<CRxConfigWatcher> create(CRxConfigChangeSink* sink);
+
+    virtual ~CRxConfigWatcher() {}
+
+    bool watch_file(const std::string& path, int kind);
+    bool watch_dir(const std::string& dir, const std::string& suffix, int kind);
+
+    virtual void event_process(int events);
+    virtual int real_net_process() { return 0; }
+
+private:
+    struct DirWatch {
+        std::string dir;
+        std::map<std::string, int> files;
+        std::map<std::string, int> suffixes;
+    };
+
+    CRxConfigWatcher(int fd, CRxConfigChangeSink* sink);
+
+    DirWatch* add_dir_watch(const std::string& dir);
+    void dispatch(const DirWatch& watch, const std::string& name);
+
+    CRxConfigChangeSink* sink_;
+    std::map<int, DirWatch> watches_;
+};
+
+#endif
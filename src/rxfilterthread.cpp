@@ -4,20 +4,66 @@
 #include "rxprocdata.h"
 #include "rxreloadthread.h"
 #include "rxcapturemessages.h"
-#include "pdef/parser.h"
+#include "rxpdefcache.h"
+#include "rxmetrics.h"
+#include "rxprotocoldispatcher.h"
+#include "rxarchive.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <netinet/in.h>
 
 namespace {
     const int RX_THREAD_FILTER_TYPE = 5;
+    const size_t MAX_CAPTURE_ENDIAN = 256;
+
+    class PdefSet {
+    public:
+        explicit PdefSet(CRxPdefCache* cache) : cache_(cache) {}
+        ~PdefSet()
+        {
+            for (size_t i = 0; i < defs.size(); ++i) {
+                cache_->release(defs[i]);
+            }
+        }
+
+        std::vector<const ProtocolDef*> defs;
+        std::vector<std::string> paths;
+
+    private:
+        PdefSet(const PdefSet&);
+        PdefSet& operator=(const PdefSet&);
+
+        CRxPdefCache* cache_;
+    };
+
+    std::string protocol_output_path(const std::string& filtered_path, const char* proto_name)
+    {
+        std::string tag;
+        for (const char* c = proto_name; *c; ++c) {
+            char ch = *c;
+            if (ch >= 'A' && ch <= 'Z') {
+                ch = static_cast<char>(ch - 'A' + 'a');
+            }
+            tag.push_back((ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') ? ch : '_');
+        }
+        size_t dot = filtered_path.rfind(".pcap");
+        if (dot == std::string::npos || dot + 5 != filtered_path.size()) {
+            return filtered_path + "." + tag;
+        }
+        return filtered_path.substr(0, dot) + "." + tag + ".pcap";
+    }
 }
 
 CRxFilterThread::CRxFilterThread()
     : base_net_thread(1)
     , protocol_def_(NULL)
     , dump_ctx_(NULL)
+    , reassembler_(NULL)
+    , inline_endian_(ENDIAN_TYPE_UNKNOWN)
+    , inline_endian_reported_(false)
+    , capture_endian_seq_(0)
     , type_(RX_THREAD_FILTER_TYPE)
     , name_("filter")
 {
@@ -25,10 +71,31 @@ CRxFilterThread::CRxFilterThread()
 
 CRxFilterThread::~CRxFilterThread()
 {
-    LOG_NOTICE("Filter thread destructing, stats: processed=%lu matched=%lu filtered=%lu",
+    LOG_NOTICE("Filter thread destructing, stats: processed=%lu matched=%lu filtered=%lu flow_cache_hit=%.1f%%",
                stats_.packets_processed,
                stats_.packets_matched,
-               stats_.packets_filtered);
+               stats_.packets_filtered,
+               stats_.flow_cache_hit_ratio() * 100.0);
+    delete reassembler_;
+}
+
+void CRxFilterThread::configure_reassembly(uint32_t max_flows, uint32_t depth)
+{
+    delete reassembler_;
+    reassembler_ = NULL;
+    if (max_flows == 0 || depth == 0) {
+        return;
+    }
+    reassembler_ = new (std::nothrow) CRxTcpReassembler(max_flows, depth);
+    if (!reassembler_ || !reassembler_->valid()) {
+        LOG_WARNING("Filter thread: failed to allocate TCP reassembly pool (%u flows x %u bytes)",
+                    max_flows, depth);
+        delete reassembler_;
+        reassembler_ = NULL;
+        return;
+    }
+    LOG_NOTICE("Filter thread: TCP reassembly enabled, %u flows x %u bytes (%zu bytes total)",
+               max_flows, depth, reassembler_->memory_bytes());
 }
 
 bool CRxFilterThread::init(ProtocolDef* protocol_def, CRxDumpCtx* dump_ctx)
@@ -40,6 +107,17 @@ bool CRxFilterThread::init(ProtocolDef* protocol_def, CRxDumpCtx* dump_ctx)
 
     protocol_def_ = protocol_def;
     dump_ctx_ = dump_ctx;
+    if (protocol_def_) {
+        inline_endian_ = ENDIAN_TYPE_UNKNOWN;
+        inline_endian_reported_ = false;
+        inline_dispatcher_.add(protocol_def_, &inline_endian_);
+        inline_dispatcher_.build(false);
+    }
+    decoder_.set_linktype(dump_ctx->p ? pcap_datalink(dump_ctx->p) : DLT_EN10MB);
+    if (!decoder_.supported()) {
+        LOG_WARNING("Filter thread: linktype %d is not supported by the packet decoder",
+                    decoder_.linktype());
+    }
     return true;
 }
 
@@ -88,53 +166,42 @@ void CRxFilterThread::handle_packet_captured(shared_ptr<SRxPacketMsg>& packet_ms
     stats_.packets_processed++;
 
 
-    int endian_before = ENDIAN_TYPE_UNKNOWN;
-    if (protocol_def_ && protocol_def_->endian_mode == ENDIAN_MODE_AUTO) {
-        __sync_synchronize();
-        endian_before = protocol_def_->detected_endian;
-    }
-
-
     bool matched = apply_filter(packet_msg.get());
 
-    if (protocol_def_ && protocol_def_->endian_mode == ENDIAN_MODE_AUTO) {
-        __sync_synchronize();
-        int endian_after = protocol_def_->detected_endian;
-
-        if (endian_before == ENDIAN_TYPE_UNKNOWN && endian_after != ENDIAN_TYPE_UNKNOWN) {
-
+    if (protocol_def_ && protocol_def_->endian_mode == ENDIAN_MODE_AUTO && !inline_endian_reported_) {
+        int endian_after = ENDIAN_STATE_TYPE(inline_endian_);
 
-            int old_val = __sync_val_compare_and_swap(&protocol_def_->endian_writeback_done,
-                                                       0, 1);
-            if (old_val == 0) {
+        if (endian_after != ENDIAN_TYPE_UNKNOWN) {
+            inline_endian_reported_ = true;
 
-                CRxProcData* proc_data = CRxProcData::instance();
-                CRxReloadThread* reload_thread = proc_data ? proc_data->get_reload_thread() : NULL;
+            CRxProcData* proc_data = CRxProcData::instance();
+            CRxReloadThread* reload_thread = proc_data ? proc_data->get_reload_thread() : NULL;
 
-                if (reload_thread && protocol_def_->pdef_file_path[0] != '\0') {
-                    shared_ptr<SRxPdefEndianMsg> msg = make_shared<SRxPdefEndianMsg>();
-                    snprintf(msg->pdef_file_path, sizeof(msg->pdef_file_path), "%s",
-                             protocol_def_->pdef_file_path);
-                    msg->detected_endian = endian_after;
+            if (reload_thread && protocol_def_->pdef_file_path[0] != '\0') {
+                shared_ptr<SRxPdefEndianMsg> msg = make_shared<SRxPdefEndianMsg>();
+                snprintf(msg->pdef_file_path, sizeof(msg->pdef_file_path), "%s",
+                         protocol_def_->pdef_file_path);
+                msg->detected_endian = endian_after;
 
 
-                    ObjId target;
-                    target._id = OBJ_ID_THREAD;
-                    target._thread_index = reload_thread->get_thread_index();
+                ObjId target;
+                target._id = OBJ_ID_THREAD;
+                target._thread_index = reload_thread->get_thread_index();
 
-                    shared_ptr<normal_msg> base_msg = static_pointer_cast<normal_msg>(msg);
-                    base_net_thread::put_obj_msg(target, base_msg);
+                shared_ptr<normal_msg> base_msg = static_pointer_cast<normal_msg>(msg);
+                base_net_thread::put_obj_msg(target, base_msg);
 
-                    LOG_NOTICE("Sent PDEF endian writeback request: %s -> %s",
-                               protocol_def_->pdef_file_path,
-                               endian_after == ENDIAN_TYPE_BIG ? "big" : "little");
-                }
+                LOG_NOTICE("Sent PDEF endian writeback request: %s -> %s",
+                           protocol_def_->pdef_file_path,
+                           endian_after == ENDIAN_TYPE_BIG ? "big" : "little");
             }
         }
     }
 
+    CRxMetrics::inc(RX_CNT_FILTER_PACKETS);
     if (matched) {
         stats_.packets_matched++;
+        CRxMetrics::inc(RX_CNT_FILTER_MATCHED);
 
 
         write_packet(packet_msg.get());
@@ -159,26 +226,66 @@ bool CRxFilterThread::apply_filter(const SRxPacketMsg* packet)
         return false;
     }
 
-    const uint8_t* app_data = packet->data + packet->app_offset;
+    ParsedPacket parsed = parse_packet_data(decoder_, packet->data, packet->header.caplen);
+    if (!parsed.valid) {
+        // Without addresses there is no flow to cache a verdict for; an
+        // all-zero key would share one verdict across unrelated packets.
+        return inline_dispatcher_.match(packet->data + packet->app_offset, packet->app_len,
+                                        packet->src_port, packet->dst_port) != CRxProtocolDispatcher::NO_MATCH;
+    }
+    parsed.app_data = packet->data + packet->app_offset;
+    parsed.app_len = packet->app_len;
+
+    return match_flow(parsed, static_cast<uint32_t>(packet->header.ts.tv_sec),
+                      inline_dispatcher_) != CRxProtocolDispatcher::NO_MATCH;
+}
+
+int CRxFilterThread::match_flow(const ParsedPacket& parsed, uint32_t ts_sec,
+                                CRxProtocolDispatcher& dispatcher)
+{
+    const SRxFlowKey& key = parsed.key;
 
+    SRxFlowEntry* flow = flow_cache_.lookup(key, ts_sec);
+    stats_.flow_cache_lookups++;
+    if (flow->verdict == RX_FLOW_MATCHED) {
+        stats_.flow_cache_hits++;
+        return flow->tag;
+    }
+    if (flow->verdict == RX_FLOW_REJECTED) {
+        stats_.flow_cache_hits++;
+        return CRxProtocolDispatcher::NO_MATCH;
+    }
 
-    bool matched = packet_filter_match(
-        app_data,
-        packet->app_len,
-        packet->dst_port,
-        protocol_def_
-    );
+    bool sampled = CRxMetrics::sample_tick();
+    uint64_t match_start_ns = sampled ? CRxMetrics::now_ns() : 0;
 
-    if (!matched) {
+    int matched = dispatcher.match(parsed.app_data, parsed.app_len, parsed.src_port, parsed.dst_port);
 
-        matched = packet_filter_match(
-            app_data,
-            packet->app_len,
-            packet->src_port,
-            protocol_def_
-        );
+    if (reassembler_ && parsed.ip_proto == IPPROTO_TCP) {
+        if (matched == CRxProtocolDispatcher::NO_MATCH) {
+            uint32_t stream_len = 0;
+            const uint8_t* stream = reassembler_->add(key, parsed.tcp_seq, parsed.tcp_flags,
+                                                      parsed.app_data, parsed.app_len, &stream_len);
+            if (stream && stream_len > parsed.app_len) {
+                matched = dispatcher.match(stream, stream_len, parsed.src_port, parsed.dst_port);
+                if (matched != CRxProtocolDispatcher::NO_MATCH) {
+                    stats_.reassembled_matches++;
+                }
+            }
+        }
     }
 
+    if (sampled) {
+        CRxMetrics::observe_ns(RX_HIST_FILTER_PACKET, CRxMetrics::now_ns() - match_start_ns);
+    }
+
+    flow_cache_.resolve(flow, matched != CRxProtocolDispatcher::NO_MATCH,
+                        static_cast<uint8_t>(matched < 0 ? 0 : matched));
+
+    if (reassembler_ && reassembler_->active() > 0 && flow->verdict != RX_FLOW_UNDECIDED) {
+        reassembler_->release(key);
+        reassembler_->release(key.reversed());
+    }
     return matched;
 }
 
@@ -203,56 +310,40 @@ void CRxFilterThread::write_packet(const SRxPacketMsg* packet)
 
     pcap_dump((u_char*)dump_ctx_->d, &packet->header, packet->data);
     dump_ctx_->written += pkt_bytes;
+    CRxMetrics::inc(RX_CNT_WRITE_BYTES, static_cast<uint64_t>(pkt_bytes));
 }
 
-CRxFilterThread::ParsedPacket CRxFilterThread::parse_packet_data(const uint8_t* data, uint32_t len)
+CRxFilterThread::ParsedPacket CRxFilterThread::parse_packet_data(const CRxPacketDecoder& decoder,
+                                                                 const uint8_t* data, uint32_t len)
 {
     ParsedPacket result;
     result.app_data = NULL;
     result.app_len = 0;
     result.src_port = 0;
     result.dst_port = 0;
+    result.ip_proto = 0;
+    result.tcp_flags = 0;
+    result.tcp_seq = 0;
     result.valid = false;
-    const uint32_t eth_header_len = 14u;
-
-
-    if (len < eth_header_len) return result;
-
-    uint16_t eth_type = (data[12] << 8) | data[13];
-    if (eth_type != 0x0800) return result;
-
-
-    const uint8_t* ip_header = data + eth_header_len;
-    if (len < eth_header_len + 20u) return result;
-
-    uint32_t ip_header_len = static_cast<uint32_t>((ip_header[0] & 0x0F) * 4);
-    uint8_t protocol = ip_header[9];
-
-    if (len < eth_header_len + ip_header_len) return result;
-
 
-    const uint8_t* transport_header = ip_header + ip_header_len;
-    if (len < eth_header_len + ip_header_len + 4u) return result;
-
-    result.src_port = (transport_header[0] << 8) | transport_header[1];
-    result.dst_port = (transport_header[2] << 8) | transport_header[3];
-
-    uint32_t transport_header_len = 0;
-    if (protocol == 6) {
-        if (len < eth_header_len + ip_header_len + 12u) return result;
-        transport_header_len = static_cast<uint32_t>(((transport_header[12] >> 4) & 0x0F) * 4);
-    } else if (protocol == 17) {
-        transport_header_len = 8u;
-    } else {
+    SRxDecodedPacket pkt;
+    if (!decoder.decode(data, len, pkt)) {
         return result;
     }
 
-
-    uint32_t offset = eth_header_len + ip_header_len + transport_header_len;
-    if (offset >= len) return result;
-
-    result.app_data = transport_header + transport_header_len;
-    result.app_len = len - offset;
+    SRxFlowKey key = CRxPacketDecoder::flow_key(pkt);
+    result.key = key;
+    result.src_port = key.src_port;
+    result.dst_port = key.dst_port;
+    result.ip_proto = key.proto;
+    if (pkt.ip_proto == IPPROTO_TCP && pkt.l4_offset + 14 <= len) {
+        const uint8_t* tcp = data + pkt.l4_offset;
+        result.tcp_seq = (static_cast<uint32_t>(tcp[4]) << 24) | (static_cast<uint32_t>(tcp[5]) << 16) |
+                         (static_cast<uint32_t>(tcp[6]) << 8) | tcp[7];
+        result.tcp_flags = tcp[13];
+    }
+    result.app_data = data + pkt.payload_offset;
+    result.app_len = pkt.payload_len;
     result.valid = (result.app_len > 0);
 
     return result;
@@ -276,34 +367,62 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
     int64_t start_ts = rx_capture_now_usec();
 
 
-    ProtocolDef* pdef = NULL;
+    CRxPdefCache* pdef_cache = CRxPdefCache::instance();
+    PdefSet pdefs(pdef_cache);
     char errmsg[512];
+    errmsg[0] = '\0';
 
     if (!raw_msg->pdef_inline_content.empty()) {
-        fprintf(stderr, "[DEBUG FILTER RAW] Parsing inline PDEF\n");
-        pdef = pdef_parse_string(raw_msg->pdef_inline_content.c_str(), errmsg, sizeof(errmsg));
-    } else if (!raw_msg->pdef_file_path.empty()) {
-        fprintf(stderr, "[DEBUG FILTER RAW] Parsing PDEF file: %s\n", raw_msg->pdef_file_path.c_str());
-        pdef = pdef_parse_file(raw_msg->pdef_file_path.c_str(), errmsg, sizeof(errmsg));
+        LOG_DEBUG("FilterThread %u: loading inline PDEF", get_thread_index());
+        const ProtocolDef* def = pdef_cache->acquire_source(raw_msg->pdef_inline_content, std::string(),
+                                                            errmsg, sizeof(errmsg));
+        if (def) {
+            pdefs.defs.push_back(def);
+            pdefs.paths.push_back(std::string());
+        }
+    } else {
+        std::vector<std::string> paths = CRxProtocolDispatcher::split_list(raw_msg->pdef_file_path);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            LOG_DEBUG("FilterThread %u: loading PDEF file %s", get_thread_index(), paths[i].c_str());
+            const ProtocolDef* def = pdef_cache->acquire_file(paths[i], errmsg, sizeof(errmsg));
+            if (!def) {
+                LOG_ERROR("FilterThread: failed to load PDEF %s: %s", paths[i].c_str(), errmsg);
+                continue;
+            }
+            pdefs.defs.push_back(def);
+            pdefs.paths.push_back(paths[i]);
+        }
     }
 
-    if (!pdef) {
+    if (pdefs.defs.empty()) {
         fprintf(stderr, "[DEBUG FILTER RAW] ERROR: Failed to load PDEF: %s\n", errmsg);
         LOG_ERROR("FilterThread: failed to load PDEF: %s", errmsg);
 
         return;
     }
 
-    fprintf(stderr, "[DEBUG FILTER RAW] PDEF loaded successfully\n");
+    std::string pdef_id = raw_msg->pdef_inline_content.empty() ? raw_msg->pdef_file_path
+                                                               : raw_msg->pdef_inline_content;
+    CaptureEndian& endian = capture_endian(raw_msg->capture_id, pdef_id, pdefs.defs.size());
+
+    CRxProtocolDispatcher dispatcher;
+    for (size_t i = 0; i < pdefs.defs.size(); ++i) {
+        if (dispatcher.add(pdefs.defs[i], &endian.states[i]) == CRxProtocolDispatcher::NO_MATCH) {
+            LOG_WARNING("FilterThread: too many PDEFs, ignoring %s", pdefs.defs[i]->name);
+        }
+    }
+    bool split_output = dispatcher.size() > 1;
+    dispatcher.build(split_output);
+
+    LOG_DEBUG("FilterThread %u: %zu PDEF(s) loaded", get_thread_index(), dispatcher.size());
 
 
     char pcap_errbuf[PCAP_ERRBUF_SIZE];
     fprintf(stderr, "[DEBUG FILTER RAW] Opening raw pcap: %s\n", raw_msg->raw_pcap_path.c_str());
-    pcap_t* pcap_in = pcap_open_offline(raw_msg->raw_pcap_path.c_str(), pcap_errbuf);
+    pcap_t* pcap_in = CRxArchiveReader::open_offline(raw_msg->raw_pcap_path, pcap_errbuf);
     if (!pcap_in) {
         fprintf(stderr, "[DEBUG FILTER RAW] ERROR: Failed to open raw pcap: %s\n", pcap_errbuf);
         LOG_ERROR("FilterThread: failed to open raw pcap: %s", pcap_errbuf);
-        protocol_free(pdef);
         return;
     }
 
@@ -317,19 +436,49 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
         filtered_path += ".filtered";
     }
 
-    fprintf(stderr, "[DEBUG FILTER RAW] Creating filtered output: %s\n", filtered_path.c_str());
+    std::vector<std::string> out_paths(dispatcher.size(), filtered_path);
+    std::vector<pcap_dumper_t*> outs(dispatcher.size(), static_cast<pcap_dumper_t*>(NULL));
+    std::vector<unsigned long> out_matched(dispatcher.size(), 0);
+    for (size_t i = 0; split_output && i < dispatcher.size(); ++i) {
+        out_paths[i] = protocol_output_path(filtered_path, dispatcher.protocol(static_cast<int>(i))->name);
+    }
 
-    pcap_dumper_t* pcap_out = pcap_dump_open(pcap_in, filtered_path.c_str());
-    if (!pcap_out) {
-        fprintf(stderr, "[DEBUG FILTER RAW] ERROR: Failed to open output pcap: %s\n", pcap_geterr(pcap_in));
-        LOG_ERROR("FilterThread: failed to open output pcap: %s", pcap_geterr(pcap_in));
-        pcap_close(pcap_in);
-        protocol_free(pdef);
-        return;
+    for (size_t i = 0; i < outs.size(); ++i) {
+        if (split_output && i > 0 && out_paths[i] == out_paths[0]) {
+            continue;
+        }
+        fprintf(stderr, "[DEBUG FILTER RAW] Creating filtered output: %s\n", out_paths[i].c_str());
+        outs[i] = pcap_dump_open(pcap_in, out_paths[i].c_str());
+        if (!outs[i]) {
+            fprintf(stderr, "[DEBUG FILTER RAW] ERROR: Failed to open output pcap: %s\n", pcap_geterr(pcap_in));
+            LOG_ERROR("FilterThread: failed to open output pcap: %s", pcap_geterr(pcap_in));
+            for (size_t j = 0; j < i; ++j) {
+                if (outs[j]) {
+                    pcap_dump_close(outs[j]);
+                    unlink(out_paths[j].c_str());
+                }
+            }
+            pcap_close(pcap_in);
+            return;
+        }
     }
 
     fprintf(stderr, "[DEBUG FILTER RAW] Output pcap created, starting filtering...\n");
 
+    CRxPacketDecoder decoder(pcap_datalink(pcap_in));
+    if (!decoder.supported()) {
+        LOG_WARNING("FilterThread %u: linktype %d of %s is not supported, no packet will match",
+                    get_thread_index(), decoder.linktype(), raw_msg->raw_pcap_path.c_str());
+    }
+
+    flow_cache_.clear();
+    if (reassembler_) {
+        reassembler_->clear();
+    }
+    unsigned long reassembled_before = stats_.reassembled_matches;
+    unsigned long lookups_before = stats_.flow_cache_lookups;
+    unsigned long hits_before = stats_.flow_cache_hits;
+
 
     struct pcap_pkthdr* header;
     const u_char* data;
@@ -340,29 +489,17 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
     while ((ret = pcap_next_ex(pcap_in, &header, &data)) > 0) {
         total++;
 
-        ParsedPacket parsed = parse_packet_data(data, header->caplen);
+        ParsedPacket parsed = parse_packet_data(decoder, data, header->caplen);
         if (!parsed.valid || parsed.app_len == 0) {
             continue;
         }
 
-        bool match = packet_filter_match(
-            parsed.app_data,
-            parsed.app_len,
-            parsed.dst_port,
-            pdef
-        );
-
-        if (!match) {
-            match = packet_filter_match(
-                parsed.app_data,
-                parsed.app_len,
-                parsed.src_port,
-                pdef
-            );
-        }
+        int match = match_flow(parsed, static_cast<uint32_t>(header->ts.tv_sec), dispatcher);
 
-        if (match) {
-            pcap_dump((u_char*)pcap_out, header, data);
+        if (match != CRxProtocolDispatcher::NO_MATCH) {
+            pcap_dumper_t* out = outs[match] ? outs[match] : outs[0];
+            pcap_dump((u_char*)out, header, data);
+            out_matched[match]++;
             matched++;
         }
 
@@ -375,17 +512,40 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
 
 
     fprintf(stderr, "[DEBUG FILTER RAW] Filtering complete: %lu/%lu packets matched. Closing files...\n", matched, total);
-    pcap_dump_close(pcap_out);
+    for (size_t i = 0; i < outs.size(); ++i) {
+        if (outs[i]) {
+            pcap_dump_close(outs[i]);
+        }
+    }
     pcap_close(pcap_in);
 
     int64_t finish_ts = rx_capture_now_usec();
     double elapsed_sec = (finish_ts - start_ts) / 1000000.0;
 
+    CRxMetrics::inc(RX_CNT_FILTER_FILES);
+    CRxMetrics::inc(RX_CNT_FILTER_PACKETS, total);
+    CRxMetrics::inc(RX_CNT_FILTER_MATCHED, matched);
+    CRxMetrics::observe_ns(RX_HIST_FILTER_FILE, static_cast<uint64_t>(finish_ts - start_ts) * 1000ULL);
+
     fprintf(stderr, "[DEBUG FILTER RAW] Files closed, elapsed time: %.2f sec\n", elapsed_sec);
 
-    LOG_NOTICE("FilterThread %u: filtered %s in %.2f sec (%lu/%lu packets kept)",
+    stats_.packets_processed += total;
+    stats_.packets_matched += matched;
+    stats_.packets_filtered += total - matched;
+    unsigned long file_lookups = stats_.flow_cache_lookups - lookups_before;
+    unsigned long file_hits = stats_.flow_cache_hits - hits_before;
+
+    LOG_NOTICE("FilterThread %u: filtered %s in %.2f sec (%lu/%lu packets kept, flow cache hit %.1f%% of %lu, evictions=%lu)",
                get_thread_index(), raw_msg->raw_pcap_path.c_str(),
-               elapsed_sec, matched, total);
+               elapsed_sec, matched, total,
+               file_lookups > 0 ? 100.0 * static_cast<double>(file_hits) / static_cast<double>(file_lookups) : 0.0,
+               file_lookups, flow_cache_.stats().evictions);
+    if (reassembler_) {
+        const CRxTcpReassembler::Stats& rs = reassembler_->stats();
+        LOG_NOTICE("FilterThread %u: TCP reassembly matched %lu flows (streams=%lu evictions=%lu gaps=%lu reordered=%lu retransmits=%lu truncated=%lu)",
+                   get_thread_index(), stats_.reassembled_matches - reassembled_before,
+                   rs.streams, rs.evictions, rs.gaps, rs.reordered, rs.retransmits, rs.truncated);
+    }
 
 
     if (unlink(raw_msg->raw_pcap_path.c_str()) != 0) {
@@ -411,7 +571,28 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
 
 
     struct stat st;
-    if (stat(filtered_path.c_str(), &st) == 0) {
+    if (split_output) {
+        for (size_t i = 0; i < outs.size(); ++i) {
+            if (!outs[i]) {
+                continue;
+            }
+            CaptureFileInfo info;
+            info.file_path = out_paths[i];
+            if (stat(out_paths[i].c_str(), &st) == 0) {
+                info.file_size = static_cast<unsigned long>(st.st_size);
+            }
+            filtered->protocol_files.push_back(info);
+            LOG_NOTICE("FilterThread %u: %s -> %s (%lu packets)",
+                       get_thread_index(), dispatcher.protocol(static_cast<int>(i))->name,
+                       out_paths[i].c_str(), out_matched[i]);
+        }
+        filtered->filtered_pcap_path = out_paths[0];
+        const CRxProtocolDispatcher::Stats& ds = dispatcher.stats();
+        LOG_NOTICE("FilterThread %u: dispatched %lu packets over %zu PDEFs (%lu port-indexed, %lu fallback evaluations)",
+                   get_thread_index(), ds.packets, dispatcher.size(),
+                   ds.port_evaluations, ds.fallback_evaluations);
+    }
+    if (stat(filtered->filtered_pcap_path.c_str(), &st) == 0) {
         filtered->file_size = static_cast<unsigned long>(st.st_size);
     }
 
@@ -423,16 +604,20 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
     base_net_thread::put_obj_msg(target, base_msg);
 
 
-    if (pdef->endian_mode == ENDIAN_MODE_AUTO &&
-        pdef->detected_endian != ENDIAN_TYPE_UNKNOWN) {
+    for (size_t i = 0; i < dispatcher.size(); ++i) {
+        int detected_endian = dispatcher.detected_endian(static_cast<int>(i));
+        if (dispatcher.protocol(static_cast<int>(i))->endian_mode != ENDIAN_MODE_AUTO ||
+            detected_endian == ENDIAN_TYPE_UNKNOWN || endian.reported[i]) {
+            continue;
+        }
+        endian.reported[i] = true;
 
-        std::string pdef_path = !raw_msg->pdef_file_path.empty() ?
-                                raw_msg->pdef_file_path : "";
+        const std::string& pdef_path = pdefs.paths[i];
 
         if (!pdef_path.empty()) {
             LOG_NOTICE("FilterThread %u: detected endian=%s for %s (capture_id=%d)",
                       get_thread_index(),
-                      pdef->detected_endian == ENDIAN_TYPE_BIG ? "big" : "little",
+                      detected_endian == ENDIAN_TYPE_BIG ? "big" : "little",
                       pdef_path.c_str(),
                       raw_msg->capture_id);
 
@@ -440,14 +625,39 @@ void CRxFilterThread::handle_raw_file(shared_ptr<SRxCaptureRawFileMsgV2>& raw_ms
             send_endian_detected_to_manager(
                 raw_msg->manager_thread_index,
                 pdef_path,
-                pdef->detected_endian,
+                detected_endian,
                 raw_msg->capture_id
             );
         }
     }
+}
 
+CRxFilterThread::CaptureEndian& CRxFilterThread::capture_endian(int capture_id, const std::string& pdefs,
+                                                                size_t count)
+{
+    std::map<int, CaptureEndian>::iterator it = capture_endian_.find(capture_id);
+    if (it == capture_endian_.end()) {
+        if (capture_endian_.size() >= MAX_CAPTURE_ENDIAN) {
+            std::map<int, CaptureEndian>::iterator oldest = capture_endian_.begin();
+            for (std::map<int, CaptureEndian>::iterator e = capture_endian_.begin();
+                 e != capture_endian_.end(); ++e) {
+                if (e->second.last_use < oldest->second.last_use) {
+                    oldest = e;
+                }
+            }
+            capture_endian_.erase(oldest);
+        }
+        it = capture_endian_.insert(std::make_pair(capture_id, CaptureEndian())).first;
+    }
 
-    protocol_free(pdef);
+    CaptureEndian& endian = it->second;
+    if (endian.pdefs != pdefs || endian.states.size() != count) {
+        endian.pdefs = pdefs;
+        endian.states.assign(count, ENDIAN_TYPE_UNKNOWN);
+        endian.reported.assign(count, false);
+    }
+    endian.last_use = ++capture_endian_seq_;
+    return endian;
 }
 
 void CRxFilterThread::send_endian_detected_to_manager(
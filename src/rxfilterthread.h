@@ -6,7 +6,13 @@
 #include "pdef/pdef_types.h"
 #include "rxmsgtypes.h"
 #include "rxstorageutils.h"
+#include "rxflowcache.h"
+#include "rxpacketdecoder.h"
+#include "rxprotocoldispatcher.h"
+#include "rxtcpreassembly.h"
+#include <map>
 #include <string>
+#include <vector>
 #include <pcap.h>
 
 using compat::shared_ptr;
@@ -47,12 +53,17 @@ public:
 
     bool start();
 
+    void configure_reassembly(uint32_t max_flows, uint32_t depth);
+
     struct FilterStats {
         unsigned long packets_processed;
         unsigned long packets_matched;
         unsigned long packets_filtered;
         unsigned long queue_empty_count;
         unsigned long output_queue_full_count;
+        unsigned long flow_cache_lookups;
+        unsigned long flow_cache_hits;
+        unsigned long reassembled_matches;
 
         FilterStats()
             : packets_processed(0)
@@ -60,12 +71,23 @@ public:
             , packets_filtered(0)
             , queue_empty_count(0)
             , output_queue_full_count(0)
+            , flow_cache_lookups(0)
+            , flow_cache_hits(0)
+            , reassembled_matches(0)
         {}
+
+        double flow_cache_hit_ratio() const
+        {
+            return flow_cache_lookups > 0 ?
+                static_cast<double>(flow_cache_hits) / static_cast<double>(flow_cache_lookups) : 0.0;
+        }
     };
 
     FilterStats get_stats() const { return stats_; }
     void reset_stats() { stats_ = FilterStats(); }
 
+    const CRxTcpReassembler* reassembler() const { return reassembler_; }
+
 protected:
     virtual void handle_msg(shared_ptr<normal_msg>& p_msg);
 
@@ -81,11 +103,31 @@ private:
     struct ParsedPacket {
         const uint8_t* app_data;
         uint32_t app_len;
+        SRxFlowKey key;
         uint16_t src_port;
         uint16_t dst_port;
+        uint8_t ip_proto;
+        uint8_t tcp_flags;
+        uint32_t tcp_seq;
         bool valid;
     };
-    ParsedPacket parse_packet_data(const uint8_t* data, uint32_t len);
+    ParsedPacket parse_packet_data(const CRxPacketDecoder& decoder, const uint8_t* data, uint32_t len);
+
+    int match_flow(const ParsedPacket& parsed, uint32_t ts_sec,
+                   CRxProtocolDispatcher& dispatcher);
+
+    // Endian detection state of one capture, kept for the whole capture so
+    // that every file it hands over continues the same vote. The cached
+    // ProtocolDef is shared between captures and is never written.
+    struct CaptureEndian {
+        std::string pdefs;
+        std::vector<int> states;
+        std::vector<bool> reported;
+        uint64_t last_use;
+
+        CaptureEndian() : last_use(0) {}
+    };
+    CaptureEndian& capture_endian(int capture_id, const std::string& pdefs, size_t count);
 
     void send_endian_detected_to_manager(int manager_thread_index,
                                         const std::string& pdef_path,
@@ -96,6 +138,14 @@ private:
     ProtocolDef* protocol_def_;
     CRxDumpCtx* dump_ctx_;
     FilterStats stats_;
+    CRxFlowCache flow_cache_;
+    CRxPacketDecoder decoder_;
+    CRxProtocolDispatcher inline_dispatcher_;
+    CRxTcpReassembler* reassembler_;
+    volatile int inline_endian_;
+    bool inline_endian_reported_;
+    std::map<int, CaptureEndian> capture_endian_;
+    uint64_t capture_endian_seq_;
     int type_;
     std::string name_;
 };
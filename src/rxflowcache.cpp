@@ -0,0 +1,152 @@
+#include "rxflowcache.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+uint32_t round_up_pow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) {
+        p <<= 1;
+    }
+    return p;
+}
+
+void canonicalize(const SRxFlowKey& key, SRxFlowEntry& out)
+{
+    int order = memcmp(key.src_ip, key.dst_ip, sizeof(key.src_ip));
+    bool forward = order < 0 || (order == 0 && key.src_port <= key.dst_port);
+    memcpy(out.ip_lo, forward ? key.src_ip : key.dst_ip, sizeof(out.ip_lo));
+    memcpy(out.ip_hi, forward ? key.dst_ip : key.src_ip, sizeof(out.ip_hi));
+    out.port_lo = forward ? key.src_port : key.dst_port;
+    out.port_hi = forward ? key.dst_port : key.src_port;
+    out.proto = key.proto;
+    out.ip_version = key.ip_version;
+}
+
+bool same_flow(const SRxFlowEntry& a, const SRxFlowEntry& b)
+{
+    return memcmp(a.ip_lo, b.ip_lo, sizeof(a.ip_lo)) == 0 &&
+           memcmp(a.ip_hi, b.ip_hi, sizeof(a.ip_hi)) == 0 &&
+           a.port_lo == b.port_lo && a.port_hi == b.port_hi &&
+           a.proto == b.proto && a.ip_version == b.ip_version;
+}
+
+}
+
+CRxFlowCache::CRxFlowCache(uint32_t capacity, uint32_t undecided_limit, uint32_t idle_timeout_sec)
+    : buckets_(NULL),
+      bucket_count_(1),
+      bucket_mask_(0),
+      undecided_limit_(undecided_limit > 0 ? undecided_limit : 1),
+      idle_timeout_sec_(idle_timeout_sec)
+{
+    if (undecided_limit_ > 255) {
+        undecided_limit_ = 255;
+    }
+
+    uint32_t wanted = round_up_pow2((capacity + WAYS - 1) / WAYS);
+    void* mem = NULL;
+    if (wanted > 0 && posix_memalign(&mem, 64, sizeof(Bucket) * wanted) == 0 && mem) {
+        buckets_ = static_cast<Bucket*>(mem);
+        bucket_count_ = wanted;
+        bucket_mask_ = wanted - 1;
+    } else {
+        buckets_ = &fallback_;
+    }
+    clear();
+}
+
+CRxFlowCache::~CRxFlowCache()
+{
+    if (buckets_ != &fallback_) {
+        free(buckets_);
+    }
+}
+
+void CRxFlowCache::clear()
+{
+    memset(buckets_, 0, sizeof(Bucket) * bucket_count_);
+    stats_ = Stats();
+}
+
+uint32_t CRxFlowCache::hash(const SRxFlowEntry& k)
+{
+    uint64_t h = (static_cast<uint64_t>(k.ip_lo[0]) << 32) | k.ip_hi[0];
+    for (int i = 1; i < 4; ++i) {
+        h = (h << 13 | h >> 51) ^ ((static_cast<uint64_t>(k.ip_lo[i]) << 32) | k.ip_hi[i]);
+    }
+    h ^= (static_cast<uint64_t>(k.port_lo) << 24) ^ (static_cast<uint64_t>(k.port_hi) << 8) ^ k.proto;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+SRxFlowEntry* CRxFlowCache::lookup(const SRxFlowKey& key, uint32_t now_sec)
+{
+    SRxFlowEntry probe;
+    memset(&probe, 0, sizeof(probe));
+    canonicalize(key, probe);
+
+    Bucket& bucket = buckets_[hash(probe) & bucket_mask_];
+    ++stats_.lookups;
+
+    SRxFlowEntry* victim = NULL;
+    for (int i = 0; i < WAYS; ++i) {
+        SRxFlowEntry* e = &bucket.entries[i];
+        if (e->verdict == RX_FLOW_EMPTY) {
+            if (!victim || victim->verdict != RX_FLOW_EMPTY) {
+                victim = e;
+            }
+            continue;
+        }
+
+        bool idle = idle_timeout_sec_ > 0 && now_sec > e->last_seen &&
+                    now_sec - e->last_seen > idle_timeout_sec_;
+        if (same_flow(*e, probe)) {
+            if (idle) {
+                ++stats_.expired;
+                e->verdict = RX_FLOW_UNDECIDED;
+                e->undecided = 0;
+            } else if (e->verdict != RX_FLOW_UNDECIDED) {
+                ++stats_.hits;
+            }
+            e->last_seen = now_sec;
+            return e;
+        }
+
+        if (!victim) {
+            victim = e;
+        } else if (victim->verdict != RX_FLOW_EMPTY && e->last_seen < victim->last_seen) {
+            victim = e;
+        }
+    }
+
+    if (victim->verdict != RX_FLOW_EMPTY) {
+        ++stats_.evictions;
+    }
+    ++stats_.inserts;
+    *victim = probe;
+    victim->verdict = RX_FLOW_UNDECIDED;
+    victim->last_seen = now_sec;
+    return victim;
+}
+
+void CRxFlowCache::resolve(SRxFlowEntry* entry, bool matched, uint8_t tag)
+{
+    if (!entry || entry->verdict != RX_FLOW_UNDECIDED) {
+        return;
+    }
+    if (matched) {
+        entry->verdict = RX_FLOW_MATCHED;
+        entry->tag = tag;
+        return;
+    }
+    if (++entry->undecided >= undecided_limit_) {
+        entry->verdict = RX_FLOW_REJECTED;
+    }
+}
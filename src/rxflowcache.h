@@ -0,0 +1,122 @@
+#ifndef RX_FLOW_CACHE_H
+#define RX_FLOW_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum ERxFlowVerdict {
+    RX_FLOW_EMPTY = 0,
+    RX_FLOW_UNDECIDED = 1,
+    RX_FLOW_MATCHED = 2,
+    RX_FLOW_REJECTED = 3
+};
+
+// Addresses are kept in full as four host-order words; IPv4 uses only the
+// first word.
+struct SRxFlowKey {
+    uint32_t src_ip[4];
+    uint32_t dst_ip[4];
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t proto;
+    uint8_t ip_version;
+
+    SRxFlowKey() { memset(this, 0, sizeof(*this)); }
+
+    void set_ipv4(uint32_t src, uint32_t dst)
+    {
+        memset(src_ip, 0, sizeof(src_ip));
+        memset(dst_ip, 0, sizeof(dst_ip));
+        src_ip[0] = src;
+        dst_ip[0] = dst;
+        ip_version = 4;
+    }
+
+    SRxFlowKey reversed() const
+    {
+        SRxFlowKey r = *this;
+        memcpy(r.src_ip, dst_ip, sizeof(r.src_ip));
+        memcpy(r.dst_ip, src_ip, sizeof(r.dst_ip));
+        r.src_port = dst_port;
+        r.dst_port = src_port;
+        return r;
+    }
+
+    bool operator==(const SRxFlowKey& o) const
+    {
+        return memcmp(src_ip, o.src_ip, sizeof(src_ip)) == 0 &&
+               memcmp(dst_ip, o.dst_ip, sizeof(dst_ip)) == 0 &&
+               src_port == o.src_port && dst_port == o.dst_port &&
+               proto == o.proto && ip_version == o.ip_version;
+    }
+};
+
+struct SRxFlowEntry {
+    uint32_t ip_lo[4];
+    uint32_t ip_hi[4];
+    uint32_t last_seen;
+    uint16_t port_lo;
+    uint16_t port_hi;
+    uint8_t proto;
+    uint8_t verdict;
+    uint8_t undecided;
+    uint8_t tag;
+    uint8_t ip_version;
+    uint8_t pad[3];
+};
+
+class CRxFlowCache {
+public:
+    enum {
+        WAYS = 4,
+        DEFAULT_CAPACITY = 32768,
+        DEFAULT_UNDECIDED_LIMIT = 8,
+        DEFAULT_IDLE_TIMEOUT_SEC = 120
+    };
+
+    struct Stats {
+        unsigned long lookups;
+        unsigned long hits;
+        unsigned long inserts;
+        unsigned long evictions;
+        unsigned long expired;
+
+        Stats() : lookups(0), hits(0), inserts(0), evictions(0), expired(0) {}
+    };
+
+    explicit CRxFlowCache(uint32_t capacity = DEFAULT_CAPACITY,
+                          uint32_t undecided_limit = DEFAULT_UNDECIDED_LIMIT,
+                          uint32_t idle_timeout_sec = DEFAULT_IDLE_TIMEOUT_SEC);
+    ~CRxFlowCache();
+
+    SRxFlowEntry* lookup(const SRxFlowKey& key, uint32_t now_sec);
+
+    void resolve(SRxFlowEntry* entry, bool matched, uint8_t tag = 0);
+
+    void clear();
+
+    uint32_t capacity() const { return bucket_count_ * WAYS; }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    CRxFlowCache(const CRxFlowCache&);
+    CRxFlowCache& operator=(const CRxFlowCache&);
+
+    struct Bucket {
+        SRxFlowEntry entries[WAYS];
+    } __attribute__((aligned(64)));
+
+    static uint32_t hash(const SRxFlowEntry& k);
+
+    Bucket* buckets_;
+    Bucket fallback_;
+    uint32_t bucket_count_;
+    uint32_t bucket_mask_;
+    uint32_t undecided_limit_;
+    uint32_t idle_timeout_sec_;
+    Stats stats_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include "rxstrategyconfig.h"
 #include "legacy_core.h"
 #include "rxprocdata.h"
+#include "rxmetrics.h"
 
 
 CRxHttpResDataProcess::CRxHttpResDataProcess(http_base_process* process,
@@ -95,7 +96,10 @@ void CRxHttpResDataProcess::msg_recv_finish()
         std::string body_response;
 
         ObjId conn_id = connection_id();
+        CRxMetrics::inc(RX_CNT_HTTP_REQUESTS);
+        uint64_t perform_start_ns = CRxMetrics::now_ns();
         bool is_ready = current_handler_->perform(&req_head, &recv_body_, &res_head, &body_response, conn_id);
+        CRxMetrics::observe_ns(RX_HIST_HTTP_REQUEST, CRxMetrics::now_ns() - perform_start_ns);
         LOG_DEBUG_MSG("HTTP handler %s ready=%d conn=%u thread=%u",
                       req_head._url_path.c_str(),
                       is_ready ? 1 : 0,
@@ -108,6 +112,7 @@ void CRxHttpResDataProcess::msg_recv_finish()
             _base_process->notify_send_ready();
         }
         else {
+            CRxMetrics::inc(RX_CNT_HTTP_ASYNC);
             set_async_response_pending(true);
         }
 
@@ -2,6 +2,7 @@
 #include "rxhttpthread.h"
 #include "rxserverconfig.h"
 #include "rxprocdata.h"
+#include "rxplacement.h"
 #include "legacy_core.h"
 
 #include <cstdio>
@@ -32,6 +33,7 @@ void CRxHttpServer::start()
     listen_thread * lthread = new (std::nothrow)listen_thread();
     lthread->init(_conf->bind_addr(), _conf->port());
     CRxProcData::instance()->add_name_thread("listen_thread", lthread);
+    CRxThreadPlacement::instance()->place(lthread, RX_ROLE_CONTROL, "listen");
 
     int works = _conf->workers()? _conf->workers() : 1;
     for (int i = 0; i < works; i++) {
@@ -50,6 +52,7 @@ void CRxHttpServer::start()
         lthread->add_worker_thread(net_thread->get_thread_index());
 
         CRxProcData::instance()->add_name_thread("http_res", net_thread);
+        CRxThreadPlacement::instance()->place(net_thread, RX_ROLE_HTTP, net_thread->name());
         net_thread->start();
     }
 
@@ -0,0 +1,148 @@
+#include "rxmetrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+namespace {
+
+struct MetricDesc {
+    const char* name;
+    const char* help;
+};
+
+const MetricDesc kCounterDesc[RX_CNT_MAX] = {
+    { "rxtrace_capture_packets_total", "Packets handed to the pcap dump callback" },
+    { "rxtrace_capture_bytes_total", "Captured bytes handed to the pcap dump callback" },
+    { "rxtrace_capture_pcap_received_total", "Packets received as reported by pcap_stats" },
+    { "rxtrace_capture_pcap_dropped_total", "Packets dropped by the kernel as reported by pcap_stats" },
+    { "rxtrace_capture_pcap_ifdropped_total", "Packets dropped by the interface as reported by pcap_stats" },
+    { "rxtrace_filter_packets_total", "Packets evaluated against a PDEF filter" },
+    { "rxtrace_filter_matched_total", "Packets accepted by a PDEF filter" },
+    { "rxtrace_filter_files_total", "Raw capture files processed by filter threads" },
+    { "rxtrace_write_bytes_total", "Bytes written to pcap dump files" },
+    { "rxtrace_write_rotations_total", "Pcap dump file rotations" },
+    { "rxtrace_compress_batches_total", "Compression batches attempted" },
+    { "rxtrace_compress_files_total", "Files submitted for compression" },
+    { "rxtrace_compress_failures_total", "Compression batches that failed" },
+    { "rxtrace_compress_input_bytes_total", "Capture bytes archived by compression workers" },
+    { "rxtrace_compress_output_bytes_total", "Archive bytes written by compression workers" },
+    { "rxtrace_compress_throttled_ms_total", "Milliseconds compression workers slept in the I/O throttle" },
+    { "rxtrace_http_requests_total", "HTTP requests dispatched to URL handlers" },
+    { "rxtrace_http_async_total", "HTTP requests answered asynchronously" },
+    { "rxtrace_channel_messages_put_total", "Messages posted to inter-thread channels" },
+    { "rxtrace_channel_messages_handled_total", "Inter-thread channel messages handed to their thread" }
+};
+
+const MetricDesc kHistogramDesc[RX_HIST_MAX] = {
+    { "rxtrace_capture_dispatch_seconds", "Duration of one pcap_dispatch call" },
+    { "rxtrace_filter_packet_seconds", "PDEF evaluation time per packet (sampled)" },
+    { "rxtrace_filter_file_seconds", "Time to filter one raw capture file" },
+    { "rxtrace_write_stall_seconds", "Time spent in pcap_dump and rotation (sampled)" },
+    { "rxtrace_compress_seconds", "Duration of one compression batch" },
+    { "rxtrace_http_request_seconds", "Synchronous URL handler execution time" }
+};
+
+SRxMetricShard* g_shard_head = NULL;
+
+void append_format(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void append_format(std::string& out, const char* fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out.append(buf, static_cast<size_t>(n) < sizeof(buf) ? static_cast<size_t>(n) : sizeof(buf) - 1);
+    }
+}
+
+}
+
+__thread SRxMetricShard* CRxMetrics::tls_shard_ = NULL;
+
+SRxMetricShard* CRxMetrics::register_shard()
+{
+    void* mem = NULL;
+    if (posix_memalign(&mem, 64, sizeof(SRxMetricShard)) != 0 || !mem) {
+        static SRxMetricShard fallback;
+        return &fallback;
+    }
+    SRxMetricShard* shard = new (mem) SRxMetricShard();
+    memset(shard, 0, sizeof(*shard));
+
+    SRxMetricShard* head = NULL;
+    do {
+        head = __atomic_load_n(&g_shard_head, __ATOMIC_ACQUIRE);
+        shard->next = head;
+    } while (!__sync_bool_compare_and_swap(&g_shard_head, head, shard));
+
+    tls_shard_ = shard;
+    return shard;
+}
+
+uint64_t CRxMetrics::counter_total(ERxMetricCounter id)
+{
+    uint64_t total = 0;
+    for (SRxMetricShard* s = __atomic_load_n(&g_shard_head, __ATOMIC_ACQUIRE); s; s = s->next) {
+        total += __atomic_load_n(&s->counters[id], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void CRxMetrics::append_gauge(std::string& out, const char* name, const char* help, double value)
+{
+    append_format(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.17g\n", name, help, name, name, value);
+}
+
+void CRxMetrics::append_counter(std::string& out, const char* name, const char* help, uint64_t value)
+{
+    append_format(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name,
+                  static_cast<unsigned long long>(value));
+}
+
+void CRxMetrics::render_prometheus(std::string& out)
+{
+    SRxMetricShard* head = __atomic_load_n(&g_shard_head, __ATOMIC_ACQUIRE);
+
+    for (int id = 0; id < RX_CNT_MAX; ++id) {
+        append_counter(out, kCounterDesc[id].name, kCounterDesc[id].help,
+                       counter_total(static_cast<ERxMetricCounter>(id)));
+    }
+
+    for (int id = 0; id < RX_HIST_MAX; ++id) {
+        uint64_t buckets[RX_HIST_BUCKETS];
+        memset(buckets, 0, sizeof(buckets));
+        uint64_t sum_ns = 0;
+        uint64_t count = 0;
+        for (SRxMetricShard* s = head; s; s = s->next) {
+            for (int b = 0; b < RX_HIST_BUCKETS; ++b) {
+                buckets[b] += __atomic_load_n(&s->hist_buckets[id][b], __ATOMIC_RELAXED);
+            }
+            sum_ns += __atomic_load_n(&s->hist_sum[id], __ATOMIC_RELAXED);
+            count += __atomic_load_n(&s->hist_count[id], __ATOMIC_RELAXED);
+        }
+
+        const char* name = kHistogramDesc[id].name;
+        append_format(out, "# HELP %s %s\n# TYPE %s histogram\n",
+                      name, kHistogramDesc[id].help, name);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < RX_HIST_BUCKETS - 1; ++b) {
+            cumulative += buckets[b];
+            double le = static_cast<double>(1ULL << (RX_HIST_MIN_SHIFT + b)) / 1e9;
+            append_format(out, "%s_bucket{le=\"%.9g\"} %llu\n", name, le,
+                          static_cast<unsigned long long>(cumulative));
+        }
+        cumulative += buckets[RX_HIST_BUCKETS - 1];
+        if (cumulative < count) {
+            cumulative = count;
+        }
+        append_format(out, "%s_bucket{le=\"+Inf\"} %llu\n", name,
+                      static_cast<unsigned long long>(cumulative));
+        append_format(out, "%s_sum %.9f\n", name, static_cast<double>(sum_ns) / 1e9);
+        append_format(out, "%s_count %llu\n", name, static_cast<unsigned long long>(count));
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef RX_METRICS_H
+#define RX_METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+
+enum ERxMetricCounter {
+    RX_CNT_CAPTURE_PACKETS = 0,
+    RX_CNT_CAPTURE_BYTES,
+    RX_CNT_CAPTURE_PCAP_RECV,
+    RX_CNT_CAPTURE_PCAP_DROP,
+    RX_CNT_CAPTURE_PCAP_IFDROP,
+    RX_CNT_FILTER_PACKETS,
+    RX_CNT_FILTER_MATCHED,
+    RX_CNT_FILTER_FILES,
+    RX_CNT_WRITE_BYTES,
+    RX_CNT_WRITE_ROTATIONS,
+    RX_CNT_COMPRESS_BATCHES,
+    RX_CNT_COMPRESS_FILES,
+    RX_CNT_COMPRESS_FAILURES,
+    RX_CNT_COMPRESS_IN_BYTES,
+    RX_CNT_COMPRESS_OUT_BYTES,
+    RX_CNT_COMPRESS_THROTTLE_MS,
+    RX_CNT_HTTP_REQUESTS,
+    RX_CNT_HTTP_ASYNC,
+    RX_CNT_CHANNEL_PUT,
+    RX_CNT_CHANNEL_HANDLED,
+    RX_CNT_MAX
+};
+
+enum ERxMetricHistogram {
+    RX_HIST_CAPTURE_DISPATCH = 0,
+    RX_HIST_FILTER_PACKET,
+    RX_HIST_FILTER_FILE,
+    RX_HIST_WRITE_STALL,
+    RX_HIST_COMPRESS,
+    RX_HIST_HTTP_REQUEST,
+    RX_HIST_MAX
+};
+
+enum {
+    RX_HIST_MIN_SHIFT = 6,
+    RX_HIST_BUCKETS = 30,
+    RX_METRIC_SAMPLE_MASK = 63
+};
+
+struct SRxMetricShard {
+    uint64_t counters[RX_CNT_MAX];
+    uint64_t hist_buckets[RX_HIST_MAX][RX_HIST_BUCKETS];
+    uint64_t hist_sum[RX_HIST_MAX];
+    uint64_t hist_count[RX_HIST_MAX];
+    uint32_t sample_tick;
+    SRxMetricShard* next;
+} __attribute__((aligned(64)));
+
+class CRxMetrics {
+public:
+    static void inc(ERxMetricCounter id, uint64_t n = 1)
+    {
+        SRxMetricShard* shard = local_shard();
+        uint64_t v = __atomic_load_n(&shard->counters[id], __ATOMIC_RELAXED);
+        __atomic_store_n(&shard->counters[id], v + n, __ATOMIC_RELAXED);
+    }
+
+    static void observe_ns(ERxMetricHistogram id, uint64_t ns)
+    {
+        SRxMetricShard* shard = local_shard();
+        unsigned bucket = bucket_index(ns);
+        uint64_t b = __atomic_load_n(&shard->hist_buckets[id][bucket], __ATOMIC_RELAXED);
+        __atomic_store_n(&shard->hist_buckets[id][bucket], b + 1, __ATOMIC_RELAXED);
+        uint64_t s = __atomic_load_n(&shard->hist_sum[id], __ATOMIC_RELAXED);
+        __atomic_store_n(&shard->hist_sum[id], s + ns, __ATOMIC_RELAXED);
+        uint64_t c = __atomic_load_n(&shard->hist_count[id], __ATOMIC_RELAXED);
+        __atomic_store_n(&shard->hist_count[id], c + 1, __ATOMIC_RELAXED);
+    }
+
+    static bool sample_tick()
+    {
+        SRxMetricShard* shard = local_shard();
+        return ((shard->sample_tick++) & RX_METRIC_SAMPLE_MASK) == 0;
+    }
+
+    static uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    static unsigned bucket_index(uint64_t ns)
+    {
+        if (ns < (1ULL << RX_HIST_MIN_SHIFT)) {
+            return 0;
+        }
+        unsigned bits = 64u - static_cast<unsigned>(__builtin_clzll(ns - 1));
+        unsigned idx = bits - RX_HIST_MIN_SHIFT;
+        return idx < RX_HIST_BUCKETS ? idx : RX_HIST_BUCKETS - 1;
+    }
+
+    static uint64_t counter_total(ERxMetricCounter id);
+
+    static void render_prometheus(std::string& out);
+
+    static void append_gauge(std::string& out, const char* name, const char* help, double value);
+    static void append_counter(std::string& out, const char* name, const char* help, uint64_t value);
+
+private:
+    static SRxMetricShard* local_shard()
+    {
+        SRxMetricShard* shard = tls_shard_;
+        if (__builtin_expect(shard != NULL, 1)) {
+            return shard;
+        }
+        return register_shard();
+    }
+
+    static SRxMetricShard* register_shard();
+
+    static __thread SRxMetricShard* tls_shard_;
+};
+
+class CRxMetricTimer {
+public:
+    explicit CRxMetricTimer(ERxMetricHistogram id) : id_(id), start_ns_(CRxMetrics::now_ns()) {}
+    ~CRxMetricTimer() { CRxMetrics::observe_ns(id_, CRxMetrics::now_ns() - start_ns_); }
+
+private:
+    CRxMetricTimer(const CRxMetricTimer&);
+    CRxMetricTimer& operator=(const CRxMetricTimer&);
+
+    ERxMetricHistogram id_;
+    uint64_t start_ns_;
+};
+
+#endif
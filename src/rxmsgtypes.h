@@ -42,13 +42,13 @@ enum ERxCaptureMsg {
     RX_MSG_CAPTURE_CONFIG_REFRESH = 20003,
 
     RX_MSG_CAPTURE_STARTED = 30000,
-    RX_MSG_CAPTURE_PROGRESS = 30001,
     RX_MSG_CAPTURE_FILE_READY = 30002,
     RX_MSG_CAPTURE_FINISHED = 30003,
     RX_MSG_CAPTURE_FAILED = 30004,
     RX_MSG_CAPTURE_HEARTBEAT = 30005,
     RX_MSG_CAPTURE_RAW_FILE = 30006,
     RX_MSG_CAPTURE_FILTERED_FILE = 30007,
+    RX_MSG_CAPTURE_FILE_BATCH = 30008,
 
     RX_MSG_FILE_ENQUEUE = 40000,
     RX_MSG_CLEAN_CFG_REFRESH = 40001,
@@ -67,7 +67,9 @@ enum ERxSampleMsg {
 
 enum ERxCleanupMsg {
     RX_MSG_POST_DONE = 4001,
-    RX_MSG_POST_BATCH_COMPRESS = 4002
+    RX_MSG_POST_BATCH_COMPRESS = 4002,
+    RX_MSG_COMPRESS_JOB = 4003,
+    RX_MSG_COMPRESS_DONE = 4004
 };
 
 enum ERxReloadMsg {
@@ -123,13 +125,13 @@ inline const char* rx_msg_type_to_string(int msg_type)
     if (msg_type == RX_MSG_CAPTURE_CANCEL) return "RX_MSG_CAPTURE_CANCEL";
     if (msg_type == RX_MSG_CAPTURE_CONFIG_REFRESH) return "RX_MSG_CAPTURE_CONFIG_REFRESH";
     if (msg_type == RX_MSG_CAPTURE_STARTED) return "RX_MSG_CAPTURE_STARTED";
-    if (msg_type == RX_MSG_CAPTURE_PROGRESS) return "RX_MSG_CAPTURE_PROGRESS";
     if (msg_type == RX_MSG_CAPTURE_FILE_READY) return "RX_MSG_CAPTURE_FILE_READY";
     if (msg_type == RX_MSG_CAPTURE_FINISHED) return "RX_MSG_CAPTURE_FINISHED";
     if (msg_type == RX_MSG_CAPTURE_FAILED) return "RX_MSG_CAPTURE_FAILED";
     if (msg_type == RX_MSG_CAPTURE_HEARTBEAT) return "RX_MSG_CAPTURE_HEARTBEAT";
     if (msg_type == RX_MSG_CAPTURE_RAW_FILE) return "RX_MSG_CAPTURE_RAW_FILE";
     if (msg_type == RX_MSG_CAPTURE_FILTERED_FILE) return "RX_MSG_CAPTURE_FILTERED_FILE";
+    if (msg_type == RX_MSG_CAPTURE_FILE_BATCH) return "RX_MSG_CAPTURE_FILE_BATCH";
     if (msg_type == RX_MSG_FILE_ENQUEUE) return "RX_MSG_FILE_ENQUEUE";
     if (msg_type == RX_MSG_CLEAN_CFG_REFRESH) return "RX_MSG_CLEAN_CFG_REFRESH";
     if (msg_type == RX_MSG_CLEAN_SHUTDOWN) return "RX_MSG_CLEAN_SHUTDOWN";
@@ -143,6 +145,8 @@ inline const char* rx_msg_type_to_string(int msg_type)
 
     if (msg_type == RX_MSG_POST_DONE) return "RX_MSG_POST_DONE";
     if (msg_type == RX_MSG_POST_BATCH_COMPRESS) return "RX_MSG_POST_BATCH_COMPRESS";
+    if (msg_type == RX_MSG_COMPRESS_JOB) return "RX_MSG_COMPRESS_JOB";
+    if (msg_type == RX_MSG_COMPRESS_DONE) return "RX_MSG_COMPRESS_DONE";
 
     if (msg_type == RX_MSG_RELOAD_CONFIG) return "RX_MSG_RELOAD_CONFIG";
     if (msg_type == RX_MSG_PDEF_ENDIAN_DETECTED) return "RX_MSG_PDEF_ENDIAN_DETECTED";
@@ -0,0 +1,294 @@
+#include "rxpacketdecoder.h"
+#include <string.h>
+
+namespace {
+
+const uint16_t kEthIpv4 = 0x0800;
+const uint16_t kEthIpv6 = 0x86DD;
+const uint16_t kEthVlan = 0x8100;
+const uint16_t kEthQinq = 0x88A8;
+const uint16_t kEthQinqLegacy = 0x9100;
+const uint16_t kEthBridged = 0x6558;
+
+enum Next {
+    NEXT_ETHER,
+    NEXT_ETHERTYPE,
+    NEXT_IPV4,
+    NEXT_IPV6,
+    NEXT_L4
+};
+
+inline uint16_t rd16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t rd32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline bool is_ipv6_ext(uint8_t proto)
+{
+    return proto == 0 || proto == 43 || proto == 44 || proto == 51 || proto == 60;
+}
+
+Next family_to_next(uint32_t family, bool* ok)
+{
+    *ok = true;
+    if (family == 2) {
+        return NEXT_IPV4;
+    }
+    if (family == 10 || family == 24 || family == 28 || family == 30) {
+        return NEXT_IPV6;
+    }
+    *ok = false;
+    return NEXT_IPV4;
+}
+
+}
+
+CRxPacketDecoder::CRxPacketDecoder(int linktype)
+    : linktype_(linktype), l2_(L2_NONE)
+{
+    set_linktype(linktype);
+}
+
+void CRxPacketDecoder::set_linktype(int linktype)
+{
+    linktype_ = linktype;
+    switch (linktype) {
+        case DLT_EN10MB: l2_ = L2_ETHER; break;
+        case DLT_LINUX_SLL: l2_ = L2_SLL; break;
+        case DLT_LINUX_SLL2: l2_ = L2_SLL2; break;
+        case DLT_RAW:
+        case DLT_IPV4:
+        case DLT_IPV6: l2_ = L2_RAW; break;
+        case DLT_NULL: l2_ = L2_NULL_HOST; break;
+        case DLT_LOOP: l2_ = L2_NULL_NET; break;
+        default: l2_ = L2_NONE; break;
+    }
+}
+
+const char* CRxPacketDecoder::linktype_name(int linktype)
+{
+    switch (linktype) {
+        case DLT_EN10MB: return "EN10MB";
+        case DLT_LINUX_SLL: return "LINUX_SLL";
+        case DLT_LINUX_SLL2: return "LINUX_SLL2";
+        case DLT_RAW: return "RAW";
+        case DLT_IPV4: return "IPV4";
+        case DLT_IPV6: return "IPV6";
+        case DLT_NULL: return "NULL";
+        case DLT_LOOP: return "LOOP";
+        default: return "unsupported";
+    }
+}
+
+bool CRxPacketDecoder::decode(const uint8_t* data, uint32_t len, SRxDecodedPacket& out) const
+{
+    out.l3_offset = 0;
+    out.l4_offset = 0;
+    out.payload_offset = 0;
+    out.payload_len = 0;
+    out.src_port = 0;
+    out.dst_port = 0;
+    out.ip_version = 0;
+    out.ip_proto = 0;
+    out.vlan_depth = 0;
+    out.tunnel_depth = 0;
+    if (!data) {
+        return false;
+    }
+
+    uint32_t off = 0;
+    uint32_t end = len;
+    uint16_t ethertype = 0;
+    uint8_t proto = 0;
+    bool ok = true;
+    Next next = NEXT_ETHER;
+
+    switch (l2_) {
+        case L2_ETHER:
+            next = NEXT_ETHER;
+            break;
+        case L2_SLL:
+            if (len < 16) return false;
+            ethertype = rd16(data + 14);
+            off = 16;
+            next = NEXT_ETHERTYPE;
+            break;
+        case L2_SLL2:
+            if (len < 20) return false;
+            ethertype = rd16(data);
+            off = 20;
+            next = NEXT_ETHERTYPE;
+            break;
+        case L2_RAW:
+            if (len < 1) return false;
+            next = (data[0] >> 4) == 6 ? NEXT_IPV6 : NEXT_IPV4;
+            break;
+        case L2_NULL_HOST:
+        case L2_NULL_NET: {
+            if (len < 4) return false;
+            uint32_t family = 0;
+            if (l2_ == L2_NULL_NET) {
+                family = rd32(data);
+            } else {
+                memcpy(&family, data, sizeof(family));
+            }
+            next = family_to_next(family, &ok);
+            if (!ok) return false;
+            off = 4;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    for (;;) {
+        switch (next) {
+            case NEXT_ETHER:
+                if (off + 14 > end) return false;
+                ethertype = rd16(data + off + 12);
+                off += 14;
+                next = NEXT_ETHERTYPE;
+                break;
+
+            case NEXT_ETHERTYPE:
+                if (ethertype == kEthIpv4) {
+                    next = NEXT_IPV4;
+                } else if (ethertype == kEthIpv6) {
+                    next = NEXT_IPV6;
+                } else if (ethertype == kEthVlan || ethertype == kEthQinq || ethertype == kEthQinqLegacy) {
+                    if (out.vlan_depth >= MAX_VLAN_DEPTH || off + 4 > end) return false;
+                    ethertype = rd16(data + off + 2);
+                    off += 4;
+                    ++out.vlan_depth;
+                } else {
+                    return false;
+                }
+                break;
+
+            case NEXT_IPV4: {
+                if (off + 20 > end) return false;
+                const uint8_t* ip = data + off;
+                uint32_t ihl = static_cast<uint32_t>(ip[0] & 0x0F) * 4;
+                if ((ip[0] >> 4) != 4 || ihl < 20 || off + ihl > end) return false;
+                uint32_t total = rd16(ip + 2);
+                if (total >= ihl && off + total < end) {
+                    end = off + total;
+                }
+                out.l3_offset = off;
+                out.ip_version = 4;
+                memcpy(out.src_addr, ip + 12, 4);
+                memcpy(out.dst_addr, ip + 16, 4);
+                proto = ip[9];
+                if (rd16(ip + 6) & 0x1FFF) return false;
+                off += ihl;
+                next = NEXT_L4;
+                break;
+            }
+
+            case NEXT_IPV6: {
+                if (off + 40 > end) return false;
+                const uint8_t* ip = data + off;
+                if ((ip[0] >> 4) != 6) return false;
+                uint32_t plen = rd16(ip + 4);
+                if (plen != 0 && off + 40 + plen < end) {
+                    end = off + 40 + plen;
+                }
+                out.l3_offset = off;
+                out.ip_version = 6;
+                memcpy(out.src_addr, ip + 8, 16);
+                memcpy(out.dst_addr, ip + 24, 16);
+                proto = ip[6];
+                off += 40;
+                for (int n = 0; n < MAX_IPV6_EXT && is_ipv6_ext(proto); ++n) {
+                    if (off + 8 > end) return false;
+                    const uint8_t* ext = data + off;
+                    uint32_t hlen;
+                    if (proto == 44) {
+                        if (rd16(ext + 2) & 0xFFF8) return false;
+                        hlen = 8;
+                    } else if (proto == 51) {
+                        hlen = (static_cast<uint32_t>(ext[1]) + 2) * 4;
+                    } else {
+                        hlen = (static_cast<uint32_t>(ext[1]) + 1) * 8;
+                    }
+                    proto = ext[0];
+                    off += hlen;
+                }
+                if (is_ipv6_ext(proto)) return false;
+                next = NEXT_L4;
+                break;
+            }
+
+            case NEXT_L4:
+                out.ip_proto = proto;
+                out.l4_offset = off;
+                if (proto == 6) {
+                    if (off + 20 > end) return false;
+                    uint32_t thl = static_cast<uint32_t>(data[off + 12] >> 4) * 4;
+                    if (thl < 20 || off + thl > end) return false;
+                    out.src_port = rd16(data + off);
+                    out.dst_port = rd16(data + off + 2);
+                    out.payload_offset = off + thl;
+                    out.payload_len = end - out.payload_offset;
+                    return true;
+                }
+                if (proto == 17) {
+                    if (off + 8 > end) return false;
+                    out.src_port = rd16(data + off);
+                    out.dst_port = rd16(data + off + 2);
+                    if (out.dst_port == VXLAN_PORT && out.tunnel_depth < MAX_TUNNEL_DEPTH &&
+                        off + 16 <= end && (data[off + 8] & 0x08)) {
+                        ++out.tunnel_depth;
+                        off += 16;
+                        next = NEXT_ETHER;
+                        break;
+                    }
+                    out.payload_offset = off + 8;
+                    out.payload_len = end - out.payload_offset;
+                    return true;
+                }
+                if (out.tunnel_depth >= MAX_TUNNEL_DEPTH) return false;
+                if (proto == 4 || proto == 41) {
+                    ++out.tunnel_depth;
+                    next = proto == 4 ? NEXT_IPV4 : NEXT_IPV6;
+                    break;
+                }
+                if (proto == 47) {
+                    if (off + 4 > end) return false;
+                    uint16_t flags = rd16(data + off);
+                    if (flags & 0x4007) return false;
+                    ethertype = rd16(data + off + 2);
+                    off += 4 + ((flags & 0x8000) ? 4 : 0) + ((flags & 0x2000) ? 4 : 0) +
+                           ((flags & 0x1000) ? 4 : 0);
+                    ++out.tunnel_depth;
+                    next = ethertype == kEthBridged ? NEXT_ETHER : NEXT_ETHERTYPE;
+                    break;
+                }
+                return false;
+        }
+    }
+}
+
+SRxFlowKey CRxPacketDecoder::flow_key(const SRxDecodedPacket& pkt)
+{
+    SRxFlowKey key;
+    key.src_port = pkt.src_port;
+    key.dst_port = pkt.dst_port;
+    key.proto = pkt.ip_proto;
+    if (pkt.ip_version == 6) {
+        for (int i = 0; i < 4; ++i) {
+            key.src_ip[i] = rd32(pkt.src_addr + i * 4);
+            key.dst_ip[i] = rd32(pkt.dst_addr + i * 4);
+        }
+        key.ip_version = 6;
+    } else {
+        key.set_ipv4(rd32(pkt.src_addr), rd32(pkt.dst_addr));
+    }
+    return key;
+}
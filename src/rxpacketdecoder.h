@@ -0,0 +1,69 @@
+#ifndef RX_PACKET_DECODER_H
+#define RX_PACKET_DECODER_H
+
+#include "rxflowcache.h"
+#include <pcap.h>
+#include <stdint.h>
+
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2 276
+#endif
+#ifndef DLT_IPV4
+#define DLT_IPV4 228
+#endif
+#ifndef DLT_IPV6
+#define DLT_IPV6 229
+#endif
+
+struct SRxDecodedPacket {
+    uint32_t l3_offset;
+    uint32_t l4_offset;
+    uint32_t payload_offset;
+    uint32_t payload_len;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t ip_version;
+    uint8_t ip_proto;
+    uint8_t vlan_depth;
+    uint8_t tunnel_depth;
+    uint8_t src_addr[16];
+    uint8_t dst_addr[16];
+};
+
+class CRxPacketDecoder {
+public:
+    enum {
+        MAX_VLAN_DEPTH = 4,
+        MAX_TUNNEL_DEPTH = 2,
+        MAX_IPV6_EXT = 8,
+        VXLAN_PORT = 4789
+    };
+
+    explicit CRxPacketDecoder(int linktype = DLT_EN10MB);
+
+    void set_linktype(int linktype);
+    int linktype() const { return linktype_; }
+    bool supported() const { return l2_ != L2_NONE; }
+
+    bool decode(const uint8_t* data, uint32_t len, SRxDecodedPacket& out) const;
+
+    static SRxFlowKey flow_key(const SRxDecodedPacket& pkt);
+
+    static const char* linktype_name(int linktype);
+
+private:
+    enum L2Kind {
+        L2_NONE,
+        L2_ETHER,
+        L2_SLL,
+        L2_SLL2,
+        L2_RAW,
+        L2_NULL_HOST,
+        L2_NULL_NET
+    };
+
+    int linktype_;
+    L2Kind l2_;
+};
+
+#endif
@@ -0,0 +1,636 @@
+#include "rxpdefbpf.h"
+#include "rxpacketdecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const int kNext = -2;
+const int kNone = -1;
+
+const uint32_t kMemPayloadOff = 0;
+const uint32_t kMemPayloadLen = 1;
+const uint32_t kMemScratch = 2;
+const uint32_t kMemAcc = 3;
+
+const uint32_t kMaxInsns = 4096;
+
+struct AsmInsn {
+    struct bpf_insn insn;
+    int jt;
+    int jf;
+    bool is_ja;
+};
+
+class BpfAsm {
+public:
+    int new_label()
+    {
+        labels_.push_back(kNone);
+        return static_cast<int>(labels_.size()) - 1;
+    }
+
+    void bind(int label)
+    {
+        labels_[label] = static_cast<int>(code_.size());
+    }
+
+    void stmt(uint16_t code, uint32_t k)
+    {
+        AsmInsn a;
+        a.insn.code = code;
+        a.insn.jt = 0;
+        a.insn.jf = 0;
+        a.insn.k = k;
+        a.jt = kNone;
+        a.jf = kNone;
+        a.is_ja = false;
+        code_.push_back(a);
+    }
+
+    void jump(uint16_t code, uint32_t k, int jt, int jf)
+    {
+        stmt(BPF_JMP | code, k);
+        code_.back().jt = jt;
+        code_.back().jf = jf;
+    }
+
+    void ja(int label)
+    {
+        stmt(BPF_JMP | BPF_JA, 0);
+        code_.back().jt = label;
+        code_.back().is_ja = true;
+    }
+
+    bool assemble(std::vector<struct bpf_insn>& out, std::string& reason) const;
+
+private:
+    int target_index(int label, size_t at) const
+    {
+        return label == kNext ? static_cast<int>(at) + 1 : labels_[label];
+    }
+
+    std::vector<AsmInsn> code_;
+    std::vector<int> labels_;
+};
+
+bool BpfAsm::assemble(std::vector<struct bpf_insn>& out, std::string& reason) const
+{
+    size_t n = code_.size();
+    std::vector<bool> expanded(n, false);
+    std::vector<uint32_t> addr(n + 1, 0);
+
+    for (size_t i = 0; i < labels_.size(); ++i) {
+        if (labels_[i] == kNone) {
+            reason = "unbound label";
+            return false;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        uint32_t pc = 0;
+        for (size_t i = 0; i < n; ++i) {
+            addr[i] = pc;
+            pc += expanded[i] ? 3 : 1;
+        }
+        addr[n] = pc;
+
+        for (size_t i = 0; i < n; ++i) {
+            const AsmInsn& a = code_[i];
+            if (a.is_ja || a.jt == kNone || expanded[i]) {
+                continue;
+            }
+            int t = target_index(a.jt, i);
+            int f = target_index(a.jf, i);
+            if (t <= static_cast<int>(i) || f <= static_cast<int>(i)) {
+                reason = "backward jump";
+                return false;
+            }
+            uint32_t jt_off = addr[t] - addr[i] - 1;
+            uint32_t jf_off = addr[f] - addr[i] - 1;
+            if (jt_off > 255 || jf_off > 255) {
+                expanded[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    if (addr[n] > kMaxInsns) {
+        reason = "program too long";
+        return false;
+    }
+
+    out.clear();
+    out.reserve(addr[n]);
+    for (size_t i = 0; i < n; ++i) {
+        const AsmInsn& a = code_[i];
+        struct bpf_insn insn = a.insn;
+        if (a.is_ja) {
+            int t = target_index(a.jt, i);
+            if (t <= static_cast<int>(i)) {
+                reason = "backward jump";
+                return false;
+            }
+            insn.k = addr[t] - addr[i] - 1;
+            out.push_back(insn);
+        } else if (a.jt == kNone) {
+            out.push_back(insn);
+        } else if (!expanded[i]) {
+            insn.jt = static_cast<unsigned char>(addr[target_index(a.jt, i)] - addr[i] - 1);
+            insn.jf = static_cast<unsigned char>(addr[target_index(a.jf, i)] - addr[i] - 1);
+            out.push_back(insn);
+        } else {
+            insn.jt = 0;
+            insn.jf = 1;
+            out.push_back(insn);
+            struct bpf_insn far = { static_cast<unsigned short>(BPF_JMP | BPF_JA), 0, 0, 0 };
+            far.k = addr[target_index(a.jt, i)] - addr[i] - 2;
+            out.push_back(far);
+            far.k = addr[target_index(a.jf, i)] - addr[i] - 3;
+            out.push_back(far);
+        }
+    }
+    return true;
+}
+
+bool load_shape(OpCode op, uint32_t* width, bool* little)
+{
+    switch (op) {
+        case OP_LOAD_U8: *width = 1; *little = false; return true;
+        case OP_LOAD_U16_BE: *width = 2; *little = false; return true;
+        case OP_LOAD_U16_LE: *width = 2; *little = true; return true;
+        case OP_LOAD_U32_BE: *width = 4; *little = false; return true;
+        case OP_LOAD_U32_LE: *width = 4; *little = true; return true;
+        default: return false;
+    }
+}
+
+bool is_cmp(OpCode op)
+{
+    return op >= OP_CMP_EQ && op <= OP_CMP_IN_TABLE;
+}
+
+void set_members(const Instruction& cmp, std::vector<uint64_t>& out)
+{
+    out.clear();
+    const uint64_t* table = instruction_set_table(&cmp);
+    if (cmp.opcode == OP_CMP_IN_BITMAP) {
+        for (uint32_t v = 0; v < 256; ++v) {
+            if ((table[v >> 6] >> (v & 63)) & 1) {
+                out.push_back(v);
+            }
+        }
+    } else if (cmp.opcode == OP_CMP_IN_TABLE) {
+        out.assign(table, table + cmp.operand2);
+    }
+}
+
+bool is_load(OpCode op)
+{
+    return op >= OP_LOAD_U8 && op <= OP_LOAD_I64_LE;
+}
+
+bool is_cond_jump(OpCode op)
+{
+    return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+bool check_rule(const Instruction* code, uint32_t len, std::string& reason)
+{
+    bool have_acc = false;
+    for (uint32_t ip = 0; ip < len; ++ip) {
+        const Instruction& ins = code[ip];
+        uint32_t width = 0;
+        bool little = false;
+        if (is_load(ins.opcode)) {
+            if (!load_shape(ins.opcode, &width, &little)) {
+                reason = std::string("unsupported load ") + opcode_name(ins.opcode);
+                return false;
+            }
+            if (ins.offset > 0xFFFF) {
+                reason = "load offset out of range";
+                return false;
+            }
+            have_acc = true;
+        } else if (is_cmp(ins.opcode)) {
+            if (!have_acc) {
+                reason = "compare without a preceding load";
+                return false;
+            }
+            if (ip + 1 >= len || !is_cond_jump(code[ip + 1].opcode)) {
+                reason = "compare not followed by a conditional jump";
+                return false;
+            }
+            if (ins.opcode == OP_CMP_IN_TABLE) {
+                if (instruction_set_table(&ins)[ins.operand2 - 1] > 0xFFFFFFFFULL) {
+                    reason = "set member wider than 32 bits";
+                    return false;
+                }
+            } else if (ins.opcode != OP_CMP_IN_BITMAP &&
+                       (ins.operand > 0xFFFFFFFFULL || ins.operand2 > 0xFFFFFFFFULL)) {
+                reason = "operand wider than 32 bits";
+                return false;
+            }
+            ++ip;
+        } else if (is_cond_jump(ins.opcode)) {
+            reason = "conditional jump without a compare";
+            return false;
+        } else if (ins.opcode == OP_CHECK_LEN) {
+            if (ip != 0 || ins.operand > 0xFFFFFFFFULL) {
+                reason = "length check outside the rule prologue";
+                return false;
+            }
+        }
+
+        if (is_cond_jump(ins.opcode) || ins.opcode == OP_JUMP ||
+            (is_cmp(ins.opcode) && is_cond_jump(code[ip].opcode))) {
+            uint32_t target = code[ip].jump_target;
+            if (target <= ip && target < len) {
+                reason = "backward jump";
+                return false;
+            }
+            if (target < len && is_cond_jump(code[target].opcode)) {
+                reason = "jump into a compare pair";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void emit_load(BpfAsm& a, uint32_t base, uint32_t offset, uint32_t width, bool little,
+               bool checked, int fail)
+{
+    if (!checked) {
+        a.stmt(BPF_LD | BPF_MEM, kMemPayloadLen);
+        a.jump(BPF_JGE | BPF_K, offset + width, kNext, fail);
+    }
+
+    if (!little || width == 1) {
+        uint16_t size = width == 1 ? BPF_B : (width == 2 ? BPF_H : BPF_W);
+        a.stmt(BPF_LD | size | BPF_IND, base + offset);
+        return;
+    }
+
+    a.stmt(BPF_LD | BPF_B | BPF_IND, base + offset + width - 1);
+    a.stmt(BPF_ST, kMemScratch);
+    for (int b = static_cast<int>(width) - 2; b >= 0; --b) {
+        a.stmt(BPF_LD | BPF_MEM, kMemScratch);
+        a.stmt(BPF_ALU | BPF_LSH | BPF_K, 8);
+        a.stmt(BPF_ST, kMemScratch);
+        a.stmt(BPF_LD | BPF_B | BPF_IND, base + offset + static_cast<uint32_t>(b));
+        a.stmt(BPF_LDX | BPF_MEM, kMemScratch);
+        a.stmt(BPF_ALU | BPF_OR | BPF_X, 0);
+        a.stmt(BPF_ST, kMemScratch);
+        a.stmt(BPF_LDX | BPF_MEM, kMemPayloadOff);
+    }
+    a.stmt(BPF_LD | BPF_MEM, kMemScratch);
+}
+
+void emit_compare(BpfAsm& a, const Instruction& cmp, int on_true, int on_false)
+{
+    uint32_t k = static_cast<uint32_t>(cmp.operand);
+    switch (cmp.opcode) {
+        case OP_CMP_EQ: a.jump(BPF_JEQ | BPF_K, k, on_true, on_false); break;
+        case OP_CMP_NE: a.jump(BPF_JEQ | BPF_K, k, on_false, on_true); break;
+        case OP_CMP_GT: a.jump(BPF_JGT | BPF_K, k, on_true, on_false); break;
+        case OP_CMP_GE: a.jump(BPF_JGE | BPF_K, k, on_true, on_false); break;
+        case OP_CMP_LT: a.jump(BPF_JGE | BPF_K, k, on_false, on_true); break;
+        case OP_CMP_LE: a.jump(BPF_JGT | BPF_K, k, on_false, on_true); break;
+        case OP_CMP_RANGE:
+            a.jump(BPF_JGE | BPF_K, k, kNext, on_false);
+            a.jump(BPF_JGT | BPF_K, static_cast<uint32_t>(cmp.operand2), on_false, on_true);
+            break;
+        case OP_CMP_IN_BITMAP:
+        case OP_CMP_IN_TABLE: {
+            std::vector<uint64_t> members;
+            set_members(cmp, members);
+            for (size_t m = 0; m < members.size(); ++m) {
+                a.jump(BPF_JEQ | BPF_K, static_cast<uint32_t>(members[m]), on_true,
+                       m + 1 < members.size() ? kNext : on_false);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool reads_acc(const Instruction* code, uint32_t len, uint32_t ip)
+{
+    return ip < len && (is_cmp(code[ip].opcode) || code[ip].opcode == OP_JUMP);
+}
+
+void emit_mask(BpfAsm& a, const Instruction* code, uint32_t len, uint32_t ip,
+               uint32_t t_ip, uint32_t f_ip, int on_true, int on_false)
+{
+    bool keep_t = reads_acc(code, len, t_ip);
+    bool keep_f = reads_acc(code, len, f_ip);
+    if (keep_t || keep_f) {
+        a.stmt(BPF_ST, kMemAcc);
+    }
+    int t = keep_t ? a.new_label() : on_true;
+    int f = keep_f ? a.new_label() : on_false;
+    a.stmt(BPF_ALU | BPF_AND | BPF_K, static_cast<uint32_t>(code[ip].operand));
+    a.jump(BPF_JEQ | BPF_K, static_cast<uint32_t>(code[ip].operand2), t, f);
+    if (keep_t) {
+        a.bind(t);
+        a.stmt(BPF_LD | BPF_MEM, kMemAcc);
+        a.ja(on_true);
+    }
+    if (keep_f) {
+        a.bind(f);
+        a.stmt(BPF_LD | BPF_MEM, kMemAcc);
+        a.ja(on_false);
+    }
+}
+
+void emit_rule(BpfAsm& a, const Instruction* code, uint32_t len,
+               uint32_t base, uint32_t accept_len, int next_rule)
+{
+    std::vector<int> labels(len);
+    for (uint32_t i = 0; i < len; ++i) {
+        labels[i] = a.new_label();
+    }
+
+    bool checked = false;
+    for (uint32_t ip = 0; ip < len; ++ip) {
+        const Instruction& ins = code[ip];
+        a.bind(labels[ip]);
+        uint32_t width = 0;
+        bool little = false;
+        if (load_shape(ins.opcode, &width, &little)) {
+            emit_load(a, base, ins.offset, width, little, checked, next_rule);
+        } else if (is_cmp(ins.opcode)) {
+            const Instruction& jmp = code[ip + 1];
+            uint32_t taken = jmp.jump_target;
+            uint32_t fall = ip + 2;
+            uint32_t t_ip = jmp.opcode == OP_JUMP_IF_TRUE ? taken : fall;
+            uint32_t f_ip = jmp.opcode == OP_JUMP_IF_TRUE ? fall : taken;
+            int on_true = t_ip < len ? labels[t_ip] : next_rule;
+            int on_false = f_ip < len ? labels[f_ip] : next_rule;
+            if (ins.opcode == OP_CMP_MASK) {
+                emit_mask(a, code, len, ip, t_ip, f_ip, on_true, on_false);
+            } else {
+                emit_compare(a, ins, on_true, on_false);
+            }
+            ++ip;
+            a.bind(labels[ip]);
+        } else if (ins.opcode == OP_CHECK_LEN) {
+            a.stmt(BPF_LD | BPF_MEM, kMemPayloadLen);
+            a.jump(BPF_JGE | BPF_K, static_cast<uint32_t>(ins.operand), kNext, next_rule);
+            checked = true;
+        } else if (ins.opcode == OP_JUMP) {
+            a.ja(ins.jump_target < len ? labels[ins.jump_target] : next_rule);
+        } else if (ins.opcode == OP_RETURN_TRUE) {
+            a.stmt(BPF_RET | BPF_K, accept_len);
+        } else if (ins.opcode == OP_RETURN_FALSE) {
+            a.ja(next_rule);
+        }
+    }
+    a.ja(next_rule);
+}
+
+
+// Stores the payload offset/length the rule loads are relative to, then one
+// block per rule with OR semantics.
+void emit_rules(BpfAsm& a, const ProtocolDef* proto, uint32_t l2, uint32_t accept_len, int reject)
+{
+    a.stmt(BPF_STX, kMemPayloadOff);
+    a.stmt(BPF_LD | BPF_W | BPF_LEN, 0);
+    a.stmt(BPF_ALU | BPF_SUB | BPF_X, 0);
+    a.jump(BPF_JGT | BPF_K, l2, kNext, reject);
+    a.stmt(BPF_ALU | BPF_SUB | BPF_K, l2);
+    a.stmt(BPF_ST, kMemPayloadLen);
+
+    for (uint32_t r = 0; r < proto->filter_count; ++r) {
+        const FilterRule* rule = &proto->filters[r];
+        bool little = proto->endian_mode == ENDIAN_MODE_LITTLE && rule->bytecode_le;
+        const Instruction* code = little ? rule->bytecode_le : rule->bytecode;
+        uint32_t len = little ? rule->bytecode_le_len : rule->bytecode_len;
+        int next_rule = r + 1 < proto->filter_count ? a.new_label() : reject;
+        emit_rule(a, code, len, l2, accept_len, next_rule);
+        if (next_rule != reject) {
+            a.bind(next_rule);
+        }
+    }
+}
+
+}
+
+bool CRxPdefBpf::translate(const ProtocolDef* proto, int linktype, uint32_t accept_len, bool per_packet,
+                           std::vector<struct bpf_insn>& out, std::string& reason)
+{
+    if (!proto || proto->filter_count == 0) {
+        reason = "no filter rules";
+        return false;
+    }
+    if (per_packet && proto->endian_mode == ENDIAN_MODE_AUTO) {
+        reason = "auto endian";
+        return false;
+    }
+
+    for (uint32_t r = 0; per_packet && r < proto->filter_count; ++r) {
+        const FilterRule* rule = &proto->filters[r];
+        if (rule->sliding_window) {
+            reason = std::string("sliding window rule ") + rule->name;
+            return false;
+        }
+        bool little = proto->endian_mode == ENDIAN_MODE_LITTLE && rule->bytecode_le;
+        const Instruction* code = little ? rule->bytecode_le : rule->bytecode;
+        uint32_t len = little ? rule->bytecode_le_len : rule->bytecode_len;
+        std::string why;
+        if (!code || len == 0 || !check_rule(code, len, why)) {
+            reason = std::string("rule ") + rule->name + ": " + (why.empty() ? "empty bytecode" : why);
+            return false;
+        }
+    }
+
+    uint32_t l2 = 0;
+    BpfAsm a;
+    int reject = a.new_label();
+    int pass = a.new_label();
+    int tcp = a.new_label();
+    int udp = a.new_label();
+    int payload = a.new_label();
+
+    switch (linktype) {
+        case DLT_EN10MB:
+        case DLT_LINUX_SLL:
+            l2 = linktype == DLT_EN10MB ? 14 : 16;
+            a.stmt(BPF_LD | BPF_H | BPF_ABS, l2 - 2);
+            a.jump(BPF_JEQ | BPF_K, 0x0800, kNext, pass);
+            break;
+        case DLT_RAW:
+            l2 = 0;
+            a.stmt(BPF_LD | BPF_B | BPF_ABS, 0);
+            a.stmt(BPF_ALU | BPF_AND | BPF_K, 0xf0);
+            a.jump(BPF_JEQ | BPF_K, 0x40, kNext, pass);
+            break;
+        default: {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "unsupported linktype %d", linktype);
+            reason = buf;
+            return false;
+        }
+    }
+
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, l2 + 6);
+    a.jump(BPF_JSET | BPF_K, 0x1fff, per_packet ? reject : pass, kNext);
+    a.stmt(BPF_LDX | BPF_B | BPF_MSH, l2);
+    a.stmt(BPF_LD | BPF_B | BPF_ABS, l2 + 9);
+    a.jump(BPF_JEQ | BPF_K, 6, tcp, kNext);
+    a.jump(BPF_JEQ | BPF_K, 17, udp, kNext);
+    a.jump(BPF_JEQ | BPF_K, 4, pass, kNext);
+    a.jump(BPF_JEQ | BPF_K, 41, pass, kNext);
+    a.jump(BPF_JEQ | BPF_K, 47, pass, reject);
+
+    a.bind(udp);
+    a.stmt(BPF_LD | BPF_H | BPF_IND, l2 + 2);
+    a.jump(BPF_JEQ | BPF_K, CRxPacketDecoder::VXLAN_PORT, pass, kNext);
+    a.stmt(BPF_MISC | BPF_TXA, 0);
+    a.stmt(BPF_ALU | BPF_ADD | BPF_K, 8);
+    a.stmt(BPF_MISC | BPF_TAX, 0);
+    a.ja(payload);
+
+    a.bind(tcp);
+    a.stmt(BPF_LD | BPF_B | BPF_IND, l2 + 12);
+    a.stmt(BPF_ALU | BPF_RSH | BPF_K, 4);
+    a.stmt(BPF_ALU | BPF_MUL | BPF_K, 4);
+    a.stmt(BPF_ALU | BPF_ADD | BPF_X, 0);
+    a.stmt(BPF_MISC | BPF_TAX, 0);
+
+    a.bind(payload);
+    if (!per_packet) {
+        // IPv4 total length minus IP and L4 headers; Ethernet padding on
+        // short frames must not count as payload.
+        a.stmt(BPF_LD | BPF_H | BPF_ABS, l2 + 2);
+        a.stmt(BPF_ALU | BPF_SUB | BPF_X, 0);
+        a.jump(BPF_JGT | BPF_K, 0, pass, reject);
+    } else {
+        emit_rules(a, proto, l2, accept_len, reject);
+    }
+
+    a.bind(pass);
+    a.stmt(BPF_RET | BPF_K, accept_len);
+    a.bind(reject);
+    a.stmt(BPF_RET | BPF_K, 0);
+
+    return a.assemble(out, reason);
+}
+
+bool CRxPdefBpf::combine(const struct bpf_program* user, const std::vector<struct bpf_insn>& pdef,
+                         struct bpf_program* out, std::string& reason)
+{
+    uint32_t user_len = user ? user->bf_len : 0;
+    uint32_t total = user_len + static_cast<uint32_t>(pdef.size());
+    out->bf_len = 0;
+    out->bf_insns = NULL;
+    if (pdef.empty() || total > kMaxInsns) {
+        reason = pdef.empty() ? "empty PDEF program" : "combined program too long";
+        return false;
+    }
+
+    struct bpf_insn* insns = static_cast<struct bpf_insn*>(calloc(total, sizeof(struct bpf_insn)));
+    if (!insns) {
+        reason = "out of memory";
+        return false;
+    }
+
+    for (uint32_t i = 0; i < user_len; ++i) {
+        struct bpf_insn insn = user->bf_insns[i];
+        if (BPF_CLASS(insn.code) == BPF_RET) {
+            if (BPF_RVAL(insn.code) != BPF_K) {
+                free(insns);
+                reason = "user filter returns a computed length";
+                return false;
+            }
+            if (insn.k != 0) {
+                insn.code = BPF_JMP | BPF_JA;
+                insn.jt = 0;
+                insn.jf = 0;
+                insn.k = user_len - i - 1;
+            }
+        }
+        insns[i] = insn;
+    }
+    memcpy(insns + user_len, &pdef[0], pdef.size() * sizeof(struct bpf_insn));
+
+    out->bf_len = total;
+    out->bf_insns = insns;
+    return true;
+}
+
+void CRxPdefBpf::release(struct bpf_program* prog)
+{
+    if (prog && prog->bf_insns) {
+        free(prog->bf_insns);
+        prog->bf_insns = NULL;
+        prog->bf_len = 0;
+    }
+}
+
+bool CRxPdefBpf::install(pcap_t* handle, const std::string& user_bpf,
+                         const ProtocolDef* proto, bool per_packet, std::string& detail)
+{
+    if (!handle) {
+        return false;
+    }
+
+    struct bpf_program user;
+    memset(&user, 0, sizeof(user));
+    bool have_user = false;
+    if (!user_bpf.empty()) {
+        if (pcap_compile(handle, &user, user_bpf.c_str(), 1, PCAP_NETMASK_UNKNOWN) == 0) {
+            have_user = true;
+        } else {
+            fprintf(stderr, "pcap_compile failed for BPF: %s\n", user_bpf.c_str());
+
+        }
+    }
+
+    uint32_t accept_len = 0;
+    for (uint32_t i = 0; have_user && i < user.bf_len; ++i) {
+        const struct bpf_insn& insn = user.bf_insns[i];
+        if (BPF_CLASS(insn.code) == BPF_RET && BPF_RVAL(insn.code) == BPF_K && insn.k > accept_len) {
+            accept_len = insn.k;
+        }
+    }
+    if (accept_len == 0) {
+        accept_len = ACCEPT_LEN;
+    }
+
+    std::vector<struct bpf_insn> pdef_code;
+    struct bpf_program combined;
+    memset(&combined, 0, sizeof(combined));
+    bool installed = false;
+
+    if (!proto) {
+        detail = "no PDEF filter";
+    } else if (CRxPdefBpf::translate(proto, pcap_datalink(handle), accept_len, per_packet, pdef_code, detail) &&
+               CRxPdefBpf::combine(have_user ? &user : NULL, pdef_code, &combined, detail)) {
+        if (!bpf_validate(combined.bf_insns, static_cast<int>(combined.bf_len))) {
+            detail = "combined program rejected by bpf_validate";
+        } else if (pcap_setfilter(handle, &combined) != 0) {
+            detail = std::string("pcap_setfilter failed: ") + pcap_geterr(handle);
+        } else {
+            char buf[96];
+            snprintf(buf, sizeof(buf), "%u user + %u PDEF instructions",
+                     have_user ? user.bf_len : 0, static_cast<unsigned>(pdef_code.size()));
+            detail = buf;
+            installed = true;
+        }
+        CRxPdefBpf::release(&combined);
+    }
+
+    if (!installed && have_user) {
+        pcap_setfilter(handle, &user);
+    }
+    if (have_user) {
+        pcap_freecode(&user);
+    }
+    return installed;
+}
@@ -0,0 +1,32 @@
+#ifndef RX_PDEF_BPF_H
+#define RX_PDEF_BPF_H
+
+#include "pdef/pdef_types.h"
+#include <pcap/pcap.h>
+#include <string>
+#include <vector>
+
+class CRxPdefBpf {
+public:
+    enum {
+        ACCEPT_LEN = 262144
+    };
+
+    // per_packet compiles the PDEF rules themselves and is only valid when the
+    // consumer judges every packet on its own. Filter threads keep whole flows
+    // (replies, continuation segments) once one packet matched, so for them
+    // only the flow-agnostic part is emitted: IPv4 TCP/UDP packets without
+    // payload are dropped, everything else is passed to userspace.
+    static bool translate(const ProtocolDef* proto, int linktype, uint32_t accept_len, bool per_packet,
+                          std::vector<struct bpf_insn>& out, std::string& reason);
+
+    static bool combine(const struct bpf_program* user, const std::vector<struct bpf_insn>& pdef,
+                        struct bpf_program* out, std::string& reason);
+
+    static void release(struct bpf_program* prog);
+
+    static bool install(pcap_t* handle, const std::string& user_bpf,
+                        const ProtocolDef* proto, bool per_packet, std::string& detail);
+};
+
+#endif
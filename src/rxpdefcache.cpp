@@ -0,0 +1,274 @@
+#include "rxpdefcache.h"
+#include "pdef/parser.h"
+#include "runtime/protocol.h"
+#include <stdio.h>
+#include <string.h>
+#include <new>
+
+namespace {
+
+inline uint64_t fnv1a64_append(uint64_t hash, const unsigned char* data, size_t len)
+{
+    const uint64_t kPrime = 1099511628211ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= kPrime;
+    }
+    return hash;
+}
+
+bool read_file_content(const std::string& path, std::string& out)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    out.clear();
+    char buf[4096];
+    size_t n = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.append(buf, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+}
+
+const size_t CRxPdefCache::DEFAULT_CAPACITY;
+
+CRxPdefCache* CRxPdefCache::instance()
+{
+    static CRxPdefCache cache;
+    return &cache;
+}
+
+CRxPdefCache::CRxPdefCache(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1)
+{
+}
+
+CRxPdefCache::~CRxPdefCache()
+{
+    for (DefMap::iterator it = by_def_.begin(); it != by_def_.end(); ++it) {
+        protocol_free(it->second->def);
+        delete it->second;
+    }
+    by_def_.clear();
+    entries_.clear();
+    lru_.clear();
+}
+
+uint64_t CRxPdefCache::make_key(const std::string& source, const std::string& origin_path)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    hash = fnv1a64_append(hash, reinterpret_cast<const unsigned char*>(source.data()), source.size());
+    hash = fnv1a64_append(hash, reinterpret_cast<const unsigned char*>("\0"), 1);
+    hash = fnv1a64_append(hash, reinterpret_cast<const unsigned char*>(origin_path.data()), origin_path.size());
+    return hash;
+}
+
+const ProtocolDef* CRxPdefCache::acquire_source(const std::string& source,
+                                                const std::string& origin_path,
+                                                char* error_msg, size_t error_size)
+{
+    uint64_t key = make_key(source, origin_path);
+
+    {
+        CRxThreadLock lock(&mutex_);
+        EntryMap::iterator it = entries_.find(key);
+        if (it != entries_.end() &&
+            it->second->source == source &&
+            it->second->origin_path == origin_path) {
+            Entry* entry = it->second;
+            entry->refcount++;
+            touch_locked(entry);
+            stats_.hits++;
+            return entry->def;
+        }
+        stats_.misses++;
+    }
+
+
+    ProtocolDef* def = pdef_parse_string(source.c_str(), error_msg, error_size);
+    if (!def) {
+        CRxThreadLock lock(&mutex_);
+        stats_.parse_failures++;
+        return NULL;
+    }
+    if (!origin_path.empty()) {
+        strncpy(def->pdef_file_path, origin_path.c_str(), sizeof(def->pdef_file_path) - 1);
+        def->pdef_file_path[sizeof(def->pdef_file_path) - 1] = '\0';
+    }
+    def->detected_endian = ENDIAN_TYPE_UNKNOWN;
+
+    Entry* entry = new (std::nothrow) Entry();
+    if (!entry) {
+        protocol_free(def);
+        if (error_msg && error_size > 0) {
+            snprintf(error_msg, error_size, "Memory allocation failed");
+        }
+        return NULL;
+    }
+    entry->key = key;
+    entry->source = source;
+    entry->origin_path = origin_path;
+    entry->def = def;
+    entry->refcount = 1;
+
+    CRxThreadLock lock(&mutex_);
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end() &&
+        it->second->source == source &&
+        it->second->origin_path == origin_path) {
+
+        Entry* existing = it->second;
+        existing->refcount++;
+        touch_locked(existing);
+        protocol_free(def);
+        delete entry;
+        return existing->def;
+    }
+
+    if (it == entries_.end()) {
+        entry->cached = true;
+        lru_.push_front(key);
+        entry->lru_pos = lru_.begin();
+        entries_[key] = entry;
+    }
+    by_def_[def] = entry;
+    evict_locked();
+    return def;
+}
+
+const ProtocolDef* CRxPdefCache::acquire_file(const std::string& path,
+                                              char* error_msg, size_t error_size)
+{
+    std::string source;
+    if (!read_file_content(path, source)) {
+        if (error_msg && error_size > 0) {
+            snprintf(error_msg, error_size, "Failed to open file: %s", path.c_str());
+        }
+        return NULL;
+    }
+    return acquire_source(source, path, error_msg, error_size);
+}
+
+void CRxPdefCache::release(const ProtocolDef* def)
+{
+    if (!def) {
+        return;
+    }
+    CRxThreadLock lock(&mutex_);
+    DefMap::iterator it = by_def_.find(def);
+    if (it == by_def_.end()) {
+        LOG_WARNING("PdefCache: release of unknown ProtocolDef %p", (const void*)def);
+        return;
+    }
+    Entry* entry = it->second;
+    if (entry->refcount > 0) {
+        entry->refcount--;
+    }
+    if (entry->refcount == 0) {
+        if (!entry->cached) {
+            destroy_entry_locked(entry);
+        } else {
+            evict_locked();
+        }
+    }
+}
+
+size_t CRxPdefCache::forget_path(const std::string& path)
+{
+    CRxThreadLock lock(&mutex_);
+    return forget_locked(&path);
+}
+
+size_t CRxPdefCache::forget_files()
+{
+    CRxThreadLock lock(&mutex_);
+    return forget_locked(NULL);
+}
+
+size_t CRxPdefCache::forget_locked(const std::string* path)
+{
+    size_t dropped = 0;
+    EntryMap::iterator it = entries_.begin();
+    while (it != entries_.end()) {
+        Entry* entry = it->second;
+        if (path ? entry->origin_path != *path : entry->origin_path.empty()) {
+            ++it;
+            continue;
+        }
+        lru_.erase(entry->lru_pos);
+        entries_.erase(it++);
+        entry->cached = false;
+        dropped++;
+        if (entry->refcount == 0) {
+            destroy_entry_locked(entry);
+        }
+    }
+    return dropped;
+}
+
+void CRxPdefCache::set_capacity(size_t capacity)
+{
+    CRxThreadLock lock(&mutex_);
+    capacity_ = capacity > 0 ? capacity : 1;
+    evict_locked();
+}
+
+CRxPdefCache::Stats CRxPdefCache::get_stats() const
+{
+    CRxThreadLock lock(&mutex_);
+    Stats stats = stats_;
+    stats.entries = entries_.size();
+    stats.in_use = 0;
+    for (DefMap::const_iterator it = by_def_.begin(); it != by_def_.end(); ++it) {
+        if (it->second->refcount > 0) {
+            stats.in_use++;
+        }
+    }
+    return stats;
+}
+
+void CRxPdefCache::touch_locked(Entry* entry)
+{
+    if (!entry->cached) {
+        return;
+    }
+    lru_.splice(lru_.begin(), lru_, entry->lru_pos);
+    entry->lru_pos = lru_.begin();
+}
+
+void CRxPdefCache::evict_locked()
+{
+    if (entries_.size() <= capacity_) {
+        return;
+    }
+    std::list<uint64_t>::iterator it = lru_.end();
+    while (entries_.size() > capacity_ && it != lru_.begin()) {
+        --it;
+        EntryMap::iterator found = entries_.find(*it);
+        if (found == entries_.end() || found->second->refcount > 0) {
+            continue;
+        }
+        Entry* victim = found->second;
+        it = lru_.erase(it);
+        entries_.erase(found);
+        victim->cached = false;
+        stats_.evictions++;
+        LOG_DEBUG("PdefCache: evicted %s (key=%016llx)",
+                  victim->def ? victim->def->name : "?",
+                  static_cast<unsigned long long>(victim->key));
+        destroy_entry_locked(victim);
+    }
+}
+
+void CRxPdefCache::destroy_entry_locked(Entry* entry)
+{
+    by_def_.erase(entry->def);
+    protocol_free(entry->def);
+    delete entry;
+}
@@ -0,0 +1,122 @@
+#ifndef RX_PDEF_CACHE_H
+#define RX_PDEF_CACHE_H
+
+#include "legacy_core.h"
+#include "pdef/pdef_types.h"
+#include <list>
+#include <map>
+#include <string>
+#include <stdint.h>
+
+class CRxPdefCache {
+public:
+    struct Stats {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        unsigned long parse_failures;
+        size_t entries;
+        size_t in_use;
+
+        Stats()
+            : hits(0)
+            , misses(0)
+            , evictions(0)
+            , parse_failures(0)
+            , entries(0)
+            , in_use(0)
+        {}
+    };
+
+    static CRxPdefCache* instance();
+
+    explicit CRxPdefCache(size_t capacity = DEFAULT_CAPACITY);
+    ~CRxPdefCache();
+
+
+    const ProtocolDef* acquire_source(const std::string& source,
+                                      const std::string& origin_path,
+                                      char* error_msg, size_t error_size);
+
+    const ProtocolDef* acquire_file(const std::string& path,
+                                    char* error_msg, size_t error_size);
+
+    void release(const ProtocolDef* def);
+
+    // Drops cached parses of a file that changed on disk; definitions still in
+    // use are freed on their last release. Returns the number of entries dropped.
+    size_t forget_path(const std::string& path);
+
+    // Same for every file-backed entry, for when the watcher lost track of
+    // which files changed. Inline sources are keyed by content and stay.
+    size_t forget_files();
+
+    void set_capacity(size_t capacity);
+    size_t capacity() const { return capacity_; }
+
+    Stats get_stats() const;
+
+    static uint64_t make_key(const std::string& source, const std::string& origin_path);
+
+    static const size_t DEFAULT_CAPACITY = 32;
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::string source;
+        std::string origin_path;
+        ProtocolDef* def;
+        int refcount;
+        bool cached;
+        std::list<uint64_t>::iterator lru_pos;
+
+        Entry() : key(0), def(NULL), refcount(0), cached(false) {}
+    };
+
+    typedef std::map<uint64_t, Entry*> EntryMap;
+    typedef std::map<const ProtocolDef*, Entry*> DefMap;
+
+    void touch_locked(Entry* entry);
+    void evict_locked();
+    void destroy_entry_locked(Entry* entry);
+    size_t forget_locked(const std::string* path);
+
+    CRxPdefCache(const CRxPdefCache&);
+    CRxPdefCache& operator=(const CRxPdefCache&);
+
+private:
+    mutable CRxThreadMutex mutex_;
+    size_t capacity_;
+    EntryMap entries_;
+    DefMap by_def_;
+    std::list<uint64_t> lru_;
+    Stats stats_;
+};
+
+class CRxPdefHandle {
+public:
+    CRxPdefHandle() : cache_(NULL), def_(NULL) {}
+    CRxPdefHandle(CRxPdefCache* cache, const ProtocolDef* def) : cache_(cache), def_(def) {}
+    ~CRxPdefHandle() { reset(); }
+
+    void reset()
+    {
+        if (cache_ && def_) {
+            cache_->release(def_);
+        }
+        def_ = NULL;
+    }
+
+    const ProtocolDef* get() const { return def_; }
+    const ProtocolDef* operator->() const { return def_; }
+    bool valid() const { return def_ != NULL; }
+
+private:
+    CRxPdefHandle(const CRxPdefHandle&);
+    CRxPdefHandle& operator=(const CRxPdefHandle&);
+
+    CRxPdefCache* cache_;
+    const ProtocolDef* def_;
+};
+
+#endif
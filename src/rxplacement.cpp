@@ -0,0 +1,299 @@
+#include "rxplacement.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+bool read_line(const std::string& path, std::string& out)
+{
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[4096];
+    bool ok = fgets(buf, sizeof(buf), fp) != NULL;
+    fclose(fp);
+    if (!ok) {
+        return false;
+    }
+    out = buf;
+    while (!out.empty() && (out[out.size() - 1] == '\n' || out[out.size() - 1] == ' ')) {
+        out.erase(out.size() - 1);
+    }
+    return true;
+}
+
+std::string trim(const std::string& s)
+{
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) {
+        return std::string();
+    }
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+}
+
+const char* thread_role_to_string(int role)
+{
+    switch (role) {
+        case RX_ROLE_CAPTURE: return "capture";
+        case RX_ROLE_FILTER: return "filter";
+        case RX_ROLE_CLEANUP: return "cleanup";
+        case RX_ROLE_HTTP: return "http";
+        case RX_ROLE_CONTROL: return "control";
+        default: return "unknown";
+    }
+}
+
+CRxThreadPlacement* CRxThreadPlacement::instance()
+{
+    static CRxThreadPlacement placement;
+    return &placement;
+}
+
+CRxThreadPlacement::CRxThreadPlacement()
+    : numa_auto_(false)
+    , capture_seq_(0)
+{
+}
+
+bool CRxThreadPlacement::parse_cpu_list(const std::string& text, std::vector<int>& cpus)
+{
+    cpus.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        char* end = NULL;
+        long first = strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (end == item.c_str() || first < 0) {
+            return false;
+        }
+        if (*end == '-') {
+            const char* p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return false;
+            }
+        }
+        if (*end != '\0' || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+std::string CRxThreadPlacement::format_cpu_list(const std::vector<int>& cpus)
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < cpus.size(); ) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (i > 0) {
+            out << ',';
+        }
+        out << cpus[i];
+        if (j > i) {
+            out << '-' << cpus[j];
+        }
+        i = j + 1;
+    }
+    return out.str();
+}
+
+int CRxThreadPlacement::iface_numa_node(const std::string& iface)
+{
+    if (iface.empty() || iface == "any" || iface.find('/') != std::string::npos) {
+        return -1;
+    }
+    std::string line;
+    if (!read_line("/sys/class/net/" + iface + "/device/numa_node", line)) {
+        return -1;
+    }
+    return atoi(line.c_str());
+}
+
+void CRxThreadPlacement::load_topology()
+{
+    node_cpus_.clear();
+    cpu_node_.clear();
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (!dir) {
+        return;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) != 0 || ent->d_name[4] < '0' || ent->d_name[4] > '9') {
+            continue;
+        }
+        int node = atoi(ent->d_name + 4);
+        std::string line;
+        std::vector<int> cpus;
+        if (!read_line(std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist", line) ||
+            !parse_cpu_list(line, cpus) || cpus.empty()) {
+            continue;
+        }
+        node_cpus_[node] = cpus;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            cpu_node_[cpus[i]] = node;
+        }
+    }
+    closedir(dir);
+}
+
+int CRxThreadPlacement::node_of_cpus(const std::vector<int>& cpus) const
+{
+    int node = -1;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        std::map<int, int>::const_iterator it = cpu_node_.find(cpus[i]);
+        if (it == cpu_node_.end() || (node >= 0 && it->second != node)) {
+            return -1;
+        }
+        node = it->second;
+    }
+    return node;
+}
+
+void CRxThreadPlacement::configure(const CRxServerConfig::PlacementConfig& cfg, const std::string& default_iface)
+{
+    CRxThreadLock lock(&mutex_);
+
+    load_topology();
+    numa_auto_ = cfg.numa == "auto";
+    if (!numa_auto_ && cfg.numa != "off") {
+        LOG_WARNING("placement: unknown numa policy '%s', treating as off", cfg.numa.c_str());
+    }
+
+    const std::string* lists[RX_ROLE_MAX] = {
+        &cfg.capture_cpus, &cfg.filter_cpus, &cfg.cleanup_cpus, &cfg.http_cpus, &cfg.control_cpus
+    };
+    for (int role = 0; role < RX_ROLE_MAX; ++role) {
+        if (!parse_cpu_list(*lists[role], role_cpus_[role])) {
+            LOG_WARNING("placement: invalid %s cpu list '%s', ignored", thread_role_to_string(role), lists[role]->c_str());
+            role_cpus_[role].clear();
+        }
+    }
+
+    capture_nodes_.clear();
+    capture_ifaces_.clear();
+    std::stringstream ss(cfg.capture_interfaces.empty() ? default_iface : cfg.capture_interfaces);
+    std::string iface;
+    while (std::getline(ss, iface, ',')) {
+        iface = trim(iface);
+        if (iface.empty()) {
+            continue;
+        }
+        int node = iface_numa_node(iface);
+        capture_ifaces_.push_back(std::make_pair(iface, node));
+        LOG_NOTICE("placement: capture interface %s on numa node %d", iface.c_str(), node);
+        if (node >= 0 && node_cpus_.count(node) &&
+            std::find(capture_nodes_.begin(), capture_nodes_.end(), node) == capture_nodes_.end()) {
+            capture_nodes_.push_back(node);
+        }
+    }
+
+    LOG_NOTICE("placement: %zu numa node(s), policy %s", node_cpus_.size(), numa_auto_ ? "auto" : "off");
+}
+
+void CRxThreadPlacement::place(base_net_thread* thread, ERxThreadRole role, const std::string& name)
+{
+    if (!thread) {
+        return;
+    }
+
+    CRxThreadLock lock(&mutex_);
+
+    std::vector<int> cpus;
+    int node = -1;
+    const std::vector<int>& explicit_cpus = role_cpus_[role];
+    if (!explicit_cpus.empty()) {
+        // Capture workers get one CPU each so that two busy workers never
+        // share a core; other roles float within their set.
+        if (role == RX_ROLE_CAPTURE) {
+            cpus.push_back(explicit_cpus[capture_seq_ % explicit_cpus.size()]);
+        } else {
+            cpus = explicit_cpus;
+        }
+        node = node_of_cpus(cpus);
+    } else if (numa_auto_ && node_cpus_.size() > 1 && !capture_nodes_.empty()) {
+        if (role == RX_ROLE_CAPTURE) {
+            node = capture_nodes_[capture_seq_ % capture_nodes_.size()];
+        } else if (role == RX_ROLE_FILTER || role == RX_ROLE_CLEANUP) {
+            node = capture_nodes_[0];
+        }
+        if (node >= 0) {
+            cpus = node_cpus_[node];
+        }
+    }
+    if (role == RX_ROLE_CAPTURE) {
+        capture_seq_++;
+    }
+    // A memory policy only matters with more than one node, and "off" leaves
+    // allocation to the kernel even when CPUs are pinned explicitly.
+    thread->set_placement(cpus, numa_auto_ && node_cpus_.size() > 1 ? node : -1);
+
+    Entry entry;
+    entry.name = name;
+    entry.role = role;
+    entry.thread_index = thread->get_thread_index();
+    entry.cpus = cpus.empty() ? std::string("all") : format_cpu_list(cpus);
+    entry.node = node;
+    entries_.push_back(entry);
+
+    LOG_NOTICE("placement: %s thread %s (index %u) -> cpus %s, node %d",
+               thread_role_to_string(role), name.c_str(), entry.thread_index, entry.cpus.c_str(), node);
+}
+
+int CRxThreadPlacement::thread_node(uint32_t thread_index) const
+{
+    CRxThreadLock lock(&mutex_);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].thread_index == thread_index) {
+            return entries_[i].node;
+        }
+    }
+    return -1;
+}
+
+std::vector<CRxThreadPlacement::Entry> CRxThreadPlacement::entries() const
+{
+    CRxThreadLock lock(&mutex_);
+    return entries_;
+}
+
+void CRxThreadPlacement::render_prometheus(std::string& out) const
+{
+    CRxThreadLock lock(&mutex_);
+    std::ostringstream os;
+    os << "# HELP rxtrace_thread_numa_node NUMA node a thread is placed on (-1 when not placed)\n"
+       << "# TYPE rxtrace_thread_numa_node gauge\n";
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        os << "rxtrace_thread_numa_node{thread=\"" << e.name << "\",role=\"" << thread_role_to_string(e.role)
+           << "\",index=\"" << e.thread_index << "\",cpus=\"" << e.cpus << "\"} " << e.node << "\n";
+    }
+    os << "# HELP rxtrace_capture_iface_numa_node NUMA node of a capture interface (-1 when unknown)\n"
+       << "# TYPE rxtrace_capture_iface_numa_node gauge\n";
+    for (size_t i = 0; i < capture_ifaces_.size(); ++i) {
+        os << "rxtrace_capture_iface_numa_node{iface=\"" << capture_ifaces_[i].first << "\"} "
+           << capture_ifaces_[i].second << "\n";
+    }
+    out += os.str();
+}
@@ -0,0 +1,72 @@
+#ifndef RX_PLACEMENT_H
+#define RX_PLACEMENT_H
+
+#include "legacy_core.h"
+#include "rxserverconfig.h"
+#include <map>
+#include <utility>
+#include <string>
+#include <vector>
+
+enum ERxThreadRole {
+    RX_ROLE_CAPTURE = 0,
+    RX_ROLE_FILTER,
+    RX_ROLE_CLEANUP,
+    RX_ROLE_HTTP,
+    RX_ROLE_CONTROL,
+    RX_ROLE_MAX
+};
+
+const char* thread_role_to_string(int role);
+
+// Decides CPU affinity and preferred memory node for each thread before it is
+// started. Explicit per-role CPU lists win; otherwise, with numa "auto" on a
+// multi-node host, capture workers are spread over the nodes of the capture
+// NICs and filter/cleanup threads follow the first of them. Placement happens
+// at startup; the recorded table is read by /metrics.
+class CRxThreadPlacement {
+public:
+    struct Entry {
+        std::string name;
+        int role;
+        uint32_t thread_index;
+        std::string cpus;
+        int node;
+    };
+
+    static CRxThreadPlacement* instance();
+
+    CRxThreadPlacement();
+
+    void configure(const CRxServerConfig::PlacementConfig& cfg, const std::string& default_iface);
+
+    void place(base_net_thread* thread, ERxThreadRole role, const std::string& name);
+
+    // -1 when the thread was not placed on a node.
+    int thread_node(uint32_t thread_index) const;
+
+    std::vector<Entry> entries() const;
+    void render_prometheus(std::string& out) const;
+
+    static bool parse_cpu_list(const std::string& text, std::vector<int>& cpus);
+    static std::string format_cpu_list(const std::vector<int>& cpus);
+    // -1 for virtual interfaces, "any", or hosts without NUMA information.
+    static int iface_numa_node(const std::string& iface);
+
+private:
+    void load_topology();
+    int node_of_cpus(const std::vector<int>& cpus) const;
+
+    bool numa_auto_;
+    std::vector<int> role_cpus_[RX_ROLE_MAX];
+    std::vector<int> capture_nodes_;
+    std::vector<std::pair<std::string, int> > capture_ifaces_;
+    std::map<int, std::vector<int> > node_cpus_;
+    std::map<int, int> cpu_node_;
+    unsigned int capture_seq_;
+
+    mutable CRxThreadMutex mutex_;
+    std::vector<Entry> entries_;
+};
+
+#endif
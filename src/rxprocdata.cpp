@@ -9,6 +9,7 @@
 #include "rxhttpthread.h"
 #include "rxcapturemessages.h"
 #include "rxurlhandlers.h"
+#include "rxplacement.h"
 #include <time.h>
 
 namespace {
@@ -64,6 +65,8 @@ uint32_t compute_config_hash(const CaptureConfigSnapshot& cfg)
     hash = fnv1a_mix_uint64(hash, static_cast<uint64_t>(cfg.max_bytes));
     hash = fnv1a_mix_uint32(hash, static_cast<uint32_t>(cfg.max_packets));
     hash = fnv1a_mix_uint32(hash, static_cast<uint32_t>(cfg.snaplen));
+    hash = fnv1a_mix_string(hash, cfg.rate_ladder);
+    hash = fnv1a_mix_uint32(hash, static_cast<uint32_t>(cfg.rate_drop_pct * 1000.0));
     hash = fnv1a_mix_uint32(hash, cfg.compress_enabled ? 1u : 0u);
     hash = fnv1a_mix_uint32(hash, static_cast<uint32_t>(cfg.compress_threshold_mb));
     hash = fnv1a_mix_string(hash, cfg.compress_format);
@@ -190,10 +193,15 @@ void CRxProcData::reg_handler()
     url_handler_map_.insert(std::make_pair("/", handler));
     url_handler_map_.insert(std::make_pair("", handler));
 
+    handler.reset(new CRxUrlHandlerMetrics());
+    url_handler_map_.insert(std::make_pair("/metrics", handler));
+
     shared_ptr<CRxUrlHandler> capture_handler(new CRxUrlHandlerCaptureApi());
     url_handler_map_.insert(std::make_pair("/api/capture/start", capture_handler));
     url_handler_map_.insert(std::make_pair("/api/capture/stop", capture_handler));
     url_handler_map_.insert(std::make_pair("/api/capture/status", capture_handler));
+    url_handler_map_.insert(std::make_pair("/api/capture/stats", capture_handler));
+    url_handler_map_.insert(std::make_pair("/api/capture/list", capture_handler));
 
     shared_ptr<CRxUrlHandler> pdef_upload_handler(new CRxUrlHandlerPdefUpload());
     url_handler_map_.insert(std::make_pair("/api/pdef/upload", pdef_upload_handler));
@@ -273,6 +281,10 @@ int CRxProcData::init_threads()
 
     LOG_NOTICE("Initializing all threads...");
 
+    if (_conf) {
+        CRxThreadPlacement::instance()->configure(_conf->placement(), _conf->capture().default_interface);
+    }
+
     _capture_manager_thread = new (std::nothrow) CRxCaptureManagerThread();
     if (!_capture_manager_thread)
     {
@@ -304,6 +316,14 @@ int CRxProcData::init_threads()
         return -1;
     }
 
+    CRxThreadPlacement* placement = CRxThreadPlacement::instance();
+    placement->place(_capture_manager_thread, RX_ROLE_CONTROL, "capture_manager");
+    placement->place(_sample_thread, RX_ROLE_CONTROL, "sample");
+    placement->place(_cleanup_thread, RX_ROLE_CLEANUP, "cleanup");
+    placement->place(_reload_thread, RX_ROLE_CONTROL, "reload");
+
+    load_task_journal();
+
     LOG_NOTICE("Starting CRxCaptureManagerThread...");
     if (!_capture_manager_thread->start())
     {
@@ -345,6 +365,96 @@ int CRxProcData::init_threads()
     return 0;
 }
 
+std::string CRxProcData::task_journal_path() const
+{
+    if (_conf && !_conf->journal().path.empty()) {
+        return _conf->journal().path;
+    }
+    std::string base;
+    CRxStrategyConfigManager* cfg = current_strategy_config();
+    if (cfg) {
+        base = cfg->storage().base_dir;
+    }
+    if (base.empty() && _conf) {
+        base = _conf->storage().base_dir;
+    }
+    if (base.empty()) {
+        base = "/var/log/rxtrace/captures";
+    }
+    if (base[base.size() - 1] != '/') {
+        base += "/";
+    }
+    return base + "tasks.journal";
+}
+
+void CRxProcData::load_task_journal()
+{
+    if (!_conf || !_conf->journal().enabled) {
+        return;
+    }
+
+    std::string path = task_journal_path();
+    std::vector<SRxCaptureTask*> tasks;
+    CRxTaskJournal::LoadStats stats;
+    std::string error;
+    if (!_task_journal.load(path, _conf->journal().history_max_tasks, tasks, stats, error)) {
+        LOG_WARNING("Task journal unavailable, history will not survive restarts: %s", error.c_str());
+        return;
+    }
+
+    // Whatever was queued or running died with the previous process.
+    size_t interrupted = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        SRxCaptureTask* task = tasks[i];
+        if (!TaskTable::is_active_status(task->status)) {
+            continue;
+        }
+        task->status = STATUS_FAILED;
+        if (task->error_message.empty()) {
+            task->error_message = "interrupted_by_restart";
+        }
+        if (task->end_time == 0) {
+            task->end_time = task->start_time;
+        }
+        interrupted++;
+    }
+
+    _capture_task_mgr.restore_tasks(tasks);
+    _capture_task_mgr.set_journal(&_task_journal);
+
+    LOG_NOTICE("Task journal %s: restored %zu task(s) (%zu interrupted) from %llu record(s) in %llu us",
+               path.c_str(), tasks.size(), interrupted,
+               static_cast<unsigned long long>(stats.records),
+               static_cast<unsigned long long>(stats.elapsed_us));
+
+    compact_task_journal();
+}
+
+bool CRxProcData::compact_task_journal()
+{
+    if (!_task_journal.is_open()) {
+        return false;
+    }
+    std::vector<const SRxCaptureTask*> tasks;
+    _capture_task_mgr.collect_tasks(tasks);
+    size_t max_tasks = _conf ? _conf->journal().history_max_tasks : 0;
+    if (max_tasks > 0 && tasks.size() > max_tasks) {
+        tasks.erase(tasks.begin(), tasks.end() - max_tasks);
+    }
+
+    uint64_t before = _task_journal.records();
+    std::string error;
+    if (!_task_journal.compact(tasks, error)) {
+        LOG_WARNING("Task journal compaction failed: %s", error.c_str());
+        return false;
+    }
+    LOG_NOTICE("Task journal compacted: %llu -> %llu record(s), %zu task(s)",
+               static_cast<unsigned long long>(before),
+               static_cast<unsigned long long>(_task_journal.records()),
+               tasks.size());
+    return true;
+}
+
 int CRxProcData::reload()
 {
     int flag = 0;
@@ -357,6 +467,14 @@ int CRxProcData::reload()
     return flag;
 }
 
+int CRxProcData::force_reload()
+{
+    if (!_strategy_dict) {
+        return -1;
+    }
+    return _strategy_dict->reload();
+}
+
 bool CRxProcData::need_reload()
 {
     return true;
@@ -421,6 +539,8 @@ CaptureConfigSnapshot CRxProcData::get_capture_config_snapshot() const
         snapshot.max_bytes = defaults.max_bytes;
         snapshot.max_packets = 0;
         snapshot.snaplen = 65535;
+        snapshot.rate_ladder = defaults.rate_ladder;
+        snapshot.rate_drop_pct = defaults.rate_drop_pct;
 
         if (storage.progress_bytes_threshold > 0) {
             snapshot.compress_threshold_mb = static_cast<int>(storage.progress_bytes_threshold / (1024 * 1024));
@@ -8,6 +8,7 @@
 #include "rxcapturetasktypes.h"
 #include "rxcapturemessages.h"
 #include "rxsafetaskmgr.h"
+#include "rxtaskjournal.h"
 #include <vector>
 #include <deque>
 #include <stdint.h>
@@ -75,6 +76,7 @@ class CRxProcData:public reload_inf
         int init(CRxServerConfig *conf);
         virtual int load();
         virtual int reload();
+        int force_reload();
         virtual bool need_reload();
         virtual int dump();
         virtual int destroy();
@@ -95,6 +97,9 @@ class CRxProcData:public reload_inf
         shared_ptr<CRxUrlHandler> get_url_handler(const std::string& key);
 
         CRxSafeTaskMgr& capture_task_mgr() { return _capture_task_mgr; }
+        CRxTaskJournal& task_journal() { return _task_journal; }
+        // Rewrites the journal from the task manager; capture manager thread only.
+        bool compact_task_journal();
         CRxServerConfig* server_config() const { return _conf; }
         CaptureConfigSnapshot get_capture_config_snapshot() const;
         CRxStrategyConfigManager* current_strategy_config() const {
@@ -121,9 +126,14 @@ class CRxProcData:public reload_inf
         bool _threads_initialized;
 
         CRxSafeTaskMgr _capture_task_mgr;
+        CRxTaskJournal _task_journal;
         uint64_t _next_sample_alert_id;
         std::deque<SRxSampleAlertRecord> _sample_alerts;
 
+    private:
+        void load_task_journal();
+        std::string task_journal_path() const;
+
     private:
         static CRxProcData* _singleton;
 };
@@ -79,10 +79,13 @@ std::vector<int> CRxProcessResolver::GetListeningPorts(pid_t pid)
     std::vector<unsigned long> socket_inodes = GetSocketInodes(pid);
     std::set<unsigned long> inode_set(socket_inodes.begin(), socket_inodes.end());
 
-    std::vector<int> tcp_ports = ParseTcpFile("/proc/net/tcp", inode_set);
+    char net_dir[64];
+    snprintf(net_dir, sizeof(net_dir), "/proc/%d/net", pid);
+
+    std::vector<int> tcp_ports = ParseTcpFile(std::string(net_dir) + "/tcp", inode_set);
     ports.insert(tcp_ports.begin(), tcp_ports.end());
 
-    std::vector<int> tcp6_ports = ParseTcpFile("/proc/net/tcp6", inode_set);
+    std::vector<int> tcp6_ports = ParseTcpFile(std::string(net_dir) + "/tcp6", inode_set);
     ports.insert(tcp6_ports.begin(), tcp6_ports.end());
 
     if (!ports.empty()) {
@@ -214,6 +217,28 @@ std::string CRxProcessResolver::GetNetNsPath(pid_t pid)
     return std::string();
 }
 
+std::string CRxProcessResolver::GetForeignNetNsFile(pid_t pid)
+{
+    std::string target = GetNetNsPath(pid);
+    if (target.empty()) {
+        return std::string();
+    }
+
+    char link[512];
+    ssize_t len = readlink("/proc/self/ns/net", link, sizeof(link) - 1);
+    if (len <= 0) {
+        return std::string();
+    }
+    link[len] = '\0';
+    if (target == link) {
+        return std::string();
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/ns/net", pid);
+    return std::string(path);
+}
+
 std::string CRxProcessResolver::GetCmdline(pid_t pid)
 {
     char path[256];
@@ -27,6 +27,10 @@ public:
 
     static std::string GetNetNsPath(pid_t pid);
 
+    // Openable /proc/<pid>/ns/net when pid lives in another network namespace
+    // than this daemon, empty otherwise.
+    static std::string GetForeignNetNsFile(pid_t pid);
+
     static std::string GetCmdline(pid_t pid);
 
     static std::string GetComm(pid_t pid);
@@ -0,0 +1,143 @@
+#include "rxprotocoldispatcher.h"
+#include "runtime/protocol.h"
+#include <string.h>
+
+CRxProtocolDispatcher::CRxProtocolDispatcher()
+{
+    memset(endian_storage_, 0, sizeof(endian_storage_));
+    memset(port_bits_, 0, sizeof(port_bits_));
+}
+
+int CRxProtocolDispatcher::add(const ProtocolDef* proto, volatile int* endian_state)
+{
+    if (!proto || protos_.size() >= MAX_PROTOCOLS) {
+        return NO_MATCH;
+    }
+    size_t index = protos_.size();
+    endian_storage_[index] = ENDIAN_TYPE_UNKNOWN;
+    protos_.push_back(proto);
+    endian_.push_back(endian_state ? endian_state : &endian_storage_[index]);
+    return static_cast<int>(index);
+}
+
+void CRxProtocolDispatcher::build(bool port_gated)
+{
+    memset(port_bits_, 0, sizeof(port_bits_));
+    port_head_.clear();
+    port_protos_.clear();
+    fallback_.clear();
+
+    std::vector<uint32_t> counts;
+    for (size_t i = 0; i < protos_.size(); ++i) {
+        const ProtocolDef* proto = protos_[i];
+        if (!port_gated || proto->port_count == 0 || !proto->ports) {
+            fallback_.push_back(static_cast<uint8_t>(i));
+            continue;
+        }
+        if (counts.empty()) {
+            counts.assign(65536, 0);
+        }
+        for (uint32_t k = 0; k < proto->port_count; ++k) {
+            ++counts[proto->ports[k]];
+        }
+    }
+    if (counts.empty()) {
+        return;
+    }
+
+    port_head_.assign(65537, 0);
+    for (uint32_t p = 0; p < 65536; ++p) {
+        port_head_[p + 1] = port_head_[p] + counts[p];
+        if (counts[p]) {
+            port_bits_[p >> 6] |= 1ULL << (p & 63);
+        }
+    }
+
+    port_protos_.resize(port_head_[65536]);
+    std::vector<uint32_t> fill(port_head_.begin(), port_head_.end() - 1);
+    for (size_t i = 0; i < protos_.size(); ++i) {
+        const ProtocolDef* proto = protos_[i];
+        if (proto->port_count == 0 || !proto->ports) {
+            continue;
+        }
+        for (uint32_t k = 0; k < proto->port_count; ++k) {
+            port_protos_[fill[proto->ports[k]]++] = static_cast<uint8_t>(i);
+        }
+    }
+}
+
+bool CRxProtocolDispatcher::try_protocol(int index, const uint8_t* payload, uint32_t len, uint32_t* match_offset)
+{
+    return packet_filter_match_at(payload, len, protos_[index], endian_[index], match_offset);
+}
+
+bool CRxProtocolDispatcher::match_one(int index, const uint8_t* payload, uint32_t len, uint32_t* match_offset)
+{
+    if (index < 0 || static_cast<size_t>(index) >= protos_.size()) {
+        return false;
+    }
+    return try_protocol(index, payload, len, match_offset);
+}
+
+int CRxProtocolDispatcher::match(const uint8_t* payload, uint32_t len, uint16_t src_port, uint16_t dst_port,
+                                 uint32_t* match_offset)
+{
+    ++stats_.packets;
+
+    uint64_t tried = 0;
+    uint16_t ports[2] = { dst_port, src_port };
+    for (int i = 0; i < 2; ++i) {
+        uint16_t p = ports[i];
+        if (i == 1 && p == dst_port) {
+            break;
+        }
+        if (!((port_bits_[p >> 6] >> (p & 63)) & 1ULL)) {
+            continue;
+        }
+        for (uint32_t k = port_head_[p]; k < port_head_[p + 1]; ++k) {
+            int index = port_protos_[k];
+            uint64_t bit = 1ULL << index;
+            if (tried & bit) {
+                continue;
+            }
+            tried |= bit;
+            ++stats_.port_evaluations;
+            if (try_protocol(index, payload, len, match_offset)) {
+                return index;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < fallback_.size(); ++i) {
+        ++stats_.fallback_evaluations;
+        if (try_protocol(fallback_[i], payload, len, match_offset)) {
+            return fallback_[i];
+        }
+    }
+    return NO_MATCH;
+}
+
+std::vector<std::string> CRxProtocolDispatcher::split_list(const std::string& list)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        size_t b = start;
+        size_t e = comma;
+        while (b < e && (list[b] == ' ' || list[b] == '\t')) {
+            ++b;
+        }
+        while (e > b && (list[e - 1] == ' ' || list[e - 1] == '\t')) {
+            --e;
+        }
+        if (e > b) {
+            out.push_back(list.substr(b, e - b));
+        }
+        start = comma + 1;
+    }
+    return out;
+}
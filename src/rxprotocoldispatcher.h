@@ -0,0 +1,59 @@
+#ifndef RX_PROTOCOL_DISPATCHER_H
+#define RX_PROTOCOL_DISPATCHER_H
+
+#include "pdef/pdef_types.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CRxProtocolDispatcher {
+public:
+    enum {
+        NO_MATCH = -1,
+        MAX_PROTOCOLS = 64
+    };
+
+    struct Stats {
+        unsigned long packets;
+        unsigned long port_evaluations;
+        unsigned long fallback_evaluations;
+
+        Stats() : packets(0), port_evaluations(0), fallback_evaluations(0) {}
+    };
+
+    CRxProtocolDispatcher();
+
+    int add(const ProtocolDef* proto, volatile int* endian_state = NULL);
+
+    void build(bool port_gated);
+
+    int match(const uint8_t* payload, uint32_t len, uint16_t src_port, uint16_t dst_port,
+              uint32_t* match_offset = NULL);
+
+    bool match_one(int index, const uint8_t* payload, uint32_t len, uint32_t* match_offset = NULL);
+
+    size_t size() const { return protos_.size(); }
+    const ProtocolDef* protocol(int index) const { return protos_[index]; }
+    int detected_endian(int index) const { return ENDIAN_STATE_TYPE(*endian_[index]); }
+
+    const Stats& stats() const { return stats_; }
+
+    static std::vector<std::string> split_list(const std::string& list);
+
+private:
+    CRxProtocolDispatcher(const CRxProtocolDispatcher&);
+    CRxProtocolDispatcher& operator=(const CRxProtocolDispatcher&);
+
+    bool try_protocol(int index, const uint8_t* payload, uint32_t len, uint32_t* match_offset);
+
+    std::vector<const ProtocolDef*> protos_;
+    std::vector<volatile int*> endian_;
+    int endian_storage_[MAX_PROTOCOLS];
+    std::vector<uint32_t> port_head_;
+    std::vector<uint8_t> port_protos_;
+    std::vector<uint8_t> fallback_;
+    uint64_t port_bits_[1024];
+    Stats stats_;
+};
+
+#endif
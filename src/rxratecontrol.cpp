@@ -0,0 +1,145 @@
+#include "rxratecontrol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+std::string trim(const std::string& s)
+{
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) {
+        return std::string();
+    }
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+bool parse_size(const std::string& text, long& out)
+{
+    char* end = NULL;
+    long v = strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || v <= 0) {
+        return false;
+    }
+    if (*end == 'k' || *end == 'K') {
+        v *= 1024L;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        v *= 1024L * 1024L;
+        end++;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    out = v;
+    return true;
+}
+
+}
+
+CRxRateController::CRxRateController()
+    : drop_pct_(0.1),
+      next_(0),
+      cooldown_(0),
+      backlog_secs_(0)
+{
+}
+
+bool CRxRateController::parse_ladder(const std::string& spec, std::vector<SRxRateStep>& out, std::string& error)
+{
+    out.clear();
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = spec.size();
+        }
+        std::string item = trim(spec.substr(pos, comma - pos));
+        pos = comma + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            error = "rate step '" + item + "' has no value";
+            return false;
+        }
+        std::string kind = trim(item.substr(0, colon));
+        std::string value = trim(item.substr(colon + 1));
+
+        SRxRateStep step;
+        if (kind == "buffer") {
+            step.kind = RX_RATE_BUFFER;
+        } else if (kind == "snaplen") {
+            step.kind = RX_RATE_SNAPLEN;
+        } else if (kind == "sample") {
+            step.kind = RX_RATE_SAMPLE;
+        } else {
+            error = "unknown rate step '" + kind + "'";
+            return false;
+        }
+        if (!parse_size(value, step.value) ||
+            (step.kind != RX_RATE_BUFFER && value.find_first_not_of("0123456789") != std::string::npos) ||
+            (step.kind == RX_RATE_SNAPLEN && step.value < 64) ||
+            (step.kind == RX_RATE_SAMPLE && step.value < 2)) {
+            error = "invalid value in rate step '" + item + "'";
+            return false;
+        }
+        out.push_back(step);
+    }
+    return true;
+}
+
+std::string CRxRateController::describe(const SRxRateStep& step)
+{
+    char buf[64];
+    switch (step.kind) {
+    case RX_RATE_BUFFER:
+        snprintf(buf, sizeof(buf), "buffer=%ldKB", step.value / 1024);
+        break;
+    case RX_RATE_SNAPLEN:
+        snprintf(buf, sizeof(buf), "snaplen=%ld", step.value);
+        break;
+    default:
+        snprintf(buf, sizeof(buf), "sample=1/%ld", step.value);
+        break;
+    }
+    return buf;
+}
+
+bool CRxRateController::configure(const std::string& ladder, double drop_pct, std::string& error)
+{
+    next_ = 0;
+    cooldown_ = 0;
+    backlog_secs_ = 0;
+    drop_pct_ = drop_pct > 0.0 ? drop_pct : 0.1;
+    return parse_ladder(ladder, ladder_, error);
+}
+
+int CRxRateController::observe(uint64_t recv_delta, uint64_t drop_delta, double backlog_ratio)
+{
+    if (ladder_.empty()) {
+        return -1;
+    }
+    backlog_secs_ = backlog_ratio >= 0.95 ? backlog_secs_ + 1 : 0;
+    if (cooldown_ > 0) {
+        cooldown_--;
+        return -1;
+    }
+    if (next_ >= static_cast<int>(ladder_.size())) {
+        return -1;
+    }
+
+    uint64_t seen = recv_delta + drop_delta;
+    bool dropping = drop_delta > 0 && seen > 0 &&
+                    100.0 * static_cast<double>(drop_delta) / static_cast<double>(seen) >= drop_pct_;
+    if (!dropping && backlog_secs_ < BACKLOG_SEC) {
+        return -1;
+    }
+
+    backlog_secs_ = 0;
+    cooldown_ = COOLDOWN_SEC;
+    return next_++;
+}
@@ -0,0 +1,54 @@
+#ifndef RX_RATE_CONTROL_H
+#define RX_RATE_CONTROL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum ERxRateStepKind {
+    RX_RATE_BUFFER = 0,
+    RX_RATE_SNAPLEN = 1,
+    RX_RATE_SAMPLE = 2
+};
+
+struct SRxRateStep {
+    int kind;
+    long value;
+};
+
+// Steps down a configured ladder while the kernel reports drops. The ladder is
+// a comma separated list such as "buffer:64m,snaplen:256,sample:4,sample:16";
+// buffer sizes take k/m suffixes, sample:N keeps one flow in N.
+class CRxRateController {
+public:
+    enum {
+        COOLDOWN_SEC = 3,
+        BACKLOG_SEC = 3
+    };
+
+    CRxRateController();
+
+    static bool parse_ladder(const std::string& spec, std::vector<SRxRateStep>& out, std::string& error);
+    static std::string describe(const SRxRateStep& step);
+
+    bool configure(const std::string& ladder, double drop_pct, std::string& error);
+
+    bool enabled() const { return !ladder_.empty(); }
+
+    // Fed once per second with kernel counter deltas and the fraction of
+    // dispatch calls that returned a full batch. Returns the ladder index to
+    // apply next, or -1 to hold.
+    int observe(uint64_t recv_delta, uint64_t drop_delta, double backlog_ratio);
+
+    const SRxRateStep& step(int index) const { return ladder_[static_cast<size_t>(index)]; }
+    int position() const { return next_; }
+
+private:
+    std::vector<SRxRateStep> ladder_;
+    double drop_pct_;
+    int next_;
+    int cooldown_;
+    int backlog_secs_;
+};
+
+#endif
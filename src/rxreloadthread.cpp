@@ -16,10 +16,48 @@ using compat::dynamic_pointer_cast;
 using compat::const_pointer_cast;
 using compat::make_shared;
 #include "rxstrategyconfig.h"
+#include "rxpdefcache.h"
+
+namespace {
+
+// Edits usually arrive as a burst (write + rename, several files saved at
+// once); apply them together once things settle.
+const uint32_t kDebounceMs = 1000;
+// Only used when inotify is unavailable.
+const uint32_t kPollIntervalMs = 5000;
+const uint32_t kHeapCheckMs = 10000;
+const size_t kTrimFreeBytes = 32UL * 1024 * 1024;
+const time_t kTrimMinIntervalSec = 60;
+
+size_t heap_free_bytes()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2();
+    return mi.fordblks;
+#else
+    struct mallinfo mi = mallinfo();
+    return static_cast<size_t>(static_cast<unsigned int>(mi.fordblks));
+#endif
+}
+
+std::string parent_dir(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? std::string("/") : path.substr(0, slash);
+}
+
+}
 
 CRxReloadThread::CRxReloadThread()
     : _is_first(false)
     , _reload_interval_ms(60000)
+    , _pending_kinds(0)
+    , _pending_pdef_flush(false)
+    , _debounce_armed(false)
+    , _last_trim(0)
 {
 }
 
@@ -28,7 +66,108 @@ void CRxReloadThread::run_process()
     if (!_is_first)
     {
         _is_first = true;
-        reload_timer_start();
+        if (!start_watch()) {
+            LOG_WARNING("Config watch unavailable, polling every %u ms", kPollIntervalMs);
+            reload_timer_start();
+        }
+        start_timer(TIMER_TYPE_HEAP_TRIM, kHeapCheckMs);
+    }
+}
+
+bool CRxReloadThread::start_watch()
+{
+    CRxProcData* p_data = CRxProcData::instance();
+    CRxServerConfig* conf = p_data ? p_data->server_config() : NULL;
+    if (!conf) {
+        return false;
+    }
+
+    _watcher = CRxConfigWatcher::create(this);
+    if (!_watcher) {
+        return false;
+    }
+    shared_ptr<base_net_obj> obj = _watcher;
+    obj->set_net_container(get_net_container());
+
+    if (!conf->loaded_path().empty()) {
+        _watcher->watch_file(conf->loaded_path(), RX_WATCH_SERVER_CONFIG);
+    }
+    if (!conf->strategy_path().empty()) {
+        _watcher->watch_file(conf->strategy_path(), RX_WATCH_STRATEGY);
+    }
+    watch_pdef_dirs();
+    return true;
+}
+
+void CRxReloadThread::watch_pdef_dirs()
+{
+    CRxProcData* p_data = CRxProcData::instance();
+    CRxStrategyConfigManager* strategy = p_data ? p_data->current_strategy_config() : NULL;
+    if (!_watcher || !strategy) {
+        return;
+    }
+
+    // inotify_add_watch on an already watched directory just merges the mask,
+    // so re-adding after each strategy reload is harmless.
+    std::set<std::string> dirs;
+    const std::map<std::string, std::string>& pdefs = strategy->protocol_pdefs();
+    for (std::map<std::string, std::string>::const_iterator it = pdefs.begin(); it != pdefs.end(); ++it) {
+        dirs.insert(parent_dir(it->second));
+    }
+    for (std::set<std::string>::const_iterator it = dirs.begin(); it != dirs.end(); ++it) {
+        _watcher->watch_dir(*it, ".pdef", RX_WATCH_PDEF);
+    }
+}
+
+void CRxReloadThread::on_config_change(int kind, const std::string& path)
+{
+    _pending_kinds |= kind;
+    if (kind & RX_WATCH_PDEF) {
+        // An empty path comes from an inotify queue overflow: any file may have changed.
+        if (path.empty()) {
+            _pending_pdef_flush = true;
+        } else {
+            _pending_pdefs.insert(path);
+        }
+    }
+    if (!_debounce_armed) {
+        _debounce_armed = true;
+        start_timer(TIMER_TYPE_RELOAD_DEBOUNCE, kDebounceMs);
+    }
+}
+
+void CRxReloadThread::apply_pending()
+{
+    int kinds = _pending_kinds;
+    bool flush_pdefs = _pending_pdef_flush;
+    std::set<std::string> pdefs;
+    pdefs.swap(_pending_pdefs);
+    _pending_kinds = 0;
+    _pending_pdef_flush = false;
+
+    CRxProcData* p_data = CRxProcData::instance();
+    if (!p_data) {
+        return;
+    }
+
+    if (kinds & (RX_WATCH_SERVER_CONFIG | RX_WATCH_STRATEGY)) {
+        LOG_NOTICE("Config change detected, reloading strategy");
+        if (p_data->force_reload() != 0) {
+            LOG_WARNING("Strategy reload failed, keeping previous configuration");
+        }
+        watch_pdef_dirs();
+    }
+
+    if (flush_pdefs) {
+        size_t dropped = CRxPdefCache::instance()->forget_files();
+        LOG_NOTICE("Config watch overflowed, dropped %zu cached PDEF definition(s)", dropped);
+        return;
+    }
+    for (std::set<std::string>::const_iterator it = pdefs.begin(); it != pdefs.end(); ++it) {
+        size_t dropped = CRxPdefCache::instance()->forget_path(*it);
+        if (dropped > 0) {
+            LOG_NOTICE("PDEF %s changed, dropped %zu cached definition(s)", it->c_str(), dropped);
+        }
     }
 }
 
@@ -66,31 +205,56 @@ void CRxReloadThread::handle_timeout(shared_ptr<timer_msg> & t_msg)
 {
     LOG_DEBUG("handle_timeout timer_type:%d, time_length:%d", t_msg->_timer_type, t_msg->_time_length);
     CRxProcData* p_data = CRxProcData::instance();
-    if (t_msg->_timer_type == TIMER_TYPE_RELOAD_CONF && p_data)
+    switch (t_msg->_timer_type)
     {
-        if (p_data->reload())
-        {
-        }
-
-        {
+        case TIMER_TYPE_RELOAD_CONF:
+            if (p_data) {
+                p_data->reload();
+            }
             reload_timer_start();
-        }
+            break;
 
-        malloc_trim(0);
+        case TIMER_TYPE_RELOAD_DEBOUNCE:
+            _debounce_armed = false;
+            apply_pending();
+            break;
+
+        case TIMER_TYPE_HEAP_TRIM:
+            trim_heap();
+            start_timer(TIMER_TYPE_HEAP_TRIM, kHeapCheckMs);
+            break;
+
+        default:
+            break;
     }
 }
 
-void CRxReloadThread::reload_timer_start()
+void CRxReloadThread::trim_heap()
 {
-    CRxProcData* p_data = CRxProcData::instance();
-    (void)p_data;
-
+    time_t now = time(NULL);
+    if (now - _last_trim < kTrimMinIntervalSec) {
+        return;
+    }
+    size_t free_bytes = heap_free_bytes();
+    if (free_bytes < kTrimFreeBytes) {
+        return;
+    }
+    _last_trim = now;
+    malloc_trim(0);
+    LOG_DEBUG("malloc_trim released heap, free before trim: %zu bytes", free_bytes);
+}
 
-    _reload_interval_ms = 1000;
+void CRxReloadThread::reload_timer_start()
+{
+    _reload_interval_ms = kPollIntervalMs;
+    start_timer(TIMER_TYPE_RELOAD_CONF, _reload_interval_ms);
+}
 
+void CRxReloadThread::start_timer(uint32_t timer_type, uint32_t ms)
+{
     shared_ptr<timer_msg> t_msg(new timer_msg);
-    t_msg->_timer_type = TIMER_TYPE_RELOAD_CONF;
-    t_msg->_time_length = _reload_interval_ms;
+    t_msg->_timer_type = timer_type;
+    t_msg->_time_length = ms;
     t_msg->_obj_id = OBJ_ID_THREAD;
     add_timer(t_msg);
 }
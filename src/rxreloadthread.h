@@ -3,10 +3,14 @@
 
 #include "legacy_core.h"
 #include "rxprocdata.h"
+#include "rxconfigwatch.h"
+#include <set>
 
 #define TIMER_TYPE_RELOAD_CONF 100
+#define TIMER_TYPE_RELOAD_DEBOUNCE 101
+#define TIMER_TYPE_HEAP_TRIM 102
 
-class CRxReloadThread:public base_net_thread
+class CRxReloadThread:public base_net_thread, public CRxConfigChangeSink
 {
     public:
         CRxReloadThread();
@@ -19,10 +23,25 @@ class CRxReloadThread:public base_net_thread
 
         void reload_timer_start();
 
+        virtual void on_config_change(int kind, const std::string& path);
+
     private:
         bool _is_first;
         uint32_t _reload_interval_ms;
 
+        shared_ptr<CRxConfigWatcher> _watcher;
+        int _pending_kinds;
+        std::set<std::string> _pending_pdefs;
+        bool _pending_pdef_flush;
+        bool _debounce_armed;
+        time_t _last_trim;
+
+        bool start_watch();
+        void watch_pdef_dirs();
+        void apply_pending();
+        void start_timer(uint32_t timer_type, uint32_t ms);
+        void trim_heap();
+
 
         void writeback_pdef_endian(const char* pdef_file_path, int detected_endian);
 };
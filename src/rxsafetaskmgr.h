@@ -2,9 +2,14 @@
 #define __SAFE_TASK_MGR_H__
 
 #include "rxcapturetasktypes.h"
+#include "rxtaskjournal.h"
+#include <algorithm>
+#include <functional>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
+#include <limits.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -18,8 +23,10 @@ struct TaskSnapshot
     ECaptureMode capture_mode;
     std::string iface;
     std::string proc_name;
+    std::string category;
     pid_t target_pid;
     uint32_t worker_thread_index;
+    int priority;
     bool stop_requested;
     bool cancel_requested;
     std::string filter;
@@ -34,6 +41,7 @@ struct TaskSnapshot
     std::string request_user;
     std::vector<CaptureFileInfo> captured_files;
     std::vector<CaptureArchiveInfo> archives;
+    CaptureLossStats loss;
 
     TaskSnapshot()
         : capture_id(-1)
@@ -41,6 +49,7 @@ struct TaskSnapshot
         , capture_mode(MODE_INTERFACE)
         , target_pid(-1)
         , worker_thread_index(0)
+        , priority(0)
         , stop_requested(false)
         , cancel_requested(false)
         , port_filter(0)
@@ -75,6 +84,51 @@ struct TaskStats
     }
 };
 
+struct TaskQuery
+{
+    // One bit per ECaptureTaskStatus (1 << status); 0 matches any status.
+    unsigned status_mask;
+    std::string category;
+    std::string iface;
+    std::string proc_name;
+    // Inclusive start_time bounds; 0 leaves that side open.
+    long since;
+    long until;
+    // Results are ordered newest start_time first. With has_cursor set the
+    // page resumes strictly after (cursor_start, cursor_id).
+    bool has_cursor;
+    long cursor_start;
+    int cursor_id;
+    size_t limit;
+
+    TaskQuery()
+        : status_mask(0)
+        , since(0)
+        , until(0)
+        , has_cursor(false)
+        , cursor_start(0)
+        , cursor_id(0)
+        , limit(50)
+    {
+    }
+};
+
+struct TaskQueryResult
+{
+    std::vector<int> capture_ids;
+    bool has_more;
+    // Position of the last returned task, to be passed back as the cursor.
+    long next_start;
+    int next_id;
+
+    TaskQueryResult()
+        : has_more(false)
+        , next_start(0)
+        , next_id(0)
+    {
+    }
+};
+
 class CRxTaskSlot
 {
 public:
@@ -202,8 +256,10 @@ struct TaskTable
         snapshot.capture_mode = task->capture_mode;
         snapshot.iface = task->iface;
         snapshot.proc_name = task->proc_name;
+        snapshot.category = task->category;
         snapshot.target_pid = task->target_pid;
         snapshot.worker_thread_index = task->worker_thread_index;
+        snapshot.priority = task->priority;
         snapshot.stop_requested = task->stop_requested;
         snapshot.cancel_requested = task->cancel_requested;
         snapshot.filter = task->filter;
@@ -218,6 +274,7 @@ struct TaskTable
         snapshot.request_user = task->request_user;
         snapshot.captured_files = task->captured_files;
         snapshot.archives = task->archives;
+        snapshot.loss = task->loss;
 
         return true;
     }
@@ -257,6 +314,192 @@ struct TaskTable
     }
 };
 
+// Secondary indexes over the tasks for list queries. Every index is a set of
+// (start_time, capture_id) so that whichever one drives a query is already in
+// page order. Updated by the thread that owns the task manager, read from
+// the HTTP threads.
+class CRxTaskIndex
+{
+public:
+    typedef std::pair<long, int> Key;
+    typedef std::set<Key> KeySet;
+
+    void put(const SRxCaptureTask& task)
+    {
+        CRxWriteLock lock(&_rwlock);
+        std::map<int, Entry>::iterator it = _entries.find(task.capture_id);
+        if (it != _entries.end()) {
+            unlink(it->first, it->second);
+        } else {
+            it = _entries.insert(std::make_pair(task.capture_id, Entry())).first;
+        }
+        Entry& entry = it->second;
+        entry.status = task.status;
+        entry.start_time = task.start_time;
+        entry.category = task.category;
+        entry.iface = task.iface;
+        entry.proc_name = task.proc_name;
+
+        Key key(entry.start_time, task.capture_id);
+        _by_start.insert(key);
+        _by_status[entry.status].insert(key);
+        if (!entry.category.empty()) {
+            _by_category[entry.category].insert(key);
+        }
+    }
+
+    void erase(int capture_id)
+    {
+        CRxWriteLock lock(&_rwlock);
+        std::map<int, Entry>::iterator it = _entries.find(capture_id);
+        if (it == _entries.end()) {
+            return;
+        }
+        unlink(it->first, it->second);
+        _entries.erase(it);
+    }
+
+    size_t size() const
+    {
+        CRxReadLock lock(&_rwlock);
+        return _entries.size();
+    }
+
+    void query(const TaskQuery& query, TaskQueryResult& result) const
+    {
+        result = TaskQueryResult();
+        if (query.limit == 0) {
+            return;
+        }
+        size_t want = query.limit + 1;
+
+        // Everything at or past this key is excluded, whether by the cursor
+        // or by the until bound.
+        Key bound(LONG_MAX, INT_MAX);
+        if (query.until > 0 && query.until < LONG_MAX) {
+            bound = Key(query.until + 1, INT_MIN);
+        }
+        if (query.has_cursor && Key(query.cursor_start, query.cursor_id) < bound) {
+            bound = Key(query.cursor_start, query.cursor_id);
+        }
+
+        std::vector<Key> keys;
+        CRxReadLock lock(&_rwlock);
+        if (!query.category.empty()) {
+            std::map<std::string, KeySet>::const_iterator it = _by_category.find(query.category);
+            if (it != _by_category.end()) {
+                scan(it->second, query, bound, want, keys);
+            }
+        } else if (query.status_mask != 0) {
+            // Each status set yields its own newest matches; the page is the
+            // newest of their union.
+            for (std::map<int, KeySet>::const_iterator it = _by_status.begin(); it != _by_status.end(); ++it) {
+                if (query.status_mask & (1u << it->first)) {
+                    scan(it->second, query, bound, want, keys);
+                }
+            }
+            std::sort(keys.begin(), keys.end(), std::greater<Key>());
+            if (keys.size() > want) {
+                keys.resize(want);
+            }
+        } else {
+            scan(_by_start, query, bound, want, keys);
+        }
+
+        result.has_more = keys.size() > query.limit;
+        if (result.has_more) {
+            keys.resize(query.limit);
+        }
+        result.capture_ids.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            result.capture_ids.push_back(keys[i].second);
+        }
+        if (!keys.empty()) {
+            result.next_start = keys.back().first;
+            result.next_id = keys.back().second;
+        }
+    }
+
+private:
+    struct Entry {
+        ECaptureTaskStatus status;
+        long start_time;
+        std::string category;
+        std::string iface;
+        std::string proc_name;
+
+        Entry() : status(STATUS_PENDING), start_time(0) {}
+    };
+
+    void unlink(int capture_id, const Entry& entry)
+    {
+        Key key(entry.start_time, capture_id);
+        _by_start.erase(key);
+        std::map<int, KeySet>::iterator st = _by_status.find(entry.status);
+        if (st != _by_status.end()) {
+            st->second.erase(key);
+            if (st->second.empty()) {
+                _by_status.erase(st);
+            }
+        }
+        if (!entry.category.empty()) {
+            std::map<std::string, KeySet>::iterator cat = _by_category.find(entry.category);
+            if (cat != _by_category.end()) {
+                cat->second.erase(key);
+                if (cat->second.empty()) {
+                    _by_category.erase(cat);
+                }
+            }
+        }
+    }
+
+    bool matches(const Key& key, const TaskQuery& query) const
+    {
+        std::map<int, Entry>::const_iterator it = _entries.find(key.second);
+        if (it == _entries.end()) {
+            return false;
+        }
+        const Entry& entry = it->second;
+        if (query.status_mask != 0 && !(query.status_mask & (1u << entry.status))) {
+            return false;
+        }
+        if (!query.category.empty() && entry.category != query.category) {
+            return false;
+        }
+        if (!query.iface.empty() && entry.iface != query.iface) {
+            return false;
+        }
+        if (!query.proc_name.empty() && entry.proc_name != query.proc_name) {
+            return false;
+        }
+        return true;
+    }
+
+    // Appends up to want matching keys of the set below bound, newest first.
+    void scan(const KeySet& set, const TaskQuery& query, const Key& bound, size_t want,
+              std::vector<Key>& out) const
+    {
+        size_t found = 0;
+        KeySet::const_iterator it = set.lower_bound(bound);
+        while (it != set.begin() && found < want) {
+            --it;
+            if (query.since > 0 && it->first < query.since) {
+                break;
+            }
+            if (matches(*it, query)) {
+                out.push_back(*it);
+                ++found;
+            }
+        }
+    }
+
+    mutable CRxThreadRwlock _rwlock;
+    std::map<int, Entry> _entries;
+    KeySet _by_start;
+    std::map<int, KeySet> _by_status;
+    std::map<std::string, KeySet> _by_category;
+};
+
 class CRxSafeTaskMgr
 {
     struct TaskUpdaterStart {
@@ -417,6 +660,7 @@ public:
         , _completed_count(0)
         , _failed_count(0)
         , _stopped_count(0)
+        , _journal(NULL)
     {
     }
 
@@ -435,6 +679,34 @@ public:
         cleanup_pending_deletes();
     }
 
+    // Task changes are journaled from here on; tasks replayed from the
+    // journal must be added before it is attached.
+    void set_journal(CRxTaskJournal* journal)
+    {
+        _journal = journal;
+    }
+
+    // Tasks of the current table in capture_id order; only valid on the thread
+    // that updates the manager, until its next cleanup_pending_deletes().
+    void collect_tasks(std::vector<const SRxCaptureTask*>& out) const
+    {
+        int curr_idx = __sync_fetch_and_add(const_cast<volatile int*>(&_curr), 0);
+        const std::map<int, CRxTaskSlot>& slots = _tables[curr_idx].slots;
+        for (std::map<int, CRxTaskSlot>::const_iterator it = slots.begin(); it != slots.end(); ++it) {
+            SRxCaptureTask* task = it->second.get();
+            if (task) {
+                out.push_back(task);
+            }
+        }
+    }
+
+    int max_capture_id() const
+    {
+        int curr_idx = __sync_fetch_and_add(const_cast<volatile int*>(&_curr), 0);
+        const std::map<int, CRxTaskSlot>& slots = _tables[curr_idx].slots;
+        return slots.empty() ? 0 : slots.rbegin()->first;
+    }
+
     bool query_task(int capture_id, TaskSnapshot& snapshot) const
     {
 
@@ -510,6 +782,14 @@ public:
         return true;
     }
 
+    // Capture ids of the tasks matching the query, one page at a time; the
+    // tasks themselves are read back with query_task() and may be gone by
+    // then.
+    void query_tasks(const TaskQuery& query, TaskQueryResult& result) const
+    {
+        _index.query(query, result);
+    }
+
     TaskStats get_stats() const
     {
         TaskStats stats;
@@ -541,13 +821,21 @@ public:
             return false;
         }
         TaskAppendFiles updater(files);
-        return update_task(capture_id, updater);
+        bool updated = update_task(capture_id, updater);
+        if (updated && _journal) {
+            _journal->log_files(capture_id, files);
+        }
+        return updated;
     }
 
     bool record_archive(int capture_id, const CaptureArchiveInfo& archive)
     {
         TaskArchiveRecorder updater(archive);
-        return update_task(capture_id, updater);
+        bool updated = update_task(capture_id, updater);
+        if (updated && _journal) {
+            _journal->log_archive(capture_id, archive);
+        }
+        return updated;
     }
 
     bool update_progress(int capture_id, unsigned long packets,
@@ -612,6 +900,7 @@ public:
 
             SRxCaptureTask* old_task = _tables[idle_idx].remove_task(key_it->second);
             if (old_task) {
+                _index.erase(old_task->capture_id);
                 decrement_status_count(old_task->status);
                 _pending_deletes.push_back(old_task);
             }
@@ -623,6 +912,7 @@ public:
             if (sig_it != _tables[idle_idx].signature_to_id.end() && sig_it->second != capture_id) {
                 SRxCaptureTask* old_task = _tables[idle_idx].remove_task(sig_it->second);
                 if (old_task) {
+                    _index.erase(old_task->capture_id);
                     decrement_status_count(old_task->status);
                     _pending_deletes.push_back(old_task);
                 }
@@ -635,6 +925,7 @@ public:
             if (sid_it != _tables[idle_idx].sid_to_id.end() && sid_it->second != capture_id) {
                 SRxCaptureTask* old_task = _tables[idle_idx].remove_task(sid_it->second);
                 if (old_task) {
+                    _index.erase(old_task->capture_id);
                     decrement_status_count(old_task->status);
                     _pending_deletes.push_back(old_task);
                 }
@@ -648,10 +939,33 @@ public:
         __sync_lock_test_and_set(&_curr, idle_idx);
 
         increment_status_count(task->status);
+        _index.put(*task);
+
+        if (_journal) {
+            _journal->log_task(*task);
+        }
 
         return true;
     }
 
+    // Bulk insert of tasks replayed at startup, before any other thread reads
+    // the manager; skips the per-task table copy of add_task().
+    void restore_tasks(const std::vector<SRxCaptureTask*>& tasks)
+    {
+        int curr_idx = __sync_fetch_and_add(&_curr, 0);
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            SRxCaptureTask* task = tasks[i];
+            SRxCaptureTask* old_task = _tables[curr_idx].remove_task(task->capture_id);
+            if (old_task) {
+                decrement_status_count(old_task->status);
+                _pending_deletes.push_back(old_task);
+            }
+            _tables[curr_idx].add_task(task->capture_id, task->key, task->signature, task->sid, task);
+            increment_status_count(task->status);
+            _index.put(*task);
+        }
+    }
+
     void remove_task(int capture_id)
     {
         int curr_idx = __sync_fetch_and_add(&_curr, 0);
@@ -666,6 +980,7 @@ public:
         __sync_lock_test_and_set(&_curr, idle_idx);
 
         if (old_task) {
+            _index.erase(old_task->capture_id);
             decrement_status_count(old_task->status);
             _pending_deletes.push_back(old_task);
         }
@@ -711,6 +1026,11 @@ public:
             increment_status_count(new_status);
             _pending_deletes.push_back(replaced);
         }
+        _index.put(*new_task);
+
+        if (_journal) {
+            _journal->log_state(*new_task);
+        }
 
         return true;
     }
@@ -733,6 +1053,7 @@ public:
         SRxCaptureTask* new_task = new SRxCaptureTask(*old_task);
 
         ECaptureTaskStatus old_status = new_task->status;
+        long old_start_time = new_task->start_time;
 
         updater(*new_task);
 
@@ -757,12 +1078,19 @@ public:
         if (replaced && old_status != new_task->status) {
             decrement_status_count(old_status);
             increment_status_count(new_task->status);
+            if (_journal) {
+                _journal->log_state(*new_task);
+            }
         }
 
         if (replaced) {
             _pending_deletes.push_back(replaced);
         }
 
+        if (old_status != new_task->status || old_start_time != new_task->start_time) {
+            _index.put(*new_task);
+        }
+
         return true;
     }
 
@@ -846,6 +1174,8 @@ private:
     volatile size_t _stopped_count;
 
     std::vector<SRxCaptureTask*> _pending_deletes;
+    CRxTaskJournal* _journal;
+    CRxTaskIndex _index;
 };
 
 #endif
@@ -32,6 +32,8 @@ void CRxServerConfig::init_defaults()
     loaded_path_.clear();
     log_config = LogConfig();
     cleanup_config = CleanupConfig();
+    placement_config = PlacementConfig();
+    journal_config = JournalConfig();
     update_log_path();
 }
 
@@ -128,6 +130,15 @@ bool CRxServerConfig::load_from_path(const std::string& path)
         if (capture.HasMember("max_file_size_mb") && capture["max_file_size_mb"].IsInt()) {
             capture_config.max_file_size_mb = capture["max_file_size_mb"].GetInt();
         }
+        if (capture.HasMember("rate_control") && capture["rate_control"].IsObject()) {
+            const rapidjson::Value& rate = capture["rate_control"];
+            if (rate.HasMember("ladder") && rate["ladder"].IsString()) {
+                capture_config.rate_ladder = rate["ladder"].GetString();
+            }
+            if (rate.HasMember("drop_pct") && rate["drop_pct"].IsNumber()) {
+                capture_config.rate_drop_pct = rate["drop_pct"].GetDouble();
+            }
+        }
     }
 
 
@@ -148,6 +159,9 @@ bool CRxServerConfig::load_from_path(const std::string& path)
         if (storage.HasMember("temp_pdef_ttl_hours") && storage["temp_pdef_ttl_hours"].IsInt()) {
             storage_config.temp_pdef_ttl_hours = storage["temp_pdef_ttl_hours"].GetInt();
         }
+        if (storage.HasMember("replay_dir") && storage["replay_dir"].IsString()) {
+            storage_config.replay_dir = storage["replay_dir"].GetString();
+        }
     }
 
 
@@ -174,6 +188,27 @@ bool CRxServerConfig::load_from_path(const std::string& path)
         if (cleanup.HasMember("archive_remove_source") && cleanup["archive_remove_source"].IsBool()) {
             cleanup_config.archive_remove_source = cleanup["archive_remove_source"].GetBool();
         }
+        if (cleanup.HasMember("archive_frame_mb") && cleanup["archive_frame_mb"].IsUint()) {
+            cleanup_config.archive_frame_mb = cleanup["archive_frame_mb"].GetUint();
+        }
+        if (cleanup.HasMember("archive_threads") && cleanup["archive_threads"].IsInt()) {
+            cleanup_config.archive_threads = cleanup["archive_threads"].GetInt();
+        }
+        if (cleanup.HasMember("compress_workers") && cleanup["compress_workers"].IsInt()) {
+            cleanup_config.compress_workers = cleanup["compress_workers"].GetInt();
+        }
+        if (cleanup.HasMember("compress_queue_max") && cleanup["compress_queue_max"].IsUint()) {
+            cleanup_config.compress_queue_max = cleanup["compress_queue_max"].GetUint();
+        }
+        if (cleanup.HasMember("compress_order") && cleanup["compress_order"].IsString()) {
+            cleanup_config.compress_order = cleanup["compress_order"].GetString();
+        }
+        if (cleanup.HasMember("compress_ioprio") && cleanup["compress_ioprio"].IsString()) {
+            cleanup_config.compress_ioprio = cleanup["compress_ioprio"].GetString();
+        }
+        if (cleanup.HasMember("compress_max_read_mbps") && cleanup["compress_max_read_mbps"].IsUint()) {
+            cleanup_config.compress_max_read_mbps = cleanup["compress_max_read_mbps"].GetUint();
+        }
     }
 
 
@@ -182,6 +217,69 @@ bool CRxServerConfig::load_from_path(const std::string& path)
         if (limits.HasMember("max_concurrent_captures") && limits["max_concurrent_captures"].IsInt()) {
             limits_config.max_concurrent_captures = limits["max_concurrent_captures"].GetInt();
         }
+        if (limits.HasMember("max_captures_per_iface") && limits["max_captures_per_iface"].IsInt()) {
+            limits_config.max_captures_per_iface = limits["max_captures_per_iface"].GetInt();
+        }
+        if (limits.HasMember("max_pending_captures") && limits["max_pending_captures"].IsInt()) {
+            limits_config.max_pending_captures = limits["max_pending_captures"].GetInt();
+        }
+    }
+
+    if (doc.HasMember("filter") && doc["filter"].IsObject()) {
+        const rapidjson::Value& filter = doc["filter"];
+        if (filter.HasMember("tcp_reassembly") && filter["tcp_reassembly"].IsBool()) {
+            filter_config.tcp_reassembly = filter["tcp_reassembly"].GetBool();
+        }
+        if (filter.HasMember("reassembly_max_flows") && filter["reassembly_max_flows"].IsUint()) {
+            filter_config.reassembly_max_flows = filter["reassembly_max_flows"].GetUint();
+        }
+        if (filter.HasMember("reassembly_depth") && filter["reassembly_depth"].IsUint()) {
+            filter_config.reassembly_depth = filter["reassembly_depth"].GetUint();
+        }
+    }
+
+    if (doc.HasMember("placement") && doc["placement"].IsObject()) {
+        const rapidjson::Value& placement = doc["placement"];
+        if (placement.HasMember("numa") && placement["numa"].IsString()) {
+            placement_config.numa = placement["numa"].GetString();
+        }
+        if (placement.HasMember("capture_interfaces") && placement["capture_interfaces"].IsString()) {
+            placement_config.capture_interfaces = placement["capture_interfaces"].GetString();
+        }
+        if (placement.HasMember("capture_cpus") && placement["capture_cpus"].IsString()) {
+            placement_config.capture_cpus = placement["capture_cpus"].GetString();
+        }
+        if (placement.HasMember("filter_cpus") && placement["filter_cpus"].IsString()) {
+            placement_config.filter_cpus = placement["filter_cpus"].GetString();
+        }
+        if (placement.HasMember("cleanup_cpus") && placement["cleanup_cpus"].IsString()) {
+            placement_config.cleanup_cpus = placement["cleanup_cpus"].GetString();
+        }
+        if (placement.HasMember("http_cpus") && placement["http_cpus"].IsString()) {
+            placement_config.http_cpus = placement["http_cpus"].GetString();
+        }
+        if (placement.HasMember("control_cpus") && placement["control_cpus"].IsString()) {
+            placement_config.control_cpus = placement["control_cpus"].GetString();
+        }
+    }
+
+    if (doc.HasMember("journal") && doc["journal"].IsObject()) {
+        const rapidjson::Value& journal = doc["journal"];
+        if (journal.HasMember("enabled") && journal["enabled"].IsBool()) {
+            journal_config.enabled = journal["enabled"].GetBool();
+        }
+        if (journal.HasMember("path") && journal["path"].IsString()) {
+            journal_config.path = journal["path"].GetString();
+        }
+        if (journal.HasMember("sync_interval_ms") && journal["sync_interval_ms"].IsUint()) {
+            journal_config.sync_interval_ms = journal["sync_interval_ms"].GetUint();
+        }
+        if (journal.HasMember("compact_interval_sec") && journal["compact_interval_sec"].IsUint()) {
+            journal_config.compact_interval_sec = journal["compact_interval_sec"].GetUint();
+        }
+        if (journal.HasMember("history_max_tasks") && journal["history_max_tasks"].IsUint()) {
+            journal_config.history_max_tasks = journal["history_max_tasks"].GetUint();
+        }
     }
 
     loaded_path_ = path;
@@ -189,6 +287,12 @@ bool CRxServerConfig::load_from_path(const std::string& path)
     return true;
 }
 
+bool CRxServerConfig::load_file(const std::string& path)
+{
+    init_defaults();
+    return load_from_path(path);
+}
+
 bool CRxServerConfig::load_from_process(const char* argv0)
 {
     std::string path = deduce_path_from_argv(argv0);
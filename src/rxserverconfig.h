@@ -9,6 +9,7 @@ public:
     CRxServerConfig();
     explicit CRxServerConfig(const char* argv0);
     bool load_from_process(const char* argv0);
+    bool load_file(const std::string& path);
 
     struct LogConfig {
         std::string path;
@@ -31,6 +32,8 @@ public:
         std::string default_category;
         std::string file_pattern;
         long max_file_size_mb;
+        std::string rate_ladder;
+        double rate_drop_pct;
 
         CaptureConfig()
             : default_interface("any")
@@ -38,6 +41,7 @@ public:
             , default_category("diag")
             , file_pattern("{day}/{date}-{iface}-{proc}-{port}.pcap")
             , max_file_size_mb(200)
+            , rate_drop_pct(0.1)
         {
         }
     } capture_config;
@@ -48,6 +52,9 @@ public:
         long max_size_gb;
         std::string temp_pdef_dir;
         int temp_pdef_ttl_hours;
+        // replay_file must resolve to a file under this directory; empty
+        // disables replay.
+        std::string replay_dir;
 
         StorageConfig()
             : base_dir("/var/log/rxtrace/captures")
@@ -55,6 +62,7 @@ public:
             , max_size_gb(100)
             , temp_pdef_dir("/tmp/rxtracenetcap_pdef")
             , temp_pdef_ttl_hours(24)
+            , replay_dir("/var/log/rxtrace/replay")
         {
         }
     } storage_config;
@@ -67,6 +75,13 @@ public:
         int archive_keep_days;
         unsigned long archive_max_total_size_mb;
         bool archive_remove_source;
+        unsigned int archive_frame_mb;
+        int archive_threads;
+        int compress_workers;
+        unsigned int compress_queue_max;
+        std::string compress_order;
+        std::string compress_ioprio;
+        unsigned int compress_max_read_mbps;
 
         CleanupConfig()
             : compress_interval_sec(600)
@@ -76,19 +91,77 @@ public:
             , archive_keep_days(14)
             , archive_max_total_size_mb(0)
             , archive_remove_source(true)
+            , archive_frame_mb(4)
+            , archive_threads(2)
+            , compress_workers(2)
+            , compress_queue_max(32)
+            , compress_order("oldest")
+            , compress_ioprio("be:7")
+            , compress_max_read_mbps(0)
         {
         }
     } cleanup_config;
 
     struct LimitsConfig {
         int max_concurrent_captures;
+        int max_captures_per_iface;
+        int max_pending_captures;
 
         LimitsConfig()
             : max_concurrent_captures(8)
+            , max_captures_per_iface(0)
+            , max_pending_captures(64)
         {
         }
     } limits_config;
 
+    struct FilterConfig {
+        bool tcp_reassembly;
+        unsigned int reassembly_max_flows;
+        unsigned int reassembly_depth;
+
+        FilterConfig()
+            : tcp_reassembly(false)
+            , reassembly_max_flows(1024)
+            , reassembly_depth(4096)
+        {
+        }
+    } filter_config;
+
+    // An empty path puts the journal at <storage base_dir>/tasks.journal.
+    struct JournalConfig {
+        bool enabled;
+        std::string path;
+        unsigned int sync_interval_ms;
+        unsigned int compact_interval_sec;
+        unsigned int history_max_tasks;
+
+        JournalConfig()
+            : enabled(true)
+            , sync_interval_ms(1000)
+            , compact_interval_sec(600)
+            , history_max_tasks(10000)
+        {
+        }
+    } journal_config;
+
+    // CPU lists use the kernel cpulist syntax ("0-3,8"); empty means no
+    // explicit set for that role.
+    struct PlacementConfig {
+        std::string numa;
+        std::string capture_interfaces;
+        std::string capture_cpus;
+        std::string filter_cpus;
+        std::string cleanup_cpus;
+        std::string http_cpus;
+        std::string control_cpus;
+
+        PlacementConfig()
+            : numa("auto")
+        {
+        }
+    } placement_config;
+
     std::string log_path;
 
     const std::string& bind_addr() const { return bind_addr_; }
@@ -101,6 +174,9 @@ public:
     const StorageConfig& storage() const { return storage_config; }
     const CleanupConfig& cleanup() const { return cleanup_config; }
     const LimitsConfig& limits() const { return limits_config; }
+    const FilterConfig& filter() const { return filter_config; }
+    const PlacementConfig& placement() const { return placement_config; }
+    const JournalConfig& journal() const { return journal_config; }
 
 private:
     static std::string deduce_path_from_argv(const char* argv0);
@@ -0,0 +1,460 @@
+#include "rxstatsaggregator.h"
+#include "rxcapturemessages.h"
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+struct AggKeyLess {
+    bool operator()(const SRxAggKey& a, const SRxAggKey& b) const
+    {
+        return memcmp(a.w, b.w, sizeof(a.w)) < 0;
+    }
+};
+
+typedef std::map<SRxAggKey, SRxTopKEntry, AggKeyLess> MergeMap;
+
+bool by_count_desc(const SRxTopKEntry& a, const SRxTopKEntry& b)
+{
+    if (a.count != b.count) {
+        return a.count > b.count;
+    }
+    return a.bytes > b.bytes;
+}
+
+void merge_into(MergeMap& acc, const std::vector<SRxTopKEntry>& entries)
+{
+    for (size_t i = 0; i < entries.size(); ++i) {
+        MergeMap::iterator it = acc.find(entries[i].key);
+        if (it == acc.end()) {
+            acc.insert(std::make_pair(entries[i].key, entries[i]));
+            continue;
+        }
+        it->second.count += entries[i].count;
+        it->second.bytes += entries[i].bytes;
+        it->second.error += entries[i].error;
+    }
+}
+
+void take_top(const MergeMap& acc, size_t k, std::vector<SRxTopKEntry>& out)
+{
+    out.clear();
+    out.reserve(acc.size());
+    for (MergeMap::const_iterator it = acc.begin(); it != acc.end(); ++it) {
+        out.push_back(it->second);
+    }
+    if (k < out.size()) {
+        std::partial_sort(out.begin(), out.begin() + k, out.end(), by_count_desc);
+        out.resize(k);
+    } else {
+        std::sort(out.begin(), out.end(), by_count_desc);
+    }
+}
+
+uint64_t read_field(const uint8_t* p, uint32_t size, FieldType type, Endian endian)
+{
+    uint64_t v = 0;
+    if (type == FIELD_TYPE_BYTES) {
+        for (uint32_t i = 0; i < size; ++i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+    if (endian == ENDIAN_LITTLE) {
+        for (uint32_t i = size; i > 0; --i) {
+            v = (v << 8) | p[i - 1];
+        }
+    } else {
+        for (uint32_t i = 0; i < size; ++i) {
+            v = (v << 8) | p[i];
+        }
+    }
+    switch (type) {
+    case FIELD_TYPE_INT8:
+        return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int8_t>(v)));
+    case FIELD_TYPE_INT16:
+        return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(v)));
+    case FIELD_TYPE_INT32:
+        return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(v)));
+    default:
+        return v;
+    }
+}
+
+uint32_t integer_width(FieldType type)
+{
+    switch (type) {
+    case FIELD_TYPE_UINT8:
+    case FIELD_TYPE_INT8:
+        return 1;
+    case FIELD_TYPE_UINT16:
+    case FIELD_TYPE_INT16:
+        return 2;
+    case FIELD_TYPE_UINT32:
+    case FIELD_TYPE_INT32:
+        return 4;
+    case FIELD_TYPE_UINT64:
+    case FIELD_TYPE_INT64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+bool is_signed_type(FieldType type)
+{
+    return type == FIELD_TYPE_INT8 || type == FIELD_TYPE_INT16 ||
+           type == FIELD_TYPE_INT32 || type == FIELD_TYPE_INT64;
+}
+
+std::string trim(const std::string& s)
+{
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) {
+        return std::string();
+    }
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+}
+
+CRxStatsAggregator::CRxStatsAggregator()
+    : decoder_(DLT_EN10MB),
+      flow_cache_(),
+      flows_(FLOW_TOPK_CAPACITY),
+      packets_(0),
+      bytes_(0),
+      matched_packets_(0),
+      matched_bytes_(0),
+      undecoded_(0)
+{
+}
+
+CRxStatsAggregator::~CRxStatsAggregator()
+{
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        delete slots_[i];
+    }
+}
+
+bool CRxStatsAggregator::init(const std::vector<const ProtocolDef*>& defs, const std::string& fields,
+                              int linktype, std::string& error)
+{
+    decoder_.set_linktype(linktype);
+    if (!decoder_.supported()) {
+        error = "unsupported linktype ";
+        error += CRxPacketDecoder::linktype_name(linktype);
+        return false;
+    }
+
+    for (size_t i = 0; i < defs.size(); ++i) {
+        if (dispatcher_.add(defs[i]) == CRxProtocolDispatcher::NO_MATCH) {
+            LOG_WARNING("StatsAggregator: too many PDEFs, ignoring %s", defs[i]->name);
+        }
+    }
+    dispatcher_.build(dispatcher_.size() > 1);
+
+    protocol_packets_.assign(dispatcher_.size(), 0);
+    protocol_bytes_.assign(dispatcher_.size(), 0);
+    slots_by_protocol_.assign(dispatcher_.size(), std::vector<FieldSlot*>());
+
+    std::vector<std::string> specs = CRxProtocolDispatcher::split_list(fields);
+    for (size_t i = 0; i < specs.size(); ++i) {
+        std::string spec = trim(specs[i]);
+        if (!spec.empty() && !resolve_field(spec, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CRxStatsAggregator::resolve_field(const std::string& spec, std::string& error)
+{
+    std::string struct_name;
+    std::string field_name = spec;
+    size_t dot = spec.find('.');
+    if (dot != std::string::npos) {
+        struct_name = spec.substr(0, dot);
+        field_name = spec.substr(dot + 1);
+    }
+
+    bool found = false;
+    for (size_t p = 0; p < dispatcher_.size(); ++p) {
+        const ProtocolDef* def = dispatcher_.protocol(static_cast<int>(p));
+        bool hit = false;
+        for (uint32_t s = 0; s < def->struct_count && !hit; ++s) {
+            const StructDef& sd = def->structs[s];
+            if (!struct_name.empty() && struct_name != sd.name) {
+                continue;
+            }
+            for (uint32_t f = 0; f < sd.field_count; ++f) {
+                const Field& field = sd.fields[f];
+                if (field_name != field.name || field.is_variable || field.is_array) {
+                    continue;
+                }
+
+                uint32_t width = integer_width(field.type);
+                if (field.type == FIELD_TYPE_BYTES) {
+                    width = field.size < static_cast<uint32_t>(MAX_FIELD_BYTES) ? field.size
+                                                                          : static_cast<uint32_t>(MAX_FIELD_BYTES);
+                }
+                if (width == 0) {
+                    error = "field " + spec + " in " + def->name + " is not an integer or fixed bytes field";
+                    return false;
+                }
+
+                FieldSlot* slot = new (std::nothrow) FieldSlot();
+                if (!slot) {
+                    error = "out of memory";
+                    return false;
+                }
+                slot->protocol = static_cast<int>(p);
+                slot->name = std::string(sd.name) + "." + field.name;
+                slot->offset = field.offset;
+                slot->size = width;
+                slot->type = field.type;
+                slot->endian = field.endian;
+                slots_.push_back(slot);
+                slots_by_protocol_[p].push_back(slot);
+                hit = true;
+                break;
+            }
+        }
+        found = found || hit;
+    }
+
+    if (!found) {
+        error = "field " + spec + " not found in loaded PDEFs";
+        return false;
+    }
+    return true;
+}
+
+void CRxStatsAggregator::pcap_cb(u_char* user, const struct pcap_pkthdr* header, const u_char* data)
+{
+    CRxStatsAggregator* self = reinterpret_cast<CRxStatsAggregator*>(user);
+    self->add_packet(data, header->caplen, header->len, static_cast<uint32_t>(header->ts.tv_sec));
+}
+
+void CRxStatsAggregator::add_packet(const uint8_t* data, uint32_t caplen, uint32_t wire_len, uint32_t ts_sec)
+{
+    packets_++;
+    bytes_ += wire_len;
+
+    SRxDecodedPacket pkt;
+    if (!decoder_.decode(data, caplen, pkt)) {
+        undecoded_++;
+        return;
+    }
+
+    if (dispatcher_.size() > 0) {
+        if (pkt.payload_len == 0) {
+            return;
+        }
+        const uint8_t* payload = data + pkt.payload_offset;
+        int protocol = CRxProtocolDispatcher::NO_MATCH;
+        bool matched = false;
+        uint32_t match_offset = 0;
+        SRxFlowEntry* flow = flow_cache_.lookup(CRxPacketDecoder::flow_key(pkt), ts_sec);
+        if (flow->verdict == RX_FLOW_MATCHED) {
+            // The verdict covers the whole flow, replies included; fields are
+            // only read from packets the protocol filter accepts on their own.
+            protocol = flow->tag;
+            matched = !slots_by_protocol_[protocol].empty() &&
+                      dispatcher_.match_one(protocol, payload, pkt.payload_len, &match_offset);
+        } else if (flow->verdict != RX_FLOW_REJECTED) {
+            protocol = dispatcher_.match(payload, pkt.payload_len, pkt.src_port, pkt.dst_port, &match_offset);
+            matched = protocol != CRxProtocolDispatcher::NO_MATCH;
+            flow_cache_.resolve(flow, matched, static_cast<uint8_t>(matched ? protocol : 0));
+        }
+        if (protocol == CRxProtocolDispatcher::NO_MATCH) {
+            return;
+        }
+        protocol_packets_[protocol]++;
+        protocol_bytes_[protocol] += wire_len;
+        if (matched) {
+            record_fields(protocol, payload + match_offset, pkt.payload_len - match_offset, wire_len);
+        }
+    }
+
+    matched_packets_++;
+    matched_bytes_ += wire_len;
+
+    SRxAggKey key;
+    memset(&key, 0, sizeof(key));
+    uint32_t addr_len = pkt.ip_version == 6 ? 16 : 4;
+    memcpy(&key.w[0], pkt.src_addr, addr_len);
+    memcpy(&key.w[2], pkt.dst_addr, addr_len);
+    key.w[4] = (static_cast<uint64_t>(pkt.src_port) << 48) |
+               (static_cast<uint64_t>(pkt.dst_port) << 32) |
+               (static_cast<uint64_t>(pkt.ip_proto) << 8) | pkt.ip_version;
+    flows_.add(key, wire_len);
+}
+
+void CRxStatsAggregator::record_fields(int protocol, const uint8_t* payload, uint32_t len, uint64_t wire_len)
+{
+    const std::vector<FieldSlot*>& slots = slots_by_protocol_[protocol];
+    if (slots.empty()) {
+        return;
+    }
+
+    bool auto_little = dispatcher_.protocol(protocol)->endian_mode == ENDIAN_MODE_AUTO &&
+                       dispatcher_.detected_endian(protocol) == ENDIAN_TYPE_LITTLE;
+
+    for (size_t i = 0; i < slots.size(); ++i) {
+        FieldSlot* slot = slots[i];
+        if (slot->offset + slot->size > len) {
+            continue;
+        }
+        SRxAggKey key;
+        memset(&key, 0, sizeof(key));
+        key.w[0] = read_field(payload + slot->offset, slot->size, slot->type,
+                              auto_little ? ENDIAN_LITTLE : slot->endian);
+        slot->top.add(key, wire_len);
+    }
+}
+
+void CRxStatsAggregator::snapshot(SRxStatsSnapshot& out, size_t k) const
+{
+    out.packets = packets_;
+    out.bytes = bytes_;
+    out.matched_packets = matched_packets_;
+    out.matched_bytes = matched_bytes_;
+    out.undecoded = undecoded_;
+    out.flow_evictions = flows_.evictions();
+    out.updated_usec = rx_capture_now_usec();
+
+    out.protocols.clear();
+    for (size_t i = 0; i < dispatcher_.size(); ++i) {
+        out.protocols.push_back(dispatcher_.protocol(static_cast<int>(i))->name);
+    }
+    out.protocol_packets = protocol_packets_;
+    out.protocol_bytes = protocol_bytes_;
+
+    out.fields.resize(slots_.size());
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        SRxStatsFieldTop& ft = out.fields[i];
+        ft.field = slots_[i]->name;
+        ft.protocol = out.protocols[slots_[i]->protocol];
+        ft.is_bytes = slots_[i]->type == FIELD_TYPE_BYTES;
+        ft.is_signed = is_signed_type(slots_[i]->type);
+        ft.width = slots_[i]->size;
+        ft.evictions = slots_[i]->top.evictions();
+        slots_[i]->top.top(ft.top, k);
+    }
+    flows_.top(out.flows, k);
+}
+
+CRxStatsRegistry* CRxStatsRegistry::instance()
+{
+    static CRxStatsRegistry registry;
+    return &registry;
+}
+
+void CRxStatsRegistry::publish(int capture_id, int producer, const SRxStatsSnapshot& snap, bool finished)
+{
+    CRxThreadLock lock(&mutex_);
+    Entry& entry = captures_[capture_id];
+    entry.producers[producer] = snap;
+    entry.updated_usec = snap.updated_usec;
+    if (finished) {
+        entry.finished = true;
+    }
+    trim_locked();
+}
+
+void CRxStatsRegistry::trim_locked()
+{
+    while (captures_.size() > MAX_CAPTURES) {
+        std::map<int, Entry>::iterator victim = captures_.end();
+        for (std::map<int, Entry>::iterator it = captures_.begin(); it != captures_.end(); ++it) {
+            if (!it->second.finished) {
+                continue;
+            }
+            if (victim == captures_.end() || it->second.updated_usec < victim->second.updated_usec) {
+                victim = it;
+            }
+        }
+        if (victim == captures_.end()) {
+            return;
+        }
+        captures_.erase(victim);
+    }
+}
+
+void CRxStatsRegistry::remove(int capture_id)
+{
+    CRxThreadLock lock(&mutex_);
+    captures_.erase(capture_id);
+}
+
+bool CRxStatsRegistry::merged(int capture_id, size_t k, SRxStatsSnapshot& out, bool* finished) const
+{
+    CRxThreadLock lock(&mutex_);
+    std::map<int, Entry>::const_iterator found = captures_.find(capture_id);
+    if (found == captures_.end() || found->second.producers.empty()) {
+        return false;
+    }
+    const Entry& entry = found->second;
+    if (finished) {
+        *finished = entry.finished;
+    }
+
+    out = SRxStatsSnapshot();
+    std::map<std::string, size_t> field_index;
+    std::vector<MergeMap> field_acc;
+    MergeMap flow_acc;
+
+    for (std::map<int, SRxStatsSnapshot>::const_iterator it = entry.producers.begin();
+         it != entry.producers.end(); ++it) {
+        const SRxStatsSnapshot& s = it->second;
+        out.packets += s.packets;
+        out.bytes += s.bytes;
+        out.matched_packets += s.matched_packets;
+        out.matched_bytes += s.matched_bytes;
+        out.undecoded += s.undecoded;
+        out.flow_evictions += s.flow_evictions;
+        if (s.updated_usec > out.updated_usec) {
+            out.updated_usec = s.updated_usec;
+        }
+
+        for (size_t i = 0; i < s.protocols.size(); ++i) {
+            size_t j = 0;
+            while (j < out.protocols.size() && out.protocols[j] != s.protocols[i]) {
+                ++j;
+            }
+            if (j == out.protocols.size()) {
+                out.protocols.push_back(s.protocols[i]);
+                out.protocol_packets.push_back(0);
+                out.protocol_bytes.push_back(0);
+            }
+            out.protocol_packets[j] += s.protocol_packets[i];
+            out.protocol_bytes[j] += s.protocol_bytes[i];
+        }
+
+        for (size_t i = 0; i < s.fields.size(); ++i) {
+            const SRxStatsFieldTop& ft = s.fields[i];
+            std::string name = ft.protocol + "/" + ft.field;
+            std::map<std::string, size_t>::iterator idx = field_index.find(name);
+            if (idx == field_index.end()) {
+                idx = field_index.insert(std::make_pair(name, out.fields.size())).first;
+                SRxStatsFieldTop header = ft;
+                header.top.clear();
+                header.evictions = 0;
+                out.fields.push_back(header);
+                field_acc.push_back(MergeMap());
+            }
+            out.fields[idx->second].evictions += ft.evictions;
+            merge_into(field_acc[idx->second], ft.top);
+        }
+
+        merge_into(flow_acc, s.flows);
+    }
+
+    for (size_t i = 0; i < out.fields.size(); ++i) {
+        take_top(field_acc[i], k, out.fields[i].top);
+    }
+    take_top(flow_acc, k, out.flows);
+    return true;
+}
@@ -0,0 +1,146 @@
+#ifndef RX_STATS_AGGREGATOR_H
+#define RX_STATS_AGGREGATOR_H
+
+#include "rxtopk.h"
+#include "rxflowcache.h"
+#include "rxpacketdecoder.h"
+#include "rxprotocoldispatcher.h"
+#include "legacy_core.h"
+#include "pdef/pdef_types.h"
+#include <pcap.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+struct SRxStatsFieldTop {
+    std::string field;
+    std::string protocol;
+    bool is_bytes;
+    bool is_signed;
+    uint32_t width;
+    uint64_t evictions;
+    std::vector<SRxTopKEntry> top;
+
+    SRxStatsFieldTop() : is_bytes(false), is_signed(false), width(0), evictions(0) {}
+};
+
+struct SRxStatsSnapshot {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t matched_packets;
+    uint64_t matched_bytes;
+    uint64_t undecoded;
+    uint64_t flow_evictions;
+    int64_t updated_usec;
+    std::vector<std::string> protocols;
+    std::vector<uint64_t> protocol_packets;
+    std::vector<uint64_t> protocol_bytes;
+    std::vector<SRxStatsFieldTop> fields;
+    std::vector<SRxTopKEntry> flows;
+
+    SRxStatsSnapshot()
+        : packets(0), bytes(0), matched_packets(0), matched_bytes(0),
+          undecoded(0), flow_evictions(0), updated_usec(0)
+    {}
+};
+
+// Per-capture-thread aggregation for stats-only captures. Every table is owned
+// by the thread that runs pcap_dispatch, so the packet path takes no locks;
+// readers only ever see snapshots pushed to CRxStatsRegistry.
+class CRxStatsAggregator {
+public:
+    enum {
+        FIELD_TOPK_CAPACITY = 256,
+        FLOW_TOPK_CAPACITY = 4096,
+        MAX_FIELD_BYTES = 8,
+        PUBLISH_TOP = 128
+    };
+
+    CRxStatsAggregator();
+    ~CRxStatsAggregator();
+
+    bool init(const std::vector<const ProtocolDef*>& defs, const std::string& fields,
+              int linktype, std::string& error);
+
+    static void pcap_cb(u_char* user, const struct pcap_pkthdr* header, const u_char* data);
+
+    void add_packet(const uint8_t* data, uint32_t caplen, uint32_t wire_len, uint32_t ts_sec);
+
+    void snapshot(SRxStatsSnapshot& out, size_t k) const;
+
+    uint64_t packets() const { return packets_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t matched_packets() const { return matched_packets_; }
+
+private:
+    struct FieldSlot {
+        int protocol;
+        std::string name;
+        uint32_t offset;
+        uint32_t size;
+        FieldType type;
+        Endian endian;
+        CRxTopK top;
+
+        FieldSlot() : protocol(0), offset(0), size(0), type(FIELD_TYPE_UINT8),
+                      endian(ENDIAN_BIG), top(FIELD_TOPK_CAPACITY) {}
+    };
+
+    CRxStatsAggregator(const CRxStatsAggregator&);
+    CRxStatsAggregator& operator=(const CRxStatsAggregator&);
+
+    bool resolve_field(const std::string& spec, std::string& error);
+    void record_fields(int protocol, const uint8_t* payload, uint32_t len, uint64_t wire_len);
+
+    CRxPacketDecoder decoder_;
+    CRxFlowCache flow_cache_;
+    CRxProtocolDispatcher dispatcher_;
+    std::vector<FieldSlot*> slots_;
+    std::vector<std::vector<FieldSlot*> > slots_by_protocol_;
+    CRxTopK flows_;
+    std::vector<uint64_t> protocol_packets_;
+    std::vector<uint64_t> protocol_bytes_;
+    uint64_t packets_;
+    uint64_t bytes_;
+    uint64_t matched_packets_;
+    uint64_t matched_bytes_;
+    uint64_t undecoded_;
+};
+
+// Latest snapshot per capture and producer thread. Producers publish about once
+// a second; readers merge on demand.
+class CRxStatsRegistry {
+public:
+    enum {
+        MAX_CAPTURES = 64
+    };
+
+    static CRxStatsRegistry* instance();
+
+    void publish(int capture_id, int producer, const SRxStatsSnapshot& snap, bool finished);
+
+    bool merged(int capture_id, size_t k, SRxStatsSnapshot& out, bool* finished = NULL) const;
+
+    void remove(int capture_id);
+
+private:
+    struct Entry {
+        std::map<int, SRxStatsSnapshot> producers;
+        bool finished;
+        int64_t updated_usec;
+
+        Entry() : finished(false), updated_usec(0) {}
+    };
+
+    CRxStatsRegistry() {}
+    CRxStatsRegistry(const CRxStatsRegistry&);
+    CRxStatsRegistry& operator=(const CRxStatsRegistry&);
+
+    void trim_locked();
+
+    mutable CRxThreadMutex mutex_;
+    std::map<int, Entry> captures_;
+};
+
+#endif
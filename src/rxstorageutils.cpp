@@ -14,6 +14,7 @@
 
 #include "legacy_core.h"
 #include "rxfilterthread.h"
+#include "rxmetrics.h"
 
 using compat::shared_ptr;
 using compat::make_shared;
@@ -219,7 +220,10 @@ void CRxStorageUtils::rotate_open(CRxDumpCtx* dc)
     if (dc->d) {
         pcap_dump_flush(dc->d);
         pcap_dump_close(dc->d);
-
+        if (!dc->current_path.empty()) {
+            dc->closed_paths.push_back(dc->current_path);
+        }
+        dc->closed_bytes += dc->written;
     }
 
     dc->seq += 1;
@@ -232,6 +236,7 @@ void CRxStorageUtils::rotate_open(CRxDumpCtx* dc)
     }
 
     dc->d = pcap_dump_open(dc->p, dc->current_path.c_str());
+    CRxMetrics::inc(RX_CNT_WRITE_ROTATIONS);
 }
 
 void CRxStorageUtils::dump_cb(u_char* user, const struct pcap_pkthdr* h, const u_char* bytes)
@@ -239,6 +244,11 @@ void CRxStorageUtils::dump_cb(u_char* user, const struct pcap_pkthdr* h, const u
     CRxDumpCtx* dc = (CRxDumpCtx*)user;
 
     long pkt_bytes = (long)sizeof(struct pcap_pkthdr) + (long)h->caplen;
+    bool sampled = CRxMetrics::sample_tick();
+    uint64_t start_ns = sampled ? CRxMetrics::now_ns() : 0;
+
+    CRxMetrics::inc(RX_CNT_CAPTURE_PACKETS);
+    CRxMetrics::inc(RX_CNT_CAPTURE_BYTES, h->len);
 
     if (dc->max_bytes > 0 && dc->d && dc->written + pkt_bytes > dc->max_bytes) {
         rotate_open(dc);
@@ -249,4 +259,9 @@ void CRxStorageUtils::dump_cb(u_char* user, const struct pcap_pkthdr* h, const u
 
     pcap_dump((u_char*)dc->d, h, bytes);
     dc->written += pkt_bytes;
+    CRxMetrics::inc(RX_CNT_WRITE_BYTES, static_cast<uint64_t>(pkt_bytes));
+
+    if (sampled) {
+        CRxMetrics::observe_ns(RX_HIST_WRITE_STALL, CRxMetrics::now_ns() - start_ns);
+    }
 }
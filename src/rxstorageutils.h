@@ -2,6 +2,7 @@
 #define RXNET_STORAGE_UTILS_H
 
 #include <string>
+#include <vector>
 #include <time.h>
 #include <pcap/pcap.h>
 
@@ -24,6 +25,11 @@ struct CRxDumpCtx {
     std::string current_path;
     bool compress_enabled;
 
+    // Segments closed by rotation since the owner last collected them, and
+    // the bytes they hold.
+    std::vector<std::string> closed_paths;
+    long closed_bytes;
+
 
     std::string protocol_filter_path;
     ProtocolDef* protocol_def;
@@ -16,6 +16,7 @@ SRxDefaults::SRxDefaults()
     , category("diag")
     , file_pattern("{day}/{date}-{iface}-{proc}-{port}.pcap")
     , max_bytes(200 * 1024 * 1024L)
+    , rate_drop_pct(0.1)
 {
 }
 
@@ -115,14 +116,24 @@ bool CRxStrategyConfigManager::load_internal(const std::string& config_path)
     sample_modules_.clear();
 
 
+    // Capture and storage defaults come from the server config file; re-read it
+    // so edits there take effect with the next strategy reload.
     CRxProcData* pdata = CRxProcData::instance();
-    if (pdata && pdata->server_config()) {
-        const CRxServerConfig::CaptureConfig& cap = pdata->server_config()->capture();
+    const CRxServerConfig* server_cfg = pdata ? pdata->server_config() : NULL;
+    CRxServerConfig fresh_server_cfg;
+    if (server_cfg && !server_cfg->loaded_path().empty() &&
+        fresh_server_cfg.load_file(server_cfg->loaded_path())) {
+        server_cfg = &fresh_server_cfg;
+    }
+    if (server_cfg) {
+        const CRxServerConfig::CaptureConfig& cap = server_cfg->capture();
         defaults_.iface = cap.default_interface;
         defaults_.duration_sec = cap.default_duration;
         defaults_.category = cap.default_category;
         defaults_.file_pattern = cap.file_pattern;
         defaults_.max_bytes = cap.max_file_size_mb * 1024L * 1024L;
+        defaults_.rate_ladder = cap.rate_ladder;
+        defaults_.rate_drop_pct = cap.rate_drop_pct;
     }
 
 
@@ -202,8 +213,8 @@ bool CRxStrategyConfigManager::load_internal(const std::string& config_path)
     }
 
 
-    if (pdata && pdata->server_config()) {
-        const CRxServerConfig::StorageConfig& stor = pdata->server_config()->storage();
+    if (server_cfg) {
+        const CRxServerConfig::StorageConfig& stor = server_cfg->storage();
         storage_.base_dir = stor.base_dir;
         storage_.max_age_days = stor.max_age_days;
         storage_.max_size_gb = stor.max_size_gb;
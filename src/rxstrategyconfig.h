@@ -13,6 +13,8 @@ struct SRxDefaults {
     std::string category;
     std::string file_pattern;
     long max_bytes;
+    std::string rate_ladder;
+    double rate_drop_pct;
 
     SRxDefaults();
 };
@@ -102,6 +104,7 @@ public:
 
 
     std::string get_protocol_pdef_path(const std::string& protocol_name) const;
+    const std::map<std::string, std::string>& protocol_pdefs() const { return protocol_pdefs_; }
 
 private:
 
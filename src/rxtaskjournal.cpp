@@ -0,0 +1,855 @@
+#include "rxtaskjournal.h"
+#include "rxmetrics.h"
+#include "rxstorageutils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <map>
+
+namespace {
+
+const uint16_t RECORD_MAGIC = 0x4a52;      // "RJ"
+const uint32_t JOURNAL_MAGIC = 0x4a545852; // "RXTJ"
+const uint8_t FLAG_MORE = 0x01;
+const size_t FLUSH_BYTES = 1024 * 1024;
+
+void put_u8(std::string& out, uint8_t v)
+{
+    out += static_cast<char>(v);
+}
+
+void put_u16(std::string& out, uint16_t v)
+{
+    out += static_cast<char>(v & 0xff);
+    out += static_cast<char>((v >> 8) & 0xff);
+}
+
+void put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+void put_u64(std::string& out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+void put_str(std::string& out, const std::string& s)
+{
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+uint16_t get_u16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const unsigned char* p)
+{
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+// Bounds-checked payload reader; any overrun latches ok to false and further
+// reads return zeroes.
+struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok;
+
+    Reader(const std::string& s)
+        : p(reinterpret_cast<const unsigned char*>(s.data()))
+        , end(reinterpret_cast<const unsigned char*>(s.data()) + s.size())
+        , ok(true)
+    {
+    }
+
+    bool need(size_t n)
+    {
+        if (!ok || static_cast<size_t>(end - p) < n) {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    uint8_t u8()
+    {
+        if (!need(1)) {
+            return 0;
+        }
+        return *p++;
+    }
+
+    uint32_t u32()
+    {
+        if (!need(4)) {
+            return 0;
+        }
+        uint32_t v = get_u32(p);
+        p += 4;
+        return v;
+    }
+
+    uint64_t u64()
+    {
+        if (!need(8)) {
+            return 0;
+        }
+        uint64_t v = get_u64(p);
+        p += 8;
+        return v;
+    }
+
+    std::string str()
+    {
+        uint32_t len = u32();
+        if (!need(len)) {
+            return std::string();
+        }
+        std::string s(reinterpret_cast<const char*>(p), len);
+        p += len;
+        return s;
+    }
+};
+
+void encode_state(std::string& out, const SRxCaptureTask& task)
+{
+    put_u8(out, static_cast<uint8_t>(task.status));
+    put_u32(out, static_cast<uint32_t>(task.capture_pid));
+    put_str(out, task.output_file);
+    put_u64(out, static_cast<uint64_t>(task.start_time));
+    put_u64(out, static_cast<uint64_t>(task.end_time));
+    put_u64(out, task.packet_count);
+    put_u64(out, task.bytes_captured);
+    put_str(out, task.error_message);
+    put_u32(out, task.worker_thread_index);
+    put_u8(out, static_cast<uint8_t>((task.stop_requested ? 1 : 0) | (task.cancel_requested ? 2 : 0)));
+    put_u64(out, task.loss.kernel_received);
+    put_u64(out, task.loss.kernel_dropped);
+    put_u64(out, task.loss.if_dropped);
+    put_u64(out, task.loss.sampled_out);
+    put_u32(out, static_cast<uint32_t>(task.loss.rate_actions.size()));
+    for (size_t i = 0; i < task.loss.rate_actions.size(); ++i) {
+        put_str(out, task.loss.rate_actions[i]);
+    }
+}
+
+void decode_state(Reader& in, SRxCaptureTask& task)
+{
+    task.status = static_cast<ECaptureTaskStatus>(in.u8());
+    task.capture_pid = static_cast<pid_t>(in.u32());
+    task.output_file = in.str();
+    task.start_time = static_cast<long>(in.u64());
+    task.end_time = static_cast<long>(in.u64());
+    task.packet_count = static_cast<unsigned long>(in.u64());
+    task.bytes_captured = static_cast<unsigned long>(in.u64());
+    task.error_message = in.str();
+    task.worker_thread_index = in.u32();
+    uint8_t flags = in.u8();
+    task.stop_requested = (flags & 1) != 0;
+    task.cancel_requested = (flags & 2) != 0;
+    task.loss.kernel_received = static_cast<unsigned long>(in.u64());
+    task.loss.kernel_dropped = static_cast<unsigned long>(in.u64());
+    task.loss.if_dropped = static_cast<unsigned long>(in.u64());
+    task.loss.sampled_out = static_cast<unsigned long>(in.u64());
+    uint32_t actions = in.u32();
+    task.loss.rate_actions.clear();
+    for (uint32_t i = 0; i < actions && in.ok; ++i) {
+        task.loss.rate_actions.push_back(in.str());
+    }
+}
+
+void encode_task(std::string& out, const SRxCaptureTask& task)
+{
+    put_str(out, task.key);
+    put_str(out, task.signature);
+    put_str(out, task.sid);
+    put_u8(out, static_cast<uint8_t>(task.capture_mode));
+    put_str(out, task.iface);
+    put_str(out, task.resolved_iface);
+    put_str(out, task.proc_name);
+    put_u32(out, static_cast<uint32_t>(task.target_pid));
+    put_str(out, task.container_id);
+    put_str(out, task.netns_path);
+    put_u32(out, static_cast<uint32_t>(task.matched_pids.size()));
+    for (size_t i = 0; i < task.matched_pids.size(); ++i) {
+        put_u32(out, static_cast<uint32_t>(task.matched_pids[i]));
+    }
+    put_str(out, task.filter);
+    put_str(out, task.protocol_filter);
+    put_str(out, task.ip_filter);
+    put_u32(out, static_cast<uint32_t>(task.port_filter));
+    put_str(out, task.category);
+    put_str(out, task.file_pattern);
+    put_u32(out, static_cast<uint32_t>(task.duration_sec));
+    put_u64(out, static_cast<uint64_t>(task.max_bytes));
+    put_u32(out, static_cast<uint32_t>(task.max_packets));
+    put_u32(out, static_cast<uint32_t>(task.priority));
+    put_str(out, task.client_ip);
+    put_str(out, task.request_user);
+    encode_state(out, task);
+}
+
+void decode_task(Reader& in, SRxCaptureTask& task)
+{
+    task.key = in.str();
+    task.signature = in.str();
+    task.sid = in.str();
+    task.capture_mode = static_cast<ECaptureMode>(in.u8());
+    task.iface = in.str();
+    task.resolved_iface = in.str();
+    task.proc_name = in.str();
+    task.target_pid = static_cast<pid_t>(in.u32());
+    task.container_id = in.str();
+    task.netns_path = in.str();
+    uint32_t pids = in.u32();
+    task.matched_pids.clear();
+    for (uint32_t i = 0; i < pids && in.ok; ++i) {
+        task.matched_pids.push_back(static_cast<pid_t>(in.u32()));
+    }
+    task.filter = in.str();
+    task.protocol_filter = in.str();
+    task.ip_filter = in.str();
+    task.port_filter = static_cast<int>(in.u32());
+    task.category = in.str();
+    task.file_pattern = in.str();
+    task.duration_sec = static_cast<int>(in.u32());
+    task.max_bytes = static_cast<long>(in.u64());
+    task.max_packets = static_cast<int>(in.u32());
+    task.priority = static_cast<int>(in.u32());
+    task.client_ip = in.str();
+    task.request_user = in.str();
+    decode_state(in, task);
+}
+
+void encode_file(std::string& out, const CaptureFileInfo& info)
+{
+    put_str(out, info.file_path);
+    put_u64(out, info.file_size);
+    put_u32(out, static_cast<uint32_t>(info.segment_index));
+    put_u32(out, static_cast<uint32_t>(info.total_segments));
+    put_str(out, info.md5);
+    put_u64(out, static_cast<uint64_t>(info.file_ready_ts));
+    put_u8(out, info.compressed ? 1 : 0);
+    put_str(out, info.archive_path);
+    put_u64(out, static_cast<uint64_t>(info.compress_finish_ts));
+}
+
+CaptureFileInfo decode_file(Reader& in)
+{
+    CaptureFileInfo info;
+    info.file_path = in.str();
+    info.file_size = static_cast<unsigned long>(in.u64());
+    info.segment_index = static_cast<int>(in.u32());
+    info.total_segments = static_cast<int>(in.u32());
+    info.md5 = in.str();
+    info.file_ready_ts = static_cast<int64_t>(in.u64());
+    info.compressed = in.u8() != 0;
+    info.archive_path = in.str();
+    info.compress_finish_ts = static_cast<int64_t>(in.u64());
+    return info;
+}
+
+void merge_file(SRxCaptureTask& task, const CaptureFileInfo& info)
+{
+    for (size_t i = 0; i < task.captured_files.size(); ++i) {
+        if (task.captured_files[i].file_path == info.file_path) {
+            task.captured_files[i] = info;
+            return;
+        }
+    }
+    task.captured_files.push_back(info);
+}
+
+void merge_archive(SRxCaptureTask& task, const CaptureArchiveInfo& archive)
+{
+    bool merged = false;
+    for (size_t i = 0; i < task.archives.size(); ++i) {
+        if (!archive.archive_path.empty() && task.archives[i].archive_path == archive.archive_path) {
+            task.archives[i] = archive;
+            merged = true;
+            break;
+        }
+    }
+    if (!merged) {
+        task.archives.push_back(archive);
+    }
+    for (size_t i = 0; i < archive.files.size(); ++i) {
+        merge_file(task, archive.files[i]);
+    }
+}
+
+void encode_files(std::string& out, const std::vector<CaptureFileInfo>& files)
+{
+    put_u32(out, static_cast<uint32_t>(files.size()));
+    for (size_t i = 0; i < files.size(); ++i) {
+        encode_file(out, files[i]);
+    }
+}
+
+void encode_archive(std::string& out, const CaptureArchiveInfo& archive)
+{
+    put_str(out, archive.archive_path);
+    put_u64(out, archive.archive_size);
+    put_u64(out, static_cast<uint64_t>(archive.compress_finish_ts));
+    encode_files(out, archive.files);
+}
+
+std::string header_payload()
+{
+    std::string out;
+    put_u32(out, JOURNAL_MAGIC);
+    put_u32(out, CRxTaskJournal::VERSION);
+    put_u64(out, static_cast<uint64_t>(time(NULL)));
+    return out;
+}
+
+bool write_full(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void sync_parent_dir(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash > 0 ? slash : 1);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+bool record_valid(const unsigned char* rec)
+{
+    if (get_u16(rec + 4) != RECORD_MAGIC || get_u16(rec + 18) > CRxTaskJournal::PAYLOAD_BYTES) {
+        return false;
+    }
+    uint32_t crc = static_cast<uint32_t>(crc32(0L, rec + 4, CRxTaskJournal::RECORD_BYTES - 4));
+    return crc == get_u32(rec);
+}
+
+// One complete event: count consecutive records starting at first.
+struct Event {
+    int type;
+    size_t first;
+    size_t count;
+};
+
+struct TaskEvents {
+    long task;
+    long state;
+    std::vector<size_t> others;
+
+    TaskEvents()
+        : task(-1)
+        , state(-1)
+    {
+    }
+};
+
+std::string event_payload(const unsigned char* base, const Event& ev)
+{
+    std::string out;
+    for (size_t i = 0; i < ev.count; ++i) {
+        const unsigned char* rec = base + (ev.first + i) * CRxTaskJournal::RECORD_BYTES;
+        out.append(reinterpret_cast<const char*>(rec + CRxTaskJournal::HEADER_BYTES), get_u16(rec + 18));
+    }
+    return out;
+}
+
+}
+
+CRxTaskJournal::CRxTaskJournal()
+    : fd_(-1)
+    , next_seq_(1)
+    , records_(0)
+    , compacted_records_(0)
+    , dirty_(false)
+    , write_failed_(false)
+{
+}
+
+CRxTaskJournal::~CRxTaskJournal()
+{
+    close();
+}
+
+void CRxTaskJournal::encode_records(std::string& out, uint32_t seq, int type, int capture_id,
+                                    const std::string& payload)
+{
+    size_t parts = payload.empty() ? 1 : (payload.size() + PAYLOAD_BYTES - 1) / PAYLOAD_BYTES;
+    for (size_t part = 0; part < parts; ++part) {
+        size_t off = part * PAYLOAD_BYTES;
+        size_t len = payload.size() - off;
+        if (len > static_cast<size_t>(PAYLOAD_BYTES)) {
+            len = PAYLOAD_BYTES;
+        }
+        size_t start = out.size();
+        put_u32(out, 0);
+        put_u16(out, RECORD_MAGIC);
+        put_u8(out, static_cast<uint8_t>(type));
+        put_u8(out, part + 1 < parts ? FLAG_MORE : 0);
+        put_u32(out, seq);
+        put_u32(out, static_cast<uint32_t>(capture_id));
+        put_u16(out, static_cast<uint16_t>(part));
+        put_u16(out, static_cast<uint16_t>(len));
+        put_u32(out, 0);
+        out.append(payload, off, len);
+        out.append(PAYLOAD_BYTES - len, '\0');
+        unsigned char* rec = reinterpret_cast<unsigned char*>(&out[start]);
+        uint32_t crc = static_cast<uint32_t>(crc32(0L, rec + 4, RECORD_BYTES - 4));
+        for (int i = 0; i < 4; ++i) {
+            rec[i] = static_cast<unsigned char>((crc >> (8 * i)) & 0xff);
+        }
+    }
+}
+
+bool CRxTaskJournal::start_new(std::string& error)
+{
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        error = "open " + path_ + ": " + strerror(errno);
+        return false;
+    }
+    std::string header;
+    encode_records(header, 0, REC_HEADER, 0, header_payload());
+    if (!write_full(fd_, header.data(), header.size()) || ::fdatasync(fd_) != 0) {
+        error = "write " + path_ + ": " + strerror(errno);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    sync_parent_dir(path_);
+    records_ = 1;
+    compacted_records_ = 1;
+    return true;
+}
+
+bool CRxTaskJournal::load(const std::string& path, size_t max_tasks, std::vector<SRxCaptureTask*>& tasks,
+                          LoadStats& stats, std::string& error)
+{
+    CRxThreadLock lock(&mutex_);
+    uint64_t start_ns = CRxMetrics::now_ns();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    path_ = path;
+    next_seq_ = 1;
+    dirty_ = false;
+    write_failed_ = false;
+
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0) {
+        CRxStorageUtils::ensure_dir(path.substr(0, slash));
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            error = "open " + path + ": " + strerror(errno);
+            return false;
+        }
+        return start_new(error);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        error = "stat " + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    size_t total = static_cast<size_t>(st.st_size) / RECORD_BYTES;
+    const unsigned char* base = NULL;
+    if (total > 0) {
+        void* map = ::mmap(NULL, total * RECORD_BYTES, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            error = "mmap " + path + ": " + strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        ::madvise(map, total * RECORD_BYTES, MADV_SEQUENTIAL);
+        base = static_cast<const unsigned char*>(map);
+    }
+
+    bool header_ok = false;
+    if (base && record_valid(base) && base[6] == REC_HEADER) {
+        std::string payload(reinterpret_cast<const char*>(base + HEADER_BYTES), get_u16(base + 18));
+        Reader in(payload);
+        header_ok = in.u32() == JOURNAL_MAGIC && in.u32() == VERSION && in.ok;
+    }
+    if (!header_ok) {
+        if (base) {
+            ::munmap(const_cast<unsigned char*>(base), total * RECORD_BYTES);
+        }
+        ::close(fd);
+        if (st.st_size > 0) {
+            std::string bad = path + ".bad";
+            LOG_WARNING("task journal %s has no valid header, moving it to %s", path.c_str(), bad.c_str());
+            ::rename(path.c_str(), bad.c_str());
+        }
+        return start_new(error);
+    }
+
+    // Pass 1: validate records and index complete events by capture. Only the
+    // newest state of each task is decoded in pass 2.
+    std::vector<Event> events;
+    std::map<int, TaskEvents> index;
+    size_t valid = 1;
+    uint32_t last_seq = 0;
+    size_t i = 1;
+    while (i < total) {
+        const unsigned char* rec = base + i * RECORD_BYTES;
+        if (!record_valid(rec) || get_u16(rec + 16) != 0) {
+            break;
+        }
+        uint32_t seq = get_u32(rec + 8);
+        size_t count = 1;
+        bool complete = true;
+        while (rec[(count - 1) * RECORD_BYTES + 7] & FLAG_MORE) {
+            if (i + count >= total) {
+                complete = false;
+                break;
+            }
+            const unsigned char* next = rec + count * RECORD_BYTES;
+            if (!record_valid(next) || get_u32(next + 8) != seq || get_u16(next + 16) != count) {
+                complete = false;
+                break;
+            }
+            ++count;
+        }
+        if (!complete) {
+            break;
+        }
+        Event ev;
+        ev.type = rec[6];
+        ev.first = i;
+        ev.count = count;
+        int capture_id = static_cast<int>(get_u32(rec + 12));
+        if (ev.type == REC_TASK) {
+            TaskEvents& te = index[capture_id];
+            te = TaskEvents();
+            te.task = static_cast<long>(events.size());
+        } else if (ev.type == REC_STATE) {
+            index[capture_id].state = static_cast<long>(events.size());
+        } else if (ev.type == REC_FILES || ev.type == REC_ARCHIVE) {
+            index[capture_id].others.push_back(events.size());
+        }
+        events.push_back(ev);
+        last_seq = seq;
+        i += count;
+        valid = i;
+    }
+    stats.records = valid;
+    stats.events = events.size();
+
+    // Pass 2: rebuild the newest max_tasks tasks.
+    size_t live = 0;
+    for (std::map<int, TaskEvents>::const_iterator it = index.begin(); it != index.end(); ++it) {
+        if (it->second.task >= 0) {
+            ++live;
+        }
+    }
+    size_t skip = (max_tasks > 0 && live > max_tasks) ? live - max_tasks : 0;
+    size_t malformed = 0;
+    for (std::map<int, TaskEvents>::const_iterator it = index.begin(); it != index.end(); ++it) {
+        const TaskEvents& te = it->second;
+        if (te.task < 0) {
+            continue;
+        }
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+        SRxCaptureTask* task = new SRxCaptureTask();
+        task->capture_id = it->first;
+        std::string payload = event_payload(base, events[te.task]);
+        Reader in(payload);
+        decode_task(in, *task);
+        if (!in.ok) {
+            ++malformed;
+            delete task;
+            continue;
+        }
+        if (te.state > te.task) {
+            std::string state = event_payload(base, events[te.state]);
+            Reader sin(state);
+            SRxCaptureTask updated(*task);
+            decode_state(sin, updated);
+            if (sin.ok) {
+                *task = updated;
+            } else {
+                ++malformed;
+            }
+        }
+        for (size_t k = 0; k < te.others.size(); ++k) {
+            const Event& ev = events[te.others[k]];
+            std::string body = event_payload(base, ev);
+            Reader rin(body);
+            if (ev.type == REC_FILES) {
+                uint32_t n = rin.u32();
+                std::vector<CaptureFileInfo> files;
+                for (uint32_t f = 0; f < n && rin.ok; ++f) {
+                    files.push_back(decode_file(rin));
+                }
+                if (rin.ok) {
+                    for (size_t f = 0; f < files.size(); ++f) {
+                        merge_file(*task, files[f]);
+                    }
+                }
+            } else {
+                CaptureArchiveInfo archive;
+                archive.archive_path = rin.str();
+                archive.archive_size = static_cast<unsigned long>(rin.u64());
+                archive.compress_finish_ts = static_cast<int64_t>(rin.u64());
+                uint32_t n = rin.u32();
+                for (uint32_t f = 0; f < n && rin.ok; ++f) {
+                    archive.files.push_back(decode_file(rin));
+                }
+                if (rin.ok) {
+                    merge_archive(*task, archive);
+                }
+            }
+            if (!rin.ok) {
+                ++malformed;
+            }
+        }
+        tasks.push_back(task);
+    }
+    stats.tasks = tasks.size();
+    if (malformed > 0) {
+        LOG_WARNING("task journal %s: skipped %zu malformed event(s)", path.c_str(), malformed);
+    }
+
+    if (base) {
+        ::munmap(const_cast<unsigned char*>(base), total * RECORD_BYTES);
+    }
+    uint64_t valid_bytes = static_cast<uint64_t>(valid) * RECORD_BYTES;
+    if (valid_bytes < static_cast<uint64_t>(st.st_size)) {
+        stats.truncated_bytes = static_cast<uint64_t>(st.st_size) - valid_bytes;
+        LOG_WARNING("task journal %s: dropping %llu byte(s) of incomplete or corrupt tail",
+                    path.c_str(), static_cast<unsigned long long>(stats.truncated_bytes));
+        if (::ftruncate(fd, static_cast<off_t>(valid_bytes)) != 0) {
+            error = "truncate " + path + ": " + strerror(errno);
+            ::close(fd);
+            return false;
+        }
+    }
+
+    fd_ = fd;
+    records_ = valid;
+    compacted_records_ = valid;
+    next_seq_ = last_seq + 1;
+    stats.elapsed_us = (CRxMetrics::now_ns() - start_ns) / 1000;
+    return true;
+}
+
+void CRxTaskJournal::close()
+{
+    CRxThreadLock lock(&mutex_);
+    if (fd_ < 0) {
+        return;
+    }
+    if (dirty_) {
+        ::fdatasync(fd_);
+        dirty_ = false;
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool CRxTaskJournal::is_open() const
+{
+    CRxThreadLock lock(&mutex_);
+    return fd_ >= 0;
+}
+
+uint64_t CRxTaskJournal::records() const
+{
+    CRxThreadLock lock(&mutex_);
+    return records_;
+}
+
+void CRxTaskJournal::append(int type, int capture_id, const std::string& payload)
+{
+    CRxThreadLock lock(&mutex_);
+    if (fd_ < 0) {
+        return;
+    }
+    std::string buf;
+    encode_records(buf, next_seq_++, type, capture_id, payload);
+    if (!write_full(fd_, buf.data(), buf.size())) {
+        int err = errno;
+        // Cut back to the last whole event so later appends stay replayable.
+        if (::ftruncate(fd_, static_cast<off_t>(records_ * RECORD_BYTES)) != 0) {
+            LOG_ERROR("task journal %s: truncate after failed write: %s", path_.c_str(), strerror(errno));
+        }
+        if (!write_failed_) {
+            LOG_WARNING("task journal %s: append failed: %s", path_.c_str(), strerror(err));
+            write_failed_ = true;
+        }
+        return;
+    }
+    write_failed_ = false;
+    records_ += buf.size() / RECORD_BYTES;
+    dirty_ = true;
+}
+
+void CRxTaskJournal::log_task(const SRxCaptureTask& task)
+{
+    std::string payload;
+    encode_task(payload, task);
+    append(REC_TASK, task.capture_id, payload);
+}
+
+void CRxTaskJournal::log_state(const SRxCaptureTask& task)
+{
+    std::string payload;
+    encode_state(payload, task);
+    append(REC_STATE, task.capture_id, payload);
+}
+
+void CRxTaskJournal::log_files(int capture_id, const std::vector<CaptureFileInfo>& files)
+{
+    std::string payload;
+    encode_files(payload, files);
+    append(REC_FILES, capture_id, payload);
+}
+
+void CRxTaskJournal::log_archive(int capture_id, const CaptureArchiveInfo& archive)
+{
+    std::string payload;
+    encode_archive(payload, archive);
+    append(REC_ARCHIVE, capture_id, payload);
+}
+
+bool CRxTaskJournal::sync()
+{
+    CRxThreadLock lock(&mutex_);
+    if (fd_ < 0 || !dirty_) {
+        return true;
+    }
+    dirty_ = false;
+    if (::fdatasync(fd_) != 0) {
+        LOG_WARNING("task journal %s: fdatasync failed: %s", path_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool CRxTaskJournal::needs_compaction(uint64_t min_records) const
+{
+    CRxThreadLock lock(&mutex_);
+    if (fd_ < 0) {
+        return false;
+    }
+    uint64_t grown = records_ - compacted_records_;
+    return grown > min_records && grown > compacted_records_;
+}
+
+bool CRxTaskJournal::compact(const std::vector<const SRxCaptureTask*>& tasks, std::string& error)
+{
+    CRxThreadLock lock(&mutex_);
+    if (path_.empty()) {
+        error = "journal not loaded";
+        return false;
+    }
+    std::string tmp = path_ + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "open " + tmp + ": " + strerror(errno);
+        return false;
+    }
+
+    std::string buf;
+    std::string payload;
+    uint64_t records = 0;
+    uint32_t seq = next_seq_;
+    bool ok = true;
+    encode_records(buf, 0, REC_HEADER, 0, header_payload());
+    for (size_t i = 0; i < tasks.size() && ok; ++i) {
+        const SRxCaptureTask& task = *tasks[i];
+        payload.clear();
+        encode_task(payload, task);
+        encode_records(buf, seq++, REC_TASK, task.capture_id, payload);
+        if (!task.captured_files.empty()) {
+            payload.clear();
+            encode_files(payload, task.captured_files);
+            encode_records(buf, seq++, REC_FILES, task.capture_id, payload);
+        }
+        for (size_t a = 0; a < task.archives.size(); ++a) {
+            payload.clear();
+            encode_archive(payload, task.archives[a]);
+            encode_records(buf, seq++, REC_ARCHIVE, task.capture_id, payload);
+        }
+        if (buf.size() >= FLUSH_BYTES) {
+            ok = write_full(fd, buf.data(), buf.size());
+            records += buf.size() / RECORD_BYTES;
+            buf.clear();
+        }
+    }
+    if (ok) {
+        ok = write_full(fd, buf.data(), buf.size());
+        records += buf.size() / RECORD_BYTES;
+    }
+    if (!ok || ::fdatasync(fd) != 0) {
+        error = "write " + tmp + ": " + strerror(errno);
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    ::close(fd);
+
+    if (::rename(tmp.c_str(), path_.c_str()) != 0) {
+        error = "rename " + tmp + ": " + strerror(errno);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    sync_parent_dir(path_);
+
+    int new_fd = ::open(path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (new_fd < 0) {
+        error = "reopen " + path_ + ": " + strerror(errno);
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        return false;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = new_fd;
+    next_seq_ = seq;
+    records_ = records;
+    compacted_records_ = records;
+    dirty_ = false;
+    return true;
+}
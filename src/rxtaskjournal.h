@@ -0,0 +1,103 @@
+#ifndef RX_TASK_JOURNAL_H
+#define RX_TASK_JOURNAL_H
+
+#include "legacy_core.h"
+#include "rxcapturetasktypes.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Append-only journal of capture task events, replayed at startup to rebuild
+// the task history. The file is a sequence of fixed-size records, each
+// carrying its own CRC32; an event larger than one record's payload spans
+// consecutive records of the same sequence number. A torn or corrupt tail is
+// cut off at the last complete event when the journal is loaded. Records are
+// written with one write() per event and made durable by sync(), which the
+// capture manager calls on a timer rather than per event.
+class CRxTaskJournal {
+public:
+    enum {
+        RECORD_BYTES = 256,
+        HEADER_BYTES = 24,
+        PAYLOAD_BYTES = RECORD_BYTES - HEADER_BYTES,
+        VERSION = 1
+    };
+
+    enum ERecordType {
+        REC_HEADER = 1,
+        // Full task descriptor plus its current state.
+        REC_TASK = 2,
+        // Status, times, counters and error of an existing task.
+        REC_STATE = 3,
+        REC_FILES = 4,
+        REC_ARCHIVE = 5
+    };
+
+    struct LoadStats {
+        uint64_t records;
+        uint64_t events;
+        uint64_t tasks;
+        uint64_t truncated_bytes;
+        uint64_t elapsed_us;
+
+        LoadStats()
+            : records(0)
+            , events(0)
+            , tasks(0)
+            , truncated_bytes(0)
+            , elapsed_us(0)
+        {
+        }
+    };
+
+    CRxTaskJournal();
+    ~CRxTaskJournal();
+
+    // Opens (creating if needed) the journal and rebuilds the tasks it
+    // describes, oldest capture_id first, keeping at most max_tasks of the
+    // newest. The caller owns the returned tasks. A journal whose header is
+    // unreadable is moved aside to <path>.bad and a new one is started.
+    bool load(const std::string& path, size_t max_tasks, std::vector<SRxCaptureTask*>& tasks,
+              LoadStats& stats, std::string& error);
+    void close();
+    bool is_open() const;
+
+    void log_task(const SRxCaptureTask& task);
+    void log_state(const SRxCaptureTask& task);
+    void log_files(int capture_id, const std::vector<CaptureFileInfo>& files);
+    void log_archive(int capture_id, const CaptureArchiveInfo& archive);
+
+    // fdatasync() if anything was appended since the last call.
+    bool sync();
+
+    // Rewrites the journal as one REC_TASK per task followed by its files and
+    // archives, then atomically replaces the old file.
+    bool compact(const std::vector<const SRxCaptureTask*>& tasks, std::string& error);
+    // True once the records appended since the last compaction outnumber
+    // both what it wrote and min_records.
+    bool needs_compaction(uint64_t min_records) const;
+
+    const std::string& path() const { return path_; }
+    uint64_t records() const;
+    uint64_t bytes() const { return records() * RECORD_BYTES; }
+
+private:
+    CRxTaskJournal(const CRxTaskJournal&);
+    CRxTaskJournal& operator=(const CRxTaskJournal&);
+
+    void append(int type, int capture_id, const std::string& payload);
+    static void encode_records(std::string& out, uint32_t seq, int type, int capture_id,
+                               const std::string& payload);
+    bool start_new(std::string& error);
+
+    mutable CRxThreadMutex mutex_;
+    int fd_;
+    std::string path_;
+    uint32_t next_seq_;
+    uint64_t records_;
+    uint64_t compacted_records_;
+    bool dirty_;
+    bool write_failed_;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include "rxtcpreassembly.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace {
+
+uint32_t round_up_pow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) {
+        p <<= 1;
+    }
+    return p;
+}
+
+bool seq_before(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+}
+
+CRxTcpReassembler::CRxTcpReassembler(uint32_t max_flows, uint32_t depth)
+    : buffers_(NULL),
+      streams_(NULL),
+      slots_(NULL),
+      slot_mask_(0),
+      max_flows_(max_flows),
+      depth_(depth),
+      active_(0),
+      lru_head_(NIL),
+      lru_tail_(NIL),
+      free_head_(NIL)
+{
+    if (max_flows_ == 0 || depth_ == 0) {
+        return;
+    }
+
+    uint32_t slot_count = round_up_pow2(max_flows_ * 2);
+    void* mem = NULL;
+    if (posix_memalign(&mem, 64, static_cast<size_t>(max_flows_) * depth_) != 0 || !mem) {
+        return;
+    }
+    streams_ = new (std::nothrow) Stream[max_flows_];
+    slots_ = new (std::nothrow) uint32_t[slot_count];
+    if (!streams_ || !slots_) {
+        free(mem);
+        delete[] streams_;
+        delete[] slots_;
+        streams_ = NULL;
+        slots_ = NULL;
+        return;
+    }
+    buffers_ = static_cast<uint8_t*>(mem);
+    slot_mask_ = slot_count - 1;
+    clear();
+}
+
+CRxTcpReassembler::~CRxTcpReassembler()
+{
+    free(buffers_);
+    delete[] streams_;
+    delete[] slots_;
+}
+
+void CRxTcpReassembler::clear()
+{
+    if (!buffers_) {
+        return;
+    }
+    for (uint32_t i = 0; i <= slot_mask_; ++i) {
+        slots_[i] = NIL;
+    }
+    for (uint32_t i = 0; i < max_flows_; ++i) {
+        streams_[i].next = i + 1 < max_flows_ ? i + 1 : NIL;
+    }
+    free_head_ = 0;
+    lru_head_ = NIL;
+    lru_tail_ = NIL;
+    active_ = 0;
+    stats_ = Stats();
+}
+
+size_t CRxTcpReassembler::memory_bytes() const
+{
+    if (!buffers_) {
+        return 0;
+    }
+    return static_cast<size_t>(max_flows_) * (depth_ + sizeof(Stream)) +
+           static_cast<size_t>(slot_mask_ + 1) * sizeof(uint32_t);
+}
+
+uint32_t CRxTcpReassembler::hash(const SRxFlowKey& k)
+{
+    uint64_t h = (static_cast<uint64_t>(k.src_ip[0]) << 32) | k.dst_ip[0];
+    for (int i = 1; i < 4; ++i) {
+        h = (h << 13 | h >> 51) ^ ((static_cast<uint64_t>(k.src_ip[i]) << 32) | k.dst_ip[i]);
+    }
+    h ^= (static_cast<uint64_t>(k.src_port) << 24) ^ (static_cast<uint64_t>(k.dst_port) << 8) ^ k.proto;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+bool CRxTcpReassembler::same(const SRxFlowKey& a, const SRxFlowKey& b)
+{
+    return a == b;
+}
+
+uint32_t CRxTcpReassembler::find(const SRxFlowKey& key, uint32_t h) const
+{
+    uint32_t slot = h & slot_mask_;
+    for (;;) {
+        uint32_t idx = slots_[slot];
+        if (idx == NIL) {
+            return NIL;
+        }
+        if (streams_[idx].hash == h && same(streams_[idx].key, key)) {
+            return idx;
+        }
+        slot = (slot + 1) & slot_mask_;
+    }
+}
+
+void CRxTcpReassembler::index_erase(uint32_t idx)
+{
+    uint32_t hole = streams_[idx].hash & slot_mask_;
+    while (slots_[hole] != idx) {
+        hole = (hole + 1) & slot_mask_;
+    }
+    uint32_t next = (hole + 1) & slot_mask_;
+    while (slots_[next] != NIL) {
+        uint32_t home = streams_[slots_[next]].hash & slot_mask_;
+        if (((next - home) & slot_mask_) >= ((next - hole) & slot_mask_)) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+        next = (next + 1) & slot_mask_;
+    }
+    slots_[hole] = NIL;
+}
+
+void CRxTcpReassembler::lru_unlink(uint32_t idx)
+{
+    Stream& s = streams_[idx];
+    if (s.prev != NIL) {
+        streams_[s.prev].next = s.next;
+    } else {
+        lru_head_ = s.next;
+    }
+    if (s.next != NIL) {
+        streams_[s.next].prev = s.prev;
+    } else {
+        lru_tail_ = s.prev;
+    }
+}
+
+void CRxTcpReassembler::lru_push_front(uint32_t idx)
+{
+    Stream& s = streams_[idx];
+    s.prev = NIL;
+    s.next = lru_head_;
+    if (lru_head_ != NIL) {
+        streams_[lru_head_].prev = idx;
+    }
+    lru_head_ = idx;
+    if (lru_tail_ == NIL) {
+        lru_tail_ = idx;
+    }
+}
+
+void CRxTcpReassembler::drop(uint32_t idx)
+{
+    index_erase(idx);
+    lru_unlink(idx);
+    streams_[idx].next = free_head_;
+    free_head_ = idx;
+    active_--;
+}
+
+uint32_t CRxTcpReassembler::acquire(const SRxFlowKey& key, uint32_t h)
+{
+    if (free_head_ == NIL) {
+        drop(lru_tail_);
+        stats_.evictions++;
+    }
+    uint32_t idx = free_head_;
+    free_head_ = streams_[idx].next;
+
+    Stream& s = streams_[idx];
+    s.key = key;
+    s.hash = h;
+    s.used = 0;
+    s.held_len = 0;
+    s.boundary = false;
+
+    uint32_t slot = h & slot_mask_;
+    while (slots_[slot] != NIL) {
+        slot = (slot + 1) & slot_mask_;
+    }
+    slots_[slot] = idx;
+    lru_push_front(idx);
+    active_++;
+    stats_.streams++;
+    return idx;
+}
+
+const uint8_t* CRxTcpReassembler::add(const SRxFlowKey& key, uint32_t seq, uint8_t flags,
+                                      const uint8_t* payload, uint32_t len, uint32_t* out_len)
+{
+    if (!buffers_) {
+        return NULL;
+    }
+    stats_.segments++;
+
+    uint32_t h = hash(key);
+    uint32_t idx = find(key, h);
+    if (idx == NIL) {
+        if (len == 0 && !(flags & RX_TCP_SYN)) {
+            return NULL;
+        }
+        idx = acquire(key, h);
+        streams_[idx].next_seq = (flags & RX_TCP_SYN) ? seq + 1 : seq;
+    } else if (idx != lru_head_) {
+        lru_unlink(idx);
+        lru_push_front(idx);
+    }
+
+    Stream& s = streams_[idx];
+    if (flags & RX_TCP_SYN) {
+        s.next_seq = seq + 1;
+        s.used = 0;
+        s.held_len = 0;
+        s.boundary = false;
+        if (len == 0) {
+            return NULL;
+        }
+        seq++;
+    }
+    uint8_t* buf = buffers_ + static_cast<size_t>(idx) * depth_;
+    if (s.boundary) {
+        if (s.held_len > 0) {
+            uint32_t ahead = s.held_seq - s.next_seq;
+            memmove(buf + ahead, buf + s.used + ahead, s.held_len);
+        }
+        s.used = 0;
+        s.boundary = false;
+    }
+    uint32_t start = seq;
+    if (seq != s.next_seq) {
+        if (seq_before(seq, s.next_seq)) {
+            uint32_t overlap = s.next_seq - seq;
+            if (overlap >= len) {
+                stats_.retransmits++;
+                return NULL;
+            }
+            payload += overlap;
+            len -= overlap;
+            start = s.next_seq;
+        } else if (len > 0 && hold(s, buf, seq, flags, payload, len)) {
+            return NULL;
+        } else {
+            stats_.gaps++;
+            s.used = 0;
+            s.held_len = 0;
+        }
+    }
+    if (len == 0) {
+        return NULL;
+    }
+
+    uint32_t room = depth_ - s.used;
+    uint32_t copy = len < room ? len : room;
+    if (copy < len) {
+        stats_.truncated++;
+    }
+    memcpy(buf + s.used, payload, copy);
+    s.used += copy;
+    s.next_seq = start + len;
+    s.boundary = (flags & RX_TCP_PSH) != 0;
+
+    if (s.held_len > 0 && !seq_before(s.next_seq, s.held_seq)) {
+        uint32_t held_end = s.held_seq + s.held_len;
+        if (seq_before(s.next_seq, held_end)) {
+            s.used += held_end - s.next_seq;
+            s.next_seq = held_end;
+            s.boundary = s.held_boundary;
+        }
+        s.held_len = 0;
+    }
+    *out_len = s.used;
+
+    if (flags & (RX_TCP_FIN | RX_TCP_RST)) {
+        drop(idx);
+    }
+    return buf;
+}
+
+// Parks a segment that arrived ahead of next_seq at the buffer position it will
+// occupy once the hole is filled. Only one contiguous run is kept.
+bool CRxTcpReassembler::hold(Stream& s, uint8_t* buf, uint32_t seq, uint8_t flags,
+                             const uint8_t* payload, uint32_t len)
+{
+    if (flags & (RX_TCP_FIN | RX_TCP_RST)) {
+        return false;
+    }
+    if (s.held_len > 0) {
+        uint32_t held_end = s.held_seq + s.held_len;
+        if (!seq_before(seq, s.held_seq) && !seq_before(held_end, seq + len)) {
+            stats_.retransmits++;
+            return true;
+        }
+        if (seq != held_end) {
+            return false;
+        }
+    }
+
+    uint64_t pos = static_cast<uint64_t>(s.used) + (seq - s.next_seq);
+    if (pos + len > depth_) {
+        return false;
+    }
+    memcpy(buf + pos, payload, len);
+    if (s.held_len == 0) {
+        s.held_seq = seq;
+    }
+    s.held_len += len;
+    s.held_boundary = (flags & RX_TCP_PSH) != 0;
+    stats_.reordered++;
+    return true;
+}
+
+void CRxTcpReassembler::release(const SRxFlowKey& key)
+{
+    if (!buffers_ || active_ == 0) {
+        return;
+    }
+    uint32_t idx = find(key, hash(key));
+    if (idx != NIL) {
+        drop(idx);
+    }
+}
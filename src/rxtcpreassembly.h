@@ -0,0 +1,106 @@
+#ifndef RX_TCP_REASSEMBLY_H
+#define RX_TCP_REASSEMBLY_H
+
+#include "rxflowcache.h"
+#include <stdint.h>
+#include <stddef.h>
+
+enum {
+    RX_TCP_FIN = 0x01,
+    RX_TCP_SYN = 0x02,
+    RX_TCP_RST = 0x04,
+    RX_TCP_PSH = 0x08
+};
+
+// Per-direction TCP reassembly with a fixed memory ceiling: max_flows buffers of
+// depth bytes are allocated up front and handed out LRU. A buffer holds the
+// message that started after the last PSH boundary (or stream start / gap);
+// bytes beyond depth are dropped and counted as truncated. One run of
+// out-of-order bytes is held in place in the same buffer until the hole fills;
+// anything that does not fit is treated as a gap.
+class CRxTcpReassembler {
+public:
+    enum {
+        DEFAULT_MAX_FLOWS = 1024,
+        DEFAULT_DEPTH = 4096
+    };
+
+    struct Stats {
+        unsigned long segments;
+        unsigned long streams;
+        unsigned long evictions;
+        unsigned long gaps;
+        unsigned long retransmits;
+        unsigned long truncated;
+        unsigned long reordered;
+
+        Stats() : segments(0), streams(0), evictions(0), gaps(0), retransmits(0), truncated(0), reordered(0) {}
+    };
+
+    CRxTcpReassembler(uint32_t max_flows = DEFAULT_MAX_FLOWS, uint32_t depth = DEFAULT_DEPTH);
+    ~CRxTcpReassembler();
+
+    bool valid() const { return buffers_ != NULL; }
+
+    // Appends one segment and returns the message buffered so far for its
+    // direction, or NULL when the segment added nothing (pure ACK/SYN,
+    // retransmission). The returned bytes stay valid until the next call.
+    const uint8_t* add(const SRxFlowKey& key, uint32_t seq, uint8_t flags,
+                       const uint8_t* payload, uint32_t len, uint32_t* out_len);
+
+    void release(const SRxFlowKey& key);
+
+    void clear();
+
+    size_t memory_bytes() const;
+    uint32_t depth() const { return depth_; }
+    uint32_t max_flows() const { return max_flows_; }
+    uint32_t active() const { return active_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    enum {
+        NIL = 0xFFFFFFFFu
+    };
+
+    struct Stream {
+        SRxFlowKey key;
+        uint32_t hash;
+        uint32_t next_seq;
+        uint32_t used;
+        uint32_t held_seq;
+        uint32_t held_len;
+        uint32_t prev;
+        uint32_t next;
+        bool boundary;
+        bool held_boundary;
+    };
+
+    CRxTcpReassembler(const CRxTcpReassembler&);
+    CRxTcpReassembler& operator=(const CRxTcpReassembler&);
+
+    static uint32_t hash(const SRxFlowKey& key);
+    static bool same(const SRxFlowKey& a, const SRxFlowKey& b);
+
+    uint32_t find(const SRxFlowKey& key, uint32_t h) const;
+    uint32_t acquire(const SRxFlowKey& key, uint32_t h);
+    void drop(uint32_t idx);
+    bool hold(Stream& s, uint8_t* buf, uint32_t seq, uint8_t flags, const uint8_t* payload, uint32_t len);
+    void index_erase(uint32_t idx);
+    void lru_unlink(uint32_t idx);
+    void lru_push_front(uint32_t idx);
+
+    uint8_t* buffers_;
+    Stream* streams_;
+    uint32_t* slots_;
+    uint32_t slot_mask_;
+    uint32_t max_flows_;
+    uint32_t depth_;
+    uint32_t active_;
+    uint32_t lru_head_;
+    uint32_t lru_tail_;
+    uint32_t free_head_;
+    Stats stats_;
+};
+
+#endif
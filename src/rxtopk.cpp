@@ -0,0 +1,201 @@
+#include "rxtopk.h"
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+uint32_t round_up_pow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) {
+        p <<= 1;
+    }
+    return p;
+}
+
+bool by_count_desc(const SRxTopKEntry& a, const SRxTopKEntry& b)
+{
+    if (a.count != b.count) {
+        return a.count > b.count;
+    }
+    return a.bytes > b.bytes;
+}
+
+}
+
+CRxTopK::CRxTopK(uint32_t capacity)
+    : mask_(0),
+      capacity_(capacity > 0 ? capacity : 1),
+      evictions_(0)
+{
+    uint32_t slot_count = round_up_pow2(capacity_ * 2);
+    slots_.assign(slot_count, static_cast<uint32_t>(EMPTY_SLOT));
+    mask_ = slot_count - 1;
+    heap_.reserve(capacity_);
+    items_.reserve(capacity_);
+}
+
+bool CRxTopK::same_key(const SRxAggKey& a, const SRxAggKey& b)
+{
+    return memcmp(a.w, b.w, sizeof(a.w)) == 0;
+}
+
+uint32_t CRxTopK::hash(const SRxAggKey& key)
+{
+    uint64_t h = (key.w[0] * 0x9e3779b97f4a7c15ULL) ^ (key.w[1] * 0xc2b2ae3d27d4eb4fULL) ^
+                 (key.w[2] * 0x165667b19e3779f9ULL) ^ (key.w[3] * 0x27d4eb2f165667c5ULL) ^
+                 (key.w[4] * 0xff51afd7ed558ccdULL);
+    h ^= h >> 32;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return static_cast<uint32_t>(h);
+}
+
+uint32_t CRxTopK::find(const SRxAggKey& key, uint32_t h) const
+{
+    uint32_t slot = h & mask_;
+    for (;;) {
+        uint32_t item = slots_[slot];
+        if (item == EMPTY_SLOT) {
+            return EMPTY_SLOT;
+        }
+        if (items_[item].hash == h && same_key(items_[item].key, key)) {
+            return item;
+        }
+        slot = (slot + 1) & mask_;
+    }
+}
+
+void CRxTopK::index_insert(uint32_t item)
+{
+    uint32_t slot = items_[item].hash & mask_;
+    while (slots_[slot] != EMPTY_SLOT) {
+        slot = (slot + 1) & mask_;
+    }
+    slots_[slot] = item;
+}
+
+void CRxTopK::index_erase(uint32_t item)
+{
+    uint32_t hole = items_[item].hash & mask_;
+    while (slots_[hole] != item) {
+        hole = (hole + 1) & mask_;
+    }
+    uint32_t next = (hole + 1) & mask_;
+    while (slots_[next] != EMPTY_SLOT) {
+        uint32_t home = items_[slots_[next]].hash & mask_;
+        if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+        next = (next + 1) & mask_;
+    }
+    slots_[hole] = EMPTY_SLOT;
+}
+
+void CRxTopK::sift_up(uint32_t pos)
+{
+    Node node = heap_[pos];
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (heap_[parent].count <= node.count) {
+            break;
+        }
+        heap_[pos] = heap_[parent];
+        items_[heap_[pos].item].heap_pos = pos;
+        pos = parent;
+    }
+    heap_[pos] = node;
+    items_[node.item].heap_pos = pos;
+}
+
+void CRxTopK::sift_down(uint32_t pos)
+{
+    uint32_t n = static_cast<uint32_t>(heap_.size());
+    Node node = heap_[pos];
+    for (;;) {
+        uint32_t child = pos * 2 + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && heap_[child + 1].count < heap_[child].count) {
+            child++;
+        }
+        if (heap_[child].count >= node.count) {
+            break;
+        }
+        heap_[pos] = heap_[child];
+        items_[heap_[pos].item].heap_pos = pos;
+        pos = child;
+    }
+    heap_[pos] = node;
+    items_[node.item].heap_pos = pos;
+}
+
+void CRxTopK::add(const SRxAggKey& key, uint64_t bytes)
+{
+    uint32_t h = hash(key);
+    uint32_t item = find(key, h);
+    if (item != EMPTY_SLOT) {
+        uint32_t pos = items_[item].heap_pos;
+        heap_[pos].count++;
+        items_[item].bytes += bytes;
+        sift_down(pos);
+        return;
+    }
+
+    if (items_.size() < capacity_) {
+        Item fresh;
+        fresh.key = key;
+        fresh.bytes = bytes;
+        fresh.error = 0;
+        fresh.hash = h;
+        fresh.heap_pos = static_cast<uint32_t>(heap_.size());
+        items_.push_back(fresh);
+        Node node;
+        node.count = 1;
+        node.item = static_cast<uint32_t>(items_.size() - 1);
+        heap_.push_back(node);
+        index_insert(node.item);
+        sift_up(fresh.heap_pos);
+        return;
+    }
+
+    Node& root = heap_[0];
+    Item& victim = items_[root.item];
+    index_erase(root.item);
+    victim.key = key;
+    victim.hash = h;
+    victim.error = root.count > 0xFFFFFFFFULL ? 0xFFFFFFFFu : static_cast<uint32_t>(root.count);
+    victim.bytes = bytes;
+    root.count++;
+    index_insert(root.item);
+    sift_down(0);
+    evictions_++;
+}
+
+void CRxTopK::top(std::vector<SRxTopKEntry>& out, size_t k) const
+{
+    out.resize(heap_.size());
+    for (size_t i = 0; i < heap_.size(); ++i) {
+        const Item& item = items_[heap_[i].item];
+        out[i].key = item.key;
+        out[i].count = heap_[i].count;
+        out[i].bytes = item.bytes;
+        out[i].error = item.error;
+    }
+    if (k < out.size()) {
+        std::partial_sort(out.begin(), out.begin() + k, out.end(), by_count_desc);
+        out.resize(k);
+    } else {
+        std::sort(out.begin(), out.end(), by_count_desc);
+    }
+}
+
+void CRxTopK::clear()
+{
+    heap_.clear();
+    items_.clear();
+    std::fill(slots_.begin(), slots_.end(), static_cast<uint32_t>(EMPTY_SLOT));
+    evictions_ = 0;
+}
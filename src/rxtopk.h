@@ -0,0 +1,75 @@
+#ifndef RX_TOPK_H
+#define RX_TOPK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct SRxAggKey {
+    uint64_t w[5];
+};
+
+struct SRxTopKEntry {
+    SRxAggKey key;
+    uint64_t count;
+    uint64_t bytes;
+    uint32_t error;
+};
+
+// Space-saving heavy hitter sketch: at most capacity keys are tracked, and a new
+// key evicts the current minimum and inherits its count as the error bound.
+// Single writer; the owner copies results out with top().
+class CRxTopK {
+public:
+    enum {
+        DEFAULT_CAPACITY = 1024
+    };
+
+    explicit CRxTopK(uint32_t capacity = DEFAULT_CAPACITY);
+
+    void add(const SRxAggKey& key, uint64_t bytes);
+
+    void top(std::vector<SRxTopKEntry>& out, size_t k) const;
+
+    void clear();
+
+    size_t size() const { return items_.size(); }
+    uint32_t capacity() const { return capacity_; }
+    uint64_t evictions() const { return evictions_; }
+
+    static bool same_key(const SRxAggKey& a, const SRxAggKey& b);
+    static uint32_t hash(const SRxAggKey& key);
+
+private:
+    enum {
+        EMPTY_SLOT = 0xFFFFFFFFu
+    };
+
+    struct Node {
+        uint64_t count;
+        uint32_t item;
+    };
+
+    struct Item {
+        SRxAggKey key;
+        uint64_t bytes;
+        uint32_t error;
+        uint32_t hash;
+        uint32_t heap_pos;
+    };
+
+    uint32_t find(const SRxAggKey& key, uint32_t h) const;
+    void index_insert(uint32_t item);
+    void index_erase(uint32_t item);
+    void sift_up(uint32_t pos);
+    void sift_down(uint32_t pos);
+
+    std::vector<Node> heap_;
+    std::vector<Item> items_;
+    std::vector<uint32_t> slots_;
+    uint32_t mask_;
+    uint32_t capacity_;
+    uint64_t evictions_;
+};
+
+#endif
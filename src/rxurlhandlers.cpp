@@ -4,14 +4,24 @@
 #include "legacy_core.h"
 #include "rxprocdata.h"
 #include "rxcapturemanagerthread.h"
+#include "rxcapturescheduler.h"
 #include "rxsafetaskmgr.h"
 #include "rxprocessresolver.h"
 #include "pdef/parser.h"
 #include "runtime/protocol.h"
+#include "rxmetrics.h"
+#include "rxplacement.h"
+#include "rxcleanupthread.h"
+#include "rxpdefcache.h"
+#include "rxprotocoldispatcher.h"
+#include "rxstatsaggregator.h"
 
 #include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 
 #include <cstdio>
+#include <climits>
 #include <cstdlib>
 #include <algorithm>
 #include <map>
@@ -23,6 +33,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <dirent.h>
+#include <arpa/inet.h>
 
 namespace {
 
@@ -149,6 +160,49 @@ static std::string get_configured_pdef_dir()
     return cfg_dir.empty() ? fallback : cfg_dir;
 }
 
+// Confines replay_file to storage.replay_dir; relative paths are taken
+// relative to it. Symlinks are resolved before the prefix check.
+static bool resolve_replay_file(const std::string& requested, std::string& resolved, std::string& error)
+{
+    CRxProcData* pdata = CRxProcData::instance();
+    std::string dir;
+    if (pdata && pdata->server_config()) {
+        dir = pdata->server_config()->storage().replay_dir;
+    }
+    if (dir.empty()) {
+        error = "replay is disabled";
+        return false;
+    }
+
+    char real_dir[PATH_MAX];
+    if (!realpath(dir.c_str(), real_dir)) {
+        error = "replay directory is not available";
+        return false;
+    }
+    std::string path = requested[0] == '/' ? requested : dir + "/" + requested;
+    char real_path[PATH_MAX];
+    if (!realpath(path.c_str(), real_path)) {
+        error = "replay_file not found";
+        return false;
+    }
+
+    std::string prefix(real_dir);
+    if (prefix.empty() || prefix[prefix.size() - 1] != '/') {
+        prefix += "/";
+    }
+    struct stat st;
+    if (std::string(real_path).compare(0, prefix.size(), prefix) != 0) {
+        error = "replay_file must be under the replay directory";
+        return false;
+    }
+    if (stat(real_path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        error = "replay_file is not a regular file";
+        return false;
+    }
+    resolved = real_path;
+    return true;
+}
+
 static void append_pdef_dirs(std::vector<std::string>& out)
 {
     const char* builtin = "config/protocols";
@@ -162,6 +216,212 @@ static void append_pdef_dirs(std::vector<std::string>& out)
     }
 }
 
+static std::string resolve_protocol_pdef(const std::string& protocol_name)
+{
+    CRxProcData* pdata = CRxProcData::instance();
+    CRxStrategyConfigManager* cfg = pdata ? pdata->current_strategy_config() : NULL;
+    if (cfg) {
+        std::string pdef_path = cfg->get_protocol_pdef_path(protocol_name);
+        if (!pdef_path.empty()) {
+            return pdef_path;
+        }
+    }
+    return "config/protocols/" + protocol_name + ".pdef";
+}
+
+static std::vector<std::string> json_string_list(const rapidjson::Value& value)
+{
+    std::vector<std::string> out;
+    if (value.IsString()) {
+        out = CRxProtocolDispatcher::split_list(value.GetString());
+    } else if (value.IsArray()) {
+        for (rapidjson::SizeType i = 0; i < value.Size(); ++i) {
+            if (value[i].IsString() && value[i].GetStringLength() > 0) {
+                out.push_back(value[i].GetString());
+            }
+        }
+    }
+    return out;
+}
+
+static std::string stats_value_string(const SRxStatsFieldTop& field, const SRxTopKEntry& entry)
+{
+    uint64_t v = entry.key.w[0];
+    if (!field.is_bytes) {
+        char buf[32];
+        if (field.is_signed) {
+            snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v));
+        } else {
+            snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(v));
+        }
+        return buf;
+    }
+
+    std::string raw;
+    bool printable = true;
+    for (uint32_t i = 0; i < field.width; ++i) {
+        unsigned char c = static_cast<unsigned char>(v >> ((field.width - 1 - i) * 8));
+        printable = printable && c >= 0x20 && c < 0x7f;
+        raw.push_back(static_cast<char>(c));
+    }
+    if (printable) {
+        return "\"" + json_escape(raw) + "\"";
+    }
+    std::string hex = "\"0x";
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < raw.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(raw[i]);
+        hex.push_back(digits[c >> 4]);
+        hex.push_back(digits[c & 0xf]);
+    }
+    hex.push_back('"');
+    return hex;
+}
+
+static std::string stats_flow_addr(const uint64_t* words, int ip_version)
+{
+    char buf[INET6_ADDRSTRLEN];
+    buf[0] = '\0';
+    inet_ntop(ip_version == 6 ? AF_INET6 : AF_INET, words, buf, sizeof(buf));
+    return buf;
+}
+
+static void append_stats_json(std::ostringstream& oss, const SRxStatsSnapshot& snap, bool finished)
+{
+    oss << "{\"finished\":" << (finished ? "true" : "false");
+    oss << ",\"updated_at\":" << snap.updated_usec;
+    oss << ",\"packets\":" << snap.packets;
+    oss << ",\"bytes\":" << snap.bytes;
+    oss << ",\"matched_packets\":" << snap.matched_packets;
+    oss << ",\"matched_bytes\":" << snap.matched_bytes;
+    oss << ",\"undecoded\":" << snap.undecoded;
+
+    oss << ",\"protocols\":[";
+    for (size_t i = 0; i < snap.protocols.size(); ++i) {
+        if (i > 0) {
+            oss << ",";
+        }
+        oss << "{\"name\":\"" << json_escape(snap.protocols[i]) << "\"";
+        oss << ",\"packets\":" << snap.protocol_packets[i];
+        oss << ",\"bytes\":" << snap.protocol_bytes[i] << "}";
+    }
+    oss << "]";
+
+    oss << ",\"fields\":[";
+    for (size_t i = 0; i < snap.fields.size(); ++i) {
+        const SRxStatsFieldTop& field = snap.fields[i];
+        if (i > 0) {
+            oss << ",";
+        }
+        oss << "{\"field\":\"" << json_escape(field.field) << "\"";
+        oss << ",\"protocol\":\"" << json_escape(field.protocol) << "\"";
+        oss << ",\"evictions\":" << field.evictions;
+        oss << ",\"top\":[";
+        for (size_t j = 0; j < field.top.size(); ++j) {
+            const SRxTopKEntry& entry = field.top[j];
+            if (j > 0) {
+                oss << ",";
+            }
+            oss << "{\"value\":" << stats_value_string(field, entry);
+            oss << ",\"count\":" << entry.count;
+            oss << ",\"bytes\":" << entry.bytes;
+            oss << ",\"error\":" << entry.error << "}";
+        }
+        oss << "]}";
+    }
+    oss << "]";
+
+    oss << ",\"flow_evictions\":" << snap.flow_evictions;
+    oss << ",\"flows\":[";
+    for (size_t i = 0; i < snap.flows.size(); ++i) {
+        const SRxTopKEntry& entry = snap.flows[i];
+        int ip_version = static_cast<int>(entry.key.w[4] & 0xff);
+        if (i > 0) {
+            oss << ",";
+        }
+        oss << "{\"src\":\"" << stats_flow_addr(&entry.key.w[0], ip_version) << "\"";
+        oss << ",\"dst\":\"" << stats_flow_addr(&entry.key.w[2], ip_version) << "\"";
+        oss << ",\"sport\":" << ((entry.key.w[4] >> 48) & 0xffff);
+        oss << ",\"dport\":" << ((entry.key.w[4] >> 32) & 0xffff);
+        oss << ",\"proto\":" << ((entry.key.w[4] >> 8) & 0xff);
+        oss << ",\"count\":" << entry.count;
+        oss << ",\"bytes\":" << entry.bytes;
+        oss << ",\"error\":" << entry.error << "}";
+    }
+    oss << "]}";
+}
+
+typedef rapidjson::Writer<rapidjson::StringBuffer> JsonWriter;
+
+static void write_json_string(JsonWriter& writer, const char* key, const std::string& value)
+{
+    writer.Key(key);
+    writer.String(value.c_str(), static_cast<rapidjson::SizeType>(value.size()));
+}
+
+static void write_file_json(JsonWriter& writer, const CaptureFileInfo& info)
+{
+    writer.StartObject();
+    write_json_string(writer, "path", info.file_path);
+    writer.Key("size");
+    writer.Uint64(info.file_size);
+    writer.Key("segment");
+    writer.Int(info.segment_index);
+    writer.Key("segments");
+    writer.Int(info.total_segments);
+    writer.Key("compressed");
+    writer.Bool(info.compressed);
+    if (!info.archive_path.empty()) {
+        write_json_string(writer, "archive", info.archive_path);
+    }
+    if (info.compress_finish_ts > 0) {
+        writer.Key("compressed_at");
+        writer.Int64(info.compress_finish_ts);
+    }
+    writer.EndObject();
+}
+
+static bool parse_capture_status(const std::string& name, ECaptureTaskStatus& status)
+{
+    static const ECaptureTaskStatus all[] = {
+        STATUS_PENDING, STATUS_RESOLVING, STATUS_RUNNING,
+        STATUS_COMPLETED, STATUS_FAILED, STATUS_STOPPED
+    };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (name == capture_status_to_string(all[i])) {
+            status = all[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_long_param(const std::string& text, long& value)
+{
+    if (text.empty()) {
+        return false;
+    }
+    char* end = NULL;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (!end || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+static std::string join_list(const std::vector<std::string>& items)
+{
+    std::string out;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) {
+            out += ",";
+        }
+        out += items[i];
+    }
+    return out;
+}
+
 }
 
 CRxUrlHandlerStaticJson::CRxUrlHandlerStaticJson(int code,
@@ -197,6 +457,78 @@ bool CRxUrlHandlerStaticJson::perform(http_req_head_para* req_head,
     return true;
 }
 
+CRxUrlHandlerMetrics::CRxUrlHandlerMetrics()
+{
+}
+
+bool CRxUrlHandlerMetrics::perform(http_req_head_para* req_head,
+                                   std::string* recv_body,
+                                   http_res_head_para* res_head,
+                                   std::string* send_body,
+                                   const ObjId& conn_id)
+{
+    (void)req_head;
+    (void)recv_body;
+    (void)conn_id;
+    if (!res_head || !send_body) {
+        return true;
+    }
+
+    std::string body;
+    body.reserve(16384);
+    CRxMetrics::render_prometheus(body);
+
+    uint64_t put_count = CRxMetrics::counter_total(RX_CNT_CHANNEL_PUT);
+    uint64_t processed_count = CRxMetrics::counter_total(RX_CNT_CHANNEL_HANDLED);
+    CRxMetrics::append_gauge(body, "rxtrace_channel_queue_depth",
+                             "Messages posted to inter-thread channels and not yet handled",
+                             put_count > processed_count ? static_cast<double>(put_count - processed_count) : 0.0);
+
+    CRxPdefCache::Stats pdef_stats = CRxPdefCache::instance()->get_stats();
+    CRxMetrics::append_gauge(body, "rxtrace_pdef_cache_entries", "Compiled PDEF definitions held in the cache",
+                             static_cast<double>(pdef_stats.entries));
+    CRxMetrics::append_counter(body, "rxtrace_pdef_cache_hits_total", "PDEF cache hits since start",
+                               pdef_stats.hits);
+    CRxMetrics::append_counter(body, "rxtrace_pdef_cache_misses_total", "PDEF cache misses since start",
+                               pdef_stats.misses);
+
+    CRxThreadPlacement::instance()->render_prometheus(body);
+
+    SRxCompressBacklog backlog = CRxCleanupThread::compress_backlog();
+    CRxMetrics::append_gauge(body, "rxtrace_compress_queue_jobs", "Archive jobs waiting for a compression worker",
+                             static_cast<double>(backlog.queued_jobs));
+    CRxMetrics::append_gauge(body, "rxtrace_compress_queue_bytes", "Capture bytes in queued archive jobs",
+                             static_cast<double>(backlog.queued_bytes));
+    CRxMetrics::append_gauge(body, "rxtrace_compress_pending_files", "Segments not yet grouped into an archive job",
+                             static_cast<double>(backlog.pending_files));
+    CRxMetrics::append_gauge(body, "rxtrace_compress_pending_bytes", "Bytes of segments not yet grouped into an archive job",
+                             static_cast<double>(backlog.pending_bytes));
+    CRxMetrics::append_gauge(body, "rxtrace_compress_workers_busy", "Compression workers building an archive",
+                             static_cast<double>(backlog.busy_workers));
+    CRxMetrics::append_gauge(body, "rxtrace_compress_workers", "Compression workers started",
+                             static_cast<double>(backlog.workers));
+
+    CRxProcData* proc_data = CRxProcData::instance();
+    if (proc_data) {
+        TaskStats task_stats = proc_data->capture_task_mgr().get_stats();
+        CRxMetrics::append_gauge(body, "rxtrace_capture_tasks_running", "Capture tasks currently running",
+                                 static_cast<double>(task_stats.running_count));
+        CRxMetrics::append_gauge(body, "rxtrace_capture_tasks_pending", "Capture tasks waiting to start",
+                                 static_cast<double>(task_stats.pending_count + task_stats.resolving_count));
+    }
+
+    res_head->_response_code = 200;
+    res_head->_response_str = "OK";
+    res_head->_headers.clear();
+    res_head->_headers["Content-Type"] = "text/plain; version=0.0.4";
+    res_head->_headers["Connection"] = "close";
+    char len_buf[32];
+    snprintf(len_buf, sizeof(len_buf), "%zu", body.size());
+    res_head->_headers["Content-Length"] = len_buf;
+    send_body->swap(body);
+    return true;
+}
+
 CRxUrlHandlerCaptureApi::CRxUrlHandlerCaptureApi()
 {
 }
@@ -223,6 +555,10 @@ bool CRxUrlHandlerCaptureApi::perform(http_req_head_para* req_head,
         return handle_stop(req_head, recv_body, res_head, send_body, conn_id);
     } else if (path.find("/api/capture/status") == 0 && (method == "GET" || method == "POST")) {
         return handle_status(req_head, recv_body, res_head, send_body, conn_id);
+    } else if (path.find("/api/capture/stats") == 0 && method == "GET") {
+        return handle_stats(req_head, recv_body, res_head, send_body, conn_id);
+    } else if (path.find("/api/capture/list") == 0 && method == "GET") {
+        return handle_list(req_head, recv_body, res_head, send_body, conn_id);
     } else {
         set_error_response(res_head, send_body, 404, "Not found");
         return true;
@@ -290,29 +626,21 @@ bool CRxUrlHandlerCaptureApi::handle_start(http_req_head_para* req_head,
         if (doc.HasMember("filter") && doc["filter"].IsString()) {
             msg->filter = doc["filter"].GetString();
         }
-        if (doc.HasMember("protocol") && doc["protocol"].IsString()) {
-            std::string protocol_name = doc["protocol"].GetString();
-
-
-            CRxProcData* pdata = CRxProcData::instance();
-            CRxStrategyConfigManager* cfg = pdata ? pdata->current_strategy_config() : NULL;
-            if (cfg) {
-                std::string pdef_path = cfg->get_protocol_pdef_path(protocol_name);
-                if (!pdef_path.empty()) {
-
-                    msg->protocol_filter = pdef_path;
-                } else {
-
-                    msg->protocol_filter = "config/protocols/" + protocol_name + ".pdef";
-                }
-            } else {
-
-                msg->protocol_filter = "config/protocols/" + protocol_name + ".pdef";
+        if (doc.HasMember("protocol")) {
+            std::vector<std::string> protocols = json_string_list(doc["protocol"]);
+            for (size_t i = 0; i < protocols.size(); ++i) {
+                protocols[i] = resolve_protocol_pdef(protocols[i]);
+            }
+            if (!protocols.empty()) {
+                msg->protocol_filter = join_list(protocols);
             }
         }
-        if (doc.HasMember("protocol_filter") && doc["protocol_filter"].IsString()) {
-            msg->protocol_filter = doc["protocol_filter"].GetString();
-            fprintf(stderr, "[DEBUG API] Set protocol_filter='%s'\n", msg->protocol_filter.c_str());
+        if (doc.HasMember("protocol_filter")) {
+            std::vector<std::string> filters = json_string_list(doc["protocol_filter"]);
+            if (!filters.empty()) {
+                msg->protocol_filter = join_list(filters);
+                fprintf(stderr, "[DEBUG API] Set protocol_filter='%s'\n", msg->protocol_filter.c_str());
+            }
         }
         if (doc.HasMember("protocol_filter_inline") && doc["protocol_filter_inline"].IsString()) {
             msg->protocol_filter_inline = doc["protocol_filter_inline"].GetString();
@@ -350,6 +678,46 @@ bool CRxUrlHandlerCaptureApi::handle_start(http_req_head_para* req_head,
             msg->max_packets = doc["max_packets"].GetInt();
         }
 
+        if (doc.HasMember("replay_file") && doc["replay_file"].IsString()
+            && doc["replay_file"].GetStringLength() > 0) {
+            std::string error;
+            if (!resolve_replay_file(doc["replay_file"].GetString(), msg->replay_file, error)) {
+                set_json_response(res_head, send_body, 400, "Bad Request",
+                                  "{\"error\":\"" + json_escape(error) + "\"}");
+                return true;
+            }
+        }
+        if (doc.HasMember("replay_speed") && doc["replay_speed"].IsNumber()) {
+            msg->replay_speed = doc["replay_speed"].GetDouble();
+        }
+        if (doc.HasMember("replay_pps") && doc["replay_pps"].IsInt64()) {
+            msg->replay_pps = static_cast<long>(doc["replay_pps"].GetInt64());
+        }
+        if (doc.HasMember("replay_loops") && doc["replay_loops"].IsInt()) {
+            msg->replay_loops = doc["replay_loops"].GetInt();
+        }
+
+        if (doc.HasMember("stats_only") && doc["stats_only"].IsBool()) {
+            msg->stats_only = doc["stats_only"].GetBool();
+        }
+        if (doc.HasMember("aggregate")) {
+            std::vector<std::string> fields = json_string_list(doc["aggregate"]);
+            if (!fields.empty()) {
+                msg->aggregate_fields = join_list(fields);
+                msg->stats_only = true;
+            }
+        }
+
+        if (doc.HasMember("priority") && doc["priority"].IsString()) {
+            int priority = capture_priority_from_string(doc["priority"].GetString());
+            if (priority < 0) {
+                set_json_response(res_head, send_body, 400, "Bad Request",
+                                  "{\"error\":\"priority must be api, sampler or batch\"}");
+                return true;
+            }
+            msg->priority = priority;
+        }
+
         if (doc.HasMember("client_ip") && doc["client_ip"].IsString()) {
             msg->client_ip = doc["client_ip"].GetString();
         }
@@ -515,116 +883,356 @@ bool CRxUrlHandlerCaptureApi::handle_status(http_req_head_para* req_head,
         capture_id = snapshot.capture_id;
     }
 
-    std::ostringstream oss;
-    oss << "{";
-    oss << "\"capture_id\":" << snapshot.capture_id;
-    oss << ",\"status\":\"" << capture_status_to_string(snapshot.status) << "\"";
-    oss << ",\"mode\":\"" << capture_mode_to_string(snapshot.capture_mode) << "\"";
-    oss << ",\"key\":\"" << json_escape(snapshot.key) << "\"";
+    rapidjson::StringBuffer buffer;
+    JsonWriter writer(buffer);
+    writer.StartObject();
+    writer.Key("capture_id");
+    writer.Int(snapshot.capture_id);
+    writer.Key("status");
+    writer.String(capture_status_to_string(snapshot.status));
+    writer.Key("mode");
+    writer.String(capture_mode_to_string(snapshot.capture_mode));
+    write_json_string(writer, "key", snapshot.key);
     if (!snapshot.sid.empty()) {
-        oss << ",\"sid\":\"" << json_escape(snapshot.sid) << "\"";
+        write_json_string(writer, "sid", snapshot.sid);
     }
 
     if (!snapshot.iface.empty()) {
-        oss << ",\"iface\":\"" << json_escape(snapshot.iface) << "\"";
+        write_json_string(writer, "iface", snapshot.iface);
     }
     if (!snapshot.proc_name.empty()) {
-        oss << ",\"proc_name\":\"" << json_escape(snapshot.proc_name) << "\"";
+        write_json_string(writer, "proc_name", snapshot.proc_name);
+    }
+    if (!snapshot.category.empty()) {
+        write_json_string(writer, "category", snapshot.category);
     }
     if (!snapshot.filter.empty()) {
-        oss << ",\"filter\":\"" << json_escape(snapshot.filter) << "\"";
+        write_json_string(writer, "filter", snapshot.filter);
     }
     if (snapshot.target_pid > 0) {
-        oss << ",\"pid\":" << snapshot.target_pid;
+        writer.Key("pid");
+        writer.Int(snapshot.target_pid);
     }
     if (snapshot.port_filter > 0) {
-        oss << ",\"port\":" << snapshot.port_filter;
+        writer.Key("port");
+        writer.Int(snapshot.port_filter);
+    }
+    writer.Key("start_time");
+    writer.Int64(snapshot.start_time);
+    writer.Key("end_time");
+    writer.Int64(snapshot.end_time);
+    writer.Key("packets");
+    writer.Uint64(snapshot.packet_count);
+    writer.Key("bytes");
+    writer.Uint64(snapshot.bytes_captured);
+    writer.Key("kernel");
+    writer.StartObject();
+    writer.Key("received");
+    writer.Uint64(snapshot.loss.kernel_received);
+    writer.Key("dropped");
+    writer.Uint64(snapshot.loss.kernel_dropped);
+    writer.Key("if_dropped");
+    writer.Uint64(snapshot.loss.if_dropped);
+    writer.Key("sampled_out");
+    writer.Uint64(snapshot.loss.sampled_out);
+    writer.EndObject();
+    if (!snapshot.loss.rate_actions.empty()) {
+        writer.Key("rate_actions");
+        writer.StartArray();
+        for (size_t i = 0; i < snapshot.loss.rate_actions.size(); ++i) {
+            const std::string& action = snapshot.loss.rate_actions[i];
+            writer.String(action.c_str(), static_cast<rapidjson::SizeType>(action.size()));
+        }
+        writer.EndArray();
     }
-    oss << ",\"start_time\":" << snapshot.start_time;
-    oss << ",\"end_time\":" << snapshot.end_time;
-    oss << ",\"packets\":" << snapshot.packet_count;
-    oss << ",\"bytes\":" << snapshot.bytes_captured;
-    oss << ",\"worker\":" << snapshot.worker_thread_index;
-    oss << ",\"stop_requested\":" << (snapshot.stop_requested ? "true" : "false");
-    oss << ",\"client_ip\":\"" << json_escape(snapshot.client_ip) << "\"";
-    oss << ",\"request_user\":\"" << json_escape(snapshot.request_user) << "\"";
+    writer.Key("worker");
+    writer.Uint(snapshot.worker_thread_index);
+    writer.Key("stop_requested");
+    writer.Bool(snapshot.stop_requested);
+    write_json_string(writer, "client_ip", snapshot.client_ip);
+    write_json_string(writer, "request_user", snapshot.request_user);
 
     if (!snapshot.error_message.empty()) {
-        oss << ",\"error\":\"" << json_escape(snapshot.error_message) << "\"";
+        write_json_string(writer, "error", snapshot.error_message);
     }
     if (!snapshot.captured_files.empty()) {
-        oss << ",\"files\":[";
+        writer.Key("files");
+        writer.StartArray();
         for (size_t i = 0; i < snapshot.captured_files.size(); ++i) {
-            const CaptureFileInfo& info = snapshot.captured_files[i];
-            if (i > 0) {
-                oss << ",";
-            }
-            oss << "{\"path\":\"" << json_escape(info.file_path) << "\"";
-            oss << ",\"size\":" << info.file_size;
-            oss << ",\"segment\":" << info.segment_index;
-            oss << ",\"segments\":" << info.total_segments;
-            oss << ",\"compressed\":" << (info.compressed ? "true" : "false");
-            if (!info.archive_path.empty()) {
-                oss << ",\"archive\":\"" << json_escape(info.archive_path) << "\"";
-            }
-            if (info.compress_finish_ts > 0) {
-                oss << ",\"compressed_at\":" << info.compress_finish_ts;
-            }
-            if (!info.record_path.empty()) {
-                oss << ",\"record\":\"" << json_escape(info.record_path) << "\"";
-            }
-            oss << "}";
+            write_file_json(writer, snapshot.captured_files[i]);
         }
-        oss << "]";
+        writer.EndArray();
     }
     if (!snapshot.archives.empty()) {
-        oss << ",\"archives\":[";
+        writer.Key("archives");
+        writer.StartArray();
         for (size_t i = 0; i < snapshot.archives.size(); ++i) {
             const CaptureArchiveInfo& arc = snapshot.archives[i];
-            if (i > 0) {
-                oss << ",";
-            }
-            oss << "{\"path\":\"" << json_escape(arc.archive_path) << "\"";
-            oss << ",\"size\":" << arc.archive_size;
+            writer.StartObject();
+            write_json_string(writer, "path", arc.archive_path);
+            writer.Key("size");
+            writer.Uint64(arc.archive_size);
             if (arc.compress_finish_ts > 0) {
-                oss << ",\"compressed_at\":" << arc.compress_finish_ts;
+                writer.Key("compressed_at");
+                writer.Int64(arc.compress_finish_ts);
             }
             if (!arc.files.empty()) {
-                oss << ",\"files\":[";
+                writer.Key("files");
+                writer.StartArray();
                 for (size_t j = 0; j < arc.files.size(); ++j) {
-                    const CaptureFileInfo& info = arc.files[j];
-                    if (j > 0) {
-                        oss << ",";
-                    }
-                    oss << "{\"path\":\"" << json_escape(info.file_path) << "\"";
-                    oss << ",\"size\":" << info.file_size;
-                    oss << ",\"segment\":" << info.segment_index;
-                    oss << ",\"segments\":" << info.total_segments;
-                    oss << ",\"compressed\":" << (info.compressed ? "true" : "false");
-                    if (!info.archive_path.empty()) {
-                        oss << ",\"archive\":\"" << json_escape(info.archive_path) << "\"";
-                    }
-                    if (info.compress_finish_ts > 0) {
-                        oss << ",\"compressed_at\":" << info.compress_finish_ts;
-                    }
-                    if (!info.record_path.empty()) {
-                        oss << ",\"record\":\"" << json_escape(info.record_path) << "\"";
-                    }
-                    oss << "}";
+                    write_file_json(writer, arc.files[j]);
                 }
-                oss << "]";
+                writer.EndArray();
             }
-            oss << "}";
+            writer.EndObject();
         }
-        oss << "]";
+        writer.EndArray();
+    }
+
+    SRxStatsSnapshot stats;
+    bool stats_finished = false;
+    if (CRxStatsRegistry::instance()->merged(snapshot.capture_id, 5, stats, &stats_finished)) {
+        std::ostringstream oss;
+        append_stats_json(oss, stats, stats_finished);
+        std::string stats_json = oss.str();
+        writer.Key("stats");
+        writer.RawValue(stats_json.c_str(), stats_json.size(), rapidjson::kObjectType);
     }
 
+    writer.EndObject();
+
+    set_json_response(res_head, send_body, 200, "OK", std::string(buffer.GetString(), buffer.GetSize()));
+    return true;
+}
+
+bool CRxUrlHandlerCaptureApi::handle_stats(http_req_head_para* req_head,
+                                           std::string* recv_body,
+                                           http_res_head_para* res_head,
+                                           std::string* send_body,
+                                           const ObjId& conn_id)
+{
+    (void)recv_body;
+    (void)conn_id;
+
+    std::map<std::string, std::string> params = parse_query_params(req_head->_url_path);
+    int capture_id = 0;
+    std::map<std::string, std::string>::const_iterator it = params.find("id");
+    if (it == params.end()) {
+        it = params.find("capture_id");
+    }
+    if (it != params.end()) {
+        capture_id = std::atoi(it->second.c_str());
+    }
+    if (capture_id <= 0) {
+        set_error_response(res_head, send_body, 400, "Missing capture identifier");
+        return true;
+    }
+
+    size_t top = 20;
+    it = params.find("top");
+    if (it != params.end()) {
+        int requested = std::atoi(it->second.c_str());
+        if (requested > 0) {
+            top = static_cast<size_t>(requested);
+        }
+    }
+    if (top > static_cast<size_t>(CRxStatsAggregator::PUBLISH_TOP)) {
+        top = CRxStatsAggregator::PUBLISH_TOP;
+    }
+
+    SRxStatsSnapshot stats;
+    bool finished = false;
+    if (!CRxStatsRegistry::instance()->merged(capture_id, top, stats, &finished)) {
+        set_error_response(res_head, send_body, 404, "stats_not_found");
+        return true;
+    }
+
+    std::ostringstream oss;
+    oss << "{\"capture_id\":" << capture_id << ",\"stats\":";
+    append_stats_json(oss, stats, finished);
     oss << "}";
 
     set_json_response(res_head, send_body, 200, "OK", oss.str());
     return true;
 }
 
+bool CRxUrlHandlerCaptureApi::handle_list(http_req_head_para* req_head,
+                                          std::string* recv_body,
+                                          http_res_head_para* res_head,
+                                          std::string* send_body,
+                                          const ObjId& conn_id)
+{
+    (void)recv_body;
+    (void)conn_id;
+
+    const size_t default_limit = 50;
+    const size_t max_limit = 500;
+
+    std::map<std::string, std::string> params = parse_query_params(req_head->_url_path);
+    std::map<std::string, std::string>::const_iterator it;
+    TaskQuery query;
+    query.limit = default_limit;
+
+    it = params.find("status");
+    if (it != params.end() && !it->second.empty()) {
+        std::vector<std::string> names = CRxProtocolDispatcher::split_list(it->second);
+        for (size_t i = 0; i < names.size(); ++i) {
+            ECaptureTaskStatus status;
+            if (!parse_capture_status(names[i], status)) {
+                set_error_response(res_head, send_body, 400, "Invalid status: " + names[i]);
+                return true;
+            }
+            query.status_mask |= 1u << status;
+        }
+    }
+    it = params.find("category");
+    if (it != params.end()) {
+        query.category = it->second;
+    }
+    it = params.find("iface");
+    if (it != params.end()) {
+        query.iface = it->second;
+    }
+    it = params.find("proc_name");
+    if (it == params.end()) {
+        it = params.find("proc");
+    }
+    if (it != params.end()) {
+        query.proc_name = it->second;
+    }
+    it = params.find("since");
+    if (it != params.end() && !parse_long_param(it->second, query.since)) {
+        set_error_response(res_head, send_body, 400, "Invalid since");
+        return true;
+    }
+    it = params.find("until");
+    if (it != params.end() && !parse_long_param(it->second, query.until)) {
+        set_error_response(res_head, send_body, 400, "Invalid until");
+        return true;
+    }
+    it = params.find("limit");
+    if (it != params.end()) {
+        long limit = 0;
+        if (!parse_long_param(it->second, limit) || limit == 0) {
+            set_error_response(res_head, send_body, 400, "Invalid limit");
+            return true;
+        }
+        query.limit = static_cast<size_t>(limit) > max_limit ? max_limit : static_cast<size_t>(limit);
+    }
+    it = params.find("cursor");
+    if (it != params.end() && !it->second.empty()) {
+        // "<start_time>-<capture_id>", as returned in next_cursor.
+        size_t dash = it->second.find('-');
+        long cursor_id = 0;
+        if (dash == std::string::npos
+            || !parse_long_param(it->second.substr(0, dash), query.cursor_start)
+            || !parse_long_param(it->second.substr(dash + 1), cursor_id)
+            || cursor_id > INT_MAX) {
+            set_error_response(res_head, send_body, 400, "Invalid cursor");
+            return true;
+        }
+        query.cursor_id = static_cast<int>(cursor_id);
+        query.has_cursor = true;
+    }
+
+    CRxProcData* pdata = CRxProcData::instance();
+    if (!pdata) {
+        set_error_response(res_head, send_body, 500, "Internal error");
+        return true;
+    }
+
+    CRxSafeTaskMgr& task_mgr = pdata->capture_task_mgr();
+    TaskQueryResult result;
+    task_mgr.query_tasks(query, result);
+
+    long now = static_cast<long>(time(NULL));
+    rapidjson::StringBuffer buffer;
+    JsonWriter writer(buffer);
+    writer.StartObject();
+    writer.Key("captures");
+    writer.StartArray();
+    size_t count = 0;
+    for (size_t i = 0; i < result.capture_ids.size(); ++i) {
+        TaskSnapshot snapshot;
+        if (!task_mgr.query_task(result.capture_ids[i], snapshot)) {
+            continue;
+        }
+        ++count;
+
+        long elapsed = 0;
+        if (snapshot.start_time > 0) {
+            long end = TaskTable::is_active_status(snapshot.status) ? now : snapshot.end_time;
+            elapsed = end > snapshot.start_time ? end - snapshot.start_time : 0;
+        }
+
+        writer.StartObject();
+        writer.Key("capture_id");
+        writer.Int(snapshot.capture_id);
+        if (!snapshot.sid.empty()) {
+            write_json_string(writer, "sid", snapshot.sid);
+        }
+        writer.Key("status");
+        writer.String(capture_status_to_string(snapshot.status));
+        writer.Key("mode");
+        writer.String(capture_mode_to_string(snapshot.capture_mode));
+        if (!snapshot.category.empty()) {
+            write_json_string(writer, "category", snapshot.category);
+        }
+        if (!snapshot.iface.empty()) {
+            write_json_string(writer, "iface", snapshot.iface);
+        }
+        if (!snapshot.proc_name.empty()) {
+            write_json_string(writer, "proc_name", snapshot.proc_name);
+        }
+        if (snapshot.target_pid > 0) {
+            writer.Key("pid");
+            writer.Int(snapshot.target_pid);
+        }
+        if (snapshot.port_filter > 0) {
+            writer.Key("port");
+            writer.Int(snapshot.port_filter);
+        }
+        if (!snapshot.filter.empty()) {
+            write_json_string(writer, "filter", snapshot.filter);
+        }
+        writer.Key("start_time");
+        writer.Int64(snapshot.start_time);
+        writer.Key("end_time");
+        writer.Int64(snapshot.end_time);
+        writer.Key("duration");
+        writer.Int(snapshot.duration_sec);
+        writer.Key("elapsed");
+        writer.Int64(elapsed);
+        writer.Key("packets");
+        writer.Uint64(snapshot.packet_count);
+        writer.Key("bytes");
+        writer.Uint64(snapshot.bytes_captured);
+        writer.Key("files");
+        writer.Uint64(snapshot.captured_files.size());
+        writer.Key("archives");
+        writer.Uint64(snapshot.archives.size());
+        if (!snapshot.error_message.empty()) {
+            write_json_string(writer, "error", snapshot.error_message);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.Key("count");
+    writer.Uint64(count);
+    writer.Key("next_cursor");
+    if (result.has_more) {
+        char cursor[48];
+        snprintf(cursor, sizeof(cursor), "%ld-%d", result.next_start, result.next_id);
+        writer.String(cursor);
+    } else {
+        writer.Null();
+    }
+    writer.EndObject();
+
+    set_json_response(res_head, send_body, 200, "OK", std::string(buffer.GetString(), buffer.GetSize()));
+    return true;
+}
+
 bool CRxUrlHandlerCaptureApi::send_to_capture_manager(shared_ptr<normal_msg> msg,
                                                       http_res_head_para* res_head,
                                                       std::string* send_body,
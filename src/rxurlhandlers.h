@@ -33,6 +33,17 @@ private:
     std::string body_;
 };
 
+class CRxUrlHandlerMetrics : public CRxUrlHandler {
+public:
+    CRxUrlHandlerMetrics();
+
+    virtual bool perform(http_req_head_para* req_head,
+                         std::string* recv_body,
+                         http_res_head_para* res_head,
+                         std::string* send_body,
+                         const ObjId& conn_id);
+};
+
 class CRxUrlHandlerCaptureApi : public CRxUrlHandler {
 public:
     CRxUrlHandlerCaptureApi();
@@ -62,6 +73,18 @@ private:
                        std::string* send_body,
                        const ObjId& conn_id);
 
+    bool handle_stats(http_req_head_para* req_head,
+                      std::string* recv_body,
+                      http_res_head_para* res_head,
+                      std::string* send_body,
+                      const ObjId& conn_id);
+
+    bool handle_list(http_req_head_para* req_head,
+                     std::string* recv_body,
+                     http_res_head_para* res_head,
+                     std::string* send_body,
+                     const ObjId& conn_id);
+
     bool send_to_capture_manager(shared_ptr<normal_msg> msg,
                                  http_res_head_para* res_head,
                                  std::string* send_body,
@@ -0,0 +1,234 @@
+#ifndef BENCH_PCAP_H
+#define BENCH_PCAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define BENCH_PCAP_MAGIC      0xa1b2c3d4u
+#define BENCH_PCAP_LINKTYPE   1u
+#define BENCH_PCAP_SNAPLEN    65535u
+#define BENCH_FRAME_MAX       2048u
+
+typedef struct {
+    uint8_t* data;
+    uint32_t caplen;
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+} BenchFrame;
+
+typedef struct {
+    BenchFrame* frames;
+    uint32_t count;
+    uint32_t linktype;
+} BenchPcap;
+
+static inline void bench_put_u16_be(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void bench_put_u32_le(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t bench_get_u32(const uint8_t* p, bool swapped)
+{
+    if (swapped) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static inline bool bench_pcap_write_header(FILE* f)
+{
+    uint8_t hdr[24];
+    bench_put_u32_le(hdr, BENCH_PCAP_MAGIC);
+    hdr[4] = 2; hdr[5] = 0;
+    hdr[6] = 4; hdr[7] = 0;
+    bench_put_u32_le(hdr + 8, 0);
+    bench_put_u32_le(hdr + 12, 0);
+    bench_put_u32_le(hdr + 16, BENCH_PCAP_SNAPLEN);
+    bench_put_u32_le(hdr + 20, BENCH_PCAP_LINKTYPE);
+    return fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr);
+}
+
+static inline bool bench_pcap_write_packet(FILE* f, uint32_t ts_sec, uint32_t ts_usec,
+                                           const uint8_t* data, uint32_t len)
+{
+    uint8_t rec[16];
+    bench_put_u32_le(rec, ts_sec);
+    bench_put_u32_le(rec + 4, ts_usec);
+    bench_put_u32_le(rec + 8, len);
+    bench_put_u32_le(rec + 12, len);
+    if (fwrite(rec, 1, sizeof(rec), f) != sizeof(rec)) {
+        return false;
+    }
+    return fwrite(data, 1, len, f) == len;
+}
+
+
+static inline uint32_t bench_build_frame(uint8_t* frame, uint32_t frame_size,
+                                         bool tcp, uint32_t src_ip, uint32_t dst_ip,
+                                         uint16_t src_port, uint16_t dst_port,
+                                         const uint8_t* payload, uint32_t payload_len)
+{
+    uint32_t l4_len = tcp ? 20u : 8u;
+    uint32_t total = 14u + 20u + l4_len + payload_len;
+    if (total > frame_size) {
+        return 0;
+    }
+    memset(frame, 0, 14u + 20u + l4_len);
+
+    frame[0] = 0x02; frame[5] = 0x01;
+    frame[6] = 0x02; frame[11] = 0x02;
+    bench_put_u16_be(frame + 12, 0x0800);
+
+    uint8_t* ip = frame + 14;
+    ip[0] = 0x45;
+    bench_put_u16_be(ip + 2, (uint16_t)(20u + l4_len + payload_len));
+    ip[8] = 64;
+    ip[9] = tcp ? 6 : 17;
+    ip[12] = (uint8_t)(src_ip >> 24); ip[13] = (uint8_t)(src_ip >> 16);
+    ip[14] = (uint8_t)(src_ip >> 8);  ip[15] = (uint8_t)src_ip;
+    ip[16] = (uint8_t)(dst_ip >> 24); ip[17] = (uint8_t)(dst_ip >> 16);
+    ip[18] = (uint8_t)(dst_ip >> 8);  ip[19] = (uint8_t)dst_ip;
+
+    uint8_t* l4 = ip + 20;
+    bench_put_u16_be(l4, src_port);
+    bench_put_u16_be(l4 + 2, dst_port);
+    if (tcp) {
+        l4[12] = 0x50;
+        l4[13] = 0x18;
+        bench_put_u16_be(l4 + 14, 65535);
+    } else {
+        bench_put_u16_be(l4 + 4, (uint16_t)(8u + payload_len));
+    }
+
+    if (payload_len > 0) {
+        memcpy(l4 + l4_len, payload, payload_len);
+    }
+    return total;
+}
+
+
+static inline bool bench_frame_payload(const uint8_t* frame, uint32_t len,
+                                       uint32_t* app_off, uint32_t* app_len,
+                                       uint16_t* src_port, uint16_t* dst_port)
+{
+    if (len < 14u + 20u) {
+        return false;
+    }
+    if (frame[12] != 0x08 || frame[13] != 0x00) {
+        return false;
+    }
+    const uint8_t* ip = frame + 14;
+    uint32_t ihl = (uint32_t)(ip[0] & 0x0F) * 4u;
+    if (ihl < 20u || len < 14u + ihl + 8u) {
+        return false;
+    }
+    const uint8_t* l4 = ip + ihl;
+    uint32_t l4_len = 0;
+    if (ip[9] == 6) {
+        if (len < 14u + ihl + 20u) {
+            return false;
+        }
+        l4_len = (uint32_t)((l4[12] >> 4) & 0x0F) * 4u;
+    } else if (ip[9] == 17) {
+        l4_len = 8u;
+    } else {
+        return false;
+    }
+    uint32_t off = 14u + ihl + l4_len;
+    if (off >= len) {
+        return false;
+    }
+    *app_off = off;
+    *app_len = len - off;
+    *src_port = (uint16_t)((l4[0] << 8) | l4[1]);
+    *dst_port = (uint16_t)((l4[2] << 8) | l4[3]);
+    return true;
+}
+
+static inline void bench_pcap_free(BenchPcap* pcap)
+{
+    if (!pcap) {
+        return;
+    }
+    for (uint32_t i = 0; i < pcap->count; i++) {
+        free(pcap->frames[i].data);
+    }
+    free(pcap->frames);
+    pcap->frames = NULL;
+    pcap->count = 0;
+}
+
+
+static inline bool bench_pcap_load(const char* path, BenchPcap* out)
+{
+    memset(out, 0, sizeof(*out));
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    uint8_t hdr[24];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        fclose(f);
+        return false;
+    }
+    bool swapped = false;
+    uint32_t magic = bench_get_u32(hdr, false);
+    if (magic == 0xd4c3b2a1u) {
+        swapped = true;
+    } else if (magic != BENCH_PCAP_MAGIC && magic != 0xa1b23c4du) {
+        fclose(f);
+        return false;
+    }
+    out->linktype = bench_get_u32(hdr + 20, swapped);
+
+    uint32_t cap = 256;
+    out->frames = (BenchFrame*)calloc(cap, sizeof(BenchFrame));
+    if (!out->frames) {
+        fclose(f);
+        return false;
+    }
+
+    uint8_t rec[16];
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        uint32_t caplen = bench_get_u32(rec + 8, swapped);
+        if (caplen == 0 || caplen > BENCH_PCAP_SNAPLEN) {
+            break;
+        }
+        if (out->count == cap) {
+            BenchFrame* grown = (BenchFrame*)realloc(out->frames, cap * 2 * sizeof(BenchFrame));
+            if (!grown) {
+                break;
+            }
+            out->frames = grown;
+            cap *= 2;
+        }
+        uint8_t* data = (uint8_t*)malloc(caplen);
+        if (!data || fread(data, 1, caplen, f) != caplen) {
+            free(data);
+            break;
+        }
+        BenchFrame* fr = &out->frames[out->count++];
+        fr->data = data;
+        fr->caplen = caplen;
+        fr->ts_sec = bench_get_u32(rec, swapped);
+        fr->ts_usec = bench_get_u32(rec + 4, swapped);
+    }
+    fclose(f);
+    return out->count > 0;
+}
+
+#endif
@@ -0,0 +1,1991 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "../src/pdef/parser.h"
+#include "../src/runtime/protocol.h"
+#include "../src/runtime/executor.h"
+#include "../src/runtime/program.h"
+#include "../src/rxlockfreequeue.h"
+#include "../src/rxstorageutils.h"
+#include "../src/rxsafetaskmgr.h"
+#include "../src/rxcapturesession.h"
+#include "../src/rxflowcache.h"
+#include "../src/rxpacketdecoder.h"
+#include "../src/rxprotocoldispatcher.h"
+#include "../src/rxstatsaggregator.h"
+#include "../src/rxtcpreassembly.h"
+#include "../src/rxcapturescheduler.h"
+#include "../src/rxcaptureprogress.h"
+#include "../src/rxarchive.h"
+#include "../src/rxcompresspool.h"
+#include "../src/rxtaskjournal.h"
+#include "legacy_core.h"
+#include "bench_pcap.h"
+
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double ops_per_sec;
+    double mb_per_sec;
+    std::string note;
+};
+
+static std::vector<BenchResult> g_results;
+static double g_scale = 1.0;
+static const char* g_filter = NULL;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t scaled(uint64_t n)
+{
+    uint64_t v = (uint64_t)((double)n * g_scale);
+    return v > 0 ? v : 1;
+}
+
+static bool selected(const std::string& name)
+{
+    return !g_filter || name.find(g_filter) != std::string::npos;
+}
+
+static void record(const std::string& name, uint64_t iterations, uint64_t elapsed_ns,
+                   uint64_t bytes, const std::string& note)
+{
+    BenchResult r;
+    r.name = name;
+    r.iterations = iterations;
+    r.ns_per_op = iterations ? (double)elapsed_ns / (double)iterations : 0.0;
+    r.ops_per_sec = elapsed_ns ? (double)iterations * 1e9 / (double)elapsed_ns : 0.0;
+    r.mb_per_sec = (elapsed_ns && bytes) ? (double)bytes * 1e9 / (double)elapsed_ns / (1024.0 * 1024.0) : 0.0;
+    r.note = note;
+    g_results.push_back(r);
+    printf("%-40s %12llu ops %10.1f ns/op %12.0f ops/s", name.c_str(),
+           (unsigned long long)iterations, r.ns_per_op, r.ops_per_sec);
+    if (r.mb_per_sec > 0.0) {
+        printf(" %8.1f MB/s", r.mb_per_sec);
+    }
+    if (!note.empty()) {
+        printf("  (%s)", note.c_str());
+    }
+    printf("\n");
+}
+
+static void record_skip(const std::string& name, const std::string& reason)
+{
+    BenchResult r;
+    r.name = name;
+    r.iterations = 0;
+    r.ns_per_op = 0.0;
+    r.ops_per_sec = 0.0;
+    r.mb_per_sec = 0.0;
+    r.note = "skipped: " + reason;
+    g_results.push_back(r);
+    printf("%-40s skipped (%s)\n", name.c_str(), reason.c_str());
+}
+
+static std::string json_escape(const std::string& in)
+{
+    std::string out;
+    for (size_t i = 0; i < in.size(); i++) {
+        char c = in[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static bool write_json(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+    char host[128];
+    if (gethostname(host, sizeof(host)) != 0) {
+        snprintf(host, sizeof(host), "unknown");
+    }
+    host[sizeof(host) - 1] = '\0';
+    fprintf(f, "{\n  \"suite\": \"rxtracenetcap\",\n  \"timestamp\": %ld,\n  \"host\": \"%s\",\n  \"scale\": %.3f,\n  \"results\": [\n",
+            (long)time(NULL), json_escape(host).c_str(), g_scale);
+    for (size_t i = 0; i < g_results.size(); i++) {
+        const BenchResult& r = g_results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, "
+                   "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, \"note\": \"%s\"}%s\n",
+                json_escape(r.name).c_str(), (unsigned long long)r.iterations,
+                r.ns_per_op, r.ops_per_sec, r.mb_per_sec, json_escape(r.note).c_str(),
+                i + 1 < g_results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+
+static bool read_text(const std::string& path, std::string& out)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.append(buf, n);
+    }
+    fclose(f);
+    return true;
+}
+
+static std::vector<std::string> list_dir(const std::string& dir, const char* suffix)
+{
+    std::vector<std::string> out;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return out;
+    }
+    struct dirent* ent;
+    size_t slen = strlen(suffix);
+    while ((ent = readdir(d)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len > slen && strcmp(ent->d_name + len - slen, suffix) == 0) {
+            out.push_back(dir + "/" + ent->d_name);
+        }
+    }
+    closedir(d);
+    for (size_t i = 1; i < out.size(); i++) {
+        for (size_t j = i; j > 0 && out[j] < out[j - 1]; j--) {
+            out[j].swap(out[j - 1]);
+        }
+    }
+    return out;
+}
+
+static std::string base_name(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+
+static const char* kFixedPdef =
+    "@protocol { name = \"BenchFixed\"; endian = big; }\n"
+    "@const { MAGIC = 0x12345678; }\n"
+    "Header { uint32 magic; uint8 version; uint8 msg_type; uint16 flags; uint32 session; }\n"
+    "@filter Login { magic = MAGIC; version = 1; msg_type = 3; }\n";
+
+static const char* kSlidingPdef =
+    "@protocol { name = \"BenchSliding\"; endian = big; }\n"
+    "@const { MAGIC = 0xABCD; }\n"
+    "Header { uint16 magic; uint16 length; }\n"
+    "@filter Anywhere { sliding = true; sliding_max = 256; magic = MAGIC; length <= 1500; }\n";
+
+static const char* kAutoPdef =
+    "@protocol { name = \"BenchAuto\"; endian = auto; }\n"
+    "@const { MAGIC = 0x12345678; }\n"
+    "Header { uint32 magic; uint16 kind; uint16 length; }\n"
+    "@filter Magic { magic = MAGIC; kind >= 1; kind <= 16; }\n";
+
+static const uint32_t kPayloadCount = 1024;
+static const uint32_t kPayloadLen = 128;
+
+static void fill_payloads(std::vector<uint8_t>& buf, const ProtocolDef* proto, bool little)
+{
+    buf.resize(kPayloadCount * kPayloadLen);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < buf.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+    if (!proto || proto->filter_count == 0) {
+        return;
+    }
+    const FilterRule* rule = &proto->filters[0];
+    for (uint32_t i = 0; i < kPayloadCount; i += 4) {
+        uint8_t* p = &buf[i * kPayloadLen];
+        uint32_t shift = rule->sliding_window ? (i * 7) % 96 : 0;
+        const Instruction* code = little && rule->bytecode_le ? rule->bytecode_le : rule->bytecode;
+        uint32_t code_len = little && rule->bytecode_le ? rule->bytecode_le_len : rule->bytecode_len;
+        uint32_t width = 0;
+        bool le = false;
+        uint32_t off = 0;
+        for (uint32_t ip = 0; ip < code_len; ip++) {
+            const Instruction* ins = &code[ip];
+            switch (ins->opcode) {
+                case OP_LOAD_U8: width = 1; le = false; off = ins->offset; break;
+                case OP_LOAD_U16_BE: width = 2; le = false; off = ins->offset; break;
+                case OP_LOAD_U16_LE: width = 2; le = true; off = ins->offset; break;
+                case OP_LOAD_U32_BE: width = 4; le = false; off = ins->offset; break;
+                case OP_LOAD_U32_LE: width = 4; le = true; off = ins->offset; break;
+                case OP_CMP_EQ:
+                case OP_CMP_GE:
+                case OP_CMP_LE:
+                    if (width && shift + off + width <= kPayloadLen) {
+                        for (uint32_t b = 0; b < width; b++) {
+                            uint32_t sh = le ? b * 8 : (width - 1 - b) * 8;
+                            p[shift + off + b] = (uint8_t)(ins->operand >> sh);
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+
+static void bench_filters()
+{
+    struct Case {
+        const char* name;
+        const char* source;
+        bool little_payloads;
+    };
+    const Case cases[] = {
+        { "fixed", kFixedPdef, false },
+        { "sliding", kSlidingPdef, false },
+        { "auto_endian", kAutoPdef, true },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        char errmsg[256];
+        ProtocolDef* proto = pdef_parse_string(cases[c].source, errmsg, sizeof(errmsg));
+        std::string bc_name = std::string("execute_bytecode/") + cases[c].name;
+        std::string fm_name = std::string("packet_filter_match/") + cases[c].name;
+        if (!proto) {
+            record_skip(fm_name, errmsg);
+            continue;
+        }
+        std::vector<uint8_t> payloads;
+        fill_payloads(payloads, proto, cases[c].little_payloads);
+        const FilterRule* rule = &proto->filters[0];
+
+        if (selected(bc_name)) {
+            uint64_t iters = scaled(5000000);
+            uint64_t hits = 0;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                const uint8_t* p = &payloads[(n % kPayloadCount) * kPayloadLen];
+                hits += execute_bytecode(p, kPayloadLen, rule->bytecode, rule->bytecode_len) ? 1 : 0;
+            }
+            uint64_t elapsed = now_ns() - start;
+            char note[64];
+            snprintf(note, sizeof(note), "match=%.1f%%", 100.0 * (double)hits / (double)iters);
+            record(bc_name, iters, elapsed, 0, note);
+        }
+
+        if (selected(fm_name)) {
+            uint64_t iters = scaled(cases[c].source == kSlidingPdef ? 500000 : 5000000);
+            uint64_t hits = 0;
+            volatile int endian_state = ENDIAN_TYPE_UNKNOWN;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                const uint8_t* p = &payloads[(n % kPayloadCount) * kPayloadLen];
+                hits += packet_filter_match_state(p, kPayloadLen, proto, &endian_state) ? 1 : 0;
+            }
+            uint64_t elapsed = now_ns() - start;
+            char note[64];
+            snprintf(note, sizeof(note), "match=%.1f%%", 100.0 * (double)hits / (double)iters);
+            record(fm_name, iters, elapsed, 0, note);
+        }
+        protocol_free(proto);
+    }
+}
+
+
+static void bench_protocols(const std::string& pdef_dir, const std::string& pcap_dir)
+{
+    std::vector<std::string> files = list_dir(pdef_dir, ".pdef");
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string proto_name = base_name(files[i]);
+        std::string source;
+        if (!read_text(files[i], source)) {
+            continue;
+        }
+
+        std::string parse_name = "pdef_parse_string/" + proto_name;
+        char errmsg[512];
+        if (selected(parse_name)) {
+            uint64_t iters = scaled(2000);
+            uint64_t ok = 0;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                ProtocolDef* p = pdef_parse_string(source.c_str(), errmsg, sizeof(errmsg));
+                if (p) {
+                    ok++;
+                    protocol_free(p);
+                }
+            }
+            uint64_t elapsed = now_ns() - start;
+            if (ok == 0) {
+                record_skip(parse_name, errmsg);
+            } else {
+                record(parse_name, iters, elapsed, (uint64_t)source.size() * iters, "");
+            }
+        }
+
+        std::string pcap_name = "pcap_filter/" + proto_name;
+        if (!selected(pcap_name)) {
+            continue;
+        }
+        ProtocolDef* proto = pdef_parse_string(source.c_str(), errmsg, sizeof(errmsg));
+        if (!proto) {
+            record_skip(pcap_name, errmsg);
+            continue;
+        }
+        BenchPcap pcap;
+        std::string pcap_path = pcap_dir + "/" + proto_name + ".pcap";
+        if (!bench_pcap_load(pcap_path.c_str(), &pcap)) {
+            record_skip(pcap_name, "missing " + pcap_path);
+            protocol_free(proto);
+            continue;
+        }
+
+        uint64_t rounds = scaled(200);
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t hits = 0;
+        volatile int endian_state = ENDIAN_TYPE_UNKNOWN;
+        uint64_t start = now_ns();
+        for (uint64_t r = 0; r < rounds; r++) {
+            for (uint32_t k = 0; k < pcap.count; k++) {
+                const BenchFrame* fr = &pcap.frames[k];
+                uint32_t off = 0;
+                uint32_t len = 0;
+                uint16_t sport = 0;
+                uint16_t dport = 0;
+                packets++;
+                bytes += fr->caplen;
+                if (!bench_frame_payload(fr->data, fr->caplen, &off, &len, &sport, &dport)) {
+                    continue;
+                }
+                hits += packet_filter_match_state(fr->data + off, len, proto, &endian_state) ? 1 : 0;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[96];
+        snprintf(note, sizeof(note), "frames=%u match=%.1f%%", pcap.count,
+                 packets ? 100.0 * (double)hits / (double)packets : 0.0);
+        record(pcap_name, packets, elapsed, bytes, note);
+
+        std::string flow_name = "pcap_flow_filter/" + proto_name;
+        if (selected(flow_name)) {
+            CRxFlowCache cache(1024);
+            CRxPacketDecoder decoder((int)pcap.linktype);
+            packets = 0;
+            hits = 0;
+            unsigned long lookups = 0;
+            unsigned long cache_hits = 0;
+            endian_state = ENDIAN_TYPE_UNKNOWN;
+            start = now_ns();
+            for (uint64_t r = 0; r < rounds; r++) {
+                cache.clear();
+                for (uint32_t k = 0; k < pcap.count; k++) {
+                    const BenchFrame* fr = &pcap.frames[k];
+                    SRxDecodedPacket pkt;
+                    packets++;
+                    if (!decoder.decode(fr->data, fr->caplen, pkt) || pkt.payload_len == 0) {
+                        continue;
+                    }
+                    SRxFlowKey key = CRxPacketDecoder::flow_key(pkt);
+                    SRxFlowEntry* flow = cache.lookup(key, fr->ts_sec);
+                    bool m;
+                    if (flow->verdict == RX_FLOW_MATCHED || flow->verdict == RX_FLOW_REJECTED) {
+                        m = flow->verdict == RX_FLOW_MATCHED;
+                    } else {
+                        m = packet_filter_match_state(fr->data + pkt.payload_offset, pkt.payload_len, proto, &endian_state);
+                        cache.resolve(flow, m);
+                    }
+                    hits += m ? 1 : 0;
+                }
+                lookups += cache.stats().lookups;
+                cache_hits += cache.stats().hits;
+            }
+            elapsed = now_ns() - start;
+            snprintf(note, sizeof(note), "match=%.1f%% cache_hit=%.1f%%",
+                     packets ? 100.0 * (double)hits / (double)packets : 0.0,
+                     lookups ? 100.0 * (double)cache_hits / (double)lookups : 0.0);
+            record(flow_name, packets, elapsed, bytes, note);
+        }
+        bench_pcap_free(&pcap);
+        protocol_free(proto);
+    }
+}
+
+
+static void bench_dispatch(const std::string& pdef_dir, const std::string& pcap_dir)
+{
+    if (!selected("dispatch/ungated") && !selected("dispatch/port_indexed")) {
+        return;
+    }
+    std::vector<ProtocolDef*> protos;
+    std::vector<BenchPcap> pcaps;
+    std::vector<int> pcap_owner;
+    std::vector<std::string> files = list_dir(pdef_dir, ".pdef");
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string source;
+        char errmsg[512];
+        if (!read_text(files[i], source)) {
+            continue;
+        }
+        ProtocolDef* proto = pdef_parse_string(source.c_str(), errmsg, sizeof(errmsg));
+        if (!proto) {
+            continue;
+        }
+        protos.push_back(proto);
+        BenchPcap pcap;
+        std::string pcap_path = pcap_dir + "/" + base_name(files[i]) + ".pcap";
+        if (bench_pcap_load(pcap_path.c_str(), &pcap)) {
+            pcaps.push_back(pcap);
+            pcap_owner.push_back((int)protos.size() - 1);
+        }
+    }
+
+    std::vector<SRxDecodedPacket> pkts;
+    std::vector<const uint8_t*> frames;
+    std::vector<int> owners;
+    for (size_t i = 0; i < pcaps.size(); i++) {
+        CRxPacketDecoder decoder((int)pcaps[i].linktype);
+        for (uint32_t k = 0; k < pcaps[i].count; k++) {
+            SRxDecodedPacket pkt;
+            if (decoder.decode(pcaps[i].frames[k].data, pcaps[i].frames[k].caplen, pkt) && pkt.payload_len > 0) {
+                pkts.push_back(pkt);
+                frames.push_back(pcaps[i].frames[k].data);
+                owners.push_back(pcap_owner[i]);
+            }
+        }
+    }
+
+    for (int gated = 0; gated < 2; gated++) {
+        std::string name = gated ? "dispatch/port_indexed" : "dispatch/ungated";
+        if (!selected(name)) {
+            continue;
+        }
+        if (protos.size() < 2 || pkts.empty()) {
+            record_skip(name, "need at least two PDEFs and sample pcaps");
+            continue;
+        }
+        CRxProtocolDispatcher dispatcher;
+        for (size_t i = 0; i < protos.size(); i++) {
+            dispatcher.add(protos[i]);
+        }
+        dispatcher.build(gated != 0);
+
+        uint64_t rounds = scaled(200);
+        uint64_t packets = 0;
+        uint64_t hits = 0;
+        uint64_t misrouted = 0;
+        uint64_t start = now_ns();
+        for (uint64_t r = 0; r < rounds; r++) {
+            for (size_t k = 0; k < pkts.size(); k++) {
+                const SRxDecodedPacket& pkt = pkts[k];
+                packets++;
+                int m = dispatcher.match(frames[k] + pkt.payload_offset, pkt.payload_len, pkt.src_port, pkt.dst_port);
+                if (m != CRxProtocolDispatcher::NO_MATCH) {
+                    hits++;
+                    misrouted += m != owners[k] ? 1 : 0;
+                }
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        const CRxProtocolDispatcher::Stats& ds = dispatcher.stats();
+        char note[128];
+        snprintf(note, sizeof(note), "protos=%zu match=%.1f%% misrouted=%.1f%% evals/pkt=%.2f",
+                 protos.size(), packets ? 100.0 * (double)hits / (double)packets : 0.0,
+                 packets ? 100.0 * (double)misrouted / (double)packets : 0.0,
+                 packets ? (double)(ds.port_evaluations + ds.fallback_evaluations) / (double)packets : 0.0);
+        record(name, packets, elapsed, 0, note);
+    }
+
+    for (size_t i = 0; i < pcaps.size(); i++) {
+        bench_pcap_free(&pcaps[i]);
+    }
+    for (size_t i = 0; i < protos.size(); i++) {
+        protocol_free(protos[i]);
+    }
+}
+
+
+static bool count_rule(const uint8_t* packet, uint32_t len, const ProtocolDef* proto,
+                       const FilterRule* rule, uint64_t* executed)
+{
+    uint32_t n = 0;
+    bool m = false;
+    if (proto->endian_mode != ENDIAN_MODE_LITTLE || !rule->bytecode_le) {
+        m = execute_bytecode_count(packet, len, rule->bytecode, rule->bytecode_len, &n);
+        *executed += n;
+    }
+    if (!m && proto->endian_mode != ENDIAN_MODE_BIG && rule->bytecode_le) {
+        m = execute_bytecode_count(packet, len, rule->bytecode_le, rule->bytecode_le_len, &n);
+        *executed += n;
+    }
+    return m;
+}
+
+static bool count_match(const uint8_t* packet, uint32_t len, const ProtocolDef* proto, uint64_t* executed)
+{
+    for (uint32_t i = 0; i < proto->filter_count; i++) {
+        const FilterRule* rule = &proto->filters[i];
+        if (!rule->sliding_window) {
+            if (count_rule(packet, len, proto, rule, executed)) {
+                return true;
+            }
+            continue;
+        }
+        uint32_t limit = len;
+        if (rule->sliding_max_offset > 0 && rule->sliding_max_offset < len) {
+            limit = rule->sliding_max_offset;
+        }
+        for (uint32_t off = 0; off < limit && len - off >= rule->min_packet_size; off++) {
+            if (count_rule(packet + off, len - off, proto, rule, executed)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static const char* kOptPdef =
+    "@protocol { name = \"BenchOpt\"; endian = big; }\n"
+    "@const { MAGIC = 0x12345678; }\n"
+    "Header { uint32 magic; uint8 version; uint8 msg_type; uint16 flags; uint32 session; }\n"
+    "@filter Login { session >= 1; session <= 0x00FFFFFF; version in [1, 2];"
+    " flags & 0x8000 = 0x0000; msg_type = 3; magic = MAGIC; }\n";
+
+static void bench_parse_flags_pair(const std::string& base_name, unsigned base_flags,
+                                   const std::string& new_name, const std::string& source,
+                                   const std::vector<const uint8_t*>& data, const std::vector<uint32_t>& lens)
+{
+    for (int variant = 0; variant < 2; variant++) {
+        const std::string& name = variant ? new_name : base_name;
+        if (!selected(name)) {
+            continue;
+        }
+        char errmsg[512];
+        ProtocolDef* proto = pdef_parse_string_ex(source.c_str(), variant ? 0 : base_flags,
+                                                  errmsg, sizeof(errmsg));
+        if (!proto) {
+            record_skip(name, errmsg);
+            continue;
+        }
+        uint32_t code_len = 0;
+        for (uint32_t r = 0; r < proto->filter_count; r++) {
+            code_len += proto->filters[r].bytecode_len;
+        }
+        uint64_t executed = 0;
+        for (size_t k = 0; k < data.size(); k++) {
+            count_match(data[k], lens[k], proto, &executed);
+        }
+
+        uint64_t iters = scaled(2000000);
+        uint64_t hits = 0;
+        volatile int endian_state = ENDIAN_TYPE_UNKNOWN;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            size_t k = n % data.size();
+            hits += packet_filter_match_state(data[k], lens[k], proto, &endian_state) ? 1 : 0;
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[128];
+        snprintf(note, sizeof(note), "code=%u insns/pkt=%.1f match=%.1f%%", code_len,
+                 (double)executed / (double)data.size(), 100.0 * (double)hits / (double)iters);
+        record(name, iters, elapsed, 0, note);
+        protocol_free(proto);
+    }
+}
+
+static void bench_optimizer(const std::string& pdef_dir, const std::string& pcap_dir)
+{
+    if (selected("pdef_opt/synthetic/naive") || selected("pdef_opt/synthetic/optimized")) {
+        char errmsg[256];
+        ProtocolDef* proto = pdef_parse_string_ex(kOptPdef, PDEF_PARSE_NO_OPTIMIZE, errmsg, sizeof(errmsg));
+        if (!proto) {
+            record_skip("pdef_opt/synthetic/naive", errmsg);
+        } else {
+            std::vector<uint8_t> payloads;
+            fill_payloads(payloads, proto, false);
+            protocol_free(proto);
+            std::vector<const uint8_t*> data;
+            std::vector<uint32_t> lens;
+            for (uint32_t i = 0; i < kPayloadCount; i++) {
+                data.push_back(&payloads[i * kPayloadLen]);
+                lens.push_back(16 + i % 3);
+            }
+            bench_parse_flags_pair("pdef_opt/synthetic/naive", PDEF_PARSE_NO_OPTIMIZE,
+                                   "pdef_opt/synthetic/optimized", kOptPdef, data, lens);
+        }
+    }
+
+    std::vector<std::string> files = list_dir(pdef_dir, ".pdef");
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string prefix = "pdef_opt/" + base_name(files[i]);
+        if (!selected(prefix + "/naive") && !selected(prefix + "/optimized")) {
+            continue;
+        }
+        std::string source;
+        if (!read_text(files[i], source)) {
+            continue;
+        }
+        BenchPcap pcap;
+        std::string pcap_path = pcap_dir + "/" + base_name(files[i]) + ".pcap";
+        if (!bench_pcap_load(pcap_path.c_str(), &pcap)) {
+            record_skip(prefix + "/naive", "missing " + pcap_path);
+            continue;
+        }
+        std::vector<const uint8_t*> data;
+        std::vector<uint32_t> lens;
+        for (uint32_t k = 0; k < pcap.count; k++) {
+            uint32_t off = 0;
+            uint32_t len = 0;
+            uint16_t sport = 0;
+            uint16_t dport = 0;
+            if (bench_frame_payload(pcap.frames[k].data, pcap.frames[k].caplen, &off, &len, &sport, &dport)) {
+                data.push_back(pcap.frames[k].data + off);
+                lens.push_back(len);
+            }
+        }
+        if (data.empty()) {
+            record_skip(prefix + "/naive", "no payloads in " + pcap_path);
+        } else {
+            bench_parse_flags_pair(prefix + "/naive", PDEF_PARSE_NO_OPTIMIZE,
+                                   prefix + "/optimized", source, data, lens);
+        }
+        bench_pcap_free(&pcap);
+    }
+}
+
+
+static std::string set_list(uint32_t count, uint32_t first, uint32_t step)
+{
+    std::string out;
+    char buf[32];
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(buf, sizeof(buf), "%s%u", i ? ", " : "", first + i * step);
+        out += buf;
+    }
+    return out;
+}
+
+static void bench_sets()
+{
+    const std::string header =
+        "@protocol { name = \"BenchSets\"; endian = big; }\n"
+        "Header { uint8 cmd; uint8 flags; uint16 kind; uint32 id; }\n";
+    struct Case {
+        const char* name;
+        std::string filter;
+        uint32_t payload_len;
+    };
+    const Case cases[] = {
+        { "bitmap", "@filter Cmds { cmd in [" + set_list(32, 1, 2) + "]; }\n", 8 },
+        { "table", "@filter Ids { id in [" + set_list(32, 100000, 7919) + "]; }\n", 8 },
+        { "range", "@filter Kinds { kind in [" + set_list(32, 0x200, 1) + "]; }\n", 8 },
+        { "sliding", "@filter Anywhere { sliding = true; sliding_max = 64; cmd in [" + set_list(32, 1, 2) +
+                     "]; kind ! in [" + set_list(16, 0x400, 3) + "]; }\n", 72 },
+    };
+
+    std::vector<uint8_t> payloads(kPayloadCount * 72);
+    uint32_t seed = 11;
+    for (size_t i = 0; i < payloads.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        payloads[i] = (uint8_t)(seed >> 16);
+    }
+    for (uint32_t i = 0; i < kPayloadCount; i += 4) {
+        uint32_t id = 100000 + (i % 32) * 7919;
+        uint8_t* p = &payloads[i * 72];
+        p[4] = (uint8_t)(id >> 24);
+        p[5] = (uint8_t)(id >> 16);
+        p[6] = (uint8_t)(id >> 8);
+        p[7] = (uint8_t)id;
+        p[2] = 0x02;
+    }
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::vector<const uint8_t*> data;
+        std::vector<uint32_t> lens;
+        for (uint32_t i = 0; i < kPayloadCount; i++) {
+            data.push_back(&payloads[i * 72]);
+            lens.push_back(cases[c].payload_len);
+        }
+        std::string prefix = std::string("pdef_set/") + cases[c].name;
+        bench_parse_flags_pair(prefix + "/chain", PDEF_PARSE_NO_SET_OPS, prefix + "/set",
+                               header + cases[c].filter, data, lens);
+    }
+}
+
+
+static void bench_vm()
+{
+    struct Case {
+        const char* name;
+        std::string source;
+    };
+    const Case cases[] = {
+        { "fixed", kFixedPdef },
+        { "opt", kOptPdef },
+        { "set", "@protocol { name = \"BenchVmSet\"; endian = big; }\n"
+                 "Header { uint8 cmd; uint8 flags; uint16 kind; uint32 id; }\n"
+                 "@filter Mixed { cmd in [" + set_list(32, 1, 2) + "]; flags != 0xFF;"
+                 " kind ! in [" + set_list(16, 0x400, 3) + "]; id <= 0x7FFFFFFF; }\n" },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::string prefix = std::string("pdef_vm/") + cases[c].name;
+        if (!selected(prefix + "/switch") && !selected(prefix + "/threaded")) {
+            continue;
+        }
+        char errmsg[256];
+        ProtocolDef* proto = pdef_parse_string(cases[c].source.c_str(), errmsg, sizeof(errmsg));
+        if (!proto) {
+            record_skip(prefix + "/switch", errmsg);
+            continue;
+        }
+        const FilterRule* rule = &proto->filters[0];
+        if (!rule->program_be) {
+            record_skip(prefix + "/threaded", "rule has no compact program");
+            protocol_free(proto);
+            continue;
+        }
+        std::vector<uint8_t> payloads;
+        fill_payloads(payloads, proto, false);
+
+        for (int variant = 0; variant < 2; variant++) {
+            std::string name = prefix + (variant ? "/threaded" : "/switch");
+            if (!selected(name)) {
+                continue;
+            }
+            uint64_t iters = scaled(5000000);
+            uint64_t hits = 0;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                const uint8_t* p = &payloads[(n % kPayloadCount) * kPayloadLen];
+                uint32_t len = 12 + (uint32_t)(n % 5);
+                hits += (variant ? pdef_program_run(rule->program_be, p, len)
+                                 : execute_bytecode(p, len, rule->bytecode, rule->bytecode_len)) ? 1 : 0;
+            }
+            uint64_t elapsed = now_ns() - start;
+            size_t bytes = variant ? rule->program_be->op_count * sizeof(PdefOp) +
+                                         rule->program_be->pool_count * sizeof(uint64_t)
+                                   : rule->bytecode_len * sizeof(Instruction);
+            char note[128];
+            snprintf(note, sizeof(note), "code=%zuB fused=%u match=%.1f%%", bytes,
+                     variant ? rule->program_be->fused : 0, 100.0 * (double)hits / (double)iters);
+            record(name, iters, elapsed, 0, note);
+        }
+        protocol_free(proto);
+    }
+}
+
+
+static void bench_endian()
+{
+    struct Case {
+        const char* name;
+        const char* source;
+    };
+    const Case cases[] = {
+        { "fixed", kAutoPdef },
+        { "sliding", "@protocol { name = \"BenchAutoSliding\"; endian = auto; }\n"
+                     "Header { uint32 magic; uint16 kind; uint16 length; }\n"
+                     "@filter Anywhere { sliding = true; sliding_max = 96; magic = 0x12345678;"
+                     " kind >= 1; kind <= 16; }\n" },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::string prefix = std::string("pdef_endian/") + cases[c].name;
+        if (!selected(prefix + "/two_pass") && !selected(prefix + "/dual")) {
+            continue;
+        }
+        char errmsg[256];
+        ProtocolDef* proto = pdef_parse_string(cases[c].source, errmsg, sizeof(errmsg));
+        if (!proto) {
+            record_skip(prefix + "/dual", errmsg);
+            continue;
+        }
+        const FilterRule* rule = &proto->filters[0];
+        if (!rule->program_be || !rule->program_be->twin) {
+            record_skip(prefix + "/dual", "rule has no twin program");
+            protocol_free(proto);
+            continue;
+        }
+        std::vector<uint8_t> payloads;
+        fill_payloads(payloads, proto, (c & 1) != 0);
+        uint32_t window = rule->sliding_window ? rule->sliding_max_offset : 1;
+
+        for (int variant = 0; variant < 2; variant++) {
+            std::string name = prefix + (variant ? "/dual" : "/two_pass");
+            if (!selected(name)) {
+                continue;
+            }
+            uint64_t iters = scaled(rule->sliding_window ? 200000 : 5000000);
+            uint64_t hits = 0;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                const uint8_t* p = &payloads[(n % kPayloadCount) * kPayloadLen];
+                uint32_t verdict = 0;
+                for (uint32_t off = 0; off < window && verdict == 0; off++) {
+                    if (variant) {
+                        verdict = pdef_program_run_dual(rule->program_be, p + off, kPayloadLen - off);
+                    } else {
+                        verdict = (pdef_program_run(rule->program_be, p + off, kPayloadLen - off) ? 1 : 0) |
+                                  (pdef_program_run(rule->program_le, p + off, kPayloadLen - off) ? 2 : 0);
+                    }
+                }
+                hits += verdict ? 1 : 0;
+            }
+            uint64_t elapsed = now_ns() - start;
+            char note[64];
+            snprintf(note, sizeof(note), "match=%.1f%%", 100.0 * (double)hits / (double)iters);
+            record(name, iters, elapsed, 0, note);
+        }
+        protocol_free(proto);
+    }
+}
+
+
+static uint32_t wrap_frame(uint8_t* out, const char* kind, bool tcp)
+{
+    static const uint8_t payload[64] = { 0x2a, 0x33, 0x0d, 0x0a };
+    uint8_t inner[256];
+    uint32_t n = bench_build_frame(inner, sizeof(inner), tcp, 0x0a000001u, 0x0a000002u,
+                                   40000, 6379, payload, sizeof(payload));
+    const uint8_t* ip = inner + 14;
+    uint32_t ip_len = n - 14;
+    uint32_t off = 0;
+
+    memset(out, 0, 512);
+    if (strcmp(kind, "eth_ipv4") == 0) {
+        memcpy(out, inner, n);
+        return n;
+    }
+    if (strcmp(kind, "sll_ipv4") == 0) {
+        bench_put_u16_be(out + 14, 0x0800);
+        memcpy(out + 16, ip, ip_len);
+        return 16 + ip_len;
+    }
+    if (strcmp(kind, "sll2_ipv4") == 0) {
+        bench_put_u16_be(out, 0x0800);
+        memcpy(out + 20, ip, ip_len);
+        return 20 + ip_len;
+    }
+    if (strcmp(kind, "qinq_ipv4") == 0) {
+        memcpy(out, inner, 12);
+        bench_put_u16_be(out + 12, 0x88A8);
+        bench_put_u16_be(out + 16, 0x8100);
+        bench_put_u16_be(out + 20, 0x0800);
+        memcpy(out + 22, ip, ip_len);
+        return 22 + ip_len;
+    }
+    if (strcmp(kind, "ipv6_ext") == 0) {
+        uint32_t l4_len = ip_len - 20;
+        memcpy(out, inner, 12);
+        bench_put_u16_be(out + 12, 0x86DD);
+        uint8_t* v6 = out + 14;
+        v6[0] = 0x60;
+        bench_put_u16_be(v6 + 4, (uint16_t)(8 + l4_len));
+        v6[6] = 0;
+        v6[7] = 64;
+        v6[23] = 1;
+        v6[39] = 2;
+        v6[40] = tcp ? 6 : 17;
+        memcpy(v6 + 48, ip + 20, l4_len);
+        return 14 + 48 + l4_len;
+    }
+    if (strcmp(kind, "gre_ipv4") == 0 || strcmp(kind, "vxlan_ipv4") == 0) {
+        bool vxlan = kind[0] == 'v';
+        memcpy(out, inner, 14);
+        uint8_t* outer = out + 14;
+        outer[0] = 0x45;
+        outer[8] = 64;
+        outer[9] = vxlan ? 17 : 47;
+        outer[12] = 192; outer[15] = 1;
+        outer[16] = 192; outer[19] = 2;
+        off = 14 + 20;
+        if (vxlan) {
+            bench_put_u16_be(out + off, 54321);
+            bench_put_u16_be(out + off + 2, CRxPacketDecoder::VXLAN_PORT);
+            bench_put_u16_be(out + off + 4, (uint16_t)(16 + n));
+            out[off + 8] = 0x08;
+            off += 16;
+            memcpy(out + off, inner, n);
+            off += n;
+        } else {
+            bench_put_u16_be(out + off + 2, 0x0800);
+            off += 4;
+            memcpy(out + off, ip, ip_len);
+            off += ip_len;
+        }
+        bench_put_u16_be(outer + 2, (uint16_t)(off - 14));
+        return off;
+    }
+    return 0;
+}
+
+static void bench_decoder()
+{
+    struct Case {
+        const char* kind;
+        int linktype;
+        bool tcp;
+    };
+    const Case cases[] = {
+        { "eth_ipv4", DLT_EN10MB, true },
+        { "sll_ipv4", DLT_LINUX_SLL, false },
+        { "sll2_ipv4", DLT_LINUX_SLL2, true },
+        { "qinq_ipv4", DLT_EN10MB, false },
+        { "ipv6_ext", DLT_EN10MB, true },
+        { "gre_ipv4", DLT_EN10MB, true },
+        { "vxlan_ipv4", DLT_EN10MB, false },
+    };
+
+    if (selected("decode/legacy_eth_ipv4")) {
+        uint8_t frame[512];
+        uint32_t n = wrap_frame(frame, "eth_ipv4", true);
+        uint64_t iters = scaled(20000000);
+        uint64_t sink = 0;
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iters; i++) {
+            uint32_t off = 0;
+            uint32_t len = 0;
+            uint16_t sport = 0;
+            uint16_t dport = 0;
+            frame[35] = (uint8_t)i;
+            if (bench_frame_payload(frame, n, &off, &len, &sport, &dport)) {
+                sink += off + len + sport;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        record("decode/legacy_eth_ipv4", iters, elapsed, (uint64_t)n * iters,
+               sink ? "" : "no payload decoded");
+    }
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::string name = std::string("decode/") + cases[c].kind;
+        if (!selected(name)) {
+            continue;
+        }
+        uint8_t frame[512];
+        uint32_t n = wrap_frame(frame, cases[c].kind, cases[c].tcp);
+        CRxPacketDecoder decoder(cases[c].linktype);
+        SRxDecodedPacket pkt;
+        if (!decoder.decode(frame, n, pkt) || pkt.payload_len != 64 || pkt.dst_port != 6379) {
+            record_skip(name, "frame did not decode");
+            continue;
+        }
+        uint32_t port_off = pkt.l4_offset;
+
+        uint64_t iters = scaled(20000000);
+        uint64_t sink = 0;
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iters; i++) {
+            frame[port_off + 1] = (uint8_t)i;
+            if (decoder.decode(frame, n, pkt)) {
+                sink += pkt.payload_offset + pkt.payload_len + pkt.src_port;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[64];
+        snprintf(note, sizeof(note), "%s vlan=%u tunnel=%u", CRxPacketDecoder::linktype_name(cases[c].linktype),
+                 (unsigned)pkt.vlan_depth, (unsigned)pkt.tunnel_depth);
+        record(name, iters, elapsed, (uint64_t)n * iters, sink ? note : "no payload decoded");
+    }
+}
+
+static void bench_lfq()
+{
+    if (!selected("lfq/push_pop")) {
+        return;
+    }
+    LockFreeQueue* q = lfq_create(1024);
+    if (!q) {
+        record_skip("lfq/push_pop", "lfq_create failed");
+        return;
+    }
+    PacketNode* node = (PacketNode*)calloc(1, sizeof(PacketNode));
+    PacketNode* out = (PacketNode*)calloc(1, sizeof(PacketNode));
+    if (!node || !out) {
+        free(node);
+        free(out);
+        lfq_destroy(q);
+        return;
+    }
+    node->header.caplen = 128;
+    node->header.len = 128;
+    node->valid = true;
+
+    uint64_t iters = scaled(200000);
+    uint64_t start = now_ns();
+    for (uint64_t n = 0; n < iters; n++) {
+        lfq_push(q, node);
+        lfq_pop(q, out);
+    }
+    uint64_t elapsed = now_ns() - start;
+    record("lfq/push_pop", iters, elapsed, 0, "single producer/consumer");
+    free(node);
+    free(out);
+    lfq_destroy(q);
+}
+
+
+static void bench_channel()
+{
+    if (!selected("channel/put_msg")) {
+        return;
+    }
+    int fd[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0) {
+        record_skip("channel/put_msg", "socketpair failed");
+        return;
+    }
+    shared_ptr<base_net_obj> no_conn;
+    channel_data_process* channel = new channel_data_process(no_conn, fd[1]);
+    shared_ptr<normal_msg> msg(new normal_msg(0));
+
+    uint64_t iters = scaled(200000);
+    char drain[4096];
+    uint64_t start = now_ns();
+    for (uint64_t n = 0; n < iters; n++) {
+        channel->put_msg(OBJ_ID_THREAD, msg);
+        if ((n & 255) == 255) {
+            while (recv(fd[0], drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    record("channel/put_msg", iters, elapsed, 0, "mutex + socketpair wakeup");
+    delete channel;
+    close(fd[0]);
+    close(fd[1]);
+}
+
+
+static void bench_dump_cb()
+{
+    if (!selected("dump_cb/write")) {
+        return;
+    }
+    pcap_t* dead = pcap_open_dead(DLT_EN10MB, 65535);
+    if (!dead) {
+        record_skip("dump_cb/write", "pcap_open_dead failed");
+        return;
+    }
+    char dir_template[] = "/tmp/rxbench_dumpXXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir) {
+        pcap_close(dead);
+        record_skip("dump_cb/write", "mkdtemp failed");
+        return;
+    }
+
+    CRxDumpCtx dc;
+    dc.p = dead;
+    dc.d = NULL;
+    dc.max_bytes = 64L * 1024L * 1024L;
+    dc.written = 0;
+    dc.closed_bytes = 0;
+    dc.seq = 0;
+    dc.start_time = time(NULL);
+    dc.base_dir = dir;
+    dc.pattern = "bench-{seq}.pcap";
+    dc.port = 0;
+    dc.compress_enabled = false;
+    dc.protocol_def = NULL;
+    dc.packets_filtered = 0;
+    dc.filter_thread_index = 0;
+    CRxStorageUtils::rotate_open(&dc);
+    if (!dc.d) {
+        pcap_close(dead);
+        rmdir(dir);
+        record_skip("dump_cb/write", "pcap_dump_open failed");
+        return;
+    }
+
+    uint8_t frame[512];
+    memset(frame, 0x5a, sizeof(frame));
+    struct pcap_pkthdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.caplen = sizeof(frame);
+    hdr.len = sizeof(frame);
+
+    uint64_t iters = scaled(500000);
+    uint64_t start = now_ns();
+    for (uint64_t n = 0; n < iters; n++) {
+        hdr.ts.tv_usec = (long)(n % 1000000);
+        CRxStorageUtils::dump_cb((u_char*)&dc, &hdr, frame);
+    }
+    pcap_dump_flush(dc.d);
+    uint64_t elapsed = now_ns() - start;
+    char note[64];
+    snprintf(note, sizeof(note), "512B frames, %d file(s)", dc.seq);
+    record("dump_cb/write", iters, elapsed, (uint64_t)(sizeof(frame) + sizeof(hdr)) * iters, note);
+
+    pcap_dump_close(dc.d);
+    pcap_close(dead);
+    std::vector<std::string> written = list_dir(dir, ".pcap");
+    for (size_t i = 0; i < written.size(); i++) {
+        unlink(written[i].c_str());
+    }
+    rmdir(dir);
+}
+
+
+static void bench_stats_agg()
+{
+    struct Case {
+        const char* name;
+        const char* fields;
+        bool pdef;
+    };
+    const Case cases[] = {
+        { "flows", "", false },
+        { "pdef_flows", "", true },
+        { "pdef_fields", "Header.msg_type,Header.session,Header.flags", true },
+    };
+
+    const uint32_t frame_count = 4096;
+    std::vector<uint8_t> frames(frame_count * 256);
+    std::vector<uint32_t> lens(frame_count);
+    uint32_t seed = 11;
+    for (uint32_t i = 0; i < frame_count; i++) {
+        uint8_t payload[64];
+        memset(payload, 0, sizeof(payload));
+        seed = seed * 1103515245u + 12345u;
+        uint32_t host = (seed >> 16) % 64;
+        host = host * host / 64;
+        bench_put_u16_be(payload, 0x1234);
+        bench_put_u16_be(payload + 2, 0x5678);
+        payload[4] = 1;
+        payload[5] = 3;
+        bench_put_u16_be(payload + 6, (uint16_t)(i % 7));
+        bench_put_u16_be(payload + 10, (uint16_t)((seed >> 8) % 512));
+        lens[i] = bench_build_frame(&frames[i * 256], 256, true, 0x0a000000u + host, 0x0a0000feu,
+                                    (uint16_t)(30000 + i % 1024), 9000, payload, sizeof(payload));
+    }
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::string name = std::string("stats_agg/") + cases[c].name;
+        if (!selected(name)) {
+            continue;
+        }
+        char errmsg[256];
+        ProtocolDef* proto = NULL;
+        std::vector<const ProtocolDef*> defs;
+        if (cases[c].pdef) {
+            proto = pdef_parse_string(kFixedPdef, errmsg, sizeof(errmsg));
+            if (!proto) {
+                record_skip(name, errmsg);
+                continue;
+            }
+            defs.push_back(proto);
+        }
+
+        CRxStatsAggregator agg;
+        std::string error;
+        if (!agg.init(defs, cases[c].fields, DLT_EN10MB, error)) {
+            record_skip(name, error);
+            if (proto) {
+                protocol_free(proto);
+            }
+            continue;
+        }
+
+        struct pcap_pkthdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        uint64_t iters = scaled(5000000);
+        uint64_t wire = 0;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            uint32_t idx = (uint32_t)(n % frame_count);
+            hdr.caplen = lens[idx];
+            hdr.len = lens[idx];
+            wire += lens[idx];
+            CRxStatsAggregator::pcap_cb((u_char*)&agg, &hdr, &frames[idx * 256]);
+        }
+        uint64_t elapsed = now_ns() - start;
+
+        SRxStatsSnapshot snap;
+        agg.snapshot(snap, 10);
+        char note[96];
+        snprintf(note, sizeof(note), "matched=%.1f%% flows=%zu top=%llu",
+                 100.0 * (double)snap.matched_packets / (double)(snap.packets ? snap.packets : 1),
+                 snap.flows.size(), (unsigned long long)(snap.flows.empty() ? 0 : snap.flows[0].count));
+        record(name, iters, elapsed, wire, note);
+        if (proto) {
+            protocol_free(proto);
+        }
+    }
+}
+
+static void bench_tcp_reasm()
+{
+    struct Case {
+        const char* name;
+        uint32_t flows;
+    };
+    const Case cases[] = {
+        { "in_pool", 256 },
+        { "evicting", 8192 },
+    };
+
+    char errmsg[256];
+    ProtocolDef* proto = pdef_parse_string(kFixedPdef, errmsg, sizeof(errmsg));
+    if (!proto) {
+        record_skip("tcp_reasm", errmsg);
+        return;
+    }
+    CRxProtocolDispatcher dispatcher;
+    dispatcher.add(proto);
+    dispatcher.build(false);
+
+    // Each message is a 12-byte header split 5 + 7 across two segments, so
+    // neither segment matches on its own.
+    uint8_t msg[12];
+    bench_put_u16_be(msg, 0x1234);
+    bench_put_u16_be(msg + 2, 0x5678);
+    msg[4] = 1;
+    msg[5] = 3;
+    bench_put_u16_be(msg + 6, 0);
+    memset(msg + 8, 0x5a, 4);
+    const uint32_t split = 5;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::string name = std::string("tcp_reasm/") + cases[c].name;
+        if (!selected(name)) {
+            continue;
+        }
+        CRxTcpReassembler reasm(CRxTcpReassembler::DEFAULT_MAX_FLOWS, CRxTcpReassembler::DEFAULT_DEPTH);
+        if (!reasm.valid()) {
+            record_skip(name, "reassembly pool allocation failed");
+            continue;
+        }
+        std::vector<uint32_t> seqs(cases[c].flows, 1000);
+
+        uint64_t iters = scaled(2000000);
+        uint64_t single = 0;
+        uint64_t reassembled = 0;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            uint32_t f = (uint32_t)(n % cases[c].flows);
+            bool second = ((n / cases[c].flows) & 1) != 0;
+            const uint8_t* seg = second ? msg + split : msg;
+            uint32_t seg_len = second ? sizeof(msg) - split : split;
+
+            SRxFlowKey key;
+            key.set_ipv4(0x0a000000u + f, 0x0a0000feu);
+            key.src_port = (uint16_t)(30000 + (f & 1023));
+            key.dst_port = 9000;
+            key.proto = 6;
+
+            if (dispatcher.match(seg, seg_len, key.src_port, key.dst_port) != CRxProtocolDispatcher::NO_MATCH) {
+                single++;
+            }
+            uint32_t stream_len = 0;
+            const uint8_t* stream = reasm.add(key, seqs[f], second ? RX_TCP_PSH : 0, seg, seg_len, &stream_len);
+            seqs[f] += seg_len;
+            if (stream && stream_len > seg_len &&
+                dispatcher.match(stream, stream_len, key.src_port, key.dst_port) != CRxProtocolDispatcher::NO_MATCH) {
+                reassembled++;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+
+        const CRxTcpReassembler::Stats& rs = reasm.stats();
+        char note[160];
+        snprintf(note, sizeof(note), "msgs=%llu single=%llu reassembled=%llu evictions=%lu gaps=%lu mem=%zuKB",
+                 (unsigned long long)(iters / 2), (unsigned long long)single,
+                 (unsigned long long)reassembled, rs.evictions, rs.gaps, reasm.memory_bytes() / 1024);
+        record(name, iters, elapsed, 0, note);
+    }
+    protocol_free(proto);
+}
+
+static void bench_replay_pipeline(const std::string& pcap_dir)
+{
+    if (!selected("replay/pipeline")) {
+        return;
+    }
+    char dir_template[] = "/tmp/rxbench_replayXXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir) {
+        record_skip("replay/pipeline", "mkdtemp failed");
+        return;
+    }
+
+    CRxCaptureTaskCfg cfg;
+    cfg.iface = "replay";
+    cfg.file_pattern = "replay-{seq}.pcap";
+    cfg.max_bytes = 64L * 1024L * 1024L;
+    cfg.replay_file = pcap_dir + "/http.pcap";
+    cfg.replay_loops = (int)scaled(2000);
+
+    CRxCaptureTaskInfo info;
+    info.cfg = cfg;
+    info.base_dir = dir;
+
+    CRxCaptureJob job(cfg, &info);
+    if (!job.prepare()) {
+        rmdir(dir);
+        record_skip("replay/pipeline", "cannot open " + cfg.replay_file);
+        return;
+    }
+    uint64_t start = now_ns();
+    while (!job.is_done()) {
+        job.run_once();
+    }
+    job.cleanup();
+    uint64_t elapsed = now_ns() - start;
+    record("replay/pipeline", job.get_packet_count(), elapsed, job.get_bytes_written(),
+           "pcap_open_offline -> dump_cb -> rotation");
+
+    std::vector<std::string> written = list_dir(dir, ".pcap");
+    for (size_t i = 0; i < written.size(); i++) {
+        unlink(written[i].c_str());
+    }
+    rmdir(dir);
+}
+
+// Builds a capture of about target bytes from the sample pcaps, shifting
+// timestamps and ports per pass so that repeats do not compress for free.
+static bool build_archive_input(const std::string& pcap_dir, const std::string& out_path, uint64_t target)
+{
+    std::vector<std::string> inputs = list_dir(pcap_dir, ".pcap");
+    std::vector<std::string> records;
+    std::string header;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        FILE* in = fopen(inputs[i].c_str(), "rb");
+        if (!in) {
+            continue;
+        }
+        char hdr[24];
+        if (fread(hdr, 1, sizeof(hdr), in) == sizeof(hdr) && header.empty()) {
+            header.assign(hdr, sizeof(hdr));
+        }
+        unsigned char rec[16];
+        while (fread(rec, 1, sizeof(rec), in) == sizeof(rec)) {
+            uint32_t caplen;
+            memcpy(&caplen, rec + 8, 4);
+            if (caplen > 65536) {
+                break;
+            }
+            std::string r((const char*)rec, sizeof(rec));
+            r.resize(sizeof(rec) + caplen);
+            if (fread(&r[sizeof(rec)], 1, caplen, in) != caplen) {
+                break;
+            }
+            records.push_back(r);
+        }
+        fclose(in);
+    }
+    if (header.empty() || records.empty()) {
+        return false;
+    }
+    FILE* out = fopen(out_path.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    fwrite(header.data(), 1, header.size(), out);
+    uint64_t written = header.size();
+    uint32_t ts = 1700000000;
+    for (uint32_t pass = 0; written < target; pass++) {
+        for (size_t i = 0; i < records.size() && written < target; i++) {
+            std::string r = records[i];
+            uint32_t sec = ts + pass;
+            memcpy(&r[0], &sec, 4);
+            if (r.size() > 16 + 38) {
+                r[16 + 34] ^= (char)(pass & 0xff);
+                r[16 + 36] ^= (char)((pass >> 8) & 0xff);
+                r[16 + 37] ^= (char)(i & 0xff);
+            }
+            fwrite(r.data(), 1, r.size(), out);
+            written += r.size();
+        }
+    }
+    fclose(out);
+    return true;
+}
+
+static uint64_t file_size(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static void bench_archive(const std::string& pcap_dir)
+{
+    if (!selected("archive/")) {
+        return;
+    }
+    char dir_template[] = "/tmp/rxbench_archiveXXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir) {
+        record_skip("archive/", "mkdtemp failed");
+        return;
+    }
+    std::string src = std::string(dir) + "/input.pcap";
+    std::string archive = std::string(dir) + "/input.pcap.gz";
+    std::string tgz = std::string(dir) + "/input.tgz";
+    if (!build_archive_input(pcap_dir, src, scaled(64ULL * 1024 * 1024))) {
+        record_skip("archive/", "no sample pcaps in " + pcap_dir);
+        rmdir(dir);
+        return;
+    }
+    uint64_t raw = file_size(src);
+
+    const int thread_counts[] = { 1, 4 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        char name[64];
+        snprintf(name, sizeof(name), "archive/write_t%d", thread_counts[t]);
+        if (!selected(name)) {
+            continue;
+        }
+        CRxArchiveWriter writer;
+        std::string error;
+        uint64_t start = now_ns();
+        bool ok = writer.open(archive, CRxArchiveWriter::DEFAULT_FRAME_BYTES, thread_counts[t], 6, error) &&
+                  writer.add_file(src, "input.pcap", error) && writer.close(error);
+        uint64_t elapsed = now_ns() - start;
+        if (!ok) {
+            record_skip(name, error);
+            continue;
+        }
+        char note[96];
+        snprintf(note, sizeof(note), "ratio=%.2f frames=4MB level=6",
+                 (double)raw / (double)file_size(archive));
+        record(name, 1, elapsed, raw, note);
+    }
+
+    if (selected("archive/tar_czf")) {
+        std::string cmd = "tar -czf '" + tgz + "' -C '" + dir + "' input.pcap 2>/dev/null";
+        uint64_t start = now_ns();
+        int rc = system(cmd.c_str());
+        uint64_t elapsed = now_ns() - start;
+        if (rc != 0) {
+            record_skip("archive/tar_czf", "tar failed");
+        } else {
+            char note[96];
+            snprintf(note, sizeof(note), "ratio=%.2f", (double)raw / (double)file_size(tgz));
+            record("archive/tar_czf", 1, elapsed, raw, note);
+        }
+        unlink(tgz.c_str());
+    }
+
+    CRxArchiveReader reader;
+    std::string error;
+    if ((selected("archive/read_frame") || selected("archive/read_all")) && !reader.open(archive, error)) {
+        CRxArchiveWriter writer;
+        if (!writer.open(archive, CRxArchiveWriter::DEFAULT_FRAME_BYTES, 1, 6, error) ||
+            !writer.add_file(src, "input.pcap", error) || !writer.close(error) ||
+            !reader.open(archive, error)) {
+            record_skip("archive/read", error);
+        }
+    }
+    if (!reader.frames().empty()) {
+        std::string buf;
+        if (selected("archive/read_frame")) {
+            // One time range lookup: find the frame and inflate only it.
+            uint64_t iters = scaled(20);
+            uint64_t bytes = 0;
+            const SRxArchiveFile& f = reader.files()[0];
+            uint32_t first = reader.frames()[f.first_frame].first_ts;
+            uint32_t last = reader.frames()[f.first_frame + f.frame_count - 1].last_ts;
+            uint64_t start = now_ns();
+            for (uint64_t n = 0; n < iters; n++) {
+                uint32_t ts = first + (uint32_t)((n * 7919) % (last - first + 1));
+                int frame = reader.frame_at_time(0, ts);
+                if (frame >= 0 && reader.read_frame(frame, buf, error)) {
+                    bytes += buf.size();
+                }
+            }
+            uint64_t elapsed = now_ns() - start;
+            char note[96];
+            snprintf(note, sizeof(note), "%u frames, one inflated per lookup", f.frame_count);
+            record("archive/read_frame", iters, elapsed, bytes, note);
+        }
+        if (selected("archive/read_all")) {
+            uint64_t bytes = 0;
+            uint64_t start = now_ns();
+            for (size_t i = 0; i < reader.frames().size(); i++) {
+                if (reader.read_frame(i, buf, error)) {
+                    bytes += buf.size();
+                }
+            }
+            uint64_t elapsed = now_ns() - start;
+            record("archive/read_all", 1, elapsed, bytes, "full inflate, what a .tgz lookup costs");
+        }
+    }
+    reader.close();
+
+    unlink(archive.c_str());
+    unlink(src.c_str());
+    rmdir(dir);
+}
+
+static void bench_compress_pool()
+{
+    if (selected("compress/queue")) {
+        // A burst of 32 captures' worth of jobs queued and drained in
+        // largest-first order, as the cleanup thread does after a busy period.
+        const int kJobs = 32;
+        CRxCompressQueue queue;
+        queue.configure(kJobs, CRxCompressQueue::ORDER_LARGEST);
+        SRxCompressJob job;
+        job.files.resize(4);
+        uint64_t iters = scaled(20000);
+        uint64_t popped = 0;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            for (int i = 0; i < kJobs; i++) {
+                job.capture_id = i;
+                job.bytes = (uint64_t)((i * 7919) % 97) << 20;
+                job.oldest_ts = (int64_t)(n + i);
+                queue.push(job);
+            }
+            while (queue.pop(job)) {
+                popped++;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[64];
+        snprintf(note, sizeof(note), "%d jobs/round, popped=%llu", kJobs, (unsigned long long)popped);
+        record("compress/queue", iters * kJobs, elapsed, 0, note);
+    }
+
+    if (selected("compress/throttle")) {
+        // 768 MB through a 256 MB/s bucket: the first second's worth passes
+        // as burst, the rest is paced, so the run should take about 2s.
+        CRxIoThrottle throttle;
+        const uint64_t rate = 256ULL * 1024 * 1024;
+        throttle.set_rate(rate);
+        uint64_t total = scaled(768ULL * 1024 * 1024);
+        const uint64_t chunk = 256 * 1024;
+        uint64_t slept = 0;
+        uint64_t start = now_ns();
+        for (uint64_t done = 0; done < total; done += chunk) {
+            slept += throttle.consume(chunk);
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[96];
+        snprintf(note, sizeof(note), "limit=256MB/s burst=1s slept=%llums",
+                 (unsigned long long)(slept / 1000000ULL));
+        record("compress/throttle", total / chunk, elapsed, total, note);
+    }
+}
+
+static void bench_task_mgr()
+{
+    const int kTasks = 64;
+    CRxSafeTaskMgr mgr;
+    for (int i = 0; i < kTasks; i++) {
+        SRxCaptureTask* task = new SRxCaptureTask();
+        task->capture_id = 1000 + i;
+        char key[32];
+        snprintf(key, sizeof(key), "bench-%d", i);
+        task->key = key;
+        task->status = STATUS_RUNNING;
+        mgr.add_task(task->capture_id, task->key, "", "", task);
+    }
+
+    if (selected("task_mgr/update_progress")) {
+        uint64_t iters = scaled(20000);
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            mgr.update_progress(1000 + (int)(n % kTasks), (unsigned long)n, (unsigned long)n * 100, (int64_t)n);
+            if ((n & 1023) == 1023) {
+                mgr.cleanup_pending_deletes();
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[64];
+        snprintf(note, sizeof(note), "%d live tasks", kTasks);
+        record("task_mgr/update_progress", iters, elapsed, 0, note);
+    }
+
+    if (selected("task_mgr/query_task")) {
+        uint64_t iters = scaled(200000);
+        TaskSnapshot snap;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            mgr.query_task(1000 + (int)(n % kTasks), snap);
+        }
+        uint64_t elapsed = now_ns() - start;
+        record("task_mgr/query_task", iters, elapsed, 0, "");
+    }
+    mgr.cleanup_pending_deletes();
+
+    if (selected("task_mgr/list")) {
+        const int kHistory = 10000;
+        static const char* categories[] = {"diag", "redis", "http", "mysql"};
+        CRxSafeTaskMgr history;
+        std::vector<SRxCaptureTask*> tasks;
+        int expected = 0;
+        for (int i = 0; i < kHistory; i++) {
+            SRxCaptureTask* task = new SRxCaptureTask();
+            task->capture_id = i + 1;
+            char key[32];
+            snprintf(key, sizeof(key), "hist-%d", i);
+            task->key = key;
+            task->category = categories[i % 4];
+            task->iface = (i % 3) ? "eth0" : "lo";
+            task->start_time = 1700000000L + i / 2;
+            task->status = (i % 10 == 0) ? STATUS_FAILED : STATUS_COMPLETED;
+            if (task->status == STATUS_FAILED && task->category == std::string("diag")) {
+                expected++;
+            }
+            tasks.push_back(task);
+        }
+        history.restore_tasks(tasks);
+
+        // Page through one category/status slice with the returned cursor,
+        // then take first pages of the unfiltered listing.
+        uint64_t passes = scaled(20);
+        uint64_t pages = 0;
+        int listed = 0;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < passes; n++) {
+            TaskQuery query;
+            query.category = "diag";
+            query.status_mask = 1u << STATUS_FAILED;
+            query.limit = 50;
+            listed = 0;
+            for (;;) {
+                TaskQueryResult result;
+                history.query_tasks(query, result);
+                pages++;
+                listed += (int)result.capture_ids.size();
+                if (!result.has_more) {
+                    break;
+                }
+                query.has_cursor = true;
+                query.cursor_start = result.next_start;
+                query.cursor_id = result.next_id;
+            }
+            TaskQuery latest;
+            TaskQueryResult result;
+            history.query_tasks(latest, result);
+            pages++;
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[96];
+        snprintf(note, sizeof(note), "%d tasks, per page, %d/%d listed", kHistory, listed, expected);
+        record("task_mgr/list", pages, elapsed, 0, note);
+    }
+}
+
+static void bench_task_journal()
+{
+    if (!selected("journal/")) {
+        return;
+    }
+    char dir_template[] = "/tmp/rxbench_journalXXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir) {
+        record_skip("journal/", "mkdtemp failed");
+        return;
+    }
+    std::string path = std::string(dir) + "/tasks.journal";
+
+    // A day of captures as the manager journals them: the task, a few state
+    // changes, four segments and one archive each.
+    const uint64_t kTasks = scaled(10000);
+    CRxTaskJournal journal;
+    std::vector<SRxCaptureTask*> loaded;
+    CRxTaskJournal::LoadStats stats;
+    std::string error;
+    if (!journal.load(path, 0, loaded, stats, error)) {
+        record_skip("journal/", error);
+        rmdir(dir);
+        return;
+    }
+
+    SRxCaptureTask task;
+    task.iface = "eth0";
+    task.proc_name = "nginx";
+    task.category = "diag";
+    task.filter = "tcp port 443";
+    task.client_ip = "10.0.0.1";
+    task.request_user = "bench";
+    std::vector<CaptureFileInfo> files(1);
+    CaptureArchiveInfo archive;
+    uint64_t events = 0;
+    uint64_t start = now_ns();
+    for (uint64_t n = 0; n < kTasks; n++) {
+        char buf[96];
+        task.capture_id = 1000 + (int)n;
+        snprintf(buf, sizeof(buf), "iface:eth0|proc:nginx|%llu", (unsigned long long)n);
+        task.key = buf;
+        task.sid = buf;
+        task.status = STATUS_PENDING;
+        journal.log_task(task);
+        task.status = STATUS_RUNNING;
+        journal.log_state(task);
+        archive.files.clear();
+        for (int seg = 0; seg < 4; seg++) {
+            snprintf(buf, sizeof(buf), "/var/log/rxtrace/captures/diag/2026-10-18/%llu-eth0-nginx-443_%d.pcap",
+                     (unsigned long long)n, seg);
+            files[0].file_path = buf;
+            files[0].file_size = 200UL << 20;
+            files[0].segment_index = seg;
+            journal.log_files(task.capture_id, files);
+            archive.files.push_back(files[0]);
+        }
+        task.status = STATUS_COMPLETED;
+        task.packet_count = (unsigned long)n * 1000;
+        journal.log_state(task);
+        archive.archive_path = std::string(buf) + ".gz";
+        journal.log_archive(task.capture_id, archive);
+        events += 8;
+        if ((n & 63) == 63) {
+            journal.sync();
+        }
+    }
+    journal.sync();
+    uint64_t elapsed = now_ns() - start;
+    uint64_t bytes = journal.bytes();
+    char note[96];
+    snprintf(note, sizeof(note), "%llu tasks, %llu records, fdatasync every 64 tasks",
+             (unsigned long long)kTasks, (unsigned long long)journal.records());
+    record("journal/append", events, elapsed, bytes, note);
+    journal.close();
+
+    start = now_ns();
+    bool loaded_ok = journal.load(path, 0, loaded, stats, error);
+    elapsed = now_ns() - start;
+    if (!loaded_ok) {
+        record_skip("journal/replay", error);
+    } else if (selected("journal/replay")) {
+        snprintf(note, sizeof(note), "%llu tasks from %llu records",
+                 (unsigned long long)stats.tasks, (unsigned long long)stats.records);
+        record("journal/replay", stats.events, elapsed, bytes, note);
+    }
+
+    if (loaded_ok && selected("journal/compact")) {
+        std::vector<const SRxCaptureTask*> live(loaded.begin(), loaded.end());
+        start = now_ns();
+        bool ok = journal.compact(live, error);
+        elapsed = now_ns() - start;
+        if (ok) {
+            snprintf(note, sizeof(note), "%llu -> %llu records",
+                     (unsigned long long)(bytes / CRxTaskJournal::RECORD_BYTES),
+                     (unsigned long long)journal.records());
+            record("journal/compact", live.size(), elapsed, journal.bytes(), note);
+        } else {
+            record_skip("journal/compact", error);
+        }
+    }
+    journal.close();
+
+    for (size_t i = 0; i < loaded.size(); i++) {
+        delete loaded[i];
+    }
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+static void bench_progress_board()
+{
+    // Same shape as task_mgr/update_progress: 64 live captures on one worker,
+    // counters published by the worker and read back by the status path.
+    const int kTasks = 64;
+    CRxProgressBoard* board = CRxProgressBoard::instance();
+    SRxProgressSlot* slots[kTasks];
+    for (int i = 0; i < kTasks; i++) {
+        slots[i] = board->claim(250, 1000 + i);
+    }
+
+    if (selected("progress/publish")) {
+        uint64_t iters = scaled(2000000);
+        CaptureProgressStats progress;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            progress.packets = (unsigned long)n;
+            progress.bytes = (unsigned long)n * 100;
+            progress.last_packet_ts = (int64_t)n;
+            CRxProgressBoard::publish(slots[n % kTasks], progress, 1);
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[64];
+        snprintf(note, sizeof(note), "%d live tasks", kTasks);
+        record("progress/publish", iters, elapsed, 0, note);
+    }
+
+    if (selected("progress/read")) {
+        uint64_t iters = scaled(200000);
+        CaptureProgressStats out;
+        unsigned long found = 0;
+        uint64_t start = now_ns();
+        for (uint64_t n = 0; n < iters; n++) {
+            found += board->read(1000 + (int)(n % kTasks), out) ? 1 : 0;
+        }
+        uint64_t elapsed = now_ns() - start;
+        char note[64];
+        snprintf(note, sizeof(note), "found=%lu", found);
+        record("progress/read", iters, elapsed, 0, note);
+    }
+
+    for (int i = 0; i < kTasks; i++) {
+        CRxProgressBoard::release(slots[i]);
+    }
+}
+
+static void bench_scheduler()
+{
+    if (!selected("scheduler/enqueue_dispatch")) {
+        return;
+    }
+
+    // 8 workers, 16 running slots, at most 2 per interface; a steady stream of
+    // mixed priority tasks over 12 interfaces, the oldest running task finishing
+    // as each new one arrives.
+    const int kIfaces = 12;
+    CRxCaptureScheduler sched;
+    for (uint32_t w = 0; w < 8; w++) {
+        sched.add_worker(200 + w);
+    }
+    sched.set_limits(16, 2, 4096);
+
+    char ifaces[kIfaces][16];
+    for (int i = 0; i < kIfaces; i++) {
+        snprintf(ifaces[i], sizeof(ifaces[i]), "eth%d", i);
+    }
+
+    std::deque<int> running;
+    uint64_t iters = scaled(500000);
+    uint64_t dispatched = 0;
+    uint64_t api_dispatched = 0;
+    uint64_t start = now_ns();
+    for (uint64_t n = 0; n < iters; n++) {
+        int id = (int)(n + 1);
+        int priority = (int)(n % 3);
+        sched.enqueue(id, priority, ifaces[(n * 7) % kIfaces]);
+        if (!running.empty() && sched.running() >= 16) {
+            sched.release(running.front());
+            running.pop_front();
+        }
+
+        int capture_id = 0;
+        uint32_t worker = 0;
+        while (sched.next(capture_id, worker)) {
+            running.push_back(capture_id);
+            if ((capture_id - 1) % 3 == PRIORITY_API) {
+                api_dispatched++;
+            }
+            dispatched++;
+        }
+        if ((n & 63) == 63) {
+            sched.sample_rates(1.0);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    char note[96];
+    snprintf(note, sizeof(note), "dispatched=%llu api=%.0f%% pending=%zu",
+             (unsigned long long)dispatched,
+             dispatched ? 100.0 * (double)api_dispatched / (double)dispatched : 0.0,
+             sched.pending());
+    record("scheduler/enqueue_dispatch", iters, elapsed, 0, note);
+}
+
+static std::string locate_dir(const char* rel)
+{
+    static const char* prefixes[] = { "", "../", "../../" };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        std::string path = std::string(prefixes[i]) + rel;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            return path;
+        }
+    }
+    return rel;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--json FILE] [--filter SUBSTR] [--scale F] [--pdef-dir DIR] [--pcap-dir DIR]\n",
+            prog);
+}
+
+int main(int argc, char** argv)
+{
+    const char* json_path = NULL;
+    std::string pdef_dir = locate_dir("config/protocols");
+    std::string pcap_dir = locate_dir("tests/samples/pcap");
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            g_filter = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            g_scale = atof(argv[++i]);
+            if (g_scale <= 0.0) {
+                g_scale = 1.0;
+            }
+        } else if (strcmp(argv[i], "--pdef-dir") == 0 && i + 1 < argc) {
+            pdef_dir = argv[++i];
+        } else if (strcmp(argv[i], "--pcap-dir") == 0 && i + 1 < argc) {
+            pcap_dir = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!freopen("/dev/null", "w", stderr)) {
+        fprintf(stdout, "warning: parser diagnostics will be interleaved with results\n");
+    }
+
+    bench_filters();
+    bench_protocols(pdef_dir, pcap_dir);
+    bench_dispatch(pdef_dir, pcap_dir);
+    bench_optimizer(pdef_dir, pcap_dir);
+    bench_sets();
+    bench_vm();
+    bench_endian();
+    bench_decoder();
+    bench_lfq();
+    bench_channel();
+    bench_dump_cb();
+    bench_stats_agg();
+    bench_tcp_reasm();
+    bench_replay_pipeline(pcap_dir);
+    bench_archive(pcap_dir);
+    bench_compress_pool();
+    bench_task_mgr();
+    bench_task_journal();
+    bench_progress_board();
+    bench_scheduler();
+
+    if (json_path && !write_json(json_path)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "../src/pdef/parser.h"
+#include "../src/runtime/protocol.h"
+#include "../src/runtime/executor.h"
+#include "bench_pcap.h"
+
+
+typedef struct {
+    const char* name;
+    uint16_t port;
+    bool tcp;
+} KnownPort;
+
+static const KnownPort kKnownPorts[] = {
+    { "dns", 53, false },
+    { "http", 80, true },
+    { "iec104", 2404, true },
+    { "memcached", 11211, true },
+    { "mqtt", 1883, true },
+    { "mysql", 3306, true },
+    { "redis", 6379, true },
+};
+
+static uint32_t g_seed = 1;
+
+static uint32_t next_rand(void)
+{
+    g_seed = g_seed * 1103515245u + 12345u;
+    return g_seed >> 8;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s <pdef-file> <out.pcap> [options]\n"
+            "  --count N        number of packets (default 1024)\n"
+            "  --match-ratio R  fraction of packets seeded to match a filter (default 0.5)\n"
+            "  --port P         server port (default derived from protocol name, else 9000)\n"
+            "  --udp            use UDP instead of TCP\n"
+            "  --seed S         PRNG seed (default 1)\n"
+            "  --flows N        spread packets over N client flows (default: one flow per packet)\n",
+            prog);
+}
+
+static int load_width(OpCode op, bool* little)
+{
+    *little = false;
+    switch (op) {
+        case OP_LOAD_U8: case OP_LOAD_I8: return 1;
+        case OP_LOAD_U16_BE: case OP_LOAD_I16_BE: return 2;
+        case OP_LOAD_U16_LE: case OP_LOAD_I16_LE: *little = true; return 2;
+        case OP_LOAD_U32_BE: case OP_LOAD_I32_BE: return 4;
+        case OP_LOAD_U32_LE: case OP_LOAD_I32_LE: *little = true; return 4;
+        case OP_LOAD_U64_BE: case OP_LOAD_I64_BE: return 8;
+        case OP_LOAD_U64_LE: case OP_LOAD_I64_LE: *little = true; return 8;
+        default: return 0;
+    }
+}
+
+static void store_value(uint8_t* buf, uint32_t buf_len, uint32_t offset,
+                        int width, bool little, uint64_t value)
+{
+    if (width <= 0 || offset + (uint32_t)width > buf_len) {
+        return;
+    }
+    for (int i = 0; i < width; i++) {
+        int shift = little ? i * 8 : (width - 1 - i) * 8;
+        buf[offset + i] = (uint8_t)(value >> shift);
+    }
+}
+
+
+static bool set_contains(const Instruction* ins, uint64_t v)
+{
+    const uint64_t* table = instruction_set_table(ins);
+    if (ins->opcode == OP_CMP_RANGE) {
+        return v >= ins->operand && v <= ins->operand2;
+    }
+    if (ins->opcode == OP_CMP_IN_BITMAP) {
+        return v < 256 && ((table[v >> 6] >> (v & 63)) & 1);
+    }
+    for (uint64_t i = 0; i < ins->operand2; i++) {
+        if (table[i] == v) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t set_first(const Instruction* ins)
+{
+    const uint64_t* table = instruction_set_table(ins);
+    if (ins->opcode == OP_CMP_RANGE) {
+        return ins->operand;
+    }
+    if (ins->opcode == OP_CMP_IN_BITMAP) {
+        for (uint64_t v = 0; v < 256; v++) {
+            if ((table[v >> 6] >> (v & 63)) & 1) {
+                return v;
+            }
+        }
+    }
+    return table[0];
+}
+
+static void seed_payload(uint8_t* buf, uint32_t len, const Instruction* code, uint32_t code_len)
+{
+    int width = 0;
+    bool little = false;
+    uint32_t offset = 0;
+    uint64_t current = 0;
+
+    for (uint32_t ip = 0; ip < code_len; ip++) {
+        const Instruction* ins = &code[ip];
+        int w = load_width(ins->opcode, &little);
+        if (w > 0) {
+            width = w;
+            offset = ins->offset;
+            current = 0;
+            for (int i = 0; i < width && offset + (uint32_t)i < len; i++) {
+                int shift = little ? i * 8 : (width - 1 - i) * 8;
+                current |= (uint64_t)buf[offset + i] << shift;
+            }
+            continue;
+        }
+        switch (ins->opcode) {
+            case OP_CMP_EQ:
+                store_value(buf, len, offset, width, little, ins->operand);
+                current = ins->operand;
+                break;
+            case OP_CMP_NE:
+                if (current == ins->operand) {
+                    current = ins->operand + 1;
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            case OP_CMP_GT:
+                if (current <= ins->operand) {
+                    current = ins->operand + 1;
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            case OP_CMP_GE:
+                if (current < ins->operand) {
+                    current = ins->operand;
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            case OP_CMP_LT:
+                if (current >= ins->operand && ins->operand > 0) {
+                    current = ins->operand - 1;
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            case OP_CMP_LE:
+                if (current > ins->operand) {
+                    current = ins->operand;
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            case OP_CMP_MASK:
+                current = (current & ~ins->operand) | (ins->operand2 & ins->operand);
+                store_value(buf, len, offset, width, little, current);
+                break;
+            case OP_CMP_RANGE:
+            case OP_CMP_IN_BITMAP:
+            case OP_CMP_IN_TABLE: {
+                bool want = !(ip + 1 < code_len && code[ip + 1].opcode == OP_JUMP_IF_TRUE);
+                if (set_contains(ins, current) != want) {
+                    current = want ? set_first(ins) : current + 1;
+                    while (!want && set_contains(ins, current)) {
+                        current++;
+                    }
+                    store_value(buf, len, offset, width, little, current);
+                }
+                break;
+            }
+            case OP_RETURN_TRUE:
+            case OP_RETURN_FALSE:
+                return;
+            default:
+                break;
+        }
+    }
+}
+
+static const FilterRule* pick_rule(const ProtocolDef* proto)
+{
+    if (proto->filter_count == 0) {
+        return NULL;
+    }
+    return &proto->filters[next_rand() % proto->filter_count];
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* pdef_path = argv[1];
+    const char* out_path = argv[2];
+    uint32_t count = 1024;
+    double match_ratio = 0.5;
+    int port = -1;
+    int force_udp = 0;
+    uint32_t flows = 0;
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--match-ratio") == 0 && i + 1 < argc) {
+            match_ratio = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--udp") == 0) {
+            force_udp = 1;
+        } else if (strcmp(argv[i], "--flows") == 0 && i + 1 < argc) {
+            flows = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            g_seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    char errmsg[512];
+    ProtocolDef* proto = pdef_parse_file_ex(pdef_path, PDEF_PARSE_NO_OPTIMIZE, errmsg, sizeof(errmsg));
+    if (!proto) {
+        fprintf(stderr, "Failed to parse %s: %s\n", pdef_path, errmsg);
+        return 1;
+    }
+
+    bool tcp = true;
+    if (port < 0) {
+        port = 9000;
+        char lower[64];
+        size_t n = strlen(proto->name);
+        if (n >= sizeof(lower)) {
+            n = sizeof(lower) - 1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            lower[i] = (char)tolower((unsigned char)proto->name[i]);
+        }
+        lower[n] = '\0';
+        for (size_t i = 0; i < sizeof(kKnownPorts) / sizeof(kKnownPorts[0]); i++) {
+            if (strcmp(lower, kKnownPorts[i].name) == 0) {
+                port = kKnownPorts[i].port;
+                tcp = kKnownPorts[i].tcp;
+                break;
+            }
+        }
+    }
+    if (force_udp) {
+        tcp = false;
+    }
+
+    FILE* f = fopen(out_path, "wb");
+    if (!f || !bench_pcap_write_header(f)) {
+        fprintf(stderr, "Failed to create %s\n", out_path);
+        if (f) {
+            fclose(f);
+        }
+        protocol_free(proto);
+        return 1;
+    }
+
+    uint8_t payload[1024];
+    uint8_t frame[BENCH_FRAME_MAX];
+    uint32_t matched = 0;
+    uint32_t written = 0;
+    uint32_t ts_sec = 1700000000u;
+    uint32_t ts_usec = 0;
+
+    for (uint32_t n = 0; n < count; n++) {
+        const FilterRule* rule = pick_rule(proto);
+        uint32_t min_len = rule && rule->min_packet_size > 16 ? rule->min_packet_size : 16;
+        uint32_t len = min_len + next_rand() % 96;
+        if (len > sizeof(payload)) {
+            len = sizeof(payload);
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            payload[i] = (uint8_t)next_rand();
+        }
+
+        bool want_match = rule && (double)(next_rand() % 10000) < match_ratio * 10000.0;
+        if (want_match) {
+            bool use_le = proto->endian_mode == ENDIAN_MODE_LITTLE ||
+                          (proto->endian_mode == ENDIAN_MODE_AUTO && (next_rand() & 1));
+            const Instruction* code = use_le && rule->bytecode_le ? rule->bytecode_le : rule->bytecode;
+            uint32_t code_len = use_le && rule->bytecode_le ? rule->bytecode_le_len : rule->bytecode_len;
+            uint32_t shift = 0;
+            if (rule->sliding_window && len > min_len) {
+                uint32_t room = len - min_len;
+                if (rule->sliding_max_offset > 0 && room > rule->sliding_max_offset) {
+                    room = rule->sliding_max_offset;
+                }
+                shift = room > 0 ? next_rand() % room : 0;
+            }
+            seed_payload(payload + shift, len - shift, code, code_len);
+        }
+
+        if (packet_filter_match(payload, len, (uint16_t)port, proto)) {
+            matched++;
+        }
+
+        bool to_server = (next_rand() & 1) != 0;
+        uint32_t flow = flows > 0 ? n % flows : n;
+        uint16_t client_port = (uint16_t)(32768 + (flow % 4096));
+        uint32_t flen = bench_build_frame(frame, sizeof(frame), tcp,
+                                          0x0a000001u + (flow % 64), 0x0a000101u,
+                                          to_server ? client_port : (uint16_t)port,
+                                          to_server ? (uint16_t)port : client_port,
+                                          payload, len);
+        if (flen == 0) {
+            continue;
+        }
+        ts_usec += 100;
+        if (ts_usec >= 1000000u) {
+            ts_usec -= 1000000u;
+            ts_sec++;
+        }
+        if (!bench_pcap_write_packet(f, ts_sec, ts_usec, frame, flen)) {
+            fprintf(stderr, "Write failed for %s\n", out_path);
+            break;
+        }
+        written++;
+    }
+
+    fclose(f);
+    printf("%s: %u packets (%u matching %s, port %d/%s)\n",
+           out_path, written, matched, proto->name, port, tcp ? "tcp" : "udp");
+    protocol_free(proto);
+    return written == count ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+#include "../src/rxarchive.h"
+
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL: %s\n", msg); \
+        return false; \
+    } \
+} while (0)
+
+#define TEST_PASS(msg) do { \
+    printf("PASS: %s\n", msg); \
+} while (0)
+
+static std::string g_dir;
+
+static void put_u32(std::string& out, uint32_t v)
+{
+    out.append(reinterpret_cast<const char*>(&v), 4);
+}
+
+static void put_u16(std::string& out, uint16_t v)
+{
+    out.append(reinterpret_cast<const char*>(&v), 2);
+}
+
+// Native byte order pcap with packets of caplen bytes, one per second from
+// first_ts on; every payload byte encodes the packet's sequence number.
+static std::string make_pcap(uint32_t snaplen, uint32_t linktype, uint32_t first_ts,
+                             int packets, uint32_t caplen)
+{
+    std::string out;
+    put_u32(out, 0xa1b2c3d4);
+    put_u16(out, 2);
+    put_u16(out, 4);
+    put_u32(out, 0);
+    put_u32(out, 0);
+    put_u32(out, snaplen);
+    put_u32(out, linktype);
+    for (int i = 0; i < packets; ++i) {
+        put_u32(out, first_ts + i);
+        put_u32(out, 0);
+        put_u32(out, caplen);
+        put_u32(out, caplen);
+        out.append(caplen, static_cast<char>('A' + (first_ts + i) % 26));
+    }
+    return out;
+}
+
+static std::string write_file(const char* name, const std::string& data)
+{
+    std::string path = g_dir + "/" + name;
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp) {
+        fwrite(data.data(), 1, data.size(), fp);
+        fclose(fp);
+    }
+    return path;
+}
+
+static bool write_archive(const char* name, const std::string* pcaps, size_t count, std::string& path)
+{
+    CRxArchiveWriter writer;
+    std::string error;
+    path = g_dir + "/" + name;
+    if (!writer.open(path, 64 * 1024, 2, 1, error)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        char src[32];
+        snprintf(src, sizeof(src), "seg%zu.pcap", i);
+        if (!writer.add_file(write_file(src, pcaps[i]), src, error)) {
+            return false;
+        }
+    }
+    return writer.close(error);
+}
+
+static std::string read_all(FILE* fp)
+{
+    std::string out;
+    char buf[7000];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+
+bool test_single_file_roundtrip(void)
+{
+    std::string pcap = make_pcap(65535, 1, 1000, 300, 700);
+    std::string path;
+    TEST_ASSERT(write_archive("single.pcap.gz", &pcap, 1, path), "Writing the archive failed");
+    TEST_ASSERT(CRxArchiveReader::is_archive(path), "Archive not recognised");
+
+    CRxArchiveReader reader;
+    std::string error;
+    TEST_ASSERT(reader.open(path, error), "Opening the archive failed");
+    TEST_ASSERT(reader.files().size() == 1, "Expected one archived file");
+    TEST_ASSERT(reader.files()[0].frame_count > 1, "Expected several frames");
+
+    FILE* fp = reader.open_stream(0, error);
+    TEST_ASSERT(fp != NULL, "open_stream failed");
+    std::string back = read_all(fp);
+    fclose(fp);
+    TEST_ASSERT(back == pcap, "Single file must read back unchanged");
+
+    uint64_t from = 0;
+    fp = reader.open_capture(0, from, error);
+    TEST_ASSERT(fp != NULL, "open_capture failed");
+    back = read_all(fp);
+    fclose(fp);
+    TEST_ASSERT(back == pcap, "Single file capture must read back unchanged");
+
+    TEST_PASS("Single file round trip");
+    return true;
+}
+
+bool test_multi_file_concat(void)
+{
+    std::string pcaps[3];
+    pcaps[0] = make_pcap(1500, 1, 1000, 150, 900);
+    pcaps[1] = make_pcap(65535, 1, 1150, 200, 500);
+    pcaps[2] = make_pcap(9000, 1, 1350, 10, 300);
+    std::string path;
+    TEST_ASSERT(write_archive("multi.pcap.gz", pcaps, 3, path), "Writing the archive failed");
+
+    CRxArchiveReader reader;
+    std::string error;
+    TEST_ASSERT(reader.open(path, error), "Opening the archive failed");
+    TEST_ASSERT(reader.files().size() == 3, "Expected three archived files");
+
+    std::string expect = pcaps[0];
+    uint32_t snaplen = 65535;
+    memcpy(&expect[16], &snaplen, 4);
+    for (int i = 1; i < 3; ++i) {
+        expect.append(pcaps[i], 24, std::string::npos);
+    }
+
+    uint64_t from = 0;
+    FILE* fp = reader.open_capture(0, from, error);
+    TEST_ASSERT(fp != NULL, "open_capture failed");
+    std::string back = read_all(fp);
+    TEST_ASSERT(back.size() == expect.size(), "Stream length must skip later global headers");
+    TEST_ASSERT(back == expect, "Files must stream in order behind one header");
+
+    TEST_ASSERT(fseek(fp, static_cast<long>(pcaps[0].size()), SEEK_SET) == 0, "Seek failed");
+    char rec[20];
+    TEST_ASSERT(fread(rec, 1, sizeof(rec), fp) == sizeof(rec), "Read after seek failed");
+    uint32_t ts;
+    memcpy(&ts, rec, 4);
+    TEST_ASSERT(ts == 1150, "Second file must start right after the first");
+    fclose(fp);
+
+    TEST_PASS("Multiple files stream as one capture");
+    return true;
+}
+
+bool test_from_ts_offset(void)
+{
+    std::string pcaps[2];
+    pcaps[0] = make_pcap(65535, 1, 1000, 200, 1000);
+    pcaps[1] = make_pcap(65535, 1, 2000, 200, 1000);
+    std::string path;
+    TEST_ASSERT(write_archive("ts.pcap.gz", pcaps, 2, path), "Writing the archive failed");
+
+    CRxArchiveReader reader;
+    std::string error;
+    TEST_ASSERT(reader.open(path, error), "Opening the archive failed");
+
+    uint64_t from = 0;
+    FILE* fp = reader.open_capture(2100, from, error);
+    TEST_ASSERT(fp != NULL, "open_capture failed");
+    TEST_ASSERT(from > pcaps[0].size(), "Offset must land in the second file");
+    TEST_ASSERT(from < pcaps[0].size() + pcaps[1].size() - 24, "Offset must land before the end");
+    TEST_ASSERT((from - pcaps[0].size()) % 1016 == 0, "Offset must be a record boundary");
+    fseek(fp, static_cast<long>(from), SEEK_SET);
+    char rec[4];
+    TEST_ASSERT(fread(rec, 1, sizeof(rec), fp) == sizeof(rec), "Read at offset failed");
+    uint32_t ts;
+    memcpy(&ts, rec, 4);
+    TEST_ASSERT(ts >= 2000 && ts <= 2100, "Frame at offset must not start after from_ts");
+    fclose(fp);
+
+    fp = reader.open_capture(5000, from, error);
+    TEST_ASSERT(fp != NULL, "open_capture failed");
+    fseek(fp, 0, SEEK_END);
+    TEST_ASSERT(from == static_cast<uint64_t>(ftell(fp)), "No match must point past the end");
+    fclose(fp);
+
+    TEST_PASS("from_ts maps to a stream offset across files");
+    return true;
+}
+
+bool test_linktype_mismatch(void)
+{
+    std::string pcaps[2];
+    pcaps[0] = make_pcap(65535, 1, 1000, 5, 100);
+    pcaps[1] = make_pcap(65535, 113, 1005, 5, 100);
+    std::string path;
+    TEST_ASSERT(write_archive("mixed.pcap.gz", pcaps, 2, path), "Writing the archive failed");
+
+    CRxArchiveReader reader;
+    std::string error;
+    TEST_ASSERT(reader.open(path, error), "Opening the archive failed");
+    uint64_t from = 0;
+    TEST_ASSERT(reader.open_capture(0, from, error) == NULL, "Linktype mismatch must be rejected");
+    TEST_ASSERT(error.find("linktype") != std::string::npos, "Error must name the linktype");
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    errbuf[0] = '\0';
+    TEST_ASSERT(CRxArchiveReader::open_offline(path, errbuf) == NULL, "open_offline must fail too");
+    TEST_ASSERT(strstr(errbuf, "linktype") != NULL, "open_offline must report the mismatch");
+
+    TEST_PASS("Linktype mismatch is rejected");
+    return true;
+}
+
+int main(void)
+{
+    printf("=== Archive Test Suite ===\n\n");
+
+    char tmpl[] = "/tmp/rxarchive_test.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_dir = tmpl;
+
+    int passed = 0;
+    int total = 0;
+
+    #define RUN_TEST(test) do { \
+        total++; \
+        if (test()) passed++; \
+        printf("\n"); \
+    } while (0)
+
+    RUN_TEST(test_single_file_roundtrip);
+    RUN_TEST(test_multi_file_concat);
+    RUN_TEST(test_from_ts_offset);
+    RUN_TEST(test_linktype_mismatch);
+
+    printf("=== Test Results: %d/%d passed ===\n", passed, total);
+
+    std::string cmd = "rm -rf " + g_dir;
+    if (system(cmd.c_str()) != 0) {
+        fprintf(stderr, "cannot remove %s\n", g_dir.c_str());
+    }
+
+    return (passed == total) ? 0 : 1;
+}
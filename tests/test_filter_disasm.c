@@ -1,11 +1,14 @@
 #include <stdio.h>
 #include "../src/pdef/parser.h"
+#include "../src/pdef/optimizer.h"
 #include "../src/runtime/protocol.h"
+#include "../src/runtime/program.h"
 
-int main(void) {
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "tests/samples/game_with_filter.pdef";
     char error_msg[512];
-    ProtocolDef* proto = pdef_parse_file("tests/samples/game_with_filter.pdef",
-                                          error_msg, sizeof(error_msg));
+    ProtocolDef* proto = pdef_parse_file_ex(path, PDEF_PARSE_NO_OPTIMIZE,
+                                            error_msg, sizeof(error_msg));
 
     if (!proto) {
         fprintf(stderr, "Parse failed: %s\n", error_msg);
@@ -15,7 +18,23 @@ int main(void) {
     printf("=== Filter Rules Bytecode Disassembly ===\n\n");
 
     for (uint32_t i = 0; i < proto->filter_count; i++) {
-        filter_rule_disassemble(&proto->filters[i]);
+        FilterRule* rule = &proto->filters[i];
+        printf("--- before optimization ---\n");
+        filter_rule_disassemble(rule);
+
+        PdefOptStats stats;
+        if (!pdef_optimize_rule(rule, &stats)) {
+            fprintf(stderr, "Optimization failed for %s\n", rule->name);
+            protocol_free(proto);
+            return 1;
+        }
+        printf("--- after optimization ---\n");
+        filter_rule_disassemble(rule);
+        printf("%u -> %u instructions (reordered=%u, loads_removed=%u, jumps_threaded=%u, "
+               "dead_removed=%u, checked_len=%u)\n\n",
+               stats.before_len, stats.after_len, stats.blocks_reordered, stats.loads_removed,
+               stats.jumps_threaded, stats.dead_removed, stats.checked_len);
+        pdef_program_disassemble(rule->program_be);
         printf("\n");
     }
 
@@ -7,6 +7,7 @@
 #include "../src/pdef/parser.h"
 #include "../src/runtime/protocol.h"
 #include "../src/runtime/executor.h"
+#include "../src/runtime/program.h"
 
 
 #define TEST_ASSERT(cond, msg) do { \
@@ -284,6 +285,77 @@ bool test_in_not_in_operator(void) {
 }
 
 
+static bool rule_has_opcode(const FilterRule* rule, OpCode op) {
+    for (uint32_t i = 0; rule && i < rule->bytecode_len; i++) {
+        if (rule->bytecode[i].opcode == op) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool test_set_opcodes(void) {
+    char src[2048];
+    int n = snprintf(src, sizeof(src),
+        "@protocol { name = \"SetProto\"; endian = big; }\n"
+        "Packet { uint8 cmd; uint16 kind; uint32 id; }\n"
+        "@filter Bits { cmd in [");
+    for (int v = 1; v < 64; v += 2) {
+        n += snprintf(src + n, sizeof(src) - n, "%s%d", v > 1 ? ", " : "", v);
+    }
+    snprintf(src + n, sizeof(src) - n,
+        "]; }\n"
+        "@filter Range { kind in [0x103, 0x100, 0x102, 0x101, 0x101]; }\n"
+        "@filter Table { id ! in [1000, 70000, 5, 123456789, 99, 5]; }\n");
+
+    char error_msg[512] = {0};
+    ProtocolDef* proto = pdef_parse_string(src, error_msg, sizeof(error_msg));
+    if (!proto) {
+        fprintf(stderr, "Failed to parse set pdef: %s\n", error_msg);
+        return false;
+    }
+    const FilterRule* bits = find_filter(proto, "Bits");
+    const FilterRule* range = find_filter(proto, "Range");
+    const FilterRule* table = find_filter(proto, "Table");
+    TEST_ASSERT(rule_has_opcode(bits, OP_CMP_IN_BITMAP), "8-bit list should use a bitmap");
+    TEST_ASSERT(bits->bytecode_len == 5, "32-value list should cost a single compare");
+    TEST_ASSERT(rule_has_opcode(range, OP_CMP_RANGE), "Contiguous list should use a range check");
+    TEST_ASSERT(rule_has_opcode(table, OP_CMP_IN_TABLE), "Wide list should use a sorted table");
+    TEST_ASSERT(rule_has_opcode(table, OP_JUMP_IF_TRUE), "NOT IN should branch on membership");
+
+    uint8_t packet[7] = {0};
+    for (uint32_t v = 0; v < 256; v++) {
+        packet[0] = (uint8_t)v;
+        bool expect = (v & 1) && v < 64;
+        TEST_ASSERT(execute_filter(packet, sizeof(packet), bits) == expect, "Bitmap verdict mismatch");
+    }
+    for (uint32_t v = 0xF0; v < 0x110; v++) {
+        packet[1] = (uint8_t)(v >> 8);
+        packet[2] = (uint8_t)v;
+        bool expect = v >= 0x100 && v <= 0x103;
+        TEST_ASSERT(execute_filter(packet, sizeof(packet), range) == expect, "Range verdict mismatch");
+    }
+    const uint32_t members[] = { 5, 99, 1000, 70000, 123456789 };
+    for (uint32_t m = 0; m < sizeof(members) / sizeof(members[0]); m++) {
+        for (int d = -1; d <= 1; d++) {
+            uint32_t v = members[m] + (uint32_t)d;
+            packet[3] = (uint8_t)(v >> 24);
+            packet[4] = (uint8_t)(v >> 16);
+            packet[5] = (uint8_t)(v >> 8);
+            packet[6] = (uint8_t)v;
+            TEST_ASSERT(execute_filter(packet, sizeof(packet), table) == (d != 0),
+                        "Table verdict mismatch");
+        }
+    }
+    memset(packet + 3, 0xFF, 4);
+    TEST_ASSERT(execute_filter(packet, sizeof(packet), table) == true, "Value above the table should pass");
+
+    protocol_free(proto);
+    TEST_PASS("test_set_opcodes");
+    return true;
+}
+
+
 bool test_varbytes_validation(void) {
     const char* bad_src =
         "@protocol { name = \"BadVar\"; endian = big; }\n"
@@ -359,6 +431,199 @@ bool test_object_arrays(void) {
     return true;
 }
 
+bool test_optimizer_equivalence(void) {
+    const char* src =
+        "@protocol { name = \"OptProto\"; endian = big; }\n"
+        "Packet { uint8 type; uint8 code; uint16 flags; uint32 len; }\n"
+        "@filter Mixed { len >= 10; type in [1, 2, 3]; code != 5; len <= 100;"
+        " flags & 0x0f00 = 0x0100; flags & 0x0001 = 0x0001; }\n"
+        "@filter NotIn { code ! in [0xFF, 0x10, 0x20]; type = 7; }\n"
+        "@filter Range { flags >= 0x0100; flags <= 0x01FF; }\n";
+
+    char error_msg[512] = {0};
+    ProtocolDef* naive = pdef_parse_string_ex(src, PDEF_PARSE_NO_OPTIMIZE, error_msg, sizeof(error_msg));
+    ProtocolDef* opt = pdef_parse_string(src, error_msg, sizeof(error_msg));
+    if (!naive || !opt) {
+        fprintf(stderr, "Failed to parse optimizer pdef: %s\n", error_msg);
+        protocol_free(naive);
+        protocol_free(opt);
+        return false;
+    }
+
+    uint32_t naive_len = 0;
+    uint32_t opt_len = 0;
+    for (uint32_t i = 0; i < naive->filter_count; i++) {
+        naive_len += naive->filters[i].bytecode_len;
+        opt_len += opt->filters[i].bytecode_len;
+    }
+    TEST_ASSERT(opt->filters[0].bytecode[0].opcode == OP_CHECK_LEN,
+                "Multi-load rule should start with a hoisted length check");
+    TEST_ASSERT(opt_len < naive_len, "Optimizer should shrink the bytecode");
+
+    uint8_t packet[8];
+    uint32_t seed = 1;
+    uint32_t matches = 0;
+    for (uint32_t n = 0; n < 200000; n++) {
+        for (uint32_t b = 0; b < sizeof(packet); b++) {
+            seed = seed * 1103515245u + 12345u;
+            packet[b] = (uint8_t)(seed >> 16);
+        }
+        packet[0] &= 0x07;
+        packet[1] = (n & 1) ? 0x10 : packet[1];
+        packet[2] &= 0x01;
+        packet[4] = packet[5] = packet[6] = 0;
+        uint32_t len = (seed >> 8) % (sizeof(packet) + 1);
+        for (uint32_t i = 0; i < naive->filter_count; i++) {
+            const FilterRule* a = &naive->filters[i];
+            const FilterRule* b = &opt->filters[i];
+            bool ra = execute_bytecode(packet, len, a->bytecode, a->bytecode_len);
+            bool rb = execute_bytecode(packet, len, b->bytecode, b->bytecode_len);
+            TEST_ASSERT(ra == rb, "Optimized bytecode verdict differs");
+            matches += ra ? 1 : 0;
+        }
+    }
+    TEST_ASSERT(matches > 0, "Differential payloads should exercise matching paths");
+
+    protocol_free(naive);
+    protocol_free(opt);
+    TEST_PASS("test_optimizer_equivalence");
+    return true;
+}
+
+bool test_compact_program(void) {
+    const char* src =
+        "@protocol { name = \"VmProto\"; endian = little; }\n"
+        "Packet { uint8 type; uint8 code; uint16 flags; uint32 len; int16 delta; }\n"
+        "@filter Mixed { len >= 10; type in [1, 2, 3, 5]; code != 5; len <= 100;"
+        " flags & 0x0f00 = 0x0100; }\n"
+        "@filter Eq { type = 2; flags = 0x0102; }\n"
+        "@filter NotIn { code ! in [0xFF, 0x10, 0x20, 7]; delta < 100; }\n"
+        "@filter Wide { len in [1000, 70000, 5, 9]; type ! in [1, 2]; }\n"
+        "@filter Range { flags >= 0x0100; flags <= 0x01FF; delta > 3; }\n";
+
+    char error_msg[512] = {0};
+    ProtocolDef* naive = pdef_parse_string_ex(src, PDEF_PARSE_NO_OPTIMIZE, error_msg, sizeof(error_msg));
+    ProtocolDef* opt = pdef_parse_string(src, error_msg, sizeof(error_msg));
+    if (!naive || !opt) {
+        fprintf(stderr, "Failed to parse compact pdef: %s\n", error_msg);
+        protocol_free(naive);
+        protocol_free(opt);
+        return false;
+    }
+
+    TEST_ASSERT(sizeof(PdefOp) == 8, "Compact op should be 8 bytes");
+    uint32_t fused = 0;
+    for (uint32_t i = 0; i < opt->filter_count; i++) {
+        TEST_ASSERT(naive->filters[i].program_be && opt->filters[i].program_be,
+                    "Every filter should have a compact program");
+        fused += opt->filters[i].program_be->fused;
+    }
+    TEST_ASSERT(fused > 0, "Load/compare/branch runs should be fused");
+
+    uint8_t packet[10];
+    uint32_t seed = 7;
+    uint32_t matches = 0;
+    for (uint32_t n = 0; n < 200000; n++) {
+        for (uint32_t b = 0; b < sizeof(packet); b++) {
+            seed = seed * 1103515245u + 12345u;
+            packet[b] = (uint8_t)(seed >> 16);
+        }
+        packet[0] &= 0x07;
+        packet[1] = (n & 1) ? 0x10 : packet[1];
+        packet[3] &= 0x01;
+        packet[5] = packet[6] = packet[7] = 0;
+        if (n & 2) {
+            packet[4] = (n & 4) ? 5 : 9;
+        }
+        uint32_t len = (seed >> 8) % (sizeof(packet) + 1);
+        for (uint32_t i = 0; i < opt->filter_count; i++) {
+            const ProtocolDef* defs[2] = { naive, opt };
+            for (int d = 0; d < 2; d++) {
+                const FilterRule* r = &defs[d]->filters[i];
+                bool ra = execute_bytecode(packet, len, r->bytecode, r->bytecode_len);
+                bool rb = pdef_program_run(r->program_be, packet, len);
+                TEST_ASSERT(ra == rb, "Compact program verdict differs from interpreter");
+                matches += ra ? 1 : 0;
+            }
+        }
+    }
+    TEST_ASSERT(matches > 0, "Differential payloads should exercise matching paths");
+
+    protocol_free(naive);
+    protocol_free(opt);
+    TEST_PASS("test_compact_program");
+    return true;
+}
+
+bool test_dual_endian(void) {
+    const char* src =
+        "@protocol { name = \"DualProto\"; endian = auto; }\n"
+        "Packet { uint8 type; uint8 code; uint16 kind; uint32 magic; int16 delta; }\n"
+        "@filter Magic { magic = 0x11223344; kind >= 1; kind <= 16; }\n"
+        "@filter Mixed { type in [1, 2, 3, 5]; kind ! in [0x100, 0x300, 0x500]; delta > 3; code != 9; }\n";
+
+    char error_msg[512] = {0};
+    ProtocolDef* proto = pdef_parse_string(src, error_msg, sizeof(error_msg));
+    if (!proto) {
+        fprintf(stderr, "Failed to parse dual pdef: %s\n", error_msg);
+        return false;
+    }
+    for (uint32_t i = 0; i < proto->filter_count; i++) {
+        TEST_ASSERT(proto->filters[i].program_be && proto->filters[i].program_be->twin,
+                    "Auto-endian rule should get a twin program");
+    }
+
+    uint8_t packet[10];
+    uint32_t seed = 3;
+    uint32_t split = 0;
+    for (uint32_t n = 0; n < 200000; n++) {
+        for (uint32_t b = 0; b < sizeof(packet); b++) {
+            seed = seed * 1103515245u + 12345u;
+            packet[b] = (uint8_t)(seed >> 16);
+        }
+        packet[0] &= 0x07;
+        if (n & 1) {
+            packet[2] = 0;
+        } else {
+            packet[3] = 0;
+        }
+        if (n & 2) {
+            memcpy(packet + 4, (n & 4) ? "\x11\x22\x33\x44" : "\x44\x33\x22\x11", 4);
+        }
+        uint32_t len = (seed >> 8) % (sizeof(packet) + 1);
+        for (uint32_t i = 0; i < proto->filter_count; i++) {
+            const FilterRule* r = &proto->filters[i];
+            uint32_t expect = (pdef_program_run(r->program_be, packet, len) ? PDEF_VERDICT_BIG : 0) |
+                              (pdef_program_run(r->program_le, packet, len) ? PDEF_VERDICT_LITTLE : 0);
+            uint32_t got = pdef_program_run_dual(r->program_be, packet, len);
+            TEST_ASSERT(got == expect, "Dual verdict differs from separate runs");
+            split += (got == PDEF_VERDICT_BIG || got == PDEF_VERDICT_LITTLE) ? 1 : 0;
+        }
+    }
+    TEST_ASSERT(split > 0, "Differential payloads should separate the byte orders");
+
+    const uint8_t little[10] = { 0, 0, 0x02, 0x00, 0x44, 0x33, 0x22, 0x11, 0, 0 };
+    const uint8_t big[10] = { 0, 0, 0x00, 0x02, 0x11, 0x22, 0x33, 0x44, 0, 0 };
+    volatile int state = ENDIAN_TYPE_UNKNOWN;
+    TEST_ASSERT(packet_filter_match_state(big, sizeof(big), proto, &state), "Big-endian packet should match");
+    for (int v = 0; v < 6; v++) {
+        TEST_ASSERT(packet_filter_match_state(little, sizeof(little), proto, &state),
+                    "Little-endian packet should match");
+    }
+    TEST_ASSERT(ENDIAN_STATE_TYPE(state) == ENDIAN_TYPE_UNKNOWN, "A handful of votes should not decide");
+    TEST_ASSERT(ENDIAN_STATE_VOTES_BIG(state) == 1 && ENDIAN_STATE_VOTES_LITTLE(state) == 6,
+                "Votes should be counted per byte order");
+    packet_filter_match_state(little, sizeof(little), proto, &state);
+    packet_filter_match_state(little, sizeof(little), proto, &state);
+    TEST_ASSERT(state == ENDIAN_TYPE_LITTLE, "Clear majority should settle on little-endian");
+    TEST_ASSERT(!packet_filter_match_state(big, sizeof(big), proto, &state),
+                "Settled state should stop evaluating the other byte order");
+
+    protocol_free(proto);
+    TEST_PASS("test_dual_endian");
+    return true;
+}
+
 static bool parse_custom_path(const char* path) {
     char err[512] = {0};
     ProtocolDef* proto = pdef_parse_file(path, err, sizeof(err));
@@ -401,6 +666,10 @@ int main(int argc, char** argv) {
     RUN_TEST(test_in_not_in_operator);
     RUN_TEST(test_varbytes_validation);
     RUN_TEST(test_object_arrays);
+    RUN_TEST(test_optimizer_equivalence);
+    RUN_TEST(test_set_opcodes);
+    RUN_TEST(test_compact_program);
+    RUN_TEST(test_dual_endian);
 
     printf("=== Test Results: %d/%d passed ===\n", passed, total);
 
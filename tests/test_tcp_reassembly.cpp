@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "../src/rxtcpreassembly.h"
+
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL: %s\n", msg); \
+        return false; \
+    } \
+} while (0)
+
+#define TEST_PASS(msg) do { \
+    printf("PASS: %s\n", msg); \
+} while (0)
+
+static SRxFlowKey make_key(uint16_t src_port)
+{
+    SRxFlowKey key;
+    key.set_ipv4(0x0a000001u, 0x0a000002u);
+    key.src_port = src_port;
+    key.dst_port = 7777;
+    key.proto = 6;
+    return key;
+}
+
+static const uint8_t* feed(CRxTcpReassembler& r, const SRxFlowKey& key, uint32_t seq, uint8_t flags,
+                           const char* data, uint32_t* out_len)
+{
+    *out_len = 0;
+    return r.add(key, seq, flags, reinterpret_cast<const uint8_t*>(data),
+                 static_cast<uint32_t>(strlen(data)), out_len);
+}
+
+static bool holds(const uint8_t* buf, uint32_t len, const char* expect)
+{
+    return buf && len == strlen(expect) && memcmp(buf, expect, len) == 0;
+}
+
+
+bool test_contiguous_segments(void)
+{
+    CRxTcpReassembler r(4, 64);
+    TEST_ASSERT(r.valid(), "Reassembler allocation failed");
+    SRxFlowKey key = make_key(1000);
+    uint32_t len = 0;
+
+    TEST_ASSERT(feed(r, key, 99, RX_TCP_SYN, "", &len) == NULL, "SYN must not produce data");
+    const uint8_t* out = feed(r, key, 100, 0, "HEAD", &len);
+    TEST_ASSERT(holds(out, len, "HEAD"), "First segment mismatch");
+    out = feed(r, key, 104, 0, "BODY", &len);
+    TEST_ASSERT(holds(out, len, "HEADBODY"), "Contiguous segments must concatenate");
+    TEST_ASSERT(r.active() == 1, "Expected one active stream");
+
+    TEST_PASS("Contiguous segments concatenate");
+    return true;
+}
+
+bool test_overlap_and_retransmit(void)
+{
+    CRxTcpReassembler r(4, 64);
+    SRxFlowKey key = make_key(1001);
+    uint32_t len = 0;
+
+    feed(r, key, 100, 0, "ABCD", &len);
+    TEST_ASSERT(feed(r, key, 100, 0, "ABCD", &len) == NULL, "Full retransmit must be ignored");
+    TEST_ASSERT(feed(r, key, 101, 0, "BC", &len) == NULL, "Contained retransmit must be ignored");
+    TEST_ASSERT(r.stats().retransmits == 2, "Retransmits not counted");
+
+    const uint8_t* out = feed(r, key, 102, 0, "CDEF", &len);
+    TEST_ASSERT(holds(out, len, "ABCDEF"), "Overlapping bytes must be trimmed");
+    TEST_ASSERT(r.stats().gaps == 0, "Overlap must not count as a gap");
+
+    TEST_PASS("Overlap trimming and retransmit detection");
+    return true;
+}
+
+bool test_out_of_order_hold(void)
+{
+    CRxTcpReassembler r(4, 64);
+    SRxFlowKey key = make_key(1002);
+    uint32_t len = 0;
+
+    feed(r, key, 100, 0, "AAAA", &len);
+    TEST_ASSERT(feed(r, key, 108, 0, "CCCC", &len) == NULL, "Out-of-order segment must be held");
+    TEST_ASSERT(feed(r, key, 112, RX_TCP_PSH, "DDDD", &len) == NULL, "Adjacent out-of-order segment must be held");
+    TEST_ASSERT(r.stats().reordered == 2, "Held segments not counted");
+    TEST_ASSERT(feed(r, key, 108, 0, "CCCC", &len) == NULL, "Retransmit of held bytes must be ignored");
+
+    const uint8_t* out = feed(r, key, 104, 0, "BBBB", &len);
+    TEST_ASSERT(holds(out, len, "AAAABBBBCCCCDDDD"), "Filling the hole must release held bytes");
+    TEST_ASSERT(r.stats().gaps == 0, "Held segments must not count as gaps");
+
+    out = feed(r, key, 116, 0, "EEEE", &len);
+    TEST_ASSERT(holds(out, len, "EEEE"), "PSH on the held segment must end the message");
+
+    TEST_PASS("Out-of-order segments held until the hole fills");
+    return true;
+}
+
+bool test_out_of_order_gap(void)
+{
+    CRxTcpReassembler r(4, 16);
+    SRxFlowKey key = make_key(1003);
+    uint32_t len = 0;
+
+    feed(r, key, 100, 0, "AAAA", &len);
+    const uint8_t* out = feed(r, key, 200, 0, "ZZZZ", &len);
+    TEST_ASSERT(holds(out, len, "ZZZZ"), "Segment beyond depth must restart the message");
+    TEST_ASSERT(r.stats().gaps == 1, "Gap not counted");
+
+    feed(r, key, 208, 0, "XXXX", &len);
+    out = feed(r, key, 220, 0, "YYYY", &len);
+    TEST_ASSERT(holds(out, len, "YYYY"), "Non-adjacent second hole must be treated as a gap");
+    TEST_ASSERT(r.stats().gaps == 2, "Second gap not counted");
+
+    TEST_PASS("Unholdable segments restart the message");
+    return true;
+}
+
+bool test_psh_boundary(void)
+{
+    CRxTcpReassembler r(4, 64);
+    SRxFlowKey key = make_key(1004);
+    uint32_t len = 0;
+
+    const uint8_t* out = feed(r, key, 100, RX_TCP_PSH, "MSG1", &len);
+    TEST_ASSERT(holds(out, len, "MSG1"), "PSH segment mismatch");
+    out = feed(r, key, 104, 0, "MSG2", &len);
+    TEST_ASSERT(holds(out, len, "MSG2"), "Message after PSH must start a new buffer");
+
+    feed(r, key, 108, RX_TCP_PSH, "END", &len);
+    TEST_ASSERT(feed(r, key, 115, 0, "LATE", &len) == NULL, "Segment after PSH must be held");
+    out = feed(r, key, 111, 0, "NEXT", &len);
+    TEST_ASSERT(holds(out, len, "NEXTLATE"), "Held bytes must join the new message");
+
+    SRxFlowKey key2 = make_key(1014);
+    feed(r, key2, 100, 0, "AB", &len);
+    feed(r, key2, 106, 0, "ZZ", &len);
+    feed(r, key2, 102, RX_TCP_PSH, "CD", &len);
+    out = feed(r, key2, 104, 0, "EF", &len);
+    TEST_ASSERT(holds(out, len, "EFZZ"), "Held bytes must move with the new message");
+
+    TEST_PASS("PSH starts a new message");
+    return true;
+}
+
+bool test_fin_rst_drop(void)
+{
+    CRxTcpReassembler r(4, 64);
+    SRxFlowKey fin_key = make_key(1005);
+    SRxFlowKey rst_key = make_key(1006);
+    uint32_t len = 0;
+
+    feed(r, fin_key, 100, 0, "ABC", &len);
+    const uint8_t* out = feed(r, fin_key, 103, RX_TCP_FIN, "DEF", &len);
+    TEST_ASSERT(holds(out, len, "ABCDEF"), "FIN segment must flush the message");
+    TEST_ASSERT(r.active() == 0, "FIN must release the stream");
+
+    feed(r, rst_key, 500, 0, "XY", &len);
+    out = feed(r, rst_key, 502, RX_TCP_RST, "Z", &len);
+    TEST_ASSERT(holds(out, len, "XYZ"), "RST segment must flush the message");
+    TEST_ASSERT(r.active() == 0, "RST must release the stream");
+
+    out = feed(r, rst_key, 503, 0, "NEW", &len);
+    TEST_ASSERT(holds(out, len, "NEW"), "Stream after RST must start empty");
+    r.release(rst_key);
+    TEST_ASSERT(r.active() == 0, "release() must drop the stream");
+
+    TEST_PASS("FIN/RST flush and drop the stream");
+    return true;
+}
+
+bool test_truncation(void)
+{
+    CRxTcpReassembler r(2, 8);
+    SRxFlowKey key = make_key(1007);
+    uint32_t len = 0;
+
+    feed(r, key, 100, 0, "012345", &len);
+    const uint8_t* out = feed(r, key, 106, 0, "6789", &len);
+    TEST_ASSERT(holds(out, len, "01234567"), "Buffer must stop at depth");
+    TEST_ASSERT(r.stats().truncated == 1, "Truncation not counted");
+
+    TEST_PASS("Bytes beyond depth are truncated");
+    return true;
+}
+
+bool test_lru_eviction(void)
+{
+    CRxTcpReassembler r(2, 32);
+    SRxFlowKey a = make_key(2001);
+    SRxFlowKey b = make_key(2002);
+    SRxFlowKey c = make_key(2003);
+    uint32_t len = 0;
+    size_t memory = r.memory_bytes();
+
+    feed(r, a, 100, 0, "A1", &len);
+    feed(r, b, 100, 0, "B1", &len);
+    feed(r, a, 102, 0, "A2", &len);
+    feed(r, c, 100, 0, "C1", &len);
+    TEST_ASSERT(r.stats().evictions == 1, "Full pool must evict");
+    TEST_ASSERT(r.active() == 2, "Pool must stay at max_flows");
+    TEST_ASSERT(r.memory_bytes() == memory, "Memory ceiling must not grow");
+
+    const uint8_t* out = feed(r, a, 104, 0, "A3", &len);
+    TEST_ASSERT(holds(out, len, "A1A2A3"), "Recently used stream must survive eviction");
+    out = feed(r, b, 102, 0, "B2", &len);
+    TEST_ASSERT(holds(out, len, "B2"), "Least recently used stream must be evicted");
+    TEST_ASSERT(r.stats().evictions == 2, "Re-adding the evicted stream must evict again");
+
+    TEST_PASS("LRU pool eviction");
+    return true;
+}
+
+int main(void)
+{
+    printf("=== TCP Reassembly Test Suite ===\n\n");
+
+    int passed = 0;
+    int total = 0;
+
+    #define RUN_TEST(test) do { \
+        total++; \
+        if (test()) passed++; \
+        printf("\n"); \
+    } while (0)
+
+    RUN_TEST(test_contiguous_segments);
+    RUN_TEST(test_overlap_and_retransmit);
+    RUN_TEST(test_out_of_order_hold);
+    RUN_TEST(test_out_of_order_gap);
+    RUN_TEST(test_psh_boundary);
+    RUN_TEST(test_fin_rst_drop);
+    RUN_TEST(test_truncation);
+    RUN_TEST(test_lru_eviction);
+
+    printf("=== Test Results: %d/%d passed ===\n", passed, total);
+
+    return (passed == total) ? 0 : 1;
+}
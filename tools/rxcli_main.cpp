@@ -56,6 +56,7 @@ void print_usage(const char* argv0)
         "  /api/capture/start    - 启动新的抓包任务\n"
         "  /api/capture/stop     - 停止正在运行的抓包\n"
         "  /api/capture/status   - 查询抓包状态\n"
+        "  /api/capture/stats    - 查询 stats_only 任务的聚合结果（?id=N&top=K）\n"
         "  /api/capture/list     - 列出所有抓包任务\n"
         "  /api/pdef/list        - 列出可用的 PDEF 文件\n"
         "  /api/pdef/upload      - 上传 PDEF 协议定义\n"
@@ -79,6 +80,12 @@ void print_usage(const char* argv0)
         "    protocol           - 内置 PDEF 协议名（如 \"http\"）\n"
         "    protocol_filter    - 自定义 PDEF 文件路径\n"
         "    protocol_filter_inline - 内联 PDEF 定义字符串\n"
+        "    replay_file        - 回放离线 pcap 文件代替网卡抓包（服务端 storage.replay_dir 下的路径）\n"
+        "    replay_speed       - 按原始时间戳回放的倍速（0 为尽快回放）\n"
+        "    replay_pps         - 固定包速率回放（优先于 replay_speed）\n"
+        "    replay_loops       - 回放循环次数（默认: 1）\n"
+        "    stats_only         - 只做 PDEF 字段/五元组聚合统计，不落盘\n"
+        "    aggregate          - 聚合的字段名（\"Struct.field\" 或数组），隐含 stats_only\n"
         "\n"
         "使用示例:\n"
         "\n"
@@ -468,6 +475,68 @@ bool build_task_payload(const rapidjson::Value& item, TaskRequest* task, std::st
         payload.AddMember("protocol_filter_inline", rapidjson::Value(item["protocol_filter_inline"].GetString(), alloc).Move(), alloc);
     }
 
+    if (item.HasMember("replay_file")) {
+        if (!item["replay_file"].IsString()) {
+            if (err) *err = "replay_file must be a string";
+            return false;
+        }
+        payload.AddMember("replay_file", rapidjson::Value(item["replay_file"].GetString(), alloc).Move(), alloc);
+        if (!summary.empty()) summary += " ";
+        summary += "replay=";
+        summary += item["replay_file"].GetString();
+    }
+
+    if (item.HasMember("replay_speed")) {
+        if (!item["replay_speed"].IsNumber()) {
+            if (err) *err = "replay_speed must be a number";
+            return false;
+        }
+        rapidjson::Value speed_json;
+        speed_json.SetDouble(item["replay_speed"].GetDouble());
+        payload.AddMember("replay_speed", speed_json, alloc);
+    }
+
+    if (item.HasMember("replay_pps")) {
+        if (!item["replay_pps"].IsInt64()) {
+            if (err) *err = "replay_pps must be an integer";
+            return false;
+        }
+        rapidjson::Value pps_json;
+        pps_json.SetInt64(item["replay_pps"].GetInt64());
+        payload.AddMember("replay_pps", pps_json, alloc);
+    }
+
+    if (item.HasMember("replay_loops")) {
+        if (!item["replay_loops"].IsInt()) {
+            if (err) *err = "replay_loops must be an integer";
+            return false;
+        }
+        rapidjson::Value loops_json;
+        loops_json.SetInt(item["replay_loops"].GetInt());
+        payload.AddMember("replay_loops", loops_json, alloc);
+    }
+
+    if (item.HasMember("stats_only")) {
+        if (!item["stats_only"].IsBool()) {
+            if (err) *err = "stats_only must be a boolean";
+            return false;
+        }
+        rapidjson::Value stats_json;
+        stats_json.SetBool(item["stats_only"].GetBool());
+        payload.AddMember("stats_only", stats_json, alloc);
+    }
+
+    if (item.HasMember("aggregate")) {
+        if (!item["aggregate"].IsString() && !item["aggregate"].IsArray()) {
+            if (err) *err = "aggregate must be a string or an array of strings";
+            return false;
+        }
+        rapidjson::Value aggregate_json(item["aggregate"], alloc);
+        payload.AddMember("aggregate", aggregate_json, alloc);
+        if (!summary.empty()) summary += " ";
+        summary += "stats_only";
+    }
+
     rapidjson::StringBuffer buffer;
     rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
     payload.Accept(writer);